@@ -0,0 +1,74 @@
+// Compares CuckooHashMapTC at its 95% maximum load factor with the linear probing OpenHashMapTC at its default 0.8.
+// Usage: cuckooBenchmark [number of entries]
+
+#include<chrono>
+#include<cstdint>
+#include<cstdlib>
+#include<filesystem>
+#include<iomanip>
+#include<iostream>
+#include<random>
+#include<string>
+#include<vector>
+
+#include"gradylib/CuckooHashMapTC.hpp"
+#include"gradylib/OpenHashMapTC.hpp"
+
+using namespace gradylib;
+using namespace std;
+namespace fs = std::filesystem;
+
+template<typename F>
+double seconds(F && f) {
+    auto start = chrono::steady_clock::now();
+    f();
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+template<typename Map>
+void run(string const & name, vector<int64_t> const & keys, vector<int64_t> const & missing) {
+    Map m;
+    double insert = seconds([&]() {
+        for (size_t i = 0; i < keys.size(); ++i) {
+            m.put(keys[i], static_cast<int32_t>(i));
+        }
+    });
+    int64_t sum = 0;
+    double hit = seconds([&]() {
+        for (int64_t key : keys) {
+            sum += m.at(key);
+        }
+    });
+    size_t found = 0;
+    double miss = seconds([&]() {
+        for (int64_t key : missing) {
+            found += m.contains(key);
+        }
+    });
+    fs::path tmpFile = fs::temp_directory_path() / "cuckoo_benchmark.bin";
+    m.write(tmpFile.string());
+    double bytesPerEntry = static_cast<double>(fs::file_size(tmpFile)) / keys.size();
+    fs::remove(tmpFile);
+    double n = keys.size();
+    cout << setw(16) << name
+         << setw(12) << fixed << setprecision(1) << bytesPerEntry
+         << setw(12) << insert * 1e9 / n
+         << setw(12) << hit * 1e9 / n
+         << setw(12) << miss * 1e9 / n
+         << "    (" << sum + found << ")\n";
+}
+
+int main(int argc, char ** argv) {
+    size_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 10000000;
+    mt19937_64 rng(1);
+    vector<int64_t> keys(n);
+    vector<int64_t> missing(n);
+    for (size_t i = 0; i < n; ++i) {
+        // Odd keys are in the map and even keys aren't
+        keys[i] = static_cast<int64_t>(rng() | 1);
+        missing[i] = static_cast<int64_t>(rng() & ~uint64_t{1});
+    }
+    cout << setw(16) << "map" << setw(12) << "bytes/entry" << setw(12) << "insert ns" << setw(12) << "hit ns" << setw(12) << "miss ns" << "\n";
+    run<OpenHashMapTC<int64_t, int32_t>>("OpenHashMapTC", keys, missing);
+    run<CuckooHashMapTC<int64_t, int32_t>>("CuckooHashMapTC", keys, missing);
+}
@@ -24,9 +24,64 @@ SOFTWARE.
 
 #pragma once
 
+#include<algorithm>
 #include<bit>
 #include<cstddef>
 #include<cstdint>
+#include<functional>
+#include<type_traits>
+
+namespace gradylib_helpers {
+
+    /*
+     * The multiply-add in AltHash keeps the low bits of the key, so strided keys and keys that share their low bits
+     * can pile up in long runs of a linear probing table.  The open address maps watch the probe length of inserts,
+     * and when it passes probeLimit they rehash in place with a new seed.  Seeds start at 0, which is the unseeded
+     * hash, so a map that never reseeds hashes exactly as it always has.  A hash function with an operator()(key,
+     * seed) gets the seed directly.  Any other hash function has its hash mixed with the seed, which spreads keys
+     * that share a run but can't separate keys whose hashes are equal.
+     */
+
+    // The splitmix64 finalizer.  It's a bijection, so distinct 64 bit keys get distinct hashes.
+    inline uint64_t mix64(uint64_t z) noexcept {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // Seeds follow a fixed sequence so a reseeded map is reproducible.
+    inline uint64_t nextHashSeed(uint64_t seed) noexcept {
+        uint64_t next = mix64(seed + 0x9e3779b97f4a7c15ULL);
+        return next == 0 ? 1 : next;
+    }
+
+    template<typename HashFunction, typename Key>
+    size_t seededHash(HashFunction const & hashFunction, Key const & key, uint64_t seed) {
+        if constexpr (std::is_invocable_r_v<size_t, HashFunction const &, Key const &, uint64_t>) {
+            return hashFunction(key, seed);
+        } else {
+            size_t hash = hashFunction(key);
+            return seed == 0 ? hash : mix64(hash ^ seed);
+        }
+    }
+
+    /*
+     * The longest probe an insert tolerates before its map reseeds.  With well spread keys the longest probe in a
+     * linear probing table grows with the log of its size and with 1 / (1 - load)^2, and at a load of 0.8 it stays
+     * under 20 per bit of table size.  The limit is about three times that.
+     */
+    inline size_t probeLimit(size_t keySize, double loadFactor) {
+        double slack = 1 - std::min(loadFactor, 0.99);
+        return static_cast<size_t>(2.5 * std::bit_width(keySize) / (slack * slack));
+    }
+
+    /*
+     * OpenHashMapTC and OpenHashSetTC files store the seed after their other header fields, and set this bit in the
+     * keySize word to say so.  Files written before seeds existed have neither, and are read with seed 0, the
+     * unseeded hash they were built with.
+     */
+    inline constexpr uint64_t hashSeedHeaderFlag = uint64_t(1) << 63;
+}
 
 namespace gradylib {
     template<typename IntType>
@@ -35,6 +90,14 @@ namespace gradylib {
             size_t t = i;
             return t * 94123453451234 + 4123451435554345;
         }
+
+        // Seed 0 is the unseeded hash.  Any other seed is mixed into the key itself, see gradylib_helpers::mix64.
+        size_t operator()(IntType const &i, uint64_t seed) const noexcept {
+            if (seed == 0) {
+                return (*this)(i);
+            }
+            return gradylib_helpers::mix64(static_cast<uint64_t>(i) ^ seed);
+        }
     };
 
     template<typename T>
@@ -49,6 +112,18 @@ namespace gradylib {
                 return std::hash<T>{}(key);
             }
         }
+
+        size_t operator()(T const &key, uint64_t seed) const noexcept {
+            if (seed == 0) {
+                return (*this)(key);
+            }
+            if constexpr (std::is_integral_v<T>) {
+                return gradylib_helpers::mix64(static_cast<uint64_t>(key) ^ seed);
+            }
+            else {
+                return gradylib_helpers::mix64(std::hash<T>{}(key) ^ seed);
+            }
+        }
     };
 }
 
@@ -47,6 +47,8 @@ namespace gradylib {
         UnderlyingInt *underlying = nullptr;
         size_t setSize = 0;
         bool readOnly = false;
+        // Writable, but the words belong to someone else.  See borrow.
+        bool borrowed = false;
 
         inline size_t getUnderlyingLength(size_t len) const {
             size_t base = len >> bitShiftForDivision;
@@ -86,6 +88,20 @@ namespace gradylib {
                 : underlying(underlying), setSize(setSize), readOnly(true) {
         }
 
+        // A writable set over zeroed words owned by the caller, such as part of a mapping.  They aren't freed.
+        static BitPairSet borrow(void * words, size_t setSize) {
+            BitPairSet s;
+            s.underlying = static_cast<UnderlyingInt *>(words);
+            s.setSize = setSize;
+            s.borrowed = true;
+            return s;
+        }
+
+        // The number of bytes of words behind a set of the given size
+        static size_t storageBytes(size_t size) {
+            return ((size + mask) >> bitShiftForDivision) * sizeof(UnderlyingInt);
+        }
+
         BitPairSet(BitPairSet const &s) {
             size_t len = getUnderlyingLength(s.setSize);
             underlying = new UnderlyingInt[len];
@@ -111,7 +127,7 @@ namespace gradylib {
         }
 
         ~BitPairSet() {
-            if (!readOnly) {
+            if (!readOnly && !borrowed) {
                 delete[] underlying;
             }
         }
@@ -122,22 +138,35 @@ namespace gradylib {
                 return *this;
             }
             size_t len = getUnderlyingLength(s.setSize);
-            underlying = new UnderlyingInt[len];
-            memcpy(underlying, s.underlying, len * sizeof(UnderlyingInt));
+            UnderlyingInt * newUnderlying = new UnderlyingInt[len];
+            memcpy(newUnderlying, s.underlying, len * sizeof(UnderlyingInt));
+            if (!readOnly && !borrowed) {
+                delete[] underlying;
+            }
+            underlying = newUnderlying;
             setSize = s.setSize;
+            readOnly = false;
+            borrowed = false;
             return *this;
         }
 
         BitPairSet(BitPairSet &&s)
-                : underlying(s.underlying), setSize(s.setSize), readOnly(s.readOnly) {
+                : underlying(s.underlying), setSize(s.setSize), readOnly(s.readOnly), borrowed(s.borrowed) {
             s.underlying = nullptr;
             s.setSize = 0;
         }
 
         BitPairSet &operator=(BitPairSet &&s) noexcept {
+            if (this == &s) {
+                return *this;
+            }
+            if (!readOnly && !borrowed) {
+                delete[] underlying;
+            }
             underlying = s.underlying;
             setSize = s.setSize;
             readOnly = s.readOnly;
+            borrowed = s.borrowed;
             s.underlying = nullptr;
             s.setSize = 0;
             return *this;
@@ -158,13 +187,18 @@ namespace gradylib {
             return setSize;
         }
 
+        // The word holding idx's bits, for callers that need to know which memory a change touches
+        void const * wordOf(size_t idx) const {
+            return &underlying[idx >> bitShiftForDivision];
+        }
+
         void clear() {
             memset(underlying, 0, getUnderlyingLength(setSize) * sizeof(UnderlyingInt));
         }
 
         void resize(size_t size) {
-            if (readOnly) {
-                throw gradylibMakeException("Tried to resize a read only BitPairSet");
+            if (readOnly || borrowed) {
+                throw gradylibMakeException("Tried to resize a read only or borrowed BitPairSet");
             }
             size_t newSize = getUnderlyingLength(size);
             UnderlyingInt *newUnderlying = new UnderlyingInt[newSize];
@@ -178,7 +212,7 @@ namespace gradylib {
             setSize = size;
         }
 
-        std::pair<bool, bool> operator[](int idx) const {
+        std::pair<bool, bool> operator[](size_t idx) const {
             size_t base = idx >> bitShiftForDivision;
             size_t offsetShift = (idx & mask) << 1;
             UnderlyingInt t = underlying[base] >> offsetShift;
@@ -220,6 +254,11 @@ namespace gradylib {
         bool isEitherSet(size_t idx) const {
             return isSet(idx, 0b11);
         }
+
+        // Start loading the word that holds idx's bits, for callers about to test many scattered indices.
+        void prefetch(size_t idx) const {
+            __builtin_prefetch(&underlying[idx >> bitShiftForDivision]);
+        }
     };
 }
 
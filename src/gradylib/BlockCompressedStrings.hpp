@@ -0,0 +1,516 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * A section of strings grouped into blocks of a few KB, each block compressed with a small LZ77 codec.  A string is
+ * found by its ID, which is its position in the order the strings were added.  Reading one decompresses its block
+ * into a small per-thread cache of decompressed blocks.
+ *
+ * Blocks can be compressed against a shared dictionary, which helps a lot when blocks are small and the strings
+ * are similar.  BlockCompressedStringsWriter::trainDictionary builds one from the most common substrings of a
+ * sample.
+ *
+ * Blocks that don't compress are stored raw, flagged by the high bit of their raw size, and read straight from the
+ * mapping.
+ *
+ * Section layout, starting 8 byte aligned:
+ *     numStrings, numBlocks, dictionarySize, dataSize    (8 bytes each)
+ *     blockFirstIds  (numBlocks + 1 uint64_t)
+ *     blockOffsets   (numBlocks + 1 uint64_t, relative to the start of the block data)
+ *     blockRawSizes  (numBlocks uint32_t, padded to 8 bytes)
+ *     dictionary     (padded to 8 bytes)
+ *     block data     (each block padded to 4 bytes, the whole padded to 8 bytes)
+ * A raw block is uint32_t offsets[count + 1] relative to the end of the offsets, followed by the string bytes.
+ */
+
+#pragma once
+
+#include<string.h>
+
+#include<algorithm>
+#include<atomic>
+#include<cstdint>
+#include<fstream>
+#include<sstream>
+#include<string>
+#include<string_view>
+#include<unordered_map>
+#include<utility>
+#include<vector>
+
+#include"Common.hpp"
+#include"Exception.hpp"
+#include"Integrity.hpp"
+
+namespace gradylib_helpers {
+
+    // Set in the first word of a file header when its string section is block compressed.
+    constexpr uint64_t compressedStringsFlag = uint64_t(1) << 63;
+
+    // Set in a block's raw size when the block is stored uncompressed
+    constexpr uint32_t rawBlockFlag = uint32_t(1) << 31;
+
+    inline uint32_t read32(char const * p) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    inline void appendLzLength(std::string & out, size_t len) {
+        while (len >= 255) {
+            out.push_back(static_cast<char>(255));
+            len -= 255;
+        }
+        out.push_back(static_cast<char>(len));
+    }
+
+    /*
+     * The format follows LZ4: a sequence is a token byte holding a literal length and a match length in its two
+     * nibbles, each extended by 255-run bytes when the nibble is 15, then the literals, then a two byte little endian
+     * match distance.  Matches are at least 4 bytes and may reach back into the dictionary.  The last sequence has
+     * literals only.
+     */
+    inline void lzCompress(std::string_view dictionary, std::string_view input, std::string & out) {
+        constexpr int hashBits = 14;
+        constexpr size_t minMatch = 4;
+        constexpr size_t maxDistance = 65535;
+        auto hash = [](uint32_t v) {
+            return (v * 2654435761u) >> (32 - hashBits);
+        };
+        size_t const d = dictionary.size();
+        // Positions are in the concatenation of the dictionary and the input.
+        auto byteAt = [&](size_t pos) {
+            return pos < d ? dictionary[pos] : input[pos - d];
+        };
+        std::vector<int64_t> table(size_t(1) << hashBits, -1);
+        for (size_t p = d > maxDistance ? d - maxDistance : 0; p + minMatch <= d; ++p) {
+            table[hash(read32(dictionary.data() + p))] = p;
+        }
+        size_t const n = input.size();
+        size_t anchor = 0;
+        size_t i = 0;
+        auto emitLiterals = [&](size_t literalLength, size_t matchCode) {
+            out.push_back(static_cast<char>((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15)));
+            if (literalLength >= 15) {
+                appendLzLength(out, literalLength - 15);
+            }
+            out.append(input.data() + anchor, literalLength);
+        };
+        while (i + minMatch <= n) {
+            uint32_t v = read32(input.data() + i);
+            uint32_t h = hash(v);
+            int64_t candidate = table[h];
+            table[h] = d + i;
+            if (candidate < 0 || d + i - candidate > maxDistance) {
+                ++i;
+                continue;
+            }
+            size_t candidatePos = candidate;
+            size_t len = 0;
+            while (i + len < n && byteAt(candidatePos + len) == input[i + len]) {
+                ++len;
+            }
+            if (len < minMatch) {
+                ++i;
+                continue;
+            }
+            size_t distance = d + i - candidatePos;
+            emitLiterals(i - anchor, len - minMatch);
+            out.push_back(static_cast<char>(distance & 0xff));
+            out.push_back(static_cast<char>(distance >> 8));
+            if (len - minMatch >= 15) {
+                appendLzLength(out, len - minMatch - 15);
+            }
+            i += len;
+            anchor = i;
+        }
+        emitLiterals(n - anchor, 0);
+    }
+
+    inline void throwCorruptBlock(char const * what) {
+        std::ostringstream sstr;
+        sstr << "Corrupt compressed block: " << what;
+        throw gradylibMakeException(sstr.str());
+    }
+
+    inline size_t readLzLength(uint8_t const * & src, uint8_t const * srcEnd, size_t len) {
+        if (len == 15) {
+            uint8_t b;
+            do {
+                if (src == srcEnd) {
+                    throwCorruptBlock("length runs past the end of the block");
+                }
+                b = *src++;
+                len += b;
+            } while (b == 255);
+        }
+        return len;
+    }
+
+    // Decompresses exactly dstLen bytes into dst, reading no more than srcLen bytes of compressed.
+    inline void lzDecompress(std::string_view dictionary, void const * compressed, size_t srcLen, char * dst, size_t dstLen) {
+        uint8_t const * src = static_cast<uint8_t const *>(compressed);
+        uint8_t const * const srcEnd = src + srcLen;
+        size_t const d = dictionary.size();
+        size_t outPos = 0;
+        while (outPos < dstLen) {
+            if (src == srcEnd) {
+                throwCorruptBlock("input ends before the block is complete");
+            }
+            uint8_t token = *src++;
+            size_t literalLength = readLzLength(src, srcEnd, token >> 4);
+            if (outPos + literalLength > dstLen || literalLength > static_cast<size_t>(srcEnd - src)) {
+                throwCorruptBlock("literals overrun the block");
+            }
+            memcpy(dst + outPos, src, literalLength);
+            src += literalLength;
+            outPos += literalLength;
+            if (outPos == dstLen) {
+                break;
+            }
+            if (srcEnd - src < 2) {
+                throwCorruptBlock("match distance runs past the end of the block");
+            }
+            size_t distance = src[0] | (size_t(src[1]) << 8);
+            src += 2;
+            size_t matchLength = readLzLength(src, srcEnd, token & 15) + 4;
+            if (outPos + matchLength > dstLen || distance == 0 || distance > outPos + d) {
+                throwCorruptBlock("bad match");
+            }
+            if (distance > outPos) {
+                // The match starts in the dictionary and may run on into the output
+                size_t dictPos = d - (distance - outPos);
+                size_t fromDictionary = std::min(matchLength, d - dictPos);
+                memcpy(dst + outPos, dictionary.data() + dictPos, fromDictionary);
+                outPos += fromDictionary;
+                matchLength -= fromDictionary;
+                if (matchLength == 0) {
+                    // dst + outPos - distance would point before dst
+                    continue;
+                }
+            }
+            if (distance >= matchLength) {
+                memcpy(dst + outPos, dst + outPos - distance, matchLength);
+                outPos += matchLength;
+            } else {
+                // Overlapping copy repeats the last distance bytes
+                for (size_t k = 0; k < matchLength; ++k, ++outPos) {
+                    dst[outPos] = dst[outPos - distance];
+                }
+            }
+        }
+    }
+}
+
+namespace gradylib {
+
+    class BlockCompressedStrings {
+        static constexpr size_t cacheEntries = 8;
+        static constexpr uint32_t rawBlockFlag = gradylib_helpers::rawBlockFlag;
+
+        struct CachedBlock {
+            uint64_t owner = 0;
+            size_t block = 0;
+            uint64_t lastUse = 0;
+            std::string data;
+        };
+
+        size_t numStrings = 0;
+        size_t numBlocks = 0;
+        uint64_t const * blockFirstIds = nullptr;
+        uint64_t const * blockOffsets = nullptr;
+        uint32_t const * blockRawSizes = nullptr;
+        std::string_view dictionary;
+        char const * data = nullptr;
+        size_t dataSize = 0;
+        // Identifies this section in the per-thread caches.  A new mapping never reuses an id.
+        uint64_t id = 0;
+
+        static uint64_t nextId() {
+            static std::atomic<uint64_t> counter{0};
+            return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+
+        char const * decompressedBlock(size_t block) const {
+            static thread_local CachedBlock cache[cacheEntries];
+            static thread_local uint64_t useCounter = 0;
+            ++useCounter;
+            CachedBlock * victim = &cache[0];
+            for (CachedBlock & entry : cache) {
+                if (entry.owner == id && entry.block == block) {
+                    entry.lastUse = useCounter;
+                    return entry.data.data();
+                }
+                if (entry.lastUse < victim->lastUse) {
+                    victim = &entry;
+                }
+            }
+            // Claim the entry only once the block is decompressed, so a corrupt block doesn't leave it half filled
+            victim->owner = 0;
+            victim->data.resize(blockRawSizes[block]);
+            gradylib_helpers::lzDecompress(dictionary, data + blockOffsets[block], blockOffsets[block + 1] - blockOffsets[block],
+                                           victim->data.data(), victim->data.size());
+            victim->owner = id;
+            victim->block = block;
+            victim->lastUse = useCounter;
+            return victim->data.data();
+        }
+
+        size_t blockOf(size_t stringId) const {
+            if (stringId >= numStrings) {
+                std::ostringstream sstr;
+                sstr << "String id " << stringId << " is out of range for " << numStrings << " compressed strings";
+                throw gradylibMakeException(sstr.str());
+            }
+            return std::upper_bound(blockFirstIds, blockFirstIds + numBlocks + 1, stringId) - blockFirstIds - 1;
+        }
+
+        // raw holds the block's rawSize bytes, decompressed or straight from the mapping
+        std::string_view stringIn(char const * raw, size_t rawSize, size_t block, size_t stringId) const {
+            size_t k = stringId - blockFirstIds[block];
+            size_t count = blockFirstIds[block + 1] - blockFirstIds[block];
+            if (count + 1 > rawSize / 4) {
+                gradylib_helpers::throwCorruptBlock("string offsets overrun the block");
+            }
+            uint32_t const * offsets = static_cast<uint32_t const *>(static_cast<void const *>(raw));
+            char const * bytes = raw + 4 * (count + 1);
+            if (offsets[k] > offsets[k + 1] || offsets[k + 1] > rawSize - 4 * (count + 1)) {
+                gradylib_helpers::throwCorruptBlock("string runs past the end of the block");
+            }
+            return std::string_view(bytes + offsets[k], offsets[k + 1] - offsets[k]);
+        }
+
+        size_t storedSize(size_t block) const {
+            return blockOffsets[block + 1] - blockOffsets[block];
+        }
+
+    public:
+        BlockCompressedStrings() = default;
+
+        /*
+         * section points at the start of a section written by BlockCompressedStringsWriter::write, with sectionSize
+         * bytes mapped from there.  Throws if the section's arrays don't fit in them or don't describe their blocks
+         * in order.
+         */
+        BlockCompressedStrings(void const * section, size_t sectionSize)
+            : id(nextId())
+        {
+            namespace gh = gradylib_helpers;
+            char const * what = "Compressed string section";
+            gh::checkMappedExtent(32, sectionSize, what);
+            std::byte const * ptr = static_cast<std::byte const *>(section);
+            size_t header[4];
+            memcpy(header, section, 32);
+            numStrings = header[0];
+            numBlocks = header[1];
+            size_t dictionarySize = header[2];
+            dataSize = header[3];
+            size_t dictionaryOffset = numBlocks > sectionSize ? SIZE_MAX
+                    : 32 + 16 * (numBlocks + 1) + 4 * numBlocks + gh::getPadLength<8>(4 * numBlocks);
+            gh::checkMappedExtent(dictionaryOffset, sectionSize, what);
+            size_t dataOffset = dictionarySize > sectionSize ? SIZE_MAX
+                    : dictionaryOffset + dictionarySize + gh::getPadLength<8>(dictionarySize);
+            gh::checkMappedExtent(dataOffset, sectionSize, what);
+            gh::checkMappedExtent(dataSize > sectionSize ? SIZE_MAX : dataOffset + dataSize, sectionSize, what);
+            ptr += 32;
+            blockFirstIds = static_cast<uint64_t const *>(static_cast<void const *>(ptr));
+            ptr += 8 * (numBlocks + 1);
+            blockOffsets = static_cast<uint64_t const *>(static_cast<void const *>(ptr));
+            ptr += 8 * (numBlocks + 1);
+            blockRawSizes = static_cast<uint32_t const *>(static_cast<void const *>(ptr));
+            ptr += 4 * numBlocks + gradylib_helpers::getPadLength<8>(4 * numBlocks);
+            dictionary = std::string_view(static_cast<char const *>(static_cast<void const *>(ptr)), dictionarySize);
+            ptr += dictionarySize + gradylib_helpers::getPadLength<8>(dictionarySize);
+            data = static_cast<char const *>(static_cast<void const *>(ptr));
+            // Lookups binary search the first IDs and slice the block data by the offsets
+            bool ordered = blockFirstIds[0] == 0 && blockFirstIds[numBlocks] == numStrings && blockOffsets[0] == 0 &&
+                           blockOffsets[numBlocks] <= dataSize;
+            for (size_t b = 0; ordered && b < numBlocks; ++b) {
+                ordered = blockFirstIds[b] < blockFirstIds[b + 1] && blockOffsets[b] <= blockOffsets[b + 1] &&
+                          blockOffsets[b + 1] % 4 == 0;
+            }
+            if (!ordered) {
+                std::ostringstream sstr;
+                sstr << what << " has block tables out of order or past the end of its " << numStrings << " strings";
+                throw gradylibMakeException(sstr.str());
+            }
+        }
+
+        /*
+         * Strings in compressed blocks are returned from the calling thread's block cache.  The view stays valid
+         * until the same thread reads from a few other blocks, so copy it if it has to live longer than the next
+         * call, or use the overload below.
+         */
+        std::string_view at(size_t stringId) const {
+            size_t block = blockOf(stringId);
+            if (blockRawSizes[block] & rawBlockFlag) {
+                return stringIn(data + blockOffsets[block], storedSize(block), block, stringId);
+            }
+            return stringIn(decompressedBlock(block), blockRawSizes[block], block, stringId);
+        }
+
+        /*
+         * Like at, but a string from a compressed block is copied into buffer.  The view stays valid for as long as
+         * the mapping and buffer are left alone.  Strings in raw blocks are returned straight from the mapping.
+         */
+        std::string_view at(size_t stringId, std::string & buffer) const {
+            size_t block = blockOf(stringId);
+            if (blockRawSizes[block] & rawBlockFlag) {
+                return stringIn(data + blockOffsets[block], storedSize(block), block, stringId);
+            }
+            buffer.assign(stringIn(decompressedBlock(block), blockRawSizes[block], block, stringId));
+            return buffer;
+        }
+
+        size_t size() const {
+            return numStrings;
+        }
+    };
+
+    class BlockCompressedStringsWriter {
+        size_t blockSize;
+        std::string dictionary;
+        size_t numStrings = 0;
+        std::vector<uint64_t> blockFirstIds{0};
+        std::vector<uint64_t> blockOffsets{0};
+        std::vector<uint32_t> blockRawSizes;
+        std::string blockData;
+        std::vector<uint32_t> currentOffsets{0};
+        std::string currentBytes;
+        std::string raw;
+        std::string compressed;
+        static constexpr uint32_t rawBlockFlag = gradylib_helpers::rawBlockFlag;
+
+        void flushBlock() {
+            if (currentOffsets.size() == 1) {
+                return;
+            }
+            raw.clear();
+            raw.append(gradylib_helpers::charCast(currentOffsets.data()), 4 * currentOffsets.size());
+            raw.append(currentBytes);
+            compressed.clear();
+            gradylib_helpers::lzCompress(dictionary, raw, compressed);
+            // Store the block raw when compression doesn't pay, marking it in the high bit of its size
+            if (compressed.size() < raw.size()) {
+                blockData.append(compressed);
+                blockRawSizes.push_back(raw.size());
+            } else {
+                blockData.append(raw);
+                blockRawSizes.push_back(raw.size() | rawBlockFlag);
+            }
+            // Keep raw blocks' offset arrays aligned
+            blockData.resize(blockData.size() + gradylib_helpers::getPadLength<4>(blockData.size()));
+            blockOffsets.push_back(blockData.size());
+            blockFirstIds.push_back(numStrings);
+            currentOffsets.resize(1);
+            currentBytes.clear();
+        }
+
+    public:
+        // Blocks of 4 to 16 KB give good compression while keeping the cost of reading one string low.
+        explicit BlockCompressedStringsWriter(size_t blockSize = 8192, std::string dictionary = std::string())
+            : blockSize(blockSize), dictionary(std::move(dictionary))
+        {
+        }
+
+        // Returns the ID of the string, which is the number of strings added before it.
+        size_t add(std::string_view str) {
+            if (currentBytes.size() + str.size() > UINT32_MAX / 2) {
+                std::ostringstream sstr;
+                sstr << "String of length " << str.size() << " is too long for a compressed block";
+                throw gradylibMakeException(sstr.str());
+            }
+            currentBytes.append(str);
+            currentOffsets.push_back(currentBytes.size());
+            size_t stringId = numStrings++;
+            if (currentBytes.size() + 4 * currentOffsets.size() >= blockSize) {
+                flushBlock();
+            }
+            return stringId;
+        }
+
+        size_t size() const {
+            return numStrings;
+        }
+
+        // Writes the section at the current position of ofs, which must be 8 byte aligned.
+        void write(std::ofstream & ofs) {
+            flushBlock();
+            size_t numBlocks = blockRawSizes.size();
+            size_t dictionarySize = dictionary.size();
+            size_t dataSize = blockData.size();
+            ofs.write(gradylib_helpers::charCast(&numStrings), 8);
+            ofs.write(gradylib_helpers::charCast(&numBlocks), 8);
+            ofs.write(gradylib_helpers::charCast(&dictionarySize), 8);
+            ofs.write(gradylib_helpers::charCast(&dataSize), 8);
+            ofs.write(gradylib_helpers::charCast(blockFirstIds.data()), 8 * blockFirstIds.size());
+            ofs.write(gradylib_helpers::charCast(blockOffsets.data()), 8 * blockOffsets.size());
+            ofs.write(gradylib_helpers::charCast(blockRawSizes.data()), 4 * blockRawSizes.size());
+            gradylib_helpers::writePad<8>(ofs);
+            ofs.write(dictionary.data(), dictionary.size());
+            gradylib_helpers::writePad<8>(ofs);
+            ofs.write(blockData.data(), blockData.size());
+            gradylib_helpers::writePad<8>(ofs);
+        }
+
+        /*
+         * Builds a dictionary from the substrings that occur most often in the samples.  Substrings are counted as
+         * 8 byte grams and the most frequent ones are packed into the dictionary until it's full.
+         */
+        static std::string trainDictionary(std::vector<std::string_view> const & samples, size_t dictionarySize = 16384) {
+            constexpr size_t gramLength = 8;
+            constexpr size_t maxSampleBytes = 1 << 22;
+            std::unordered_map<std::string_view, uint32_t> counts;
+            size_t sampled = 0;
+            for (std::string_view sample : samples) {
+                for (size_t p = 0; p + gramLength <= sample.size(); ++p) {
+                    ++counts[sample.substr(p, gramLength)];
+                }
+                sampled += sample.size();
+                if (sampled >= maxSampleBytes) {
+                    break;
+                }
+            }
+            std::vector<std::pair<uint32_t, std::string_view>> grams;
+            for (auto const & [gram, count] : counts) {
+                if (count > 1) {
+                    grams.emplace_back(count, gram);
+                }
+            }
+            std::sort(grams.begin(), grams.end(), [](auto const & g1, auto const & g2) {
+                return g1.first > g2.first || (g1.first == g2.first && g1.second < g2.second);
+            });
+            std::string dictionary;
+            for (auto const & [count, gram] : grams) {
+                if (dictionary.size() + gramLength > dictionarySize) {
+                    break;
+                }
+                if (dictionary.find(gram) == std::string::npos) {
+                    dictionary.append(gram);
+                }
+            }
+            return dictionary;
+        }
+    };
+}
@@ -0,0 +1,180 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * checkpointAsync writes a snapshot of a map that keeps changing, without stopping the writers for the length of
+ * the write.
+ *
+ * The calling process forks.  The child sees the map as it was at the fork, through the kernel's copy-on-write
+ * pages, writes it to a temporary file next to path and renames it over path.  The parent returns right away and
+ * can keep mutating the map; each page it touches while the child runs is copied once.  If fork isn't allowed
+ * (fails, or allowFork is false) the map is copied in-process instead and the copy is written on a background
+ * thread.
+ *
+ * The map must not be modified during the call itself, only after it returns.  The returned future becomes ready
+ * when path holds the snapshot, or holds the exception that stopped it.
+ *
+ * The child has only the thread that forked, and any lock another thread of the parent held at the fork stays
+ * held there.  So the writer must run on the calling thread alone and take no lock the parent's threads use.  The
+ * write members of the library's maps and writeMappable qualify: they write through an ofstream, which only needs
+ * malloc (made safe across fork by glibc), and in the child they checksum the integrity trailer inline.  The
+ * default thread pool throws if the writer asks for it there.  Writers that start threads, use a ThreadPool, or
+ * take application locks such as a logger's should run with allowFork = false.
+ */
+
+#pragma once
+
+#include<errno.h>
+#include<fcntl.h>
+#include<string.h>
+#include<sys/wait.h>
+#include<unistd.h>
+
+#include<concepts>
+#include<exception>
+#include<filesystem>
+#include<future>
+#include<memory>
+#include<sstream>
+#include<string>
+
+#include"Exception.hpp"
+#include"ThreadPool.hpp"
+
+namespace gradylib_helpers {
+
+    inline std::filesystem::path checkpointTemporaryPath(std::filesystem::path const & path) {
+        std::filesystem::path tmp = path;
+        tmp += ".checkpoint." + std::to_string(getpid());
+        return tmp;
+    }
+
+    template<typename Map, typename WriteFunction>
+    void writeCheckpoint(Map const & map, std::filesystem::path const & path, WriteFunction & write) {
+        std::filesystem::path tmp = checkpointTemporaryPath(path);
+        try {
+            write(map, tmp);
+            std::filesystem::rename(tmp, path);
+        } catch (...) {
+            std::error_code ec;
+            std::filesystem::remove(tmp, ec);
+            throw;
+        }
+    }
+
+    // Runs in the forked child.  Reports failures through the pipe and never returns.
+    template<typename Map, typename WriteFunction>
+    [[noreturn]] void runCheckpointChild(Map const & map, std::filesystem::path const & path, WriteFunction & write, int errorFd) {
+        GRADY_LIB_SINGLE_THREADED_CHILD = true;
+        std::string message;
+        try {
+            writeCheckpoint(map, path, write);
+        } catch (std::exception const & e) {
+            message = e.what();
+        } catch (...) {
+            message = "unknown exception while writing checkpoint";
+        }
+        for (size_t written = 0; written < message.size(); ) {
+            ssize_t n = ::write(errorFd, message.data() + written, message.size() - written);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            written += n;
+        }
+        // Skip atexit handlers and static destructors, which belong to the parent
+        _exit(message.empty() ? 0 : 1);
+    }
+
+    inline void waitForCheckpointChild(pid_t pid, int errorFd) {
+        std::string message;
+        char buffer[4096];
+        while (true) {
+            ssize_t n = read(errorFd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            message.append(buffer, n);
+        }
+        close(errorFd);
+        int status;
+        while (waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR) {
+                std::ostringstream sstr;
+                sstr << "Couldn't wait for checkpoint process " << pid << ": " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+        }
+        if (!message.empty()) {
+            throw gradylibMakeException("Checkpoint failed: " + message);
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            std::ostringstream sstr;
+            sstr << "Checkpoint process " << pid << " didn't finish: status " << status;
+            throw gradylibMakeException(sstr.str());
+        }
+    }
+}
+
+namespace gradylib {
+
+    /*
+     * write(map, path) writes the map to path.  It runs in the child process, or on a background thread with a copy
+     * of the map, so it must not depend on other threads of the caller.  Map must be copy constructible for the
+     * in-process fallback.
+     */
+    template<typename Map, typename WriteFunction>
+    requires std::invocable<WriteFunction &, Map const &, std::filesystem::path const &> && std::copy_constructible<Map>
+    std::future<void> checkpointAsync(Map const & map, std::filesystem::path path, WriteFunction write, bool allowFork = true) {
+        namespace gh = gradylib_helpers;
+        if (allowFork) {
+            int fds[2];
+            if (pipe(fds) == 0) {
+                fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+                fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+                pid_t pid = fork();
+                if (pid == 0) {
+                    close(fds[0]);
+                    gh::runCheckpointChild(map, path, write, fds[1]);
+                }
+                close(fds[1]);
+                if (pid > 0) {
+                    return std::async(std::launch::async, [pid, errorFd = fds[0]]() {
+                        gh::waitForCheckpointChild(pid, errorFd);
+                    });
+                }
+                close(fds[0]);
+            }
+        }
+        auto copy = std::make_shared<Map const>(map);
+        return std::async(std::launch::async, [copy, path, write]() mutable {
+            gh::writeCheckpoint(*copy, path, write);
+        });
+    }
+}
@@ -0,0 +1,415 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * A fixed capacity cache built on the same slot arrays as OpenHashMap.  Eviction uses the CLOCK algorithm.
+ *
+ * The BitPairSet holds both pieces of per slot metadata: the first bit says the slot is occupied and the second
+ * bit is the CLOCK reference bit.  The table is sized once in the constructor, so neither insertion nor eviction
+ * allocates (aside from whatever the Key and Value types allocate themselves).
+ *
+ * Since the table never grows, erased slots can't be left behind as tombstones or the probe chains would fill up
+ * over time.  Erasure and eviction use backward shift deletion instead, so an empty slot always ends a probe.
+ *
+ * Interface:
+ * ---------
+ * ClockCache(capacity)
+ * put
+ * get
+ * getOrCompute
+ * contains
+ * erase
+ * clear
+ * size
+ * capacity
+ *
+ * ShardedClockCache splits the cache into independently locked shards for concurrent use.  Its lookups return
+ * copies of the values since references into a shard aren't safe once the shard's lock is released.
+ */
+
+#pragma once
+
+#include<algorithm>
+#include<memory>
+#include<mutex>
+#include<optional>
+#include<string>
+#include<string_view>
+#include<type_traits>
+#include<utility>
+#include<vector>
+
+#include"AltIntHash.hpp"
+#include"BitPairSet.hpp"
+#include"Common.hpp"
+
+namespace gradylib {
+
+    template<typename Key, typename Value, template<typename> typename HashFunction = gradylib::AltHash>
+    requires std::is_default_constructible_v<Key> && std::is_default_constructible_v<Value>
+    class ClockCache {
+        std::vector<Key> keys;
+        std::vector<Value> values;
+        // First bit: the slot is occupied.  Second bit: the CLOCK reference bit.
+        BitPairSet setFlags;
+        size_t cacheCapacity = 0;
+        size_t cacheSize = 0;
+        size_t hand = 0;
+        HashFunction<Key> hashFunction = HashFunction<Key>{};
+
+        template<typename KeyType>
+        size_t hashKey(KeyType const & key) const {
+            // Handle the case where string_views are passed for a ClockCache<string, *>
+            if constexpr (std::same_as<Key, std::string> && std::same_as<std::remove_cvref_t<KeyType>, std::string_view>) {
+                return HashFunction<std::string_view>{}(key);
+            } else {
+                return hashFunction(key);
+            }
+        }
+
+        // Returns the slot holding key, or keys.size() if the key isn't in the cache.
+        template<typename KeyType>
+        size_t findSlot(KeyType const & key) const {
+            if (keys.empty()) {
+                return 0;
+            }
+            size_t idx = hashKey(key) % keys.size();
+            // There is always at least one empty slot, so this loop terminates.
+            while (setFlags.isFirstSet(idx)) {
+                if (keys[idx] == key) {
+                    return idx;
+                }
+                ++idx;
+                idx = idx == keys.size() ? 0 : idx;
+            }
+            return keys.size();
+        }
+
+        // Advance the clock hand until it reaches an occupied slot whose reference bit is clear.  Referenced slots
+        // get a second chance: their bit is cleared as the hand passes.
+        size_t findVictim() {
+            while (true) {
+                size_t idx = hand;
+                ++hand;
+                hand = hand == keys.size() ? 0 : hand;
+                if (!setFlags.isFirstSet(idx)) {
+                    continue;
+                }
+                if (setFlags.isSecondSet(idx)) {
+                    setFlags.unsetSecond(idx);
+                    continue;
+                }
+                return idx;
+            }
+        }
+
+        void removeSlot(size_t idx) {
+            size_t hole = idx;
+            size_t j = idx;
+            while (true) {
+                ++j;
+                j = j == keys.size() ? 0 : j;
+                if (!setFlags.isFirstSet(j)) {
+                    break;
+                }
+                size_t home = hashFunction(keys[j]) % keys.size();
+                // The entry at j can fill the hole unless its home slot lies cyclically in (hole, j]
+                bool homeBetween = hole <= j ? (home > hole && home <= j) : (home > hole || home <= j);
+                if (homeBetween) {
+                    continue;
+                }
+                keys[hole] = std::move(keys[j]);
+                values[hole] = std::move(values[j]);
+                if (setFlags.isSecondSet(j)) {
+                    setFlags.setSecond(hole);
+                } else {
+                    setFlags.unsetSecond(hole);
+                }
+                hole = j;
+            }
+            setFlags.unsetBoth(hole);
+            // Release anything the key and value were holding onto
+            keys[hole] = Key{};
+            values[hole] = Value{};
+            --cacheSize;
+        }
+
+        template<typename KeyType>
+        size_t insertionSlot(KeyType const & key) {
+            if (cacheSize == cacheCapacity) {
+                removeSlot(findVictim());
+            }
+            size_t idx = hashKey(key) % keys.size();
+            while (setFlags.isFirstSet(idx)) {
+                ++idx;
+                idx = idx == keys.size() ? 0 : idx;
+            }
+            return idx;
+        }
+
+    public:
+        typedef Key key_type;
+        typedef Value mapped_type;
+
+        ClockCache() = default;
+
+        explicit ClockCache(size_t capacity, double loadFactor = 0.8)
+            : cacheCapacity(capacity)
+        {
+            if (capacity == 0) {
+                throw gradylibMakeException("ClockCache capacity must be positive");
+            }
+            if (loadFactor <= 0 || loadFactor > 1) {
+                std::ostringstream sstr;
+                sstr << "ClockCache load factor must be in (0, 1], got " << loadFactor;
+                throw gradylibMakeException(sstr.str());
+            }
+            // Keep at least one slot free so every probe ends at an empty slot
+            size_t numSlots = std::max<size_t>(capacity + 1, capacity / loadFactor);
+            keys = std::vector<Key>(numSlots);
+            values = std::vector<Value>(numSlots);
+            setFlags = BitPairSet(numSlots);
+        }
+
+        template<typename KeyType, typename ValueType>
+        requires (std::is_same_v<std::remove_cvref_t<KeyType>, Key> ||
+                 std::is_convertible_v<Key, std::remove_cvref_t<KeyType>> ||
+                 (std::is_constructible_v<Key, KeyType> && std::is_assignable_v<Key, KeyType>)) &&
+                 std::is_assignable_v<Value &, ValueType>
+        void put(KeyType && key, ValueType && value) {
+            if (keys.empty()) {
+                throw gradylibMakeException("Can't insert into a ClockCache with zero capacity");
+            }
+            size_t idx = findSlot(key);
+            if (idx != keys.size()) {
+                values[idx] = std::forward<ValueType>(value);
+                setFlags.setSecond(idx);
+                return;
+            }
+            idx = insertionSlot(key);
+            // New entries start unreferenced so a one-time scan can't push out the working set
+            setFlags.setFirst(idx);
+            keys[idx] = std::forward<KeyType>(key);
+            values[idx] = std::forward<ValueType>(value);
+            ++cacheSize;
+        }
+
+        // This method returns something like an optional<Value>.  A hit sets the entry's reference bit.
+        // The reference is invalidated by the next put.
+        template<typename KeyType>
+        requires (std::is_constructible_v<Key, KeyType> ||
+                  std::is_convertible_v<Key, std::remove_cvref_t<KeyType>>) &&
+                  gradylib_helpers::equality_comparable<KeyType, Key>
+        gradylib_helpers::MapLookup<Value> get(KeyType const & key) {
+            size_t idx = findSlot(key);
+            if (idx == keys.size()) {
+                return gradylib_helpers::MapLookup<Value>();
+            }
+            setFlags.setSecond(idx);
+            return gradylib_helpers::MapLookup<Value>(&values[idx]);
+        }
+
+        // Look the key up and, on a miss, compute the value with f(key) and insert it.
+        template<typename KeyType, typename Callable>
+        requires (std::is_same_v<std::remove_cvref_t<KeyType>, Key> ||
+                  std::is_convertible_v<Key, std::remove_cvref_t<KeyType>> ||
+                  (std::is_constructible_v<Key, KeyType> && std::is_assignable_v<Key, KeyType>)) &&
+                  std::is_invocable_r_v<Value, Callable, KeyType const &>
+        Value & getOrCompute(KeyType && key, Callable && f) {
+            size_t idx = findSlot(key);
+            if (idx != keys.size()) {
+                setFlags.setSecond(idx);
+                return values[idx];
+            }
+            Value value = f(std::as_const(key));
+            if (keys.empty()) {
+                throw gradylibMakeException("Can't insert into a ClockCache with zero capacity");
+            }
+            idx = insertionSlot(key);
+            setFlags.setFirst(idx);
+            keys[idx] = std::forward<KeyType>(key);
+            values[idx] = std::move(value);
+            ++cacheSize;
+            return values[idx];
+        }
+
+        // Unlike get, contains doesn't count as a reference.
+        template<typename KeyType>
+        requires (std::is_constructible_v<Key, KeyType> ||
+                  std::is_convertible_v<Key, std::remove_cvref_t<KeyType>>) &&
+                  gradylib_helpers::equality_comparable<KeyType, Key>
+        bool contains(KeyType const & key) const {
+            return findSlot(key) != keys.size();
+        }
+
+        template<typename KeyType>
+        requires (std::is_constructible_v<Key, KeyType> ||
+                  std::is_convertible_v<Key, std::remove_cvref_t<KeyType>>) &&
+                  gradylib_helpers::equality_comparable<KeyType, Key>
+        void erase(KeyType const & key) {
+            size_t idx = findSlot(key);
+            if (idx != keys.size()) {
+                removeSlot(idx);
+            }
+        }
+
+        void clear() {
+            std::fill(keys.begin(), keys.end(), Key{});
+            std::fill(values.begin(), values.end(), Value{});
+            setFlags.clear();
+            cacheSize = 0;
+            hand = 0;
+        }
+
+        size_t size() const {
+            return cacheSize;
+        }
+
+        size_t capacity() const {
+            return cacheCapacity;
+        }
+    };
+
+    template<typename Key, typename Value, template<typename> typename HashFunction = gradylib::AltHash>
+    requires std::is_default_constructible_v<Key> && std::is_default_constructible_v<Value> && std::is_copy_constructible_v<Value>
+    class ShardedClockCache {
+        struct alignas(64) Shard {
+            std::mutex mutex;
+            ClockCache<Key, Value, HashFunction> cache;
+        };
+
+        std::unique_ptr<Shard[]> shards;
+        size_t numShards = 0;
+        size_t cacheCapacity = 0;
+        HashFunction<Key> hashFunction = HashFunction<Key>{};
+
+        template<typename KeyType>
+        Shard & getShard(KeyType const & key) const {
+            size_t hash;
+            if constexpr (std::same_as<Key, std::string> && std::same_as<std::remove_cvref_t<KeyType>, std::string_view>) {
+                hash = HashFunction<std::string_view>{}(key);
+            } else {
+                hash = hashFunction(key);
+            }
+            // The shard's table indexes with hash % size, so pick the shard from differently mixed bits.  Otherwise
+            // each shard would only ever see a fraction of its slots as home slots.
+            hash *= 0x9E3779B97F4A7C15ull;
+            return shards[(hash >> 32) % numShards];
+        }
+
+    public:
+        typedef Key key_type;
+        typedef Value mapped_type;
+
+        explicit ShardedClockCache(size_t capacity, size_t numShards = 64, double loadFactor = 0.8)
+            : numShards(numShards), cacheCapacity(capacity)
+        {
+            if (numShards == 0) {
+                throw gradylibMakeException("ShardedClockCache needs at least one shard");
+            }
+            if (capacity < numShards) {
+                std::ostringstream sstr;
+                sstr << "ShardedClockCache capacity " << capacity << " is smaller than the number of shards " << numShards;
+                throw gradylibMakeException(sstr.str());
+            }
+            shards = std::make_unique<Shard[]>(numShards);
+            for (size_t i = 0; i < numShards; ++i) {
+                size_t shardCapacity = capacity / numShards + (i < capacity % numShards ? 1 : 0);
+                shards[i].cache = ClockCache<Key, Value, HashFunction>(shardCapacity, loadFactor);
+            }
+        }
+
+        template<typename KeyType, typename ValueType>
+        void put(KeyType && key, ValueType && value) {
+            Shard & shard = getShard(key);
+            std::lock_guard lg(shard.mutex);
+            shard.cache.put(std::forward<KeyType>(key), std::forward<ValueType>(value));
+        }
+
+        template<typename KeyType>
+        std::optional<Value> get(KeyType const & key) {
+            Shard & shard = getShard(key);
+            std::lock_guard lg(shard.mutex);
+            auto lookup = shard.cache.get(key);
+            if (!lookup.has_value()) {
+                return std::nullopt;
+            }
+            return lookup.value();
+        }
+
+        // On a miss f(key) is called without holding the shard lock, so two threads missing on the same key may both
+        // compute it.  The last one to finish wins.
+        template<typename KeyType, typename Callable>
+        requires std::is_invocable_r_v<Value, Callable, KeyType const &>
+        Value getOrCompute(KeyType && key, Callable && f) {
+            Shard & shard = getShard(key);
+            {
+                std::lock_guard lg(shard.mutex);
+                auto lookup = shard.cache.get(key);
+                if (lookup.has_value()) {
+                    return lookup.value();
+                }
+            }
+            Value value = f(std::as_const(key));
+            std::lock_guard lg(shard.mutex);
+            shard.cache.put(std::forward<KeyType>(key), value);
+            return value;
+        }
+
+        template<typename KeyType>
+        bool contains(KeyType const & key) const {
+            Shard & shard = getShard(key);
+            std::lock_guard lg(shard.mutex);
+            return shard.cache.contains(key);
+        }
+
+        template<typename KeyType>
+        void erase(KeyType const & key) {
+            Shard & shard = getShard(key);
+            std::lock_guard lg(shard.mutex);
+            shard.cache.erase(key);
+        }
+
+        void clear() {
+            for (size_t i = 0; i < numShards; ++i) {
+                std::lock_guard lg(shards[i].mutex);
+                shards[i].cache.clear();
+            }
+        }
+
+        // The total is only a snapshot if other threads are inserting.
+        size_t size() const {
+            size_t total = 0;
+            for (size_t i = 0; i < numShards; ++i) {
+                std::lock_guard lg(shards[i].mutex);
+                total += shards[i].cache.size();
+            }
+            return total;
+        }
+
+        size_t capacity() const {
+            return cacheCapacity;
+        }
+    };
+}
@@ -25,6 +25,9 @@ SOFTWARE.
 #pragma once
 
 #include<concepts>
+#include<cstddef>
+#include<cstdint>
+#include<string>
 
 namespace gradylib_helpers {
     template<typename T>
@@ -92,5 +95,27 @@ namespace gradylib_helpers {
     inline char * charCast(T const * p) {
         return static_cast<char *>(const_cast<void *>(static_cast<void const *>(p)));
     }
+
+    // LEB128 style variable length integers: seven bits per byte, high bit set on all but the last byte.
+    inline void appendVarint(std::string & out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    inline uint64_t readVarint(std::byte const * & ptr) {
+        uint64_t value = 0;
+        int shift = 0;
+        while (true) {
+            uint8_t b = static_cast<uint8_t>(*ptr++);
+            value |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if ((b & 0x80) == 0) {
+                return value;
+            }
+            shift += 7;
+        }
+    }
 }
 
@@ -0,0 +1,179 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * Storage for OpenHashMapTC slot arrays that makes copies of the map O(1).
+ *
+ * The arrays live in a memfd.  The map that owns it writes through a shared mapping, and each copy is a private
+ * mapping of the same file, so a copy gets its own page from the kernel only when it writes one.  A private mapping
+ * still sees later writes to the file on pages it hasn't written, though, so the owner has to keep copies from
+ * seeing its changes.  The storage keeps a bit per page for "may still be shared with a live copy".  Making a copy
+ * sets them all, and before the owner first writes such a page, each live copy is made to take its own page with
+ * MADV_POPULATE_WRITE and the bit is cleared.  Memory grows by a page per live copy for every page the owner changes
+ * while the copies exist.
+ *
+ * The owner's writes and the making of copies need the same synchronization as any other writes to the map.
+ * Copies can be destroyed on any thread.
+ */
+
+#pragma once
+
+#include<errno.h>
+#include<string.h>
+#include<sys/mman.h>
+#include<unistd.h>
+
+#include<algorithm>
+#include<bit>
+#include<cstddef>
+#include<cstdint>
+#include<mutex>
+#include<sstream>
+#include<vector>
+
+#include"Exception.hpp"
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+namespace gradylib_helpers {
+
+    class CopyOnWriteStorage {
+        int fd = -1;
+        std::byte * base = nullptr;
+        size_t size = 0;
+        size_t pageShift = std::countr_zero(static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+        std::vector<uint64_t> sharedPages;
+        std::mutex mutex;
+        std::vector<std::byte *> copies;
+
+        bool isShared(size_t page) const {
+            return (sharedPages[page >> 6] >> (page & 63) & 1) != 0;
+        }
+
+        // Gives every live copy its own version of pages [first, last] and clears their bits.
+        void unsharePages(size_t first, size_t last) {
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t offset = first << pageShift;
+            size_t length = std::min(size, (last + 1) << pageShift) - offset;
+            for (std::byte * copy : copies) {
+                if (madvise(copy + offset, length, MADV_POPULATE_WRITE) != 0) {
+                    // Kernels before 5.14 don't have MADV_POPULATE_WRITE.  Writing a byte back to itself breaks
+                    // the sharing the same way.
+                    for (size_t page = first; page <= last; ++page) {
+                        __atomic_fetch_or(reinterpret_cast<unsigned char *>(copy + (page << pageShift)), 0, __ATOMIC_RELAXED);
+                    }
+                }
+            }
+            for (size_t page = first; page <= last; ++page) {
+                sharedPages[page >> 6] &= ~(uint64_t(1) << (page & 63));
+            }
+        }
+
+    public:
+        // bytes of zeros, rounded up to a page by the kernel
+        explicit CopyOnWriteStorage(size_t bytes)
+            : size(std::max<size_t>(bytes, 1))
+        {
+            fd = memfd_create("gradylib", MFD_CLOEXEC);
+            if (fd < 0) {
+                std::ostringstream sstr;
+                sstr << "memfd_create failed: " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            void * mapping = MAP_FAILED;
+            if (ftruncate(fd, size) == 0) {
+                mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            }
+            if (mapping == MAP_FAILED) {
+                std::ostringstream sstr;
+                sstr << "Couldn't map " << size << " bytes of copy-on-write storage: " << strerror(errno);
+                close(fd);
+                throw gradylibMakeException(sstr.str());
+            }
+            base = static_cast<std::byte *>(mapping);
+            sharedPages.resize((((size - 1) >> pageShift) + 64) / 64);
+        }
+
+        CopyOnWriteStorage(CopyOnWriteStorage const &) = delete;
+        CopyOnWriteStorage & operator=(CopyOnWriteStorage const &) = delete;
+
+        ~CopyOnWriteStorage() {
+            release();
+        }
+
+        // The owner's mapping
+        std::byte * data() const {
+            return base;
+        }
+
+        // Must be called before the owner writes [p, p + length).
+        void beforeWrite(void const * p, size_t length) {
+            size_t first = (static_cast<std::byte const *>(p) - base) >> pageShift;
+            size_t last = (static_cast<std::byte const *>(p) + length - 1 - base) >> pageShift;
+            for (size_t page = first; page <= last; ++page) {
+                if (!isShared(page)) {
+                    continue;
+                }
+                size_t end = page;
+                while (end < last && isShared(end + 1)) {
+                    ++end;
+                }
+                unsharePages(page, end);
+                page = end;
+            }
+        }
+
+        // A private mapping of the storage as it is now.  Give it back with unmapCopy.
+        std::byte * mapCopy() {
+            std::lock_guard<std::mutex> lock(mutex);
+            void * mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                std::ostringstream sstr;
+                sstr << "Couldn't map a copy-on-write copy: " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            copies.push_back(static_cast<std::byte *>(mapping));
+            std::fill(sharedPages.begin(), sharedPages.end(), ~uint64_t(0));
+            return copies.back();
+        }
+
+        void unmapCopy(std::byte * copy) {
+            std::lock_guard<std::mutex> lock(mutex);
+            copies.erase(std::find(copies.begin(), copies.end(), copy));
+            munmap(copy, size);
+        }
+
+        // Called when the owner is done with the storage.  Copies that are still mapped keep working.
+        void release() {
+            if (base) {
+                munmap(base, size);
+                close(fd);
+                base = nullptr;
+                fd = -1;
+            }
+        }
+    };
+}
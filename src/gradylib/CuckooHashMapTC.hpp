@@ -0,0 +1,626 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * CuckooHashMapTC is a map for trivially copyable keys and values that stays fast at 95% occupancy, where linear
+ * probing slows down badly.  Use it instead of OpenHashMapTC when memory is the binding constraint.
+ *
+ * The table is an array of buckets.  A bucket holds the keys and values of 4 to 8 slots and a mask of the occupied
+ * slots.  When that fits in 64 bytes, as it does for int64_t -> int32_t (5 slots), each bucket is one cache line.
+ * Every key lives in one of two buckets chosen by its hash, so a lookup reads at most two buckets.  It loads both
+ * at once and compares every slot without branching.
+ *
+ * An insertion into two full buckets does a breadth first search from both of them for a path of moves, each moving
+ * a key to its other bucket, that ends at a bucket with a free slot.  The moves are done back to front and the new
+ * key takes the slot freed at the start of the path.  If no path is found within a bounded search, or the map is at
+ * its maximum load factor, the table grows.
+ *
+ * The 'write' method writes the bucket array to disk, and the filename constructor memory maps it, as with
+ * OpenHashMapTC.  A mapped map is read only.
+ *
+ * File layout:
+ *     mapSize, numBuckets, slotsPerBucket, bucket size    (8 bytes each)
+ *     maxLoadFactor, growthFactor                           (double)
+ *     padding to 64 bytes
+ *     buckets
+ *     integrity trailer
+ */
+
+#pragma once
+
+#include<errno.h>
+#include<fcntl.h>
+#include<string.h>
+#include<sys/mman.h>
+#include<unistd.h>
+
+#include<algorithm>
+#include<bit>
+#include<cmath>
+#include<cstdint>
+#include<filesystem>
+#include<fstream>
+#include<sstream>
+#include<type_traits>
+#include<utility>
+#include<vector>
+
+#include"AltIntHash.hpp"
+#include"Common.hpp"
+#include"Exception.hpp"
+#include"Integrity.hpp"
+
+namespace gradylib_helpers {
+
+    inline constexpr size_t cuckooHeaderSize = 64;
+    inline constexpr size_t cuckooMaxSearchNodes = 512;
+
+    template<typename Key, typename Value>
+    inline constexpr size_t cuckooSlotsPerBucket = std::clamp<size_t>((64 - 1) / (sizeof(Key) + sizeof(Value)), 4, 8);
+
+    template<typename Key, typename Value, size_t Slots>
+    struct CuckooBucketLayout {
+        Key keys[Slots];
+        Value values[Slots];
+        uint8_t occupied;
+    };
+
+    // One cache line per bucket when it fits
+    template<typename Key, typename Value, size_t Slots>
+    struct alignas(sizeof(CuckooBucketLayout<Key, Value, Slots>) <= 64 ? 64 : alignof(CuckooBucketLayout<Key, Value, Slots>)) CuckooBucket {
+        Key keys[Slots];
+        Value values[Slots];
+        uint8_t occupied;
+
+        int freeSlot() const {
+            uint32_t free = ~static_cast<uint32_t>(occupied) & ((1u << Slots) - 1);
+            return free == 0 ? -1 : std::countr_zero(free);
+        }
+
+        bool isOccupied(size_t slot) const {
+            return (occupied >> slot) & 1;
+        }
+    };
+
+    // The second bucket choice, derived from the same hash with a multiplicative mix.
+    inline size_t cuckooAltHash(size_t hash) {
+        uint64_t h = static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ull;
+        return h ^ (h >> 32);
+    }
+}
+
+namespace gradylib {
+
+    template<typename Key, typename Value, template<typename> typename HashFunction = gradylib::AltHash>
+    requires std::is_trivially_copyable_v<Key> &&
+             std::is_trivially_copyable_v<Value> &&
+             std::is_default_constructible_v<Key> &&
+             std::is_default_constructible_v<Value>
+    class CuckooHashMapTC {
+    public:
+        static constexpr size_t slotsPerBucket = gradylib_helpers::cuckooSlotsPerBucket<Key, Value>;
+
+    private:
+        using Bucket = gradylib_helpers::CuckooBucket<Key, Value, slotsPerBucket>;
+
+        struct SearchNode {
+            size_t bucket;
+            int32_t parent;
+            uint8_t slot;
+        };
+
+        std::vector<Bucket> storage;
+        Bucket * buckets = nullptr;
+        size_t numBuckets = 0;
+        size_t mapSize = 0;
+        double maxLoadFactor = 0.95;
+        double growthFactor = 1.2;
+        HashFunction<Key> hashFunction = HashFunction<Key>{};
+        std::vector<SearchNode> searchNodes;
+        bool readOnly = false;
+        int fd = -1;
+        void * memoryMapping = nullptr;
+        size_t mappingSize = 0;
+        static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
+
+        void checkWritable() const {
+            if (readOnly) {
+                std::ostringstream sstr;
+                sstr << "Cannot modify mmap";
+                throw gradylibMakeException(sstr.str());
+            }
+        }
+
+        void freeResources() {
+            if (memoryMapping) {
+                munmap(memoryMapping, mappingSize);
+                close(fd);
+                memoryMapping = nullptr;
+                fd = -1;
+            }
+        }
+
+        // Both choices come from a mixed hash.  AltHash's low bits are poor (its hashes are all odd), and taking them
+        // modulo an even bucket count would confine the first choice to half the buckets.
+        std::pair<size_t, size_t> bucketChoices(Key const & key) const {
+            size_t hash = gradylib_helpers::mix64(hashFunction(key));
+            return {hash % numBuckets, gradylib_helpers::cuckooAltHash(hash) % numBuckets};
+        }
+
+        size_t otherBucket(Key const & key, size_t bucket) const {
+            auto [b1, b2] = bucketChoices(key);
+            return bucket == b1 ? b2 : b1;
+        }
+
+        // Returns the bucket and slot of key, or numBuckets if it isn't in the map.
+        std::pair<size_t, size_t> find(Key const & key) const {
+            if (mapSize == 0) {
+                return {numBuckets, 0};
+            }
+            auto [b1, b2] = bucketChoices(key);
+            // Compare every slot of both buckets and pick the match without branching on which bucket has it.  A key
+            // is equally likely to be in either bucket, so that branch would be mispredicted half the time and the
+            // misses of consecutive lookups would no longer overlap.
+            Bucket const & first = buckets[b1];
+            Bucket const & second = buckets[b2];
+            uint32_t match1 = 0;
+            uint32_t match2 = 0;
+            for (size_t s = 0; s < slotsPerBucket; ++s) {
+                match1 |= static_cast<uint32_t>(first.keys[s] == key) << s;
+                match2 |= static_cast<uint32_t>(second.keys[s] == key) << s;
+            }
+            match1 &= first.occupied;
+            match2 &= second.occupied;
+            if ((match1 | match2) == 0) {
+                return {numBuckets, 0};
+            }
+            size_t b = match1 != 0 ? b1 : b2;
+            uint32_t match = match1 != 0 ? match1 : match2;
+            return {b, static_cast<size_t>(std::countr_zero(match))};
+        }
+
+        // Frees a slot in b1 or b2 by moving keys along a path found by breadth first search.  Returns the bucket
+        // with the free slot, or numBuckets if no path was found.
+        size_t makeRoom(size_t b1, size_t b2) {
+            searchNodes.clear();
+            searchNodes.push_back({b1, -1, 0});
+            searchNodes.push_back({b2, -1, 0});
+            int32_t found = -1;
+            for (size_t head = 0; head < searchNodes.size() && found < 0; ++head) {
+                size_t bucket = searchNodes[head].bucket;
+                for (size_t s = 0; s < slotsPerBucket && searchNodes.size() < gradylib_helpers::cuckooMaxSearchNodes; ++s) {
+                    size_t next = otherBucket(buckets[bucket].keys[s], bucket);
+                    searchNodes.push_back({next, static_cast<int32_t>(head), static_cast<uint8_t>(s)});
+                    if (buckets[next].freeSlot() >= 0) {
+                        found = static_cast<int32_t>(searchNodes.size() - 1);
+                        break;
+                    }
+                }
+            }
+            if (found < 0) {
+                return numBuckets;
+            }
+            // Move back to front.  Each move empties the slot that the move before it fills.  A bucket can appear
+            // twice on a path, so each move is checked against the current table, and on a mismatch the moves
+            // already done, which all leave keys in one of their buckets, are kept and the search fails.
+            int32_t cur = found;
+            while (searchNodes[cur].parent >= 0) {
+                SearchNode const & node = searchNodes[cur];
+                Bucket & from = buckets[searchNodes[node.parent].bucket];
+                Bucket & to = buckets[node.bucket];
+                int slot = to.freeSlot();
+                if (slot < 0 || !from.isOccupied(node.slot) || otherBucket(from.keys[node.slot], searchNodes[node.parent].bucket) != node.bucket) {
+                    return numBuckets;
+                }
+                to.keys[slot] = from.keys[node.slot];
+                to.values[slot] = from.values[node.slot];
+                to.occupied |= static_cast<uint8_t>(1u << slot);
+                from.occupied &= static_cast<uint8_t>(~(1u << node.slot));
+                cur = node.parent;
+            }
+            return searchNodes[cur].bucket;
+        }
+
+        // Places a key that isn't in the map.  Returns false if there was no room.
+        bool place(Key const & key, Value const & value, Value * & placed) {
+            auto [b1, b2] = bucketChoices(key);
+            // Use the emptier bucket, which keeps buckets evenly filled and the searches rare.
+            int fill1 = std::popcount(buckets[b1].occupied);
+            int fill2 = std::popcount(buckets[b2].occupied);
+            size_t b = fill2 < fill1 ? b2 : b1;
+            if (std::min(fill1, fill2) == static_cast<int>(slotsPerBucket)) {
+                b = makeRoom(b1, b2);
+            }
+            if (b == numBuckets) {
+                return false;
+            }
+            Bucket & bucket = buckets[b];
+            int slot = bucket.freeSlot();
+            bucket.keys[slot] = key;
+            bucket.values[slot] = value;
+            bucket.occupied |= static_cast<uint8_t>(1u << slot);
+            placed = &bucket.values[slot];
+            return true;
+        }
+
+        void rehash(size_t newNumBuckets) {
+            std::vector<Bucket> old = std::move(storage);
+            Bucket const * oldBuckets = old.empty() ? buckets : old.data();
+            size_t oldNumBuckets = numBuckets;
+            while (true) {
+                storage.assign(newNumBuckets, Bucket{});
+                buckets = storage.data();
+                numBuckets = newNumBuckets;
+                bool ok = true;
+                Value * placed;
+                for (size_t b = 0; b < oldNumBuckets && ok; ++b) {
+                    for (size_t s = 0; s < slotsPerBucket && ok; ++s) {
+                        if (oldBuckets[b].isOccupied(s)) {
+                            ok = place(oldBuckets[b].keys[s], oldBuckets[b].values[s], placed);
+                        }
+                    }
+                }
+                if (ok) {
+                    return;
+                }
+                newNumBuckets = newNumBuckets + newNumBuckets / 10 + 1;
+            }
+        }
+
+        void grow() {
+            size_t minBuckets = static_cast<size_t>(std::ceil((mapSize + 1) / (slotsPerBucket * maxLoadFactor)));
+            rehash(std::max({minBuckets, static_cast<size_t>(numBuckets * growthFactor), numBuckets + 1}));
+        }
+
+        Value & insertSlot(Key const & key, Value const & value, bool overwrite) {
+            checkWritable();
+            auto [b, s] = find(key);
+            if (b != numBuckets) {
+                if (overwrite) {
+                    buckets[b].values[s] = value;
+                }
+                return buckets[b].values[s];
+            }
+            if (mapSize + 1 > numBuckets * slotsPerBucket * maxLoadFactor) {
+                grow();
+            }
+            Value * placed;
+            while (!place(key, value, placed)) {
+                grow();
+            }
+            ++mapSize;
+            return *placed;
+        }
+
+    public:
+        typedef Key key_type;
+        typedef Value mapped_type;
+
+        CuckooHashMapTC() = default;
+
+        CuckooHashMapTC(CuckooHashMapTC const & m)
+            : storage(m.buckets, m.buckets + m.numBuckets), buckets(storage.data()), numBuckets(m.numBuckets),
+              mapSize(m.mapSize), maxLoadFactor(m.maxLoadFactor), growthFactor(m.growthFactor)
+        {
+        }
+
+        CuckooHashMapTC(CuckooHashMapTC && m) noexcept {
+            *this = std::move(m);
+        }
+
+        CuckooHashMapTC & operator=(CuckooHashMapTC const & m) {
+            if (this != &m) {
+                *this = CuckooHashMapTC(m);
+            }
+            return *this;
+        }
+
+        CuckooHashMapTC & operator=(CuckooHashMapTC && m) noexcept {
+            if (this == &m) {
+                return *this;
+            }
+            freeResources();
+            storage = std::move(m.storage);
+            buckets = m.buckets;
+            numBuckets = m.numBuckets;
+            mapSize = m.mapSize;
+            maxLoadFactor = m.maxLoadFactor;
+            growthFactor = m.growthFactor;
+            readOnly = m.readOnly;
+            fd = m.fd;
+            memoryMapping = m.memoryMapping;
+            mappingSize = m.mappingSize;
+            m.buckets = nullptr;
+            m.numBuckets = 0;
+            m.mapSize = 0;
+            m.readOnly = false;
+            m.fd = -1;
+            m.memoryMapping = nullptr;
+            m.mappingSize = 0;
+            return *this;
+        }
+
+        ~CuckooHashMapTC() {
+            freeResources();
+        }
+
+        // If verify is true, the file's integrity trailer is checked in parallel before the constructor returns.
+        explicit CuckooHashMapTC(std::filesystem::path filename, bool verify = false) {
+            namespace gh = gradylib_helpers;
+            fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                std::ostringstream sstr;
+                sstr << "Error opening file " << filename;
+                throw gradylibMakeException(sstr.str());
+            }
+            mappingSize = std::filesystem::file_size(filename);
+            memoryMapping = mmapFunc(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+            if (memoryMapping == MAP_FAILED) {
+                close(fd);
+                fd = -1;
+                memoryMapping = nullptr;
+                std::ostringstream sstr;
+                sstr << "memory map failed: " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            try {
+                if (verify) {
+                    IntegrityVerifier(memoryMapping, mappingSize).verifyAll();
+                }
+                gh::checkMappedExtent(gh::cuckooHeaderSize, mappingSize, "CuckooHashMapTC");
+                std::byte const * base = static_cast<std::byte const *>(memoryMapping);
+                size_t header[4];
+                memcpy(header, base, sizeof(header));
+                memcpy(&maxLoadFactor, base + 32, 8);
+                memcpy(&growthFactor, base + 40, 8);
+                if (header[2] != slotsPerBucket || header[3] != sizeof(Bucket)) {
+                    std::ostringstream sstr;
+                    sstr << "CuckooHashMapTC file has " << header[2] << " slots per bucket and " << header[3]
+                         << " byte buckets, but this map has " << slotsPerBucket << " and " << sizeof(Bucket);
+                    throw gradylibMakeException(sstr.str());
+                }
+                mapSize = header[0];
+                numBuckets = header[1];
+                gh::checkMappedExtent(numBuckets > mappingSize ? SIZE_MAX : gh::cuckooHeaderSize + numBuckets * sizeof(Bucket), mappingSize, "CuckooHashMapTC");
+                buckets = static_cast<Bucket *>(const_cast<void *>(static_cast<void const *>(base + gh::cuckooHeaderSize)));
+            } catch (...) {
+                freeResources();
+                throw;
+            }
+            readOnly = true;
+        }
+
+        Value & operator[](Key const & key) {
+            return insertSlot(key, Value{}, false);
+        }
+
+        void put(Key const & key, Value const & value) {
+            insertSlot(key, value, true);
+        }
+
+        Value & at(Key const & key) {
+            auto [b, s] = find(key);
+            if (b == numBuckets) {
+                std::ostringstream sstr;
+                sstr << "CuckooHashMapTC doesn't contain key";
+                throw gradylibMakeException(sstr.str());
+            }
+            return buckets[b].values[s];
+        }
+
+        Value const & at(Key const & key) const {
+            return const_cast<CuckooHashMapTC *>(this)->at(key);
+        }
+
+        gradylib_helpers::MapLookup<Value> get(Key const & key) {
+            auto [b, s] = find(key);
+            if (b == numBuckets) {
+                return gradylib_helpers::MapLookup<Value>();
+            }
+            return gradylib_helpers::MapLookup<Value>(&buckets[b].values[s]);
+        }
+
+        gradylib_helpers::MapLookup<Value const> get(Key const & key) const {
+            return const_cast<CuckooHashMapTC *>(this)->get(key).makeConst();
+        }
+
+        bool contains(Key const & key) const {
+            return find(key).first != numBuckets;
+        }
+
+        void erase(Key const & key) {
+            checkWritable();
+            auto [b, s] = find(key);
+            if (b == numBuckets) {
+                return;
+            }
+            buckets[b].occupied &= static_cast<uint8_t>(~(1u << s));
+            --mapSize;
+        }
+
+        void reserve(size_t size) {
+            checkWritable();
+            size_t needed = static_cast<size_t>(std::ceil(size / (slotsPerBucket * maxLoadFactor)));
+            if (needed > numBuckets) {
+                rehash(needed);
+            }
+        }
+
+        void clear() {
+            checkWritable();
+            for (size_t b = 0; b < numBuckets; ++b) {
+                buckets[b].occupied = 0;
+            }
+            mapSize = 0;
+        }
+
+        size_t size() const {
+            return mapSize;
+        }
+
+        // The number of slots
+        size_t capacity() const {
+            return numBuckets * slotsPerBucket;
+        }
+
+        // Bytes used by the bucket array
+        size_t memoryUsage() const {
+            return numBuckets * sizeof(Bucket);
+        }
+
+        class iterator {
+            size_t idx;
+            CuckooHashMapTC * container;
+        public:
+            iterator(size_t idx, CuckooHashMapTC * container)
+                    : idx(idx), container(container) {
+            }
+
+            bool operator==(iterator const &other) const {
+                return idx == other.idx && container == other.container;
+            }
+
+            bool operator!=(iterator const &other) const {
+                return idx != other.idx || container != other.container;
+            }
+
+            std::pair<Key const &, Value &> operator*() const {
+                return {key(), container->buckets[idx / slotsPerBucket].values[idx % slotsPerBucket]};
+            }
+
+            Key const &key() const {
+                return container->buckets[idx / slotsPerBucket].keys[idx % slotsPerBucket];
+            }
+
+            Value &value() {
+                return container->buckets[idx / slotsPerBucket].values[idx % slotsPerBucket];
+            }
+
+            iterator &operator++() {
+                idx = container->nextOccupied(idx + 1);
+                return *this;
+            }
+        };
+
+        class const_iterator {
+            size_t idx;
+            CuckooHashMapTC const * container;
+        public:
+            const_iterator(size_t idx, CuckooHashMapTC const * container)
+                    : idx(idx), container(container) {
+            }
+
+            bool operator==(const_iterator const &other) const {
+                return idx == other.idx && container == other.container;
+            }
+
+            bool operator!=(const_iterator const &other) const {
+                return idx != other.idx || container != other.container;
+            }
+
+            std::pair<Key const &, Value const &> operator*() const {
+                return {key(), value()};
+            }
+
+            Key const &key() const {
+                return container->buckets[idx / slotsPerBucket].keys[idx % slotsPerBucket];
+            }
+
+            Value const &value() const {
+                return container->buckets[idx / slotsPerBucket].values[idx % slotsPerBucket];
+            }
+
+            const_iterator &operator++() {
+                idx = container->nextOccupied(idx + 1);
+                return *this;
+            }
+        };
+
+        // The first occupied slot at or after idx, or capacity()
+        size_t nextOccupied(size_t idx) const {
+            size_t end = capacity();
+            while (idx < end && !buckets[idx / slotsPerBucket].isOccupied(idx % slotsPerBucket)) {
+                ++idx;
+            }
+            return std::min(idx, end);
+        }
+
+        iterator begin() {
+            return iterator(nextOccupied(0), this);
+        }
+
+        iterator end() {
+            return iterator(capacity(), this);
+        }
+
+        const_iterator begin() const {
+            return const_iterator(nextOccupied(0), this);
+        }
+
+        const_iterator end() const {
+            return const_iterator(capacity(), this);
+        }
+
+        void write(std::filesystem::path filename) const {
+            namespace gh = gradylib_helpers;
+            std::ofstream ofs(filename, std::ios::binary);
+            if (ofs.fail()) {
+                std::ostringstream sstr;
+                sstr << "Couldn't open " << filename << " for writing in CuckooHashMapTC::write";
+                throw gradylibMakeException(sstr.str());
+            }
+            size_t header[4] = {mapSize, numBuckets, slotsPerBucket, sizeof(Bucket)};
+            ofs.write(gh::charCast(header), sizeof(header));
+            ofs.write(gh::charCast(&maxLoadFactor), 8);
+            ofs.write(gh::charCast(&growthFactor), 8);
+            gh::writePad<gh::cuckooHeaderSize>(ofs);
+            ofs.write(gh::charCast(buckets), numBuckets * sizeof(Bucket));
+            ofs.close();
+            if (ofs.fail()) {
+                std::ostringstream sstr;
+                sstr << "Writing " << filename << " failed in CuckooHashMapTC::write.";
+                throw gradylibMakeException(sstr.str());
+            }
+            appendIntegrityTrailer(filename);
+        }
+
+        template<typename, typename, template<typename> typename>
+        friend void GRADY_LIB_MOCK_CuckooHashMapTC_MMAP();
+
+        template<typename, typename, template<typename> typename>
+        friend void GRADY_LIB_DEFAULT_CuckooHashMapTC_MMAP();
+    };
+
+    template<typename Key, typename Value, template<typename> typename HashFunction = gradylib::AltHash>
+    void GRADY_LIB_MOCK_CuckooHashMapTC_MMAP() {
+        CuckooHashMapTC<Key, Value, HashFunction>::mmapFunc = [](void *, size_t, int, int, int, off_t) -> void *{
+            return MAP_FAILED;
+        };
+    }
+
+    template<typename Key, typename Value, template<typename> typename HashFunction = gradylib::AltHash>
+    void GRADY_LIB_DEFAULT_CuckooHashMapTC_MMAP() {
+        CuckooHashMapTC<Key, Value, HashFunction>::mmapFunc = mmap;
+    }
+}
@@ -0,0 +1,193 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * DurableOpenHashMapTC is an OpenHashMapTC kept durable by a snapshot file plus a MutationLog.
+ *
+ * put and erase append a small record to the log and, by default, return once it is on disk.  Concurrent writers
+ * share one fdatasync per batch.  checkpoint() writes a new snapshot and empties the log.  On construction the last
+ * snapshot is loaded and the log replayed over it.
+ *
+ * The map is guarded by a reader/writer lock, so it can be used from many threads.  A reader can see a value whose
+ * log record is still being synced.
+ *
+ * put and erase change the map before their record is synced, and a failed sync doesn't undo the change.  When one
+ * of them throws, the map may hold a change that isn't on disk, and every later commit throws too.  Reopen the map
+ * to get back to what the snapshot and log hold.
+ */
+
+#pragma once
+
+#include<fcntl.h>
+#include<unistd.h>
+
+#include<filesystem>
+#include<memory>
+#include<mutex>
+#include<optional>
+#include<shared_mutex>
+#include<sstream>
+
+#include"AltIntHash.hpp"
+#include"Exception.hpp"
+#include"Integrity.hpp"
+#include"MutationLog.hpp"
+#include"OpenHashMapTC.hpp"
+
+namespace gradylib {
+
+    template<typename Key, typename Value, template<typename> typename HashFunction = gradylib::AltHash>
+    class DurableOpenHashMapTC {
+        std::filesystem::path snapshotPath;
+        OpenHashMapTC<Key, Value, HashFunction> map;
+        mutable std::shared_mutex mapMutex;
+        std::unique_ptr<MutationLog<Key, Value>> log;
+
+        // Makes a rename in the snapshot's directory durable
+        void syncSnapshotDirectory() const {
+            std::filesystem::path dir = snapshotPath.parent_path();
+            if (dir.empty()) {
+                dir = ".";
+            }
+            int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+            if (fd < 0 || fsync(fd) != 0) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+                std::ostringstream sstr;
+                sstr << "Couldn't sync directory " << dir;
+                throw gradylibMakeException(sstr.str());
+            }
+            close(fd);
+        }
+
+    public:
+        DurableOpenHashMapTC(std::filesystem::path snapshotPath, std::filesystem::path logPath)
+            : snapshotPath(snapshotPath)
+        {
+            if (std::filesystem::exists(snapshotPath)) {
+                map = OpenHashMapTC<Key, Value, HashFunction>::read(snapshotPath);
+            }
+            log = std::make_unique<MutationLog<Key, Value>>(logPath, [this](Key const & key, Value const & value) {
+                map.put(key, value);
+            }, [this](Key const & key) {
+                map.erase(key);
+            });
+        }
+
+        // With sync false the record is only buffered; it becomes durable with the next synced write or sync().
+        // If the sync throws, the new value stays in the map without being durable.  See the top of the file.
+        void put(Key const & key, Value const & value, bool sync = true) {
+            uint64_t seq;
+            {
+                // Appending under the map lock keeps the log in the same order as the map's changes
+                std::unique_lock lock(mapMutex);
+                map.put(key, value);
+                seq = log->appendPut(key, value);
+            }
+            if (sync) {
+                log->commit(seq);
+            }
+        }
+
+        void erase(Key const & key, bool sync = true) {
+            uint64_t seq;
+            {
+                std::unique_lock lock(mapMutex);
+                if (!map.contains(key)) {
+                    return;
+                }
+                map.erase(key);
+                seq = log->appendErase(key);
+            }
+            if (sync) {
+                log->commit(seq);
+            }
+        }
+
+        void sync() {
+            log->commit();
+        }
+
+        std::optional<Value> get(Key const & key) const {
+            std::shared_lock lock(mapMutex);
+            auto lookup = map.get(key);
+            if (!lookup.has_value()) {
+                return std::nullopt;
+            }
+            return lookup.value();
+        }
+
+        bool contains(Key const & key) const {
+            std::shared_lock lock(mapMutex);
+            return map.contains(key);
+        }
+
+        size_t size() const {
+            std::shared_lock lock(mapMutex);
+            return map.size();
+        }
+
+        /*
+         * Write a new snapshot and empty the log.  Writers are blocked while the snapshot is written.  The snapshot
+         * is written to a temporary file, synced, checked against its integrity trailer and renamed into place, so a
+         * crash leaves either snapshot whole.  If any step before the rename fails, the old snapshot and the log are
+         * left as they were.
+         */
+        void checkpoint() {
+            std::unique_lock lock(mapMutex);
+            log->commit();
+            std::filesystem::path tmp = snapshotPath;
+            tmp += ".tmp";
+            try {
+                map.write(tmp.string());
+                int fd = open(tmp.c_str(), O_RDONLY);
+                if (fd < 0 || fsync(fd) != 0) {
+                    if (fd >= 0) {
+                        close(fd);
+                    }
+                    std::ostringstream sstr;
+                    sstr << "Couldn't sync snapshot " << tmp;
+                    throw gradylibMakeException(sstr.str());
+                }
+                close(fd);
+                verifyIntegrity(tmp);
+            } catch (...) {
+                std::error_code ec;
+                std::filesystem::remove(tmp, ec);
+                throw;
+            }
+            std::filesystem::rename(tmp, snapshotPath);
+            // Without this a crash could lose the rename but keep the truncated log
+            syncSnapshotDirectory();
+            log->reset();
+        }
+
+        // A copy of the current contents
+        OpenHashMapTC<Key, Value, HashFunction> copy() const {
+            std::shared_lock lock(mapMutex);
+            return map;
+        }
+    };
+}
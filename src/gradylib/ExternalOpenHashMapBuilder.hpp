@@ -0,0 +1,510 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * ExternalOpenHashMapBuilder builds map files too large to hold in memory: the MMapS2IOpenHashMap format when Key is
+ * std::string, otherwise the OpenHashMapTC format.
+ *
+ * The final table size has to be known up front, so the constructor takes the expected number of distinct keys.
+ * Each put is appended to an on-disk spill file chosen by the key's slot range.  write() then builds each slot
+ * range in memory on a ThreadPool and writes it straight to its place in the final file, so peak memory is about
+ * one range per pool thread plus a 1 MB spill buffer per range.  A spill file is only open while a full buffer is
+ * appended to it, so the number of ranges isn't bounded by the open file limit.
+ *
+ * Linear probing can run past the end of a range.  Those entries are found in a first pass over the ranges and
+ * handed, in order, to the free slots at the start of the following ranges, which is where an in-memory map would
+ * have put them.  A second pass rebuilds each range, adds the entries handed to it and writes it.  Each spill file
+ * is read twice.
+ *
+ * When a key is put more than once, the last value wins.
+ */
+
+#pragma once
+
+#include<fcntl.h>
+#include<errno.h>
+#include<string.h>
+#include<unistd.h>
+
+#include<algorithm>
+#include<concepts>
+#include<filesystem>
+#include<fstream>
+#include<memory>
+#include<sstream>
+#include<string>
+#include<string_view>
+#include<type_traits>
+#include<vector>
+
+#include"AltIntHash.hpp"
+#include"Common.hpp"
+#include"Exception.hpp"
+#include"Integrity.hpp"
+#include"OpenHashMap.hpp"
+#include"OpenHashMapTC.hpp"
+#include"ThreadPool.hpp"
+
+namespace gradylib {
+
+    template<typename Key, typename Value, template<typename> typename HashFunction = gradylib::AltHash>
+    requires (std::same_as<Key, std::string> || (std::is_trivially_copyable_v<Key> && std::equality_comparable<Key>)) &&
+             std::is_trivially_copyable_v<Value>
+    class ExternalOpenHashMapBuilder {
+        static constexpr bool stringKeys = std::same_as<Key, std::string>;
+        using KeyView = std::conditional_t<stringKeys, std::string_view, Key>;
+        using KeyArg = std::conditional_t<stringKeys, std::string_view, Key const &>;
+        // Ranges start on multiples of this so that they never share a BitPairSet word
+        static constexpr size_t slotAlignment = 64;
+        static constexpr size_t slotsPerWord = 16;
+        static constexpr size_t spillBufferSize = 1 << 20;
+        static constexpr size_t emptySlot = -1;
+
+        struct Entry {
+            size_t hash;
+            Key key;
+            Value value;
+        };
+
+        struct Record {
+            size_t hash;
+            KeyView key;
+            Value value;
+        };
+
+        struct Bucket {
+            size_t begin = 0;
+            size_t end = 0;
+            std::filesystem::path spillPath;
+            // Whether the spill file has been created yet
+            bool spilled = false;
+            std::string buffer;
+            // Results of the first pass
+            size_t occupied = 0;
+            size_t keyBytes = 0;
+            std::vector<Entry> overflow;
+            // Entries from earlier ranges that go in this range's free slots
+            std::vector<Entry> carryIn;
+
+            // The spill file goes with the bucket, including when the builder's constructor throws partway.
+            ~Bucket() {
+                if (spilled) {
+                    std::error_code ec;
+                    std::filesystem::remove(spillPath, ec);
+                }
+            }
+        };
+
+        // A range's slots, built in memory
+        struct Placement {
+            std::vector<char> data;
+            std::vector<Record> records;
+            std::vector<size_t> slotRecord;
+        };
+
+        std::filesystem::path spillDirectory;
+        size_t keySize = 0;
+        size_t slotsPerBucket = 0;
+        double loadFactor;
+        double growthFactor;
+        std::vector<std::unique_ptr<Bucket>> buckets;
+        size_t numPuts = 0;
+        bool written = false;
+
+        static size_t hashKey(KeyView key) {
+            if constexpr (stringKeys) {
+                return std::hash<std::string_view>{}(key);
+            } else {
+                return HashFunction<Key>{}(key);
+            }
+        }
+
+        static size_t keyRecordSize(std::string_view key) {
+            return 4 + key.size() + gradylib_helpers::getPadLength<4>(key.size());
+        }
+
+        static size_t alignUp(size_t offset, size_t alignment) {
+            return offset + (alignment - offset % alignment) % alignment;
+        }
+
+        static void writeAt(int fd, void const * data, size_t size, size_t offset) {
+            char const * p = static_cast<char const *>(data);
+            while (size > 0) {
+                ssize_t written = pwrite(fd, p, size, offset);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    std::ostringstream sstr;
+                    sstr << "ExternalOpenHashMapBuilder write failed: " << strerror(errno);
+                    throw gradylibMakeException(sstr.str());
+                }
+                p += written;
+                offset += written;
+                size -= written;
+            }
+        }
+
+        void flushSpill(Bucket & bucket) {
+            if (bucket.buffer.empty()) {
+                return;
+            }
+            std::ofstream spill(bucket.spillPath, std::ios::binary | (bucket.spilled ? std::ios::app : std::ios::trunc));
+            bucket.spilled = true;
+            spill.write(bucket.buffer.data(), bucket.buffer.size());
+            spill.close();
+            if (spill.fail()) {
+                std::ostringstream sstr;
+                sstr << "Problem writing spill file " << bucket.spillPath;
+                throw gradylibMakeException(sstr.str());
+            }
+            bucket.buffer.clear();
+        }
+
+        void readSpill(Bucket const & bucket, Placement & placement) const {
+            size_t fileSize = bucket.spilled ? std::filesystem::file_size(bucket.spillPath) : 0;
+            placement.data.resize(fileSize);
+            if (bucket.spilled) {
+                std::ifstream ifs(bucket.spillPath, std::ios::binary);
+                ifs.read(placement.data.data(), fileSize);
+                if (ifs.fail()) {
+                    std::ostringstream sstr;
+                    sstr << "Problem reading spill file " << bucket.spillPath;
+                    throw gradylibMakeException(sstr.str());
+                }
+            }
+            char const * ptr = placement.data.data();
+            char const * end = ptr + fileSize;
+            placement.records.clear();
+            while (ptr < end) {
+                Record r;
+                memcpy(&r.hash, ptr, 8);
+                ptr += 8;
+                if constexpr (stringKeys) {
+                    uint32_t len;
+                    memcpy(&len, ptr, 4);
+                    ptr += 4;
+                    r.key = std::string_view(ptr, len);
+                    ptr += len;
+                } else {
+                    memcpy(&r.key, ptr, sizeof(Key));
+                    ptr += sizeof(Key);
+                }
+                memcpy(&r.value, ptr, sizeof(Value));
+                ptr += sizeof(Value);
+                placement.records.push_back(r);
+            }
+        }
+
+        /*
+         * Place the range's own entries in the order they were put.  This is deterministic, so both passes get the
+         * same layout.  Entries that probe past the end of the range go in overflow if it isn't null.
+         */
+        void placeOwn(Bucket const & bucket, Placement & placement, std::vector<Entry> * overflow) const {
+            size_t rangeSize = bucket.end - bucket.begin;
+            placement.slotRecord.assign(rangeSize, emptySlot);
+            OpenHashMap<Key, size_t, HashFunction> overflowIndex;
+            for (size_t r = 0; r < placement.records.size(); ++r) {
+                Record const & record = placement.records[r];
+                size_t idx = record.hash % keySize - bucket.begin;
+                while (idx < rangeSize) {
+                    size_t existing = placement.slotRecord[idx];
+                    if (existing == emptySlot || placement.records[existing].key == record.key) {
+                        placement.slotRecord[idx] = r;
+                        break;
+                    }
+                    ++idx;
+                }
+                if (idx == rangeSize && overflow) {
+                    auto lookup = overflowIndex.get(record.key);
+                    if (lookup.has_value()) {
+                        (*overflow)[lookup.value()].value = record.value;
+                    } else {
+                        overflowIndex.put(Key(record.key), overflow->size());
+                        overflow->push_back(Entry{record.hash, Key(record.key), record.value});
+                    }
+                }
+            }
+        }
+
+        template<typename F>
+        void forEachBucket(ThreadPool & tp, F f) {
+            gradylib_helpers::runTasks(tp, buckets.size(), [&](size_t b) {
+                f(*buckets[b]);
+            });
+        }
+
+        // Hand each range's overflow, in order, to the free slots of the ranges after it, wrapping at the end.
+        void resolveCarries() {
+            std::vector<Entry> pending;
+            std::vector<size_t> freeSlots(buckets.size());
+            for (size_t b = 0; b < buckets.size(); ++b) {
+                freeSlots[b] = buckets[b]->end - buckets[b]->begin - buckets[b]->occupied;
+            }
+            auto take = [&](size_t b) {
+                size_t n = std::min(freeSlots[b], pending.size());
+                Bucket & bucket = *buckets[b];
+                std::move(pending.begin(), pending.begin() + n, std::back_inserter(bucket.carryIn));
+                pending.erase(pending.begin(), pending.begin() + n);
+                freeSlots[b] -= n;
+            };
+            for (size_t b = 0; b < buckets.size(); ++b) {
+                take(b);
+                std::move(buckets[b]->overflow.begin(), buckets[b]->overflow.end(), std::back_inserter(pending));
+                buckets[b]->overflow = std::vector<Entry>();
+            }
+            for (size_t b = 0; !pending.empty(); b = b + 1 == buckets.size() ? 0 : b + 1) {
+                take(b);
+            }
+        }
+
+    public:
+        /*
+         * expectedSize is the number of distinct keys.  The table gets expectedSize / loadFactor slots and can't
+         * grow, so more keys than expected make probes longer, and write() throws if the table would be full.
+         * slotsPerRange sets the memory each pool thread needs in write().  growthFactor is written to an
+         * OpenHashMapTC file for when the loaded map grows.
+         */
+        ExternalOpenHashMapBuilder(std::filesystem::path spillDirectory, size_t expectedSize, size_t slotsPerRange = 1 << 22,
+                                   double loadFactor = 0.8, double growthFactor = 1.2)
+            : spillDirectory(spillDirectory), loadFactor(loadFactor), growthFactor(growthFactor)
+        {
+            keySize = std::max<size_t>(slotAlignment, expectedSize / loadFactor + 1);
+            slotsPerBucket = alignUp(std::max<size_t>(1, std::min(slotsPerRange, keySize)), slotAlignment);
+            std::filesystem::create_directories(spillDirectory);
+            for (size_t begin = 0; begin < keySize; begin += slotsPerBucket) {
+                auto bucket = std::make_unique<Bucket>();
+                bucket->begin = begin;
+                bucket->end = std::min(keySize, begin + slotsPerBucket);
+                std::ostringstream name;
+                name << "gradylib_spill_" << getpid() << "_" << static_cast<void const *>(this) << "_" << buckets.size();
+                bucket->spillPath = spillDirectory / name.str();
+                buckets.push_back(std::move(bucket));
+            }
+        }
+
+        ExternalOpenHashMapBuilder(ExternalOpenHashMapBuilder const &) = delete;
+
+        ExternalOpenHashMapBuilder & operator=(ExternalOpenHashMapBuilder const &) = delete;
+
+        void put(KeyArg key, Value const & value) {
+            if (written) {
+                std::ostringstream sstr;
+                sstr << "ExternalOpenHashMapBuilder has already been written";
+                throw gradylibMakeException(sstr.str());
+            }
+            size_t hash = hashKey(key);
+            Bucket & bucket = *buckets[hash % keySize / slotsPerBucket];
+            bucket.buffer.append(gradylib_helpers::charCast(&hash), 8);
+            if constexpr (stringKeys) {
+                uint32_t len = key.size();
+                bucket.buffer.append(gradylib_helpers::charCast(&len), 4);
+                bucket.buffer.append(key);
+            } else {
+                bucket.buffer.append(gradylib_helpers::charCast(&key), sizeof(Key));
+            }
+            bucket.buffer.append(gradylib_helpers::charCast(&value), sizeof(Value));
+            if (bucket.buffer.size() >= spillBufferSize) {
+                flushSpill(bucket);
+            }
+            ++numPuts;
+        }
+
+        // The number of puts so far, counting repeated keys
+        size_t size() const {
+            return numPuts;
+        }
+
+        size_t numRanges() const {
+            return buckets.size();
+        }
+
+        void write(std::filesystem::path filename, ThreadPool & tp) {
+            if (written) {
+                std::ostringstream sstr;
+                sstr << "ExternalOpenHashMapBuilder has already been written";
+                throw gradylibMakeException(sstr.str());
+            }
+            written = true;
+            for (auto & bucket : buckets) {
+                flushSpill(*bucket);
+            }
+
+            forEachBucket(tp, [this](Bucket & bucket) {
+                Placement placement;
+                readSpill(bucket, placement);
+                placeOwn(bucket, placement, &bucket.overflow);
+                bucket.occupied = 0;
+                bucket.keyBytes = 0;
+                for (size_t r : placement.slotRecord) {
+                    if (r != emptySlot) {
+                        ++bucket.occupied;
+                    }
+                    if constexpr (stringKeys) {
+                        bucket.keyBytes += r == emptySlot ? 4 : keyRecordSize(placement.records[r].key);
+                    }
+                }
+            });
+
+            size_t mapSize = 0;
+            for (auto & bucket : buckets) {
+                mapSize += bucket->occupied + bucket->overflow.size();
+            }
+            if (mapSize >= keySize) {
+                std::ostringstream sstr;
+                sstr << "ExternalOpenHashMapBuilder has " << mapSize << " distinct keys for " << keySize << " slots";
+                throw gradylibMakeException(sstr.str());
+            }
+            resolveCarries();
+
+            // Lay out the file
+            std::vector<size_t> keyBytesStart(buckets.size() + 1, 0);
+            for (size_t b = 0; b < buckets.size(); ++b) {
+                size_t keyBytes = buckets[b]->keyBytes;
+                if constexpr (stringKeys) {
+                    for (Entry const & e : buckets[b]->carryIn) {
+                        keyBytes += keyRecordSize(e.key) - 4;
+                    }
+                }
+                keyBytesStart[b + 1] = keyBytesStart[b] + keyBytes;
+            }
+            size_t keysOffset;
+            size_t keyOffsetsOffset = 0;
+            size_t valuesOffset;
+            size_t bitPairSetOffset;
+            size_t numWords = (keySize + slotsPerWord - 1) / slotsPerWord;
+            std::vector<char> header;
+            auto appendHeader = [&header](auto value) {
+                char const * p = gradylib_helpers::charCast(&value);
+                header.insert(header.end(), p, p + 8);
+            };
+            if constexpr (stringKeys) {
+                keyOffsetsOffset = 32;
+                keysOffset = keyOffsetsOffset + 8 * keySize;
+                valuesOffset = alignUp(keysOffset + keyBytesStart.back(), 8);
+                bitPairSetOffset = alignUp(valuesOffset + sizeof(Value) * keySize, 8);
+                appendHeader(mapSize);
+                appendHeader(keySize);
+                appendHeader(valuesOffset);
+                appendHeader(bitPairSetOffset);
+            } else {
+                keysOffset = gradylib_helpers::OpenHashMapTCHeader::seededSize;
+                valuesOffset = alignUp(keysOffset + sizeof(Key) * keySize, std::max<size_t>(8, alignof(Value)));
+                bitPairSetOffset = alignUp(valuesOffset + sizeof(Value) * keySize, 8);
+                appendHeader(mapSize);
+                appendHeader(keySize | gradylib_helpers::hashSeedHeaderFlag);
+                appendHeader(loadFactor);
+                appendHeader(growthFactor);
+                appendHeader(valuesOffset);
+                appendHeader(bitPairSetOffset);
+                // Hash seed.  Keys are placed with the unseeded hash.
+                appendHeader(uint64_t(0));
+            }
+            appendHeader(keySize);
+            size_t fileSize = bitPairSetOffset + 8 + 4 * numWords;
+
+            int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) {
+                std::ostringstream sstr;
+                sstr << "Couldn't open file " << filename << " in ExternalOpenHashMapBuilder::write";
+                throw gradylibMakeException(sstr.str());
+            }
+            try {
+                if (ftruncate(fd, fileSize) != 0) {
+                    std::ostringstream sstr;
+                    sstr << "Couldn't size " << filename << ": " << strerror(errno);
+                    throw gradylibMakeException(sstr.str());
+                }
+                writeAt(fd, header.data(), header.size() - 8, 0);
+                writeAt(fd, header.data() + header.size() - 8, 8, bitPairSetOffset);
+
+                forEachBucket(tp, [&](Bucket & bucket) {
+                    Placement placement;
+                    readSpill(bucket, placement);
+                    placeOwn(bucket, placement, nullptr);
+                    // Carried entries take the first free slots in order
+                    size_t idx = 0;
+                    for (Entry const & e : bucket.carryIn) {
+                        while (placement.slotRecord[idx] != emptySlot) {
+                            ++idx;
+                        }
+                        placement.slotRecord[idx] = placement.records.size();
+                        placement.records.push_back(Record{e.hash, KeyView(e.key), e.value});
+                    }
+                    size_t rangeSize = bucket.end - bucket.begin;
+                    std::vector<Value> values(rangeSize);
+                    std::vector<uint32_t> words((rangeSize + slotsPerWord - 1) / slotsPerWord, 0);
+                    for (size_t i = 0; i < rangeSize; ++i) {
+                        size_t r = placement.slotRecord[i];
+                        if (r != emptySlot) {
+                            values[i] = placement.records[r].value;
+                            words[i / slotsPerWord] |= uint32_t(0b11) << (2 * (i % slotsPerWord));
+                        }
+                    }
+                    if constexpr (stringKeys) {
+                        size_t b = bucket.begin / slotsPerBucket;
+                        std::vector<int64_t> keyOffsets(rangeSize);
+                        std::string keyBytes;
+                        for (size_t i = 0; i < rangeSize; ++i) {
+                            keyOffsets[i] = keyBytesStart[b] + keyBytes.size();
+                            size_t r = placement.slotRecord[i];
+                            std::string_view key = r == emptySlot ? std::string_view() : placement.records[r].key;
+                            int32_t len = key.size();
+                            keyBytes.append(gradylib_helpers::charCast(&len), 4);
+                            keyBytes.append(key);
+                            keyBytes.append(gradylib_helpers::getPadLength<4>(len), '\0');
+                        }
+                        writeAt(fd, keyOffsets.data(), 8 * rangeSize, keyOffsetsOffset + 8 * bucket.begin);
+                        writeAt(fd, keyBytes.data(), keyBytes.size(), keysOffset + keyBytesStart[b]);
+                    } else {
+                        std::vector<Key> keys(rangeSize);
+                        for (size_t i = 0; i < rangeSize; ++i) {
+                            size_t r = placement.slotRecord[i];
+                            if (r != emptySlot) {
+                                keys[i] = placement.records[r].key;
+                            }
+                        }
+                        writeAt(fd, keys.data(), sizeof(Key) * rangeSize, keysOffset + sizeof(Key) * bucket.begin);
+                    }
+                    writeAt(fd, values.data(), sizeof(Value) * rangeSize, valuesOffset + sizeof(Value) * bucket.begin);
+                    writeAt(fd, words.data(), 4 * words.size(), bitPairSetOffset + 8 + 4 * (bucket.begin / slotsPerWord));
+                });
+            } catch (...) {
+                close(fd);
+                throw;
+            }
+            close(fd);
+            appendIntegrityTrailer(filename, tp);
+            for (auto & bucket : buckets) {
+                std::error_code ec;
+                std::filesystem::remove(bucket->spillPath, ec);
+                bucket->carryIn = std::vector<Entry>();
+            }
+        }
+
+        void write(std::filesystem::path filename) {
+            write(filename, gradylib_helpers::defaultThreadPool());
+        }
+    };
+}
@@ -0,0 +1,218 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * A small set associative cache for the hottest keys of a read-only map, with TinyLFU admission.
+ *
+ * Every access is counted in a count-min sketch of 4-bit counters.  On a miss the candidate is admitted only if the
+ * sketch says it is accessed more often than the entry it would replace, so one-off keys in a Zipfian stream can't
+ * flush the hot set.  The counters are halved periodically so the sketch follows changes in the distribution.
+ *
+ * HotKeyCache isn't thread safe.  It's meant to be owned by a single thread, see the CachedReader classes in
+ * MMapS2IOpenHashMap and MMapI2SOpenHashMap.
+ */
+
+#pragma once
+
+#include<algorithm>
+#include<bit>
+#include<cstdint>
+#include<string>
+#include<string_view>
+#include<type_traits>
+#include<vector>
+
+namespace gradylib {
+
+    class FrequencySketch {
+        static constexpr int depth = 4;
+        std::vector<uint8_t> counters;
+        size_t widthMask = 0;
+        size_t additions = 0;
+        size_t sampleSize = 0;
+
+        static size_t rowHash(size_t hash, int row) {
+            // Each row needs an independent index.  Remix the key's hash with a different odd constant per row.
+            static constexpr uint64_t seeds[depth] = {
+                0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0xD6E8FEB86659FD93ull
+            };
+            uint64_t h = (hash + row) * seeds[row];
+            return h ^ (h >> 29);
+        }
+
+        void age() {
+            for (auto & c : counters) {
+                c >>= 1;
+            }
+            additions /= 2;
+        }
+
+    public:
+        FrequencySketch() = default;
+
+        // The sketch has to remember more keys than the cache holds or every candidate looks as hot as the victims.
+        explicit FrequencySketch(size_t numEntries) {
+            size_t width = std::bit_ceil(std::max<size_t>(4 * numEntries, 256));
+            counters = std::vector<uint8_t>(width * depth, 0);
+            widthMask = width - 1;
+            sampleSize = 10 * width;
+        }
+
+        void increment(size_t hash) {
+            if (counters.empty()) {
+                return;
+            }
+            bool added = false;
+            for (int row = 0; row < depth; ++row) {
+                uint8_t & c = counters[row * (widthMask + 1) + (rowHash(hash, row) & widthMask)];
+                if (c < 15) {
+                    ++c;
+                    added = true;
+                }
+            }
+            if (added && ++additions >= sampleSize) {
+                age();
+            }
+        }
+
+        int frequency(size_t hash) const {
+            if (counters.empty()) {
+                return 0;
+            }
+            int ret = 15;
+            for (int row = 0; row < depth; ++row) {
+                ret = std::min<int>(ret, counters[row * (widthMask + 1) + (rowHash(hash, row) & widthMask)]);
+            }
+            return ret;
+        }
+    };
+
+    template<typename Key, typename Value>
+    requires std::is_default_constructible_v<Key> && std::is_default_constructible_v<Value>
+    class HotKeyCache {
+        static constexpr size_t ways = 4;
+
+        struct Entry {
+            size_t hash = 0;
+            Key key{};
+            Value value{};
+            bool occupied = false;
+        };
+
+        std::vector<Entry> entries;
+        size_t setMask = 0;
+        FrequencySketch sketch;
+        size_t numHits = 0;
+        size_t numMisses = 0;
+
+        size_t setStart(size_t hash) const {
+            // The low bits usually pick the slot in the map being cached.  Use the high bits here.
+            return ((hash >> 32 ^ hash >> 17) & setMask) * ways;
+        }
+
+    public:
+        HotKeyCache() = default;
+
+        // The cache holds at least numEntries entries, rounded up to a power of two number of 4-way sets.
+        explicit HotKeyCache(size_t numEntries)
+            : sketch(numEntries)
+        {
+            size_t numSets = std::bit_ceil(std::max<size_t>(1, (numEntries + ways - 1) / ways));
+            entries = std::vector<Entry>(numSets * ways);
+            setMask = numSets - 1;
+        }
+
+        // Returns a pointer to the cached value or nullptr.  Every call counts as an access of the key.
+        template<typename KeyType>
+        Value const * find(KeyType const & key, size_t hash) {
+            if (entries.empty()) {
+                return nullptr;
+            }
+            sketch.increment(hash);
+            size_t start = setStart(hash);
+            for (size_t i = start; i < start + ways; ++i) {
+                Entry const & e = entries[i];
+                if (e.occupied && e.hash == hash && e.key == key) {
+                    ++numHits;
+                    return &e.value;
+                }
+            }
+            ++numMisses;
+            return nullptr;
+        }
+
+        // Offer a key that just missed.  It replaces the least frequently used entry of its set, but only if it's
+        // been seen more often than that entry.
+        template<typename KeyType, typename ValueType>
+        void admit(KeyType const & key, size_t hash, ValueType && value) {
+            if (entries.empty()) {
+                return;
+            }
+            size_t start = setStart(hash);
+            size_t victim = start;
+            int victimFrequency = 16;
+            for (size_t i = start; i < start + ways; ++i) {
+                Entry const & e = entries[i];
+                if (!e.occupied) {
+                    victim = i;
+                    victimFrequency = -1;
+                    break;
+                }
+                int f = sketch.frequency(e.hash);
+                if (f < victimFrequency) {
+                    victim = i;
+                    victimFrequency = f;
+                }
+            }
+            if (victimFrequency >= 0 && sketch.frequency(hash) <= victimFrequency) {
+                return;
+            }
+            Entry & e = entries[victim];
+            e.hash = hash;
+            e.key = Key(key);
+            e.value = std::forward<ValueType>(value);
+            e.occupied = true;
+        }
+
+        void clear() {
+            for (auto & e : entries) {
+                e = Entry{};
+            }
+            numHits = 0;
+            numMisses = 0;
+        }
+
+        size_t capacity() const {
+            return entries.size();
+        }
+
+        size_t hits() const {
+            return numHits;
+        }
+
+        size_t misses() const {
+            return numMisses;
+        }
+    };
+}
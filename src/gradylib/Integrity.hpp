@@ -0,0 +1,420 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * CRC32C integrity trailers for the memory mappable file formats.
+ *
+ * The trailer is appended after the map's own bytes, so readers that don't know about it are unaffected and files
+ * written before it existed still load.  The data is split into fixed size sections, each with its own CRC32C, so
+ * verification can run in parallel or one section at a time as the sections are first used.
+ *
+ * Layout, after dataSize bytes of map data:
+ *     uint32_t crc[numSections]          numSections = ceil(dataSize / sectionSize)
+ *     padding to a multiple of 8
+ *     uint64_t dataSize
+ *     uint64_t sectionSize
+ *     uint32_t version
+ *     uint32_t CRC32C of the crc array and the two words above
+ *     uint64_t magic
+ *
+ * CRC32C uses the SSE4.2 crc32 instruction or the ARMv8 CRC extension when the CPU has it, and a slicing-by-8 table
+ * otherwise.
+ */
+
+#pragma once
+
+#include<errno.h>
+#include<fcntl.h>
+#include<string.h>
+#include<sys/mman.h>
+#include<unistd.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include<nmmintrin.h>
+#define GRADY_LIB_X86_CRC32C
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include<arm_acle.h>
+#define GRADY_LIB_ARM_CRC32C
+#endif
+
+#include<array>
+#include<atomic>
+#include<cstdint>
+#include<cstring>
+#include<filesystem>
+#include<memory>
+#include<sstream>
+#include<vector>
+
+#include"Exception.hpp"
+#include"ParallelRead.hpp"
+#include"ThreadPool.hpp"
+
+namespace gradylib_helpers {
+
+    inline constexpr uint32_t crc32cPolynomial = 0x82F63B78;
+    inline constexpr uint64_t integrityMagic = 0x3143524359445247; // "GRDYCRC1"
+    inline constexpr uint32_t integrityVersion = 1;
+    inline constexpr size_t integrityFooterSize = 32;
+
+    inline std::array<std::array<uint32_t, 256>, 8> const & crc32cTables() {
+        static std::array<std::array<uint32_t, 256>, 8> const tables = []() {
+            std::array<std::array<uint32_t, 256>, 8> t;
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t crc = i;
+                for (int j = 0; j < 8; ++j) {
+                    crc = crc & 1 ? (crc >> 1) ^ crc32cPolynomial : crc >> 1;
+                }
+                t[0][i] = crc;
+            }
+            for (uint32_t i = 0; i < 256; ++i) {
+                for (int k = 1; k < 8; ++k) {
+                    t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+                }
+            }
+            return t;
+        }();
+        return tables;
+    }
+
+    // Takes and returns the raw register, without the initial and final inversion.
+    inline uint32_t crc32cSoftware(uint32_t crc, unsigned char const * p, size_t len) {
+        auto const & t = crc32cTables();
+        while (len >= 8) {
+            uint64_t word;
+            memcpy(&word, p, 8);
+            word ^= crc;
+            crc = t[7][word & 0xff] ^ t[6][(word >> 8) & 0xff] ^ t[5][(word >> 16) & 0xff] ^ t[4][(word >> 24) & 0xff] ^
+                  t[3][(word >> 32) & 0xff] ^ t[2][(word >> 40) & 0xff] ^ t[1][(word >> 48) & 0xff] ^ t[0][word >> 56];
+            p += 8;
+            len -= 8;
+        }
+        while (len-- > 0) {
+            crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+        }
+        return crc;
+    }
+
+#if defined(GRADY_LIB_X86_CRC32C)
+    __attribute__((target("sse4.2")))
+    inline uint32_t crc32cHardware(uint32_t crc, unsigned char const * p, size_t len) {
+        uint64_t crc64 = crc;
+        while (len >= 8) {
+            uint64_t word;
+            memcpy(&word, p, 8);
+            crc64 = _mm_crc32_u64(crc64, word);
+            p += 8;
+            len -= 8;
+        }
+        crc = crc64;
+        while (len-- > 0) {
+            crc = _mm_crc32_u8(crc, *p++);
+        }
+        return crc;
+    }
+
+    inline bool hasHardwareCrc32c() {
+        static bool const supported = __builtin_cpu_supports("sse4.2");
+        return supported;
+    }
+#elif defined(GRADY_LIB_ARM_CRC32C)
+    inline uint32_t crc32cHardware(uint32_t crc, unsigned char const * p, size_t len) {
+        while (len >= 8) {
+            uint64_t word;
+            memcpy(&word, p, 8);
+            crc = __crc32cd(crc, word);
+            p += 8;
+            len -= 8;
+        }
+        while (len-- > 0) {
+            crc = __crc32cb(crc, *p++);
+        }
+        return crc;
+    }
+
+    inline bool hasHardwareCrc32c() {
+        return true;
+    }
+#else
+    inline uint32_t crc32cHardware(uint32_t crc, unsigned char const * p, size_t len) {
+        return crc32cSoftware(crc, p, len);
+    }
+
+    inline bool hasHardwareCrc32c() {
+        return false;
+    }
+#endif
+
+    // CRC32C of len bytes, continuing from a previous result.  Start with crc = 0.
+    inline uint32_t crc32c(uint32_t crc, void const * data, size_t len) {
+        unsigned char const * p = static_cast<unsigned char const *>(data);
+        crc = ~crc;
+        crc = hasHardwareCrc32c() ? crc32cHardware(crc, p, len) : crc32cSoftware(crc, p, len);
+        return ~crc;
+    }
+
+    inline uint32_t crc32c(void const * data, size_t len) {
+        return crc32c(0, data, len);
+    }
+}
+
+namespace gradylib_helpers {
+
+    // Cheap structural checks for the mapped readers.  They catch truncated files without reading the data.
+    inline void checkMappedExtent(size_t end, size_t mappingSize, char const * what) {
+        if (end > mappingSize) {
+            std::ostringstream sstr;
+            sstr << what << " file is truncated: it needs " << end << " bytes but has " << mappingSize;
+            throw gradylibMakeException(sstr.str());
+        }
+    }
+
+    // Checks that the BitPairSet written at offset fits in the mapping.
+    inline void checkMappedBitPairSet(void const * mapping, size_t offset, size_t mappingSize, char const * what) {
+        checkMappedExtent(offset + 8, mappingSize, what);
+        size_t setSize;
+        memcpy(&setSize, static_cast<std::byte const *>(mapping) + offset, 8);
+        checkMappedExtent(setSize / 4 > mappingSize ? SIZE_MAX : offset + 8 + (setSize + 15) / 16 * 4, mappingSize, what);
+    }
+
+    // See gradylib::appendIntegrityTrailer.  With no pool the sections are checksummed on the calling thread.
+    inline void appendIntegrityTrailerOn(std::filesystem::path const & filename, gradylib::ThreadPool * tp, size_t sectionSize) {
+        int fd = open(filename.c_str(), O_RDWR);
+        if (fd < 0) {
+            std::ostringstream sstr;
+            sstr << "Couldn't open " << filename << " to append an integrity trailer";
+            throw gradylibMakeException(sstr.str());
+        }
+        try {
+            size_t dataSize = std::filesystem::file_size(filename);
+            size_t numSections = (dataSize + sectionSize - 1) / sectionSize;
+            std::vector<uint32_t> crcs(numSections);
+            auto checksum = [&](size_t section) {
+                size_t begin = section * sectionSize;
+                std::vector<std::byte> buffer(std::min(sectionSize, dataSize - begin));
+                preadFully(fd, buffer.data(), buffer.size(), begin);
+                crcs[section] = crc32c(buffer.data(), buffer.size());
+            };
+            if (tp) {
+                runTasks(*tp, numSections, checksum);
+            } else {
+                for (size_t section = 0; section < numSections; ++section) {
+                    checksum(section);
+                }
+            }
+            std::vector<std::byte> trailer((4 * numSections + 7) / 8 * 8 + integrityFooterSize);
+            memcpy(trailer.data(), crcs.data(), 4 * numSections);
+            std::byte * footer = trailer.data() + trailer.size() - integrityFooterSize;
+            memcpy(footer, &dataSize, 8);
+            memcpy(footer + 8, &sectionSize, 8);
+            memcpy(footer + 16, &integrityVersion, 4);
+            uint32_t footerCrc = crc32c(trailer.data(), footer + 16 - trailer.data());
+            memcpy(footer + 20, &footerCrc, 4);
+            memcpy(footer + 24, &integrityMagic, 8);
+            size_t offset = dataSize;
+            for (size_t written = 0; written < trailer.size(); ) {
+                ssize_t n = pwrite(fd, trailer.data() + written, trailer.size() - written, offset + written);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n < 0) {
+                    std::ostringstream sstr;
+                    sstr << "Writing the integrity trailer of " << filename << " failed: " << strerror(errno);
+                    throw gradylibMakeException(sstr.str());
+                }
+                written += n;
+            }
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        close(fd);
+    }
+}
+
+namespace gradylib {
+
+    // How a mapped reader checks the integrity trailer: not at all, all of it while opening, or each section the
+    // first time a lookup reads from it.
+    enum class IntegrityCheck {
+        none,
+        eager,
+        lazy
+    };
+
+    /*
+     * Checks a memory mapped file against its integrity trailer.  Each section is verified at most once, so the
+     * readers of a map can call verifyRange on the bytes they are about to use and pay for each section only on
+     * first use.  OpenHashMapTC does this when it is opened with IntegrityCheck::lazy.
+     */
+    class IntegrityVerifier {
+        std::byte const * base = nullptr;
+        size_t dataSize = 0;
+        size_t sectionSize = 0;
+        size_t sections = 0;
+        uint32_t const * crcs = nullptr;
+        std::unique_ptr<std::atomic<bool>[]> verified;
+
+        static size_t tableSize(size_t numSections) {
+            return (4 * numSections + 7) / 8 * 8;
+        }
+
+    public:
+        // Returns whether the last bytes of the mapping are an integrity trailer.
+        static bool hasTrailer(void const * mapping, size_t mappingSize) {
+            if (mappingSize < gradylib_helpers::integrityFooterSize) {
+                return false;
+            }
+            uint64_t magic;
+            memcpy(&magic, static_cast<std::byte const *>(mapping) + mappingSize - 8, 8);
+            return magic == gradylib_helpers::integrityMagic;
+        }
+
+        // Throws if the mapping doesn't end with a consistent trailer, which includes files that were truncated.
+        IntegrityVerifier(void const * mapping, size_t mappingSize)
+            : base(static_cast<std::byte const *>(mapping))
+        {
+            namespace gh = gradylib_helpers;
+            std::ostringstream sstr;
+            if (!hasTrailer(mapping, mappingSize)) {
+                sstr << "File has no integrity trailer.  It may be truncated or written without one.";
+                throw gradylibMakeException(sstr.str());
+            }
+            std::byte const * footer = base + mappingSize - gh::integrityFooterSize;
+            uint32_t version, footerCrc;
+            memcpy(&dataSize, footer, 8);
+            memcpy(&sectionSize, footer + 8, 8);
+            memcpy(&version, footer + 16, 4);
+            memcpy(&footerCrc, footer + 20, 4);
+            if (version != gh::integrityVersion) {
+                sstr << "Unsupported integrity trailer version " << version;
+                throw gradylibMakeException(sstr.str());
+            }
+            sections = sectionSize == 0 ? 0 : (dataSize + sectionSize - 1) / sectionSize;
+            if (sectionSize == 0 || sectionSize % 8 != 0 || dataSize > mappingSize ||
+                dataSize + tableSize(sections) + gh::integrityFooterSize != mappingSize) {
+                sstr << "Integrity trailer doesn't match the file size " << mappingSize;
+                throw gradylibMakeException(sstr.str());
+            }
+            crcs = static_cast<uint32_t const *>(static_cast<void const *>(base + dataSize));
+            if (gh::crc32c(base + dataSize, tableSize(sections) + 16) != footerCrc) {
+                sstr << "Integrity trailer is corrupt";
+                throw gradylibMakeException(sstr.str());
+            }
+            verified = std::make_unique<std::atomic<bool>[]>(sections);
+        }
+
+        size_t numSections() const {
+            return sections;
+        }
+
+        // The size of the data the trailer covers, which is where the trailer starts.
+        size_t size() const {
+            return dataSize;
+        }
+
+        void verifySection(size_t section) const {
+            if (verified[section].load(std::memory_order_acquire)) {
+                return;
+            }
+            size_t begin = section * sectionSize;
+            size_t len = std::min(sectionSize, dataSize - begin);
+            if (gradylib_helpers::crc32c(base + begin, len) != crcs[section]) {
+                std::ostringstream sstr;
+                sstr << "Checksum mismatch in bytes " << begin << " to " << begin + len;
+                throw gradylibMakeException(sstr.str());
+            }
+            verified[section].store(true, std::memory_order_release);
+        }
+
+        void verifyRange(size_t offset, size_t len) const {
+            if (len == 0) {
+                return;
+            }
+            size_t last = std::min(offset + len, dataSize) - 1;
+            for (size_t s = offset / sectionSize; s <= last / sectionSize && s < sections; ++s) {
+                verifySection(s);
+            }
+        }
+
+        void verifyAll(ThreadPool & tp) const {
+            gradylib_helpers::runTasks(tp, sections, [this](size_t section) {
+                verifySection(section);
+            });
+        }
+
+        void verifyAll() const {
+            verifyAll(gradylib_helpers::defaultThreadPool());
+        }
+    };
+
+    /*
+     * Append an integrity trailer to a finished file.  The sections are read back with pread and checksummed on the
+     * pool; the file was just written, so this normally runs from the page cache.
+     */
+    inline void appendIntegrityTrailer(std::filesystem::path filename, ThreadPool & tp, size_t sectionSize = 4 << 20) {
+        gradylib_helpers::appendIntegrityTrailerOn(filename, &tp, sectionSize);
+    }
+
+    /*
+     * The writers call this.  The sections are checksummed on the default pool, or on the calling thread in the child
+     * of a checkpoint fork, which must not start threads.  See Checkpoint.hpp.
+     */
+    inline void appendIntegrityTrailer(std::filesystem::path filename) {
+        if (gradylib_helpers::GRADY_LIB_SINGLE_THREADED_CHILD) {
+            gradylib_helpers::appendIntegrityTrailerOn(filename, nullptr, 4 << 20);
+        } else {
+            appendIntegrityTrailer(filename, gradylib_helpers::defaultThreadPool());
+        }
+    }
+
+    // Verify a whole file in parallel.  Throws if the file has no trailer or any section doesn't match.
+    inline void verifyIntegrity(std::filesystem::path filename, ThreadPool & tp) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::ostringstream sstr;
+            sstr << "Couldn't open " << filename << " to verify it";
+            throw gradylibMakeException(sstr.str());
+        }
+        size_t fileSize = std::filesystem::file_size(filename);
+        void * mapping = fileSize == 0 ? MAP_FAILED : mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            std::ostringstream sstr;
+            sstr << filename << " is empty or can't be mapped";
+            throw gradylibMakeException(sstr.str());
+        }
+        try {
+            IntegrityVerifier(mapping, fileSize).verifyAll(tp);
+        } catch (...) {
+            munmap(mapping, fileSize);
+            throw;
+        }
+        munmap(mapping, fileSize);
+    }
+
+    inline void verifyIntegrity(std::filesystem::path filename) {
+        verifyIntegrity(filename, gradylib_helpers::defaultThreadPool());
+    }
+}
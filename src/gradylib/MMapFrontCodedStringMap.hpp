@@ -0,0 +1,495 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include<fcntl.h>
+#include<errno.h>
+#include<string.h>
+#include<sys/mman.h>
+#include<unistd.h>
+
+#include<algorithm>
+#include<filesystem>
+#include<fstream>
+#include<sstream>
+#include<string>
+#include<string_view>
+#include<utility>
+#include<vector>
+
+#include"Common.hpp"
+#include"Exception.hpp"
+#include"Integrity.hpp"
+#include"OpenHashMap.hpp"
+
+namespace gradylib {
+
+    /*
+     * This is a readonly, sorted string to integer map written by writeFrontCoded.  Strings are kept in sorted order
+     * and front coded in blocks: each string stores only the length of the prefix it shares with the one before it
+     * and the rest of its bytes.  The first string of a block shares nothing, so it can be compared straight out of
+     * the mapping, and an array of block offsets allows binary search over those first strings.  Lookups decode at
+     * most one block.
+     *
+     * Besides exact lookups this supports ordered iteration, lowerBound and prefixRange.  Positions in the sorted
+     * order are called ranks.
+     *
+     * File layout:
+     *     mapSize, blockSize, numBlocks, blockOffsetsOffset, valuesOffset    (8 bytes each)
+     *     blocks       (per string: varint shared prefix length, varint suffix length, suffix bytes)
+     *     blockOffsets (numBlocks + 1 uint64_t, relative to the start of the blocks, 8 byte aligned)
+     *     values       (mapSize IndexType in rank order, 8 byte aligned)
+     */
+    template<typename IndexType>
+    class MMapFrontCodedStringMap {
+        static constexpr size_t headerSize = 40;
+
+        std::byte const * blocks = nullptr;
+        uint64_t const * blockOffsets = nullptr;
+        IndexType const * values = nullptr;
+        size_t mapSize = 0;
+        size_t blockSize = 1;
+        size_t numBlocks = 0;
+        int fd = -1;
+        void * memoryMapping = nullptr;
+        size_t mappingSize = 0;
+        static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
+
+        std::string_view firstKey(size_t block) const {
+            std::byte const * ptr = blocks + blockOffsets[block];
+            gradylib_helpers::readVarint(ptr);
+            size_t len = gradylib_helpers::readVarint(ptr);
+            return std::string_view(static_cast<char const *>(static_cast<void const *>(ptr)), len);
+        }
+
+        // Returns the first rank whose key doesn't satisfy before.  before must be true for a prefix of the sorted
+        // keys and false for the rest.
+        template<typename Predicate>
+        size_t partitionPoint(Predicate && before) const {
+            if (mapSize == 0) {
+                return 0;
+            }
+            // Find the first block whose first key doesn't satisfy the predicate, then finish in the block before it.
+            size_t lo = 0;
+            size_t hi = numBlocks;
+            while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                if (before(firstKey(mid))) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            if (lo == 0) {
+                return 0;
+            }
+            size_t block = lo - 1;
+            size_t rank = block * blockSize;
+            size_t blockEnd = std::min(rank + blockSize, mapSize);
+            std::string key;
+            std::byte const * ptr = blocks + blockOffsets[block];
+            for (; rank < blockEnd; ++rank) {
+                decodeNext(ptr, key);
+                if (!before(std::string_view(key))) {
+                    return rank;
+                }
+            }
+            return rank;
+        }
+
+        static void decodeNext(std::byte const * & ptr, std::string & key) {
+            size_t shared = gradylib_helpers::readVarint(ptr);
+            size_t suffixLen = gradylib_helpers::readVarint(ptr);
+            key.resize(shared);
+            key.append(static_cast<char const *>(static_cast<void const *>(ptr)), suffixLen);
+            ptr += suffixLen;
+        }
+
+        // Returns the rank of key or mapSize if the map doesn't contain it.  Only the block that could hold key is
+        // decoded.
+        size_t findRank(std::string_view key) const {
+            if (mapSize == 0) {
+                return mapSize;
+            }
+            // Find the last block whose first key isn't past key
+            size_t lo = 0;
+            size_t hi = numBlocks;
+            while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                if (firstKey(mid) <= key) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            if (lo == 0) {
+                return mapSize;
+            }
+            size_t block = lo - 1;
+            size_t rank = block * blockSize;
+            size_t blockEnd = std::min(rank + blockSize, mapSize);
+            std::string k;
+            std::byte const * ptr = blocks + blockOffsets[block];
+            for (; rank < blockEnd; ++rank) {
+                decodeNext(ptr, k);
+                if (std::string_view(k) >= key) {
+                    return k == key ? rank : mapSize;
+                }
+            }
+            return mapSize;
+        }
+
+    public:
+        typedef std::string key_type;
+        typedef IndexType mapped_type;
+
+        MMapFrontCodedStringMap() = default;
+
+        MMapFrontCodedStringMap(MMapFrontCodedStringMap const &) = delete;
+
+        MMapFrontCodedStringMap & operator=(MMapFrontCodedStringMap const &) = delete;
+
+        MMapFrontCodedStringMap(MMapFrontCodedStringMap && m) noexcept {
+            *this = std::move(m);
+        }
+
+        MMapFrontCodedStringMap & operator=(MMapFrontCodedStringMap && m) noexcept {
+            if (this == &m) {
+                return *this;
+            }
+            if (memoryMapping) {
+                munmap(memoryMapping, mappingSize);
+                close(fd);
+            }
+            blocks = m.blocks;
+            blockOffsets = m.blockOffsets;
+            values = m.values;
+            mapSize = m.mapSize;
+            blockSize = m.blockSize;
+            numBlocks = m.numBlocks;
+            fd = m.fd;
+            memoryMapping = m.memoryMapping;
+            mappingSize = m.mappingSize;
+            m.blocks = nullptr;
+            m.blockOffsets = nullptr;
+            m.values = nullptr;
+            m.mapSize = 0;
+            m.blockSize = 1;
+            m.numBlocks = 0;
+            m.fd = -1;
+            m.memoryMapping = nullptr;
+            m.mappingSize = 0;
+            return *this;
+        }
+
+        explicit MMapFrontCodedStringMap(std::filesystem::path filename) {
+            fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                std::ostringstream sstr;
+                sstr << "Couldn't open " << filename << " in MMapFrontCodedStringMap";
+                throw gradylibMakeException(sstr.str());
+            }
+            mappingSize = std::filesystem::file_size(filename);
+            memoryMapping = mmapFunc(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+            if (memoryMapping == MAP_FAILED) {
+                close(fd);
+                memoryMapping = nullptr;
+                std::ostringstream sstr;
+                sstr << "mmap failed " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            try {
+                namespace gh = gradylib_helpers;
+                char const * what = "MMapFrontCodedStringMap";
+                gh::checkMappedExtent(headerSize, mappingSize, what);
+                std::byte const * base = static_cast<std::byte const *>(memoryMapping);
+                size_t const * header = static_cast<size_t const *>(memoryMapping);
+                mapSize = header[0];
+                blockSize = header[1];
+                numBlocks = header[2];
+                size_t blockOffsetsOffset = header[3];
+                size_t valuesOffset = header[4];
+                if (blockSize == 0 || mapSize > mappingSize || numBlocks != (mapSize + blockSize - 1) / blockSize) {
+                    std::ostringstream sstr;
+                    sstr << what << " header is inconsistent: " << mapSize << " keys in " << numBlocks << " blocks of " << blockSize;
+                    throw gradylibMakeException(sstr.str());
+                }
+                gh::checkMappedExtent(blockOffsetsOffset < headerSize || blockOffsetsOffset > mappingSize ? SIZE_MAX : blockOffsetsOffset + (numBlocks + 1) * sizeof(uint64_t),
+                                      mappingSize, what);
+                gh::checkMappedExtent(valuesOffset > mappingSize ? SIZE_MAX : valuesOffset + mapSize * sizeof(IndexType), mappingSize, what);
+                blocks = base + headerSize;
+                blockOffsets = static_cast<uint64_t const *>(static_cast<void const *>(base + blockOffsetsOffset));
+                values = static_cast<IndexType const *>(static_cast<void const *>(base + valuesOffset));
+                // The blocks must end where the block offsets start
+                gh::checkMappedExtent(blockOffsets[numBlocks] > mappingSize ? SIZE_MAX : headerSize + blockOffsets[numBlocks], blockOffsetsOffset, what);
+            } catch (...) {
+                munmap(memoryMapping, mappingSize);
+                close(fd);
+                memoryMapping = nullptr;
+                throw;
+            }
+        }
+
+        ~MMapFrontCodedStringMap() {
+            if (memoryMapping) {
+                munmap(memoryMapping, mappingSize);
+                close(fd);
+            }
+        }
+
+        IndexType operator[](std::string_view key) const {
+            size_t rank = findRank(key);
+            if (rank == mapSize) {
+                std::ostringstream sstr;
+                sstr << key << " not found in map";
+                throw gradylibMakeException(sstr.str());
+            }
+            return values[rank];
+        }
+
+        bool contains(std::string_view key) const {
+            return findRank(key) < mapSize;
+        }
+
+        size_t size() const {
+            return mapSize;
+        }
+
+        // The key at the given rank.  Keys are front coded, so this has to build a string.
+        std::string keyAt(size_t rank) const {
+            if (rank >= mapSize) {
+                std::ostringstream sstr;
+                sstr << "Rank " << rank << " is out of range for a map of size " << mapSize;
+                throw gradylibMakeException(sstr.str());
+            }
+            size_t block = rank / blockSize;
+            std::byte const * ptr = blocks + blockOffsets[block];
+            std::string key;
+            for (size_t r = block * blockSize; r <= rank; ++r) {
+                decodeNext(ptr, key);
+            }
+            return key;
+        }
+
+        IndexType valueAt(size_t rank) const {
+            if (rank >= mapSize) {
+                std::ostringstream sstr;
+                sstr << "Rank " << rank << " is out of range for a map of size " << mapSize;
+                throw gradylibMakeException(sstr.str());
+            }
+            return values[rank];
+        }
+
+        // The rank of the first key not less than key
+        size_t lowerBound(std::string_view key) const {
+            return partitionPoint([key](std::string_view k) {
+                return k < key;
+            });
+        }
+
+        // The rank of the first key greater than key
+        size_t upperBound(std::string_view key) const {
+            return partitionPoint([key](std::string_view k) {
+                return k <= key;
+            });
+        }
+
+        // The half open range of ranks of the keys that start with prefix
+        std::pair<size_t, size_t> prefixRange(std::string_view prefix) const {
+            size_t first = lowerBound(prefix);
+            size_t last = partitionPoint([prefix](std::string_view k) {
+                return k < prefix || k.starts_with(prefix);
+            });
+            return {first, last};
+        }
+
+        class const_iterator {
+            size_t rank;
+            std::byte const * ptr;
+            std::string currentKey;
+            MMapFrontCodedStringMap const * container;
+
+        public:
+            const_iterator(size_t rank, MMapFrontCodedStringMap const * container)
+                    : rank(rank), ptr(nullptr), container(container) {
+                if (rank < container->mapSize) {
+                    size_t block = rank / container->blockSize;
+                    ptr = container->blocks + container->blockOffsets[block];
+                    for (size_t r = block * container->blockSize; r <= rank; ++r) {
+                        decodeNext(ptr, currentKey);
+                    }
+                }
+            }
+
+            bool operator==(const_iterator const &other) const {
+                return rank == other.rank && container == other.container;
+            }
+
+            bool operator!=(const_iterator const &other) const {
+                return rank != other.rank || container != other.container;
+            }
+
+            // The string_view is valid until the iterator is advanced.
+            std::pair<std::string_view const, IndexType const &> operator*() const {
+                return {currentKey, container->values[rank]};
+            }
+
+            std::string_view key() const {
+                return currentKey;
+            }
+
+            IndexType const & value() const {
+                return container->values[rank];
+            }
+
+            size_t getRank() const {
+                return rank;
+            }
+
+            const_iterator &operator++() {
+                if (rank == container->mapSize) {
+                    return *this;
+                }
+                ++rank;
+                if (rank < container->mapSize) {
+                    decodeNext(ptr, currentKey);
+                }
+                return *this;
+            }
+        };
+
+        const_iterator begin() const {
+            return const_iterator(0, this);
+        }
+
+        const_iterator end() const {
+            return const_iterator(mapSize, this);
+        }
+
+        const_iterator iteratorAt(size_t rank) const {
+            return const_iterator(std::min(rank, mapSize), this);
+        }
+
+        OpenHashMap<std::string, IndexType> clone() const {
+            OpenHashMap<std::string, IndexType> ret;
+            ret.reserve(size());
+            for (auto && [sview, idx] : *this) {
+                ret.put(std::string(sview), idx);
+            }
+            return ret;
+        }
+
+        template<typename>
+        friend void GRADY_LIB_MOCK_MMapFrontCodedStringMap_MMAP();
+
+        template<typename>
+        friend void GRADY_LIB_DEFAULT_MMapFrontCodedStringMap_MMAP();
+    };
+
+    template<typename IndexType>
+    void writeFrontCoded(std::filesystem::path filename, OpenHashMap<std::string, IndexType> const & m, size_t blockSize = 32) {
+        if (blockSize == 0) {
+            std::ostringstream sstr;
+            sstr << "writeFrontCoded block size must be positive";
+            throw gradylibMakeException(sstr.str());
+        }
+        std::ofstream ofs(filename, std::ios::binary);
+        if (ofs.fail()) {
+            std::ostringstream sstr;
+            sstr << "Couldn't open file " << filename << " in writeFrontCoded.";
+            throw gradylibMakeException(sstr.str());
+        }
+        std::vector<std::pair<std::string const *, IndexType>> entries;
+        entries.reserve(m.size());
+        for (auto const & [key, value] : m) {
+            entries.emplace_back(&key, value);
+        }
+        std::sort(entries.begin(), entries.end(), [](auto const & e1, auto const & e2) {
+            return *e1.first < *e2.first;
+        });
+
+        size_t mapSize = entries.size();
+        size_t numBlocks = (mapSize + blockSize - 1) / blockSize;
+        std::vector<uint64_t> blockOffsets;
+        blockOffsets.reserve(numBlocks + 1);
+        std::string blockBuffer;
+        std::string_view previous;
+        for (size_t i = 0; i < mapSize; ++i) {
+            std::string_view key = *entries[i].first;
+            size_t shared = 0;
+            if (i % blockSize == 0) {
+                blockOffsets.push_back(blockBuffer.size());
+            } else {
+                size_t maxShared = std::min(key.size(), previous.size());
+                while (shared < maxShared && key[shared] == previous[shared]) {
+                    ++shared;
+                }
+            }
+            gradylib_helpers::appendVarint(blockBuffer, shared);
+            gradylib_helpers::appendVarint(blockBuffer, key.size() - shared);
+            blockBuffer.append(key.substr(shared));
+            previous = key;
+        }
+        blockOffsets.push_back(blockBuffer.size());
+
+        size_t blockOffsetsOffset = 0;
+        size_t valuesOffset = 0;
+        ofs.write(gradylib_helpers::charCast(&mapSize), 8);
+        ofs.write(gradylib_helpers::charCast(&blockSize), 8);
+        ofs.write(gradylib_helpers::charCast(&numBlocks), 8);
+        ofs.write(gradylib_helpers::charCast(&blockOffsetsOffset), 8);
+        ofs.write(gradylib_helpers::charCast(&valuesOffset), 8);
+        ofs.write(blockBuffer.data(), blockBuffer.size());
+        gradylib_helpers::writePad<8>(ofs);
+        blockOffsetsOffset = ofs.tellp();
+        ofs.write(gradylib_helpers::charCast(blockOffsets.data()), blockOffsets.size() * sizeof(uint64_t));
+        valuesOffset = ofs.tellp();
+        for (auto const & [key, value] : entries) {
+            ofs.write(gradylib_helpers::charCast(&value), sizeof(IndexType));
+        }
+        gradylib_helpers::writePad<8>(ofs);
+        ofs.seekp(24, std::ios::beg);
+        ofs.write(gradylib_helpers::charCast(&blockOffsetsOffset), 8);
+        ofs.write(gradylib_helpers::charCast(&valuesOffset), 8);
+        ofs.close();
+        if (ofs.fail()) {
+            std::ostringstream sstr;
+            sstr << "Problem writing file " << filename << " in writeFrontCoded.";
+            throw gradylibMakeException(sstr.str());
+        }
+    }
+
+    template<typename IndexType>
+    void GRADY_LIB_MOCK_MMapFrontCodedStringMap_MMAP() {
+        MMapFrontCodedStringMap<IndexType>::mmapFunc = [](void *, size_t, int, int, int, off_t) -> void *{
+            return MAP_FAILED;
+        };
+    }
+
+    template<typename IndexType>
+    void GRADY_LIB_DEFAULT_MMapFrontCodedStringMap_MMAP() {
+        MMapFrontCodedStringMap<IndexType>::mmapFunc = mmap;
+    }
+}
@@ -26,18 +26,25 @@ SOFTWARE.
 
 #include<fcntl.h>
 #include<errno.h>
+#include<string.h>
 #include<sys/mman.h>
 #include<unistd.h>
 
+#include<algorithm>
 #include<filesystem>
 #include<fstream>
+#include<limits>
 #include<sstream>
 #include<string>
 #include<string_view>
 #include<type_traits>
+#include<vector>
 
+#include"BlockCompressedStrings.hpp"
+#include"Integrity.hpp"
 #include"OpenHashMap.hpp"
 #include"OpenHashMapTC.hpp"
+#include"ThreadPool.hpp"
 
 namespace gradylib {
 
@@ -46,16 +53,37 @@ namespace gradylib {
     class MMapI2HRSOpenHashMap {
         OpenHashMapTC<IndexType, IntermediateIndexType, HashFunction> intMap;
         void const * stringMapping;
+        bool compressed = false;
+        BlockCompressedStrings compressedStrings;
         int fd = -1;
         void * memoryMapping = nullptr;
         size_t mappingSize = 0;
         static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
 
+        std::string_view stringAt(IntermediateIndexType offset) const {
+            if (compressed) {
+                return compressedStrings.at(offset);
+            }
+            std::byte const * base = static_cast<std::byte const *>(static_cast<void const *>(stringMapping));
+            std::byte const * ptr = base + offset;
+            int32_t len = *static_cast<int32_t const *>(static_cast<void const *>(ptr));
+            ptr += 4;
+            return std::string_view(static_cast<char const *>(static_cast<void const *>(ptr)), len);
+        }
+
+        std::string_view stringAt(IntermediateIndexType offset, std::string & buffer) const {
+            if (compressed) {
+                return compressedStrings.at(offset, buffer);
+            }
+            return stringAt(offset);
+        }
+
     public:
         typedef IndexType key_type;
         typedef std::string mapped_type;
 
-        explicit MMapI2HRSOpenHashMap(std::filesystem::path filename) {
+        // If verify is true, the file's integrity trailer is checked in parallel before the constructor returns.
+        explicit MMapI2HRSOpenHashMap(std::filesystem::path filename, bool verify = false) {
             fd = open(filename.c_str(), O_RDONLY);
             if (fd < 0) {
                 std::ostringstream sstr;
@@ -71,12 +99,36 @@ namespace gradylib {
                 sstr << "memory map failed: " << strerror(errno);
                 throw gradylibMakeException(sstr.str());
             }
-            std::byte *ptr = static_cast<std::byte *>(memoryMapping);
-            std::byte *base = ptr;
-            size_t intMapOffset = *static_cast<size_t*>(static_cast<void*>(ptr));
-            ptr += 8;
-            stringMapping = ptr;
-            intMap = OpenHashMapTC<IndexType, IntermediateIndexType, HashFunction>(base + intMapOffset);
+            try {
+                if (verify) {
+                    IntegrityVerifier(memoryMapping, mappingSize).verifyAll();
+                }
+                gradylib_helpers::checkMappedExtent(8, mappingSize, "MMapI2HRSOpenHashMap");
+                std::byte *ptr = static_cast<std::byte *>(memoryMapping);
+                std::byte *base = ptr;
+                size_t intMapOffset = *static_cast<size_t*>(static_cast<void*>(ptr));
+                ptr += 8;
+                if (intMapOffset & gradylib_helpers::compressedStringsFlag) {
+                    intMapOffset &= ~gradylib_helpers::compressedStringsFlag;
+                    compressed = true;
+                }
+                // The int map is last in the file, so checking its end covers the strings before it
+                gradylib_helpers::checkMappedExtent(intMapOffset, mappingSize, "MMapI2HRSOpenHashMap");
+                OpenHashMapTC<IndexType, IntermediateIndexType, HashFunction>::checkMapping(base + intMapOffset, mappingSize - intMapOffset,
+                                                                                           "MMapI2HRSOpenHashMap");
+                if (compressed) {
+                    // The section ends where the int map starts
+                    gradylib_helpers::checkMappedExtent(8, intMapOffset, "MMapI2HRSOpenHashMap");
+                    compressedStrings = BlockCompressedStrings(ptr, intMapOffset - 8);
+                }
+                stringMapping = ptr;
+                intMap = OpenHashMapTC<IndexType, IntermediateIndexType, HashFunction>(base + intMapOffset);
+            } catch (...) {
+                munmap(memoryMapping, mappingSize);
+                close(fd);
+                memoryMapping = nullptr;
+                throw;
+            }
         }
 
         ~MMapI2HRSOpenHashMap() {
@@ -90,46 +142,169 @@ namespace gradylib {
             return intMap.contains(idx);
         }
 
+        /*
+         * For a file written with writeCompressed, the view comes from the calling thread's block cache and stays
+         * valid only until the thread reads a few other blocks.  See BlockCompressedStrings::at, and use the overload
+         * taking a buffer for views that have to last.
+         */
         std::string_view at(IndexType idx) const {
             if (!contains(idx)) {
                 std::ostringstream sstr;
                 sstr << "Map doesn't contain " << idx;
                 throw gradylibMakeException(sstr.str());
             }
-            std::byte const * base = static_cast<std::byte const *>(static_cast<void const *>(stringMapping));
-            std::byte const * ptr = base + intMap.at(idx);
-            int32_t len = *static_cast<int32_t const *>(static_cast<void const *>(ptr));
-            ptr += 4;
-            return std::string_view(static_cast<char const *>(static_cast<void const *>(ptr)), len);
+            return stringAt(intMap.at(idx));
+        }
+
+        // Like at, but compressed strings are copied into buffer, so the view lasts as long as buffer.
+        std::string_view at(IndexType idx, std::string & buffer) const {
+            if (!contains(idx)) {
+                std::ostringstream sstr;
+                sstr << "Map doesn't contain " << idx;
+                throw gradylibMakeException(sstr.str());
+            }
+            return stringAt(intMap.at(idx), buffer);
         }
 
         size_t size() const {
             return intMap.size();
         }
 
+        /*
+         * Each distinct string is stored once, back to back in an arena.  A table of string IDs, keyed by the
+         * string's hash, finds repeats; each slot keeps 32 bits of the hash so most mismatches are rejected without
+         * touching the arena.
+         */
         class Builder {
+            struct StringSlot {
+                uint32_t fingerprint = 0;
+                // Zero marks an empty slot
+                IntermediateIndexType idPlusOne = 0;
+            };
+
             OpenHashMapTC<IndexType, IntermediateIndexType, HashFunction> intMap;
-            OpenHashMap<std::string, IntermediateIndexType> stringMap;
-            std::vector<std::string> strings;
+            std::string arena;
+            std::vector<uint64_t> stringStarts{0};
+            std::vector<StringSlot> stringIndex;
+
+            size_t numStrings() const {
+                return stringStarts.size() - 1;
+            }
+
+            std::string_view stringAt(size_t id) const {
+                return std::string_view(arena.data() + stringStarts[id], stringStarts[id + 1] - stringStarts[id]);
+            }
+
+            static size_t hashString(std::string_view str) {
+                return std::hash<std::string_view>{}(str);
+            }
+
+            // Returns the slot holding str or the empty slot where it belongs
+            size_t findStringSlot(std::string_view str, size_t hash) const {
+                uint32_t fingerprint = hash >> 32;
+                size_t idx = hash % stringIndex.size();
+                while (stringIndex[idx].idPlusOne != 0) {
+                    StringSlot const & slot = stringIndex[idx];
+                    if (slot.fingerprint == fingerprint && stringAt(slot.idPlusOne - 1) == str) {
+                        return idx;
+                    }
+                    ++idx;
+                    idx = idx == stringIndex.size() ? 0 : idx;
+                }
+                return idx;
+            }
+
+            void rehashStrings(size_t newSize) {
+                stringIndex.assign(newSize, StringSlot{});
+                for (size_t id = 0; id < numStrings(); ++id) {
+                    size_t hash = hashString(stringAt(id));
+                    size_t idx = findStringSlot(stringAt(id), hash);
+                    stringIndex[idx] = StringSlot{static_cast<uint32_t>(hash >> 32), static_cast<IntermediateIndexType>(id + 1)};
+                }
+            }
+
+            IntermediateIndexType internString(std::string_view str) {
+                // Keep the table at most half full
+                if (2 * (numStrings() + 1) > stringIndex.size()) {
+                    rehashStrings(std::max<size_t>(16, 2 * stringIndex.size()));
+                }
+                size_t hash = hashString(str);
+                size_t idx = findStringSlot(str, hash);
+                if (stringIndex[idx].idPlusOne != 0) {
+                    return stringIndex[idx].idPlusOne - 1;
+                }
+                if (numStrings() + 1 >= std::numeric_limits<IntermediateIndexType>::max()) {
+                    std::ostringstream sstr;
+                    sstr << "Too many distinct strings for the intermediate index type: " << numStrings() + 1;
+                    throw gradylibMakeException(sstr.str());
+                }
+                IntermediateIndexType id = numStrings();
+                arena.append(str);
+                stringStarts.push_back(arena.size());
+                stringIndex[idx] = StringSlot{static_cast<uint32_t>(hash >> 32), static_cast<IntermediateIndexType>(id + 1)};
+                return id;
+            }
+
+            void clearStrings() {
+                intMap.clear();
+                arena = std::string();
+                stringStarts.assign(1, 0);
+                stringIndex = std::vector<StringSlot>();
+            }
+
+            // Fill in the string records of ids [begin, end) in large chunks with one pwrite per chunk.
+            void writeStringRecords(int fd, size_t tableOffset, std::vector<uint64_t> const & recordOffsets, size_t begin, size_t end, int & error) const {
+                constexpr size_t chunkSize = 1 << 22;
+                std::vector<char> buffer;
+                buffer.reserve(chunkSize);
+                size_t chunkStart = begin;
+                auto flush = [&](size_t chunkEnd) {
+                    char const * p = buffer.data();
+                    size_t remaining = buffer.size();
+                    off_t offset = tableOffset + recordOffsets[chunkStart];
+                    while (remaining > 0) {
+                        ssize_t written = pwrite(fd, p, remaining, offset);
+                        if (written < 0) {
+                            if (errno == EINTR) {
+                                continue;
+                            }
+                            error = errno;
+                            return false;
+                        }
+                        p += written;
+                        offset += written;
+                        remaining -= written;
+                    }
+                    buffer.clear();
+                    chunkStart = chunkEnd;
+                    return true;
+                };
+                for (size_t id = begin; id < end; ++id) {
+                    size_t recordSize = recordOffsets[id + 1] - recordOffsets[id];
+                    if (!buffer.empty() && buffer.size() + recordSize > chunkSize) {
+                        if (!flush(id)) {
+                            return;
+                        }
+                    }
+                    std::string_view str = stringAt(id);
+                    int32_t len = str.size();
+                    size_t pos = buffer.size();
+                    buffer.resize(pos + recordSize, 0);
+                    memcpy(buffer.data() + pos, &len, 4);
+                    memcpy(buffer.data() + pos + 4, str.data(), len);
+                }
+                if (!buffer.empty()) {
+                    flush(end);
+                }
+            }
 
         public:
             bool contains(IndexType idx) const {
                 return intMap.contains(idx);
             }
 
-            template<typename StringType>
-            requires std::is_same_v<std::remove_reference_t<StringType>, std::string> ||
-                     std::is_convertible_v<std::remove_reference_t<StringType>, std::string>
-            void put(IndexType idx, StringType &&str) {
-                IntermediateIndexType strIdx = 0;
-                if (!stringMap.contains(str)) {
-                    strIdx = stringMap.size();
-                    strings.push_back(str);
-                    stringMap.put(std::forward<StringType>(str), strIdx);
-                } else {
-                    strIdx = stringMap.at(str);
-                }
-                intMap[idx] = strIdx;
+            void put(IndexType idx, std::string_view str) {
+                intMap[idx] = internString(str);
             }
 
             std::string_view at(IndexType idx) const {
@@ -138,20 +313,122 @@ namespace gradylib {
                     sstr << "Map doesn't contain " << idx;
                     throw gradylibMakeException(sstr.str());
                 }
-                return strings.at(intMap.at(idx));
+                return stringAt(intMap.at(idx));
             }
 
-            void reserve(size_t size) {
+            // numStrings and stringBytes are the expected number and total length of the distinct strings
+            void reserve(size_t size, size_t numStrings = 0, size_t stringBytes = 0) {
                 intMap.reserve(size);
-                stringMap.reserve(size);
-                strings.reserve(size);
+                stringStarts.reserve(numStrings + 1);
+                arena.reserve(stringBytes);
+                if (2 * numStrings > stringIndex.size()) {
+                    rehashStrings(2 * numStrings);
+                }
             }
 
             size_t size() const {
                 return intMap.size();
             }
 
-            void write(std::string filename, int alignment = alignof(void*)) {
+            /*
+             * The string table is laid out up front from a prefix sum of the record sizes, then written by
+             * numThreads tasks on tp (0 for one per pool thread), each filling large buffers and writing them with
+             * pwrite at their final positions.
+             */
+            void write(std::string filename, ThreadPool & tp, int alignment = alignof(void*), size_t numThreads = 0) {
+                size_t const stringTableOffset = 8;
+                std::vector<uint64_t> recordOffsets(numStrings() + 1, 0);
+                for (size_t id = 0; id < numStrings(); ++id) {
+                    size_t len = stringStarts[id + 1] - stringStarts[id];
+                    recordOffsets[id + 1] = recordOffsets[id] + 4 + len + gradylib_helpers::getPadLength<4>(len);
+                }
+                size_t tableSize = recordOffsets.back();
+                if (numStrings() > 0 && recordOffsets[numStrings() - 1] > std::numeric_limits<IntermediateIndexType>::max()) {
+                    std::ostringstream sstr;
+                    sstr << "The string table of " << tableSize << " bytes is too large for the intermediate index type";
+                    throw gradylibMakeException(sstr.str());
+                }
+                size_t tableEnd = stringTableOffset + tableSize;
+                size_t intMapOffset = tableEnd + (alignment - tableEnd % alignment) % alignment;
+
+                // The file maps keys to record offsets.  The IDs are swapped for them in place rather than in a copy of
+                // the int map, and swapped back if the write fails.  Offsets increase with the ID, so a binary search
+                // finds each one's ID.
+                for (auto && [idx1, idx2] : intMap) {
+                    idx2 = recordOffsets[idx2];
+                }
+                try {
+                    std::ofstream ofs(filename, std::ios::binary);
+                    if (ofs.fail()) {
+                        std::ostringstream sstr;
+                        sstr << "Problem opening file " << filename;
+                        throw gradylibMakeException(sstr.str());
+                    }
+                    ofs.write(static_cast<char*>(static_cast<void*>(&intMapOffset)), 8);
+                    // The string table is filled in below.  Seeking past it leaves a hole.
+                    ofs.seekp(intMapOffset, std::ios::beg);
+                    intMap.write(ofs, alignment);
+                    ofs.close();
+                    if (ofs.fail()) {
+                        std::ostringstream sstr;
+                        sstr << "Problem writing file " << filename;
+                        throw gradylibMakeException(sstr.str());
+                    }
+
+                    int fd = open(filename.c_str(), O_WRONLY);
+                    if (fd < 0) {
+                        std::ostringstream sstr;
+                        sstr << "Problem opening file " << filename << ": " << strerror(errno);
+                        throw gradylibMakeException(sstr.str());
+                    }
+                    if (numThreads == 0) {
+                        numThreads = std::max<size_t>(1, tp.size());
+                    }
+                    numThreads = std::max<size_t>(1, std::min(numThreads, numStrings() / 1024));
+                    // Split the table into byte ranges of equal size, rounded to whole records
+                    std::vector<size_t> splits(numThreads + 1, numStrings());
+                    splits[0] = 0;
+                    for (size_t t = 1; t < numThreads; ++t) {
+                        splits[t] = std::lower_bound(recordOffsets.begin(), recordOffsets.end(), tableSize * t / numThreads) - recordOffsets.begin();
+                    }
+                    std::vector<int> errors(numThreads, 0);
+                    try {
+                        gradylib_helpers::runTasks(tp, numThreads, [&](size_t t) {
+                            writeStringRecords(fd, stringTableOffset, recordOffsets, splits[t], splits[t + 1], errors[t]);
+                        });
+                    } catch (...) {
+                        close(fd);
+                        throw;
+                    }
+                    close(fd);
+                    for (int error : errors) {
+                        if (error != 0) {
+                            std::ostringstream sstr;
+                            sstr << "Problem writing file " << filename << ": " << strerror(error);
+                            throw gradylibMakeException(sstr.str());
+                        }
+                    }
+                    appendIntegrityTrailer(filename, tp);
+                } catch (...) {
+                    for (auto && [idx1, idx2] : intMap) {
+                        idx2 = std::lower_bound(recordOffsets.begin(), recordOffsets.end(), idx2) - recordOffsets.begin();
+                    }
+                    throw;
+                }
+
+                clearStrings();
+            }
+
+            // This overload of write uses the default thread pool.
+            void write(std::string filename, int alignment = alignof(void*), size_t numThreads = 0) {
+                write(filename, gradylib_helpers::defaultThreadPool(), alignment, numThreads);
+            }
+
+            /*
+             * Writes the strings block compressed, which suits large, redundant string sets that don't fit in the
+             * page cache.  With a positive dictionarySize, a shared dictionary is trained on a sample of the strings.
+             */
+            void writeCompressed(std::string filename, size_t blockSize = 8192, size_t dictionarySize = 0, int alignment = alignof(void*)) {
                 std::ofstream ofs(filename, std::ios::binary);
                 if (ofs.fail()) {
                     std::ostringstream sstr;
@@ -160,23 +437,21 @@ namespace gradylib {
                 }
                 size_t intMapOffset = 0;
                 ofs.write(static_cast<char*>(static_cast<void*>(&intMapOffset)), 8);
-                OpenHashMapTC<IntermediateIndexType, IntermediateIndexType> stringOffsetMap;
-                size_t stringTableOffset = ofs.tellp();
-                for (size_t i = 0; i < strings.size(); ++i) {
-                    std::string const & s = strings[i];
-                    int32_t len = s.length();
-                    stringOffsetMap.put(i, static_cast<size_t>(ofs.tellp()) - stringTableOffset);
-                    ofs.write(static_cast<char*>(static_cast<void*>(&len)), 4);
-                    ofs.write(s.data(), len);
-                    int padSize = 4 - ofs.tellp() % 4;
-                    for (int i = 0; i < padSize; ++i) {
-                        char t = 0;
-                        ofs.write(&t, 1);
+                std::string dictionary;
+                if (dictionarySize > 0) {
+                    std::vector<std::string_view> samples;
+                    size_t step = std::max<size_t>(1, numStrings() / 10000);
+                    for (size_t id = 0; id < numStrings(); id += step) {
+                        samples.push_back(stringAt(id));
                     }
+                    dictionary = BlockCompressedStringsWriter::trainDictionary(samples, dictionarySize);
                 }
-                for (auto && [idx1, idx2] : intMap) {
-                    idx2 = stringOffsetMap.at(idx2);
+                // The intMap values are already the string IDs the section is keyed by
+                BlockCompressedStringsWriter writer(blockSize, std::move(dictionary));
+                for (size_t id = 0; id < numStrings(); ++id) {
+                    writer.add(stringAt(id));
                 }
+                writer.write(ofs);
                 int padSize = alignment - ofs.tellp() % alignment;
                 for (int i = 0; i < padSize; ++i) {
                     char t = 0;
@@ -186,14 +461,21 @@ namespace gradylib {
                 intMap.write(ofs, alignment);
 
                 ofs.seekp(0, std::ios::beg);
+                intMapOffset |= gradylib_helpers::compressedStringsFlag;
                 ofs.write(static_cast<char*>(static_cast<void*>(&intMapOffset)), 8);
+                ofs.close();
+                if (ofs.fail()) {
+                    std::ostringstream sstr;
+                    sstr << "Writing " << filename << " failed in writeCompressed.";
+                    throw gradylibMakeException(sstr.str());
+                }
+                appendIntegrityTrailer(filename);
 
-                intMap.clear();
-                stringMap.clear();
-                strings.clear();
+                clearStrings();
             }
         };
 
+        // Views of compressed strings from an iterator have the same lifetime as those from at.
         class const_iterator {
             OpenHashMapTC<IndexType, IntermediateIndexType, HashFunction>::const_iterator iter;
             MMapI2HRSOpenHashMap const *container;
@@ -240,6 +522,61 @@ namespace gradylib {
             return const_iterator(intMap.end(), this);
         }
 
+        // k entries drawn uniformly at random, with replacement.  The strings are copied, as in MMapI2SOpenHashMap.
+        template<typename UniformRandomBitGenerator>
+        std::vector<std::pair<IndexType, std::string>> sample(size_t k, UniformRandomBitGenerator & rng) const {
+            std::vector<std::pair<IndexType, std::string>> ret;
+            ret.reserve(intMap.size() == 0 ? 0 : k);
+            for (auto const & entry : intMap.sample(k, rng)) {
+                ret.emplace_back(entry.key(), stringAt(entry.value()));
+            }
+            return ret;
+        }
+
+        // This overload of parallelForEach uses the default thread pool.
+        template<gradylib_helpers::Mergeable ReturnValue = OpenHashMap<IndexType, std::string>,
+                typename Callable,
+                typename PartialInitializer = gradylib_helpers::PartialDefaultConstructor<ReturnValue>,
+                typename FinalInitializer = gradylib_helpers::FinalDefaultConstructor<ReturnValue>>
+        requires std::is_invocable_r_v<void, Callable, ReturnValue &, IndexType const &, std::string_view> &&
+                 std::is_copy_constructible_v<Callable> &&
+                 std::is_invocable_r_v<ReturnValue, PartialInitializer, int, int> &&
+                 std::is_invocable_r_v<ReturnValue, FinalInitializer, int>
+        std::future<ReturnValue> parallelForEach(Callable && f,
+                                                 PartialInitializer && partialInitializer = PartialInitializer{},
+                                                 FinalInitializer && finalInitializer = FinalInitializer{},
+                                                 size_t numThreads = 0) const {
+            return parallelForEach<ReturnValue>(gradylib_helpers::defaultThreadPool(),
+                                                std::forward<Callable>(f),
+                                                std::forward<PartialInitializer>(partialInitializer),
+                                                std::forward<FinalInitializer>(finalInitializer),
+                                                numThreads);
+        }
+
+        /*
+         * This overload of parallelForEach takes a thread pool argument.  For a compressed file, the view passed to f
+         * is only good for the duration of the call.
+         */
+        template<gradylib_helpers::Mergeable ReturnValue = OpenHashMap<IndexType, std::string>,
+                typename Callable,
+                typename PartialInitializer = gradylib_helpers::PartialDefaultConstructor<ReturnValue>,
+                typename FinalInitializer = gradylib_helpers::FinalDefaultConstructor<ReturnValue>>
+        requires std::is_invocable_r_v<void, Callable, ReturnValue &, IndexType const &, std::string_view> &&
+                 std::is_copy_constructible_v<Callable> &&
+                 std::is_invocable_r_v<ReturnValue, PartialInitializer, int, int> &&
+                 std::is_invocable_r_v<ReturnValue, FinalInitializer, int>
+        std::future<ReturnValue> parallelForEach(ThreadPool & tp,
+                                                 Callable && f,
+                                                 PartialInitializer && partialInitializer = PartialInitializer{},
+                                                 FinalInitializer && finalInitializer = FinalInitializer{},
+                                                 size_t numThreads = 0) const {
+            auto visit = [f, this](ReturnValue & partial, IndexType const & key, IntermediateIndexType const & offset) mutable {
+                f(partial, key, stringAt(offset));
+            };
+            return intMap.template parallelForEach<ReturnValue>(tp, visit, std::forward<PartialInitializer>(partialInitializer),
+                                                                std::forward<FinalInitializer>(finalInitializer), numThreads);
+        }
+
         template<typename, typename, template<typename> typename>
         friend void GRADY_LIB_MOCK_MMapI2HRSOpenHashMap_MMAP();
 
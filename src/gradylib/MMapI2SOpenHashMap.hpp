@@ -35,7 +35,13 @@ SOFTWARE.
 
 #include"AltIntHash.hpp"
 #include"BitPairSet.hpp"
+#include"BlockCompressedStrings.hpp"
+#include"HotKeyCache.hpp"
+#include"Integrity.hpp"
 #include"OpenHashMap.hpp"
+#include"ParallelTraversals.hpp"
+#include"SlotSampling.hpp"
+#include"ThreadPool.hpp"
 
 namespace gradylib {
 
@@ -47,6 +53,8 @@ namespace gradylib {
         size_t const *valueOffsets = nullptr;
         IndexType const * keys = nullptr;
         void const * values = nullptr;
+        bool compressed = false;
+        BlockCompressedStrings compressedStrings;
         BitPairSet setFlags;
         size_t mapSize = 0;
         size_t keySize = 0;
@@ -56,12 +64,42 @@ namespace gradylib {
         HashFunction<IndexType> hashFunction = HashFunction<IndexType>{};
         static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
 
-        std::string_view getValue(std::byte const * ptr) const {
+        std::string_view getValue(size_t idx) const {
+            if (compressed) {
+                return compressedStrings.at(valueOffsets[idx]);
+            }
+            std::byte const * ptr = static_cast<std::byte const *>(values) + valueOffsets[idx];
             int32_t len = *static_cast<int32_t const *>(static_cast<void const *>(ptr));
             char const * p = static_cast<char const *>(static_cast<void const *>(ptr + 4));
             return std::string_view(p, len);
         }
 
+        std::string_view getValue(size_t idx, std::string & buffer) const {
+            if (compressed) {
+                return compressedStrings.at(valueOffsets[idx], buffer);
+            }
+            return getValue(idx);
+        }
+
+        // Returns the slot index of key or keySize if the map doesn't contain it.  The one probe loop, shared by
+        // operator[], contains and CachedReader.
+        size_t findIndex(IndexType key, size_t hash) const {
+            if (keySize == 0) {
+                return keySize;
+            }
+            size_t idx = hash % keySize;
+            size_t startIdx = idx;
+            for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
+                if (keys[idx] == key) {
+                    return isSet ? idx : keySize;
+                }
+                ++idx;
+                idx = idx == keySize ? 0 : idx;
+                if (startIdx == idx) break;
+            }
+            return keySize;
+        }
+
     public:
         typedef IndexType key_type;
         typedef std::string mapped_type;
@@ -77,6 +115,8 @@ namespace gradylib {
             valueOffsets = m.valueOffsets;
             keys = m.keys;
             values = m.values;
+            compressed = m.compressed;
+            compressedStrings = m.compressedStrings;
             mapSize = m.mapSize;
             keySize = m.keySize;
             fd = m.fd;
@@ -95,6 +135,8 @@ namespace gradylib {
             valueOffsets = m.valueOffsets;
             keys = m.keys;
             values = m.values;
+            compressed = m.compressed;
+            compressedStrings = m.compressedStrings;
             setFlags = std::move(m.setFlags);
             mapSize = m.mapSize;
             keySize = m.keySize;
@@ -111,7 +153,8 @@ namespace gradylib {
             return *this;
         }
 
-        explicit MMapI2SOpenHashMap(std::filesystem::path filename) {
+        // If verify is true, the file's integrity trailer is checked in parallel before the constructor returns.
+        explicit MMapI2SOpenHashMap(std::filesystem::path filename, bool verify = false) {
             fd = open(filename.c_str(), O_RDONLY);
             if (fd < 0) {
                 std::ostringstream sstr;
@@ -127,20 +170,42 @@ namespace gradylib {
                 sstr << "mmap failed " << strerror(errno);
                 throw gradylibMakeException(sstr.str());
             }
-            std::byte *ptr = static_cast<std::byte *>(memoryMapping);
-            std::byte *base = ptr;
-            mapSize = *static_cast<size_t *>(static_cast<void *>(ptr));
-            ptr += 8;
-            keySize = *static_cast<size_t *>(static_cast<void *>(ptr));
-            ptr += 8;
-            size_t bitPairSetOffset = *static_cast<size_t *>(static_cast<void *>(ptr));
-            ptr += 8;
-            valueOffsets = static_cast<size_t*>(static_cast<void *>(ptr));
-            ptr += 8 * keySize;
-            keys = static_cast<IndexType *>(static_cast<void *>(ptr));
-            ptr += sizeof(IndexType) * keySize;
-            values = static_cast<void *>(ptr);
-            setFlags = BitPairSet(static_cast<void *>(base + bitPairSetOffset));
+            try {
+                if (verify) {
+                    IntegrityVerifier(memoryMapping, mappingSize).verifyAll();
+                }
+                gradylib_helpers::checkMappedExtent(24, mappingSize, "MMapI2SOpenHashMap");
+                std::byte *ptr = static_cast<std::byte *>(memoryMapping);
+                std::byte *base = ptr;
+                mapSize = *static_cast<size_t *>(static_cast<void *>(ptr));
+                ptr += 8;
+                keySize = *static_cast<size_t *>(static_cast<void *>(ptr));
+                ptr += 8;
+                size_t bitPairSetOffset = *static_cast<size_t *>(static_cast<void *>(ptr));
+                ptr += 8;
+                gradylib_helpers::checkMappedExtent(keySize > mappingSize ? SIZE_MAX : 24 + (8 + sizeof(IndexType)) * keySize, mappingSize, "MMapI2SOpenHashMap");
+                gradylib_helpers::checkMappedBitPairSet(memoryMapping, bitPairSetOffset, mappingSize, "MMapI2SOpenHashMap");
+                valueOffsets = static_cast<size_t*>(static_cast<void *>(ptr));
+                ptr += 8 * keySize;
+                keys = static_cast<IndexType *>(static_cast<void *>(ptr));
+                ptr += sizeof(IndexType) * keySize;
+                values = static_cast<void *>(ptr);
+                if (mapSize & gradylib_helpers::compressedStringsFlag) {
+                    // Written by writeMappableCompressed: the value offsets are string IDs in a compressed section
+                    mapSize &= ~gradylib_helpers::compressedStringsFlag;
+                    compressed = true;
+                    ptr += gradylib_helpers::getPadLength<8>(ptr - base);
+                    // The section ends where the BitPairSet starts
+                    gradylib_helpers::checkMappedExtent(ptr - base, bitPairSetOffset, "MMapI2SOpenHashMap");
+                    compressedStrings = BlockCompressedStrings(ptr, bitPairSetOffset - (ptr - base));
+                }
+                setFlags = BitPairSet(static_cast<void *>(base + bitPairSetOffset));
+            } catch (...) {
+                munmap(memoryMapping, mappingSize);
+                close(fd);
+                memoryMapping = nullptr;
+                throw;
+            }
         }
 
         ~MMapI2SOpenHashMap() {
@@ -150,69 +215,41 @@ namespace gradylib {
             }
         }
 
+        /*
+         * For a file written with writeMappableCompressed, the view comes from the calling thread's block cache and
+         * stays valid only until the thread reads a few other blocks.  See BlockCompressedStrings::at, and use the
+         * overload of at taking a buffer for views that have to last.
+         */
         std::string_view operator[](IndexType key) const {
-            if (keySize == 0) {
+            size_t idx = findIndex(key, hashFunction(key));
+            if (idx == keySize) {
                 std::ostringstream sstr;
                 sstr << key << " not found in map";
                 throw gradylibMakeException(sstr.str());
             }
-            size_t hash;
-            size_t idx;
-            size_t startIdx;
+            return getValue(idx);
+        }
 
-            hash = hashFunction(key);
-            idx = hash % keySize;
-            startIdx = idx;
-            for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
-                IndexType k = keys[idx];
-                if (isSet && k == key) {
-                    std::byte const *valuePtr = static_cast<std::byte const *>(values) + valueOffsets[idx];
-                    return getValue(valuePtr);
-                }
-                if (wasSet && k == key) {
-                    std::ostringstream sstr;
-                    sstr << key << " not found in map";
-                    throw gradylibMakeException(sstr.str());
-                }
-                ++idx;
-                idx = idx == keySize ? 0 : idx;
-                if (startIdx == idx) {
-                    std::ostringstream sstr;
-                    sstr << key << " not found in map";
-                    throw gradylibMakeException(sstr.str());
-                }
+        // Like operator[], but compressed strings are copied into buffer, so the view lasts as long as buffer.
+        std::string_view at(IndexType key, std::string & buffer) const {
+            size_t idx = findIndex(key, hashFunction(key));
+            if (idx == keySize) {
+                std::ostringstream sstr;
+                sstr << key << " not found in map";
+                throw gradylibMakeException(sstr.str());
             }
-            std::ostringstream sstr;
-            sstr << key << " not found in map";
-            throw gradylibMakeException(sstr.str());
+            return getValue(idx, buffer);
         }
 
         bool contains(IndexType key) const {
-            if (keySize == 0) {
-                return false;
-            }
-            size_t hash = hashFunction(key);
-            size_t idx = hash % keySize;
-            size_t startIdx = idx;
-            for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
-                IndexType k = keys[idx];
-                if (isSet && k == key) {
-                    return true;
-                }
-                if (wasSet && k == key) {
-                    return false;
-                }
-                ++idx;
-                idx = idx == keySize ? 0 : idx;
-                if (startIdx == idx) break;
-            }
-            return false;
+            return findIndex(key, hashFunction(key)) != keySize;
         }
 
         size_t size() const {
             return mapSize;
         }
 
+        // Views of compressed strings from an iterator have the same lifetime as those from operator[].
         class const_iterator {
             size_t idx;
             MMapI2SOpenHashMap const * container;
@@ -230,8 +267,7 @@ namespace gradylib {
             }
 
             std::pair<IndexType const &, std::string_view const> operator*() const {
-                std::byte const *valuePtr = static_cast<std::byte const *>(container->values) + container->valueOffsets[idx];
-                return {container->keys[idx], container->getValue(valuePtr)};
+                return {container->keys[idx], container->getValue(idx)};
             }
 
             IndexType const & key() const {
@@ -239,8 +275,7 @@ namespace gradylib {
             }
 
             std::string_view const value() const {
-                std::byte const *valuePtr = static_cast<std::byte const *>(container->values) + container->valueOffsets[idx];
-                return container->getValue(valuePtr);
+                return container->getValue(idx);
             }
 
             const_iterator &operator++() {
@@ -270,6 +305,130 @@ namespace gradylib {
             return const_iterator(keySize, this);
         }
 
+        /*
+         * k entries drawn uniformly at random, with replacement.  See SlotSampling.hpp.  The strings are copied since
+         * views of a compressed file's strings don't outlast the next few reads.
+         */
+        template<typename UniformRandomBitGenerator>
+        std::vector<std::pair<IndexType, std::string>> sample(size_t k, UniformRandomBitGenerator & rng) const {
+            std::vector<std::pair<IndexType, std::string>> ret;
+            ret.reserve(mapSize == 0 ? 0 : k);
+            gradylib_helpers::sampleSlots(setFlags, keySize, mapSize, k, rng, [this](size_t j) {
+                __builtin_prefetch(&keys[j]);
+                __builtin_prefetch(&valueOffsets[j]);
+            }, [&ret, this](size_t j) {
+                ret.emplace_back(keys[j], getValue(j));
+            });
+            return ret;
+        }
+
+        // This overload of parallelForEach uses the default thread pool.
+        template<gradylib_helpers::Mergeable ReturnValue = OpenHashMap<IndexType, std::string, HashFunction>,
+                typename Callable,
+                typename PartialInitializer = gradylib_helpers::PartialDefaultConstructor<ReturnValue>,
+                typename FinalInitializer = gradylib_helpers::FinalDefaultConstructor<ReturnValue>>
+        requires std::is_invocable_r_v<void, Callable, ReturnValue &, IndexType const &, std::string_view> &&
+                 std::is_copy_constructible_v<Callable> &&
+                 std::is_invocable_r_v<ReturnValue, PartialInitializer, int, int> &&
+                 std::is_invocable_r_v<ReturnValue, FinalInitializer, int>
+        std::future<ReturnValue> parallelForEach(Callable && f,
+                                                 PartialInitializer && partialInitializer = PartialInitializer{},
+                                                 FinalInitializer && finalInitializer = FinalInitializer{},
+                                                 size_t numThreads = 0) const {
+            return parallelForEach<ReturnValue>(gradylib_helpers::defaultThreadPool(),
+                                                std::forward<Callable>(f),
+                                                std::forward<PartialInitializer>(partialInitializer),
+                                                std::forward<FinalInitializer>(finalInitializer),
+                                                numThreads);
+        }
+
+        /*
+         * This overload of parallelForEach takes a thread pool argument.  For a compressed file, the view passed to f
+         * is only good for the duration of the call.
+         */
+        template<gradylib_helpers::Mergeable ReturnValue = OpenHashMap<IndexType, std::string, HashFunction>,
+                typename Callable,
+                typename PartialInitializer = gradylib_helpers::PartialDefaultConstructor<ReturnValue>,
+                typename FinalInitializer = gradylib_helpers::FinalDefaultConstructor<ReturnValue>>
+        requires std::is_invocable_r_v<void, Callable, ReturnValue &, IndexType const &, std::string_view> &&
+                 std::is_copy_constructible_v<Callable> &&
+                 std::is_invocable_r_v<ReturnValue, PartialInitializer, int, int> &&
+                 std::is_invocable_r_v<ReturnValue, FinalInitializer, int>
+        std::future<ReturnValue> parallelForEach(ThreadPool & tp,
+                                                 Callable && f,
+                                                 PartialInitializer && partialInitializer = PartialInitializer{},
+                                                 FinalInitializer && finalInitializer = FinalInitializer{},
+                                                 size_t numThreads = 0) const {
+            auto visit = [f, this](ReturnValue & partial, size_t j) mutable {
+                if (setFlags.isFirstSet(j)) {
+                    f(partial, keys[j], getValue(j));
+                }
+            };
+            return gradylib_helpers::parallelForEachSlot<ReturnValue>(tp, mapSize == 0 ? 0 : keySize, numThreads, visit,
+                                                                      partialInitializer, finalInitializer);
+        }
+
+        /*
+         * A lookup front end that keeps the values of the hottest keys in a small HotKeyCache.  Nothing in it is
+         * synchronized, so each thread should make its own.  The map must outlive its readers.
+         */
+        class CachedReader {
+            MMapI2SOpenHashMap const * container;
+            HotKeyCache<IndexType, std::string_view> cache;
+
+        public:
+            CachedReader(MMapI2SOpenHashMap const & container, size_t cacheEntries)
+                : container(&container), cache(cacheEntries)
+            {
+            }
+
+            std::string_view operator[](IndexType key) {
+                size_t hash = container->hashFunction(key);
+                if (std::string_view const * value = cache.find(key, hash)) {
+                    return *value;
+                }
+                size_t idx = container->findIndex(key, hash);
+                if (idx == container->keySize) {
+                    std::ostringstream sstr;
+                    sstr << key << " not found in map";
+                    throw gradylibMakeException(sstr.str());
+                }
+                std::string_view value = container->getValue(idx);
+                // Views of compressed strings point into the per-thread block cache and can't be kept
+                if (!container->compressed) {
+                    cache.admit(key, hash, value);
+                }
+                return value;
+            }
+
+            bool contains(IndexType key) {
+                size_t hash = container->hashFunction(key);
+                if (cache.find(key, hash)) {
+                    return true;
+                }
+                size_t idx = container->findIndex(key, hash);
+                if (idx == container->keySize) {
+                    return false;
+                }
+                if (!container->compressed) {
+                    cache.admit(key, hash, container->getValue(idx));
+                }
+                return true;
+            }
+
+            size_t hits() const {
+                return cache.hits();
+            }
+
+            size_t misses() const {
+                return cache.misses();
+            }
+        };
+
+        CachedReader cachedReader(size_t cacheEntries) const {
+            return CachedReader(*this, cacheEntries);
+        }
+
         OpenHashMap<IndexType, std::string> clone() const {
             OpenHashMap<IndexType, std::string> ret;
             ret.reserve(size());
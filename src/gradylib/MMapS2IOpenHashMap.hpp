@@ -34,7 +34,12 @@ SOFTWARE.
 #include<string_view>
 
 #include"BitPairSet.hpp"
+#include"HotKeyCache.hpp"
+#include"Integrity.hpp"
 #include"OpenHashMap.hpp"
+#include"SlotSampling.hpp"
+#include"ParallelTraversals.hpp"
+#include"ThreadPool.hpp"
 
 namespace gradylib {
 
@@ -65,6 +70,31 @@ namespace gradylib {
             return keyPtr + 4 + len + gradylib_helpers::getPadLength<4>(len);
         }
 
+        // Returns the slot index of key or keySize if the map doesn't contain it.  The one probe loop, shared by
+        // operator[], contains and CachedReader.
+        size_t findIndex(std::string_view key, size_t hash) const {
+            if (keySize == 0) {
+                return keySize;
+            }
+            size_t idx = hash % keySize;
+            size_t startIdx = idx;
+            std::byte const *keyPtr = static_cast<std::byte const *>(keys) + keyOffsets[idx];
+            for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
+                std::string_view k = getKey(keyPtr);
+                if (k == key) {
+                    return isSet ? idx : keySize;
+                }
+                keyPtr = incKeyPtr(keyPtr);
+                ++idx;
+                if (idx == keySize) {
+                    idx = 0;
+                    keyPtr = static_cast<std::byte const *>(keys);
+                }
+                if (startIdx == idx) break;
+            }
+            return keySize;
+        }
+
     public:
         typedef std::string key_type;
         typedef IndexType mapped_type;
@@ -116,7 +146,8 @@ namespace gradylib {
             return *this;
         }
 
-        explicit MMapS2IOpenHashMap(std::filesystem::path filename) {
+        // If verify is true, the file's integrity trailer is checked in parallel before the constructor returns.
+        explicit MMapS2IOpenHashMap(std::filesystem::path filename, bool verify = false) {
             fd = open(filename.c_str(), O_RDONLY);
             if (fd < 0) {
                 std::ostringstream sstr;
@@ -132,21 +163,34 @@ namespace gradylib {
                 sstr << "mmap failed " << strerror(errno);
                 throw gradylibMakeException(sstr.str());
             }
-            std::byte *ptr = static_cast<std::byte *>(memoryMapping);
-            std::byte *base = ptr;
-            mapSize = *static_cast<size_t *>(static_cast<void *>(ptr));
-            ptr += 8;
-            keySize = *static_cast<size_t *>(static_cast<void *>(ptr));
-            ptr += 8;
-            size_t valueOffset = *static_cast<size_t *>(static_cast<void *>(ptr));
-            ptr += 8;
-            size_t bitPairSetOffset = *static_cast<size_t *>(static_cast<void *>(ptr));
-            ptr += 8;
-            keyOffsets = static_cast<int64_t *>(static_cast<void *>(ptr));
-            ptr += 8 * keySize;
-            keys = static_cast<void *>(static_cast<void *>(ptr));
-            values = static_cast<IndexType *>(static_cast<void *>(base + valueOffset));
-            setFlags = BitPairSet(static_cast<void *>(base + bitPairSetOffset));
+            try {
+                if (verify) {
+                    IntegrityVerifier(memoryMapping, mappingSize).verifyAll();
+                }
+                gradylib_helpers::checkMappedExtent(32, mappingSize, "MMapS2IOpenHashMap");
+                std::byte *ptr = static_cast<std::byte *>(memoryMapping);
+                std::byte *base = ptr;
+                mapSize = *static_cast<size_t *>(static_cast<void *>(ptr));
+                ptr += 8;
+                keySize = *static_cast<size_t *>(static_cast<void *>(ptr));
+                ptr += 8;
+                size_t valueOffset = *static_cast<size_t *>(static_cast<void *>(ptr));
+                ptr += 8;
+                size_t bitPairSetOffset = *static_cast<size_t *>(static_cast<void *>(ptr));
+                ptr += 8;
+                gradylib_helpers::checkMappedExtent(keySize > mappingSize ? SIZE_MAX : 32 + 8 * keySize, mappingSize, "MMapS2IOpenHashMap");
+                gradylib_helpers::checkMappedBitPairSet(memoryMapping, bitPairSetOffset, mappingSize, "MMapS2IOpenHashMap");
+                keyOffsets = static_cast<int64_t *>(static_cast<void *>(ptr));
+                ptr += 8 * keySize;
+                keys = static_cast<void *>(static_cast<void *>(ptr));
+                values = static_cast<IndexType *>(static_cast<void *>(base + valueOffset));
+                setFlags = BitPairSet(static_cast<void *>(base + bitPairSetOffset));
+            } catch (...) {
+                munmap(memoryMapping, mappingSize);
+                close(fd);
+                memoryMapping = nullptr;
+                throw;
+            }
         }
 
         ~MMapS2IOpenHashMap() {
@@ -157,71 +201,17 @@ namespace gradylib {
         }
 
         IndexType operator[](std::string_view key) const {
-            if (keySize == 0) {
+            size_t idx = findIndex(key, std::hash<std::string_view>{}(key));
+            if (idx == keySize) {
                 std::ostringstream sstr;
                 sstr << key << " not found in map";
                 throw gradylibMakeException(sstr.str());
             }
-            size_t hash;
-            size_t idx;
-            size_t startIdx;
-
-            hash = std::hash<std::string_view>{}(key);
-            idx = hash % keySize;
-            startIdx = idx;
-            std::byte const *keyPtr = static_cast<std::byte const *>(keys) + keyOffsets[idx];
-            for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
-                std::string_view k = getKey(keyPtr);
-                if (isSet && k == key) {
-                    return values[idx];
-                }
-                if (wasSet && k == key) {
-                    std::ostringstream sstr;
-                    sstr << key << " not found in map";
-                    throw gradylibMakeException(sstr.str());
-                }
-                keyPtr = incKeyPtr(keyPtr);
-                ++idx;
-                if (idx == keySize) {
-                    idx = 0;
-                    keyPtr = static_cast<std::byte const *>(keys);
-                }
-                if (startIdx == idx) {
-                    std::ostringstream sstr;
-                    sstr << key << " not found in map";
-                    throw gradylibMakeException(sstr.str());
-                }
-            }
-            std::ostringstream sstr;
-            sstr << key << " not found in map";
-            throw gradylibMakeException(sstr.str());
+            return values[idx];
         }
 
         bool contains(std::string_view key) const {
-            if (keySize == 0) {
-                return false;
-            }
-            size_t hash = std::hash<std::string_view>{}(key);
-            size_t idx = hash % keySize;
-            size_t startIdx = idx;
-            std::byte const *keyPtr = static_cast<std::byte const *>(keys) + keyOffsets[idx];
-            for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
-                std::string_view k = getKey(keyPtr);
-                if (isSet && k == key) {
-                    return true;
-                }
-                if (wasSet && k == key) {
-                    return false;
-                }
-                keyPtr = incKeyPtr(keyPtr);
-                ++idx;
-                if (idx == keySize) {
-                    idx = 0;
-                    keyPtr = static_cast<std::byte const *>(keys);
-                }
-                if (startIdx == idx) break;
-            }
-            return false;
+            return findIndex(key, std::hash<std::string_view>{}(key)) != keySize;
         }
 
         size_t size() const {
@@ -285,6 +275,119 @@ namespace gradylib {
             return const_iterator(keySize, this);
         }
 
+        // k entries drawn uniformly at random, with replacement.  See SlotSampling.hpp.
+        template<typename UniformRandomBitGenerator>
+        std::vector<std::pair<std::string_view, IndexType>> sample(size_t k, UniformRandomBitGenerator & rng) const {
+            std::vector<std::pair<std::string_view, IndexType>> ret;
+            ret.reserve(mapSize == 0 ? 0 : k);
+            gradylib_helpers::sampleSlots(setFlags, keySize, mapSize, k, rng, [this](size_t j) {
+                __builtin_prefetch(static_cast<std::byte const *>(keys) + keyOffsets[j]);
+                __builtin_prefetch(&values[j]);
+            }, [&ret, this](size_t j) {
+                ret.emplace_back(getKey(static_cast<std::byte const *>(keys) + keyOffsets[j]), values[j]);
+            });
+            return ret;
+        }
+
+        // This overload of parallelForEach uses the default thread pool.
+        template<gradylib_helpers::Mergeable ReturnValue = OpenHashMap<std::string, IndexType>,
+                typename Callable,
+                typename PartialInitializer = gradylib_helpers::PartialDefaultConstructor<ReturnValue>,
+                typename FinalInitializer = gradylib_helpers::FinalDefaultConstructor<ReturnValue>>
+        requires std::is_invocable_r_v<void, Callable, ReturnValue &, std::string_view, IndexType const &> &&
+                 std::is_copy_constructible_v<Callable> &&
+                 std::is_invocable_r_v<ReturnValue, PartialInitializer, int, int> &&
+                 std::is_invocable_r_v<ReturnValue, FinalInitializer, int>
+        std::future<ReturnValue> parallelForEach(Callable && f,
+                                                 PartialInitializer && partialInitializer = PartialInitializer{},
+                                                 FinalInitializer && finalInitializer = FinalInitializer{},
+                                                 size_t numThreads = 0) const {
+            return parallelForEach<ReturnValue>(gradylib_helpers::defaultThreadPool(),
+                                                std::forward<Callable>(f),
+                                                std::forward<PartialInitializer>(partialInitializer),
+                                                std::forward<FinalInitializer>(finalInitializer),
+                                                numThreads);
+        }
+
+        // This overload of parallelForEach takes a thread pool argument
+        template<gradylib_helpers::Mergeable ReturnValue = OpenHashMap<std::string, IndexType>,
+                typename Callable,
+                typename PartialInitializer = gradylib_helpers::PartialDefaultConstructor<ReturnValue>,
+                typename FinalInitializer = gradylib_helpers::FinalDefaultConstructor<ReturnValue>>
+        requires std::is_invocable_r_v<void, Callable, ReturnValue &, std::string_view, IndexType const &> &&
+                 std::is_copy_constructible_v<Callable> &&
+                 std::is_invocable_r_v<ReturnValue, PartialInitializer, int, int> &&
+                 std::is_invocable_r_v<ReturnValue, FinalInitializer, int>
+        std::future<ReturnValue> parallelForEach(ThreadPool & tp,
+                                                 Callable && f,
+                                                 PartialInitializer && partialInitializer = PartialInitializer{},
+                                                 FinalInitializer && finalInitializer = FinalInitializer{},
+                                                 size_t numThreads = 0) const {
+            auto visit = [f, this](ReturnValue & partial, size_t j) mutable {
+                if (setFlags.isFirstSet(j)) {
+                    std::byte const *keyPtr = static_cast<std::byte const *>(keys) + keyOffsets[j];
+                    f(partial, getKey(keyPtr), values[j]);
+                }
+            };
+            return gradylib_helpers::parallelForEachSlot<ReturnValue>(tp, mapSize == 0 ? 0 : keySize, numThreads, visit,
+                                                                      partialInitializer, finalInitializer);
+        }
+
+        /*
+         * A lookup front end that keeps the values of the hottest keys in a small HotKeyCache.  Nothing in it is
+         * synchronized, so each thread should make its own.  The map must outlive its readers.
+         */
+        class CachedReader {
+            MMapS2IOpenHashMap const * container;
+            HotKeyCache<std::string, IndexType> cache;
+
+        public:
+            CachedReader(MMapS2IOpenHashMap const & container, size_t cacheEntries)
+                : container(&container), cache(cacheEntries)
+            {
+            }
+
+            IndexType operator[](std::string_view key) {
+                size_t hash = std::hash<std::string_view>{}(key);
+                if (IndexType const * value = cache.find(key, hash)) {
+                    return *value;
+                }
+                size_t idx = container->findIndex(key, hash);
+                if (idx == container->keySize) {
+                    std::ostringstream sstr;
+                    sstr << key << " not found in map";
+                    throw gradylibMakeException(sstr.str());
+                }
+                cache.admit(key, hash, container->values[idx]);
+                return container->values[idx];
+            }
+
+            bool contains(std::string_view key) {
+                size_t hash = std::hash<std::string_view>{}(key);
+                if (cache.find(key, hash)) {
+                    return true;
+                }
+                size_t idx = container->findIndex(key, hash);
+                if (idx == container->keySize) {
+                    return false;
+                }
+                cache.admit(key, hash, container->values[idx]);
+                return true;
+            }
+
+            size_t hits() const {
+                return cache.hits();
+            }
+
+            size_t misses() const {
+                return cache.misses();
+            }
+        };
+
+        CachedReader cachedReader(size_t cacheEntries) const {
+            return CachedReader(*this, cacheEntries);
+        }
+
         OpenHashMap<std::string, IndexType> clone() const {
             OpenHashMap<std::string, IndexType> ret;
             ret.reserve(size());
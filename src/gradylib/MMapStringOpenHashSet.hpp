@@ -0,0 +1,344 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include<fcntl.h>
+#include<errno.h>
+#include<string.h>
+#include<sys/mman.h>
+#include<unistd.h>
+
+#include<filesystem>
+#include<future>
+#include<memory>
+#include<span>
+#include<sstream>
+#include<string>
+#include<string_view>
+
+#include"BitPairSet.hpp"
+#include"Exception.hpp"
+#include"Integrity.hpp"
+#include"OpenHashSet.hpp"
+#include"ParallelTraversals.hpp"
+#include"SlotSampling.hpp"
+#include"ThreadPool.hpp"
+
+namespace gradylib {
+
+    /*
+     * This is a readonly data structure for quickly loading an OpenHashSet<std::string> written by writeMappable.
+     * HashFunction must match the one the set was built with.
+     */
+    template<template<typename> typename HashFunction = std::hash>
+    class MMapStringOpenHashSet {
+        int64_t const *keyOffsets = nullptr;
+        std::byte const * keys = nullptr;
+        BitPairSet setFlags;
+        size_t setSize = 0;
+        size_t keySize = 0;
+        int fd = -1;
+        void * memoryMapping = nullptr;
+        size_t mappingSize = 0;
+        static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
+
+        std::string_view getKey(size_t idx) const {
+            std::byte const * ptr = keys + keyOffsets[idx];
+            int32_t len = *static_cast<int32_t const *>(static_cast<void const *>(ptr));
+            return std::string_view(static_cast<char const *>(static_cast<void const *>(ptr + 4)), len);
+        }
+
+        bool probe(std::string_view key, size_t hash) const {
+            size_t idx = hash % keySize;
+            size_t startIdx = idx;
+            for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
+                if (getKey(idx) == key) {
+                    return isSet;
+                }
+                ++idx;
+                idx = idx == keySize ? 0 : idx;
+                if (startIdx == idx) break;
+            }
+            return false;
+        }
+
+    public:
+        typedef std::string key_type;
+
+        MMapStringOpenHashSet() = default;
+
+        MMapStringOpenHashSet(MMapStringOpenHashSet const &) = delete;
+
+        MMapStringOpenHashSet &operator=(MMapStringOpenHashSet const &) = delete;
+
+        MMapStringOpenHashSet(MMapStringOpenHashSet && s) noexcept {
+            *this = std::move(s);
+        }
+
+        MMapStringOpenHashSet &operator=(MMapStringOpenHashSet && s) noexcept {
+            if (this == &s) {
+                return *this;
+            }
+            if (memoryMapping) {
+                munmap(memoryMapping, mappingSize);
+                close(fd);
+            }
+            keyOffsets = s.keyOffsets;
+            keys = s.keys;
+            setFlags = std::move(s.setFlags);
+            setSize = s.setSize;
+            keySize = s.keySize;
+            fd = s.fd;
+            memoryMapping = s.memoryMapping;
+            mappingSize = s.mappingSize;
+            s.keyOffsets = nullptr;
+            s.keys = nullptr;
+            s.setSize = 0;
+            s.keySize = 0;
+            s.fd = -1;
+            s.memoryMapping = nullptr;
+            s.mappingSize = 0;
+            return *this;
+        }
+
+        // If verify is true, the file's integrity trailer is checked in parallel before the constructor returns.
+        explicit MMapStringOpenHashSet(std::filesystem::path filename, bool verify = false) {
+            fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                std::ostringstream sstr;
+                sstr << "Couldn't open " << filename << " in MMapStringOpenHashSet";
+                throw gradylibMakeException(sstr.str());
+            }
+            mappingSize = std::filesystem::file_size(filename);
+            memoryMapping = mmapFunc(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+            if (memoryMapping == MAP_FAILED) {
+                close(fd);
+                memoryMapping = nullptr;
+                std::ostringstream sstr;
+                sstr << "mmap failed " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            try {
+                if (verify) {
+                    IntegrityVerifier(memoryMapping, mappingSize).verifyAll();
+                }
+                gradylib_helpers::checkMappedExtent(24, mappingSize, "MMapStringOpenHashSet");
+                std::byte const * base = static_cast<std::byte const *>(memoryMapping);
+                size_t const * header = static_cast<size_t const *>(memoryMapping);
+                setSize = header[0];
+                keySize = header[1];
+                size_t bitPairSetOffset = header[2];
+                gradylib_helpers::checkMappedExtent(keySize > mappingSize ? SIZE_MAX : 24 + 8 * keySize, mappingSize, "MMapStringOpenHashSet");
+                gradylib_helpers::checkMappedBitPairSet(memoryMapping, bitPairSetOffset, mappingSize, "MMapStringOpenHashSet");
+                keyOffsets = static_cast<int64_t const *>(static_cast<void const *>(base + 24));
+                keys = base + 24 + 8 * keySize;
+                setFlags = BitPairSet(static_cast<void const *>(base + bitPairSetOffset));
+            } catch (...) {
+                munmap(memoryMapping, mappingSize);
+                close(fd);
+                memoryMapping = nullptr;
+                throw;
+            }
+        }
+
+        ~MMapStringOpenHashSet() {
+            if (memoryMapping) {
+                munmap(memoryMapping, mappingSize);
+                close(fd);
+            }
+        }
+
+        bool contains(std::string_view key) const {
+            if (keySize == 0) {
+                return false;
+            }
+            return probe(key, HashFunction<std::string_view>{}(key));
+        }
+
+        /*
+         * Sets results[i] to contains(queries[i]).  Queries are handled in groups: the slots of the whole group are
+         * hashed and prefetched before any of them is probed, so the cache misses overlap instead of being taken
+         * one at a time.
+         */
+        void containsBatch(std::span<std::string_view const> queries, std::span<bool> results) const {
+            if (results.size() < queries.size()) {
+                std::ostringstream sstr;
+                sstr << "containsBatch needs " << queries.size() << " results but was given " << results.size();
+                throw gradylibMakeException(sstr.str());
+            }
+            if (keySize == 0) {
+                std::fill(results.begin(), results.begin() + queries.size(), false);
+                return;
+            }
+            constexpr size_t groupSize = 16;
+            size_t hashes[groupSize];
+            for (size_t start = 0; start < queries.size(); start += groupSize) {
+                size_t n = std::min(groupSize, queries.size() - start);
+                for (size_t i = 0; i < n; ++i) {
+                    hashes[i] = HashFunction<std::string_view>{}(queries[start + i]);
+                    __builtin_prefetch(&keyOffsets[hashes[i] % keySize]);
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    __builtin_prefetch(keys + keyOffsets[hashes[i] % keySize]);
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    results[start + i] = probe(queries[start + i], hashes[i]);
+                }
+            }
+        }
+
+        size_t size() const {
+            return setSize;
+        }
+
+        class const_iterator {
+            size_t idx;
+            MMapStringOpenHashSet const * container;
+        public:
+            const_iterator(size_t idx, MMapStringOpenHashSet const * container)
+                    : idx(idx), container(container) {
+            }
+
+            bool operator==(const_iterator const &other) const {
+                return idx == other.idx && container == other.container;
+            }
+
+            bool operator!=(const_iterator const &other) const {
+                return idx != other.idx || container != other.container;
+            }
+
+            std::string_view operator*() const {
+                return container->getKey(idx);
+            }
+
+            const_iterator &operator++() {
+                if (idx == container->keySize) {
+                    return *this;
+                }
+                ++idx;
+                while (idx < container->keySize && !container->setFlags.isFirstSet(idx)) {
+                    ++idx;
+                }
+                return *this;
+            }
+        };
+
+        const_iterator begin() const {
+            if (setSize == 0) {
+                return const_iterator(keySize, this);
+            }
+            size_t idx = 0;
+            while (idx < keySize && !setFlags.isFirstSet(idx)) {
+                ++idx;
+            }
+            return const_iterator(idx, this);
+        }
+
+        const_iterator end() const {
+            return const_iterator(keySize, this);
+        }
+
+        // k keys drawn uniformly at random, with replacement.  See SlotSampling.hpp.
+        template<typename UniformRandomBitGenerator>
+        std::vector<std::string_view> sample(size_t k, UniformRandomBitGenerator & rng) const {
+            std::vector<std::string_view> ret;
+            ret.reserve(setSize == 0 ? 0 : k);
+            gradylib_helpers::sampleSlots(setFlags, keySize, setSize, k, rng, [this](size_t j) {
+                __builtin_prefetch(keys + keyOffsets[j]);
+            }, [&ret, this](size_t j) {
+                ret.push_back(getKey(j));
+            });
+            return ret;
+        }
+
+        template<gradylib_helpers::Mergeable ReturnValue = OpenHashSet<std::string, HashFunction>,
+                typename Callable,
+                typename PartialInitializer = gradylib_helpers::PartialDefaultConstructor<ReturnValue>,
+                typename FinalInitializer = gradylib_helpers::FinalDefaultConstructor<ReturnValue>>
+        requires std::is_invocable_r_v<void, Callable, ReturnValue &, std::string_view> &&
+                 std::is_copy_constructible_v<Callable> &&
+                 std::is_invocable_r_v<ReturnValue, PartialInitializer, int, int> &&
+                 std::is_invocable_r_v<ReturnValue, FinalInitializer, int>
+        std::future<ReturnValue> parallelForEach(Callable && f,
+                                                 PartialInitializer && partialInitializer = PartialInitializer{},
+                                                 FinalInitializer && finalInitializer = FinalInitializer{},
+                                                 size_t numThreads = 0) const {
+            return parallelForEach<ReturnValue>(gradylib_helpers::defaultThreadPool(),
+                                                std::forward<Callable>(f),
+                                                std::forward<PartialInitializer>(partialInitializer),
+                                                std::forward<FinalInitializer>(finalInitializer),
+                                                numThreads);
+        }
+
+        template<gradylib_helpers::Mergeable ReturnValue = OpenHashSet<std::string, HashFunction>,
+                typename Callable,
+                typename PartialInitializer = gradylib_helpers::PartialDefaultConstructor<ReturnValue>,
+                typename FinalInitializer = gradylib_helpers::FinalDefaultConstructor<ReturnValue>>
+        requires std::is_invocable_r_v<void, Callable, ReturnValue &, std::string_view> &&
+                 std::is_copy_constructible_v<Callable> &&
+                 std::is_invocable_r_v<ReturnValue, PartialInitializer, int, int> &&
+                 std::is_invocable_r_v<ReturnValue, FinalInitializer, int>
+        std::future<ReturnValue> parallelForEach(ThreadPool & tp,
+                                                 Callable && f,
+                                                 PartialInitializer && partialInitializer = PartialInitializer{},
+                                                 FinalInitializer && finalInitializer = FinalInitializer{},
+                                                 size_t numThreads = 0) const {
+            auto visit = [f, this](ReturnValue & partial, size_t j) mutable {
+                if (setFlags.isFirstSet(j)) {
+                    f(partial, getKey(j));
+                }
+            };
+            return gradylib_helpers::parallelForEachSlot<ReturnValue>(tp, setSize == 0 ? 0 : keySize, numThreads, visit,
+                                                                      partialInitializer, finalInitializer);
+        }
+
+        OpenHashSet<std::string, HashFunction> clone() const {
+            OpenHashSet<std::string, HashFunction> ret;
+            ret.reserve(size());
+            for (std::string_view key : *this) {
+                ret.insert(std::string(key));
+            }
+            return ret;
+        }
+
+        template<template<typename> typename>
+        friend void GRADY_LIB_MOCK_MMapStringOpenHashSet_MMAP();
+
+        template<template<typename> typename>
+        friend void GRADY_LIB_DEFAULT_MMapStringOpenHashSet_MMAP();
+    };
+
+    template<template<typename> typename HashFunction = std::hash>
+    void GRADY_LIB_MOCK_MMapStringOpenHashSet_MMAP() {
+        MMapStringOpenHashSet<HashFunction>::mmapFunc = [](void *, size_t, int, int, int, off_t) -> void *{
+            return MAP_FAILED;
+        };
+    }
+
+    template<template<typename> typename HashFunction = std::hash>
+    void GRADY_LIB_DEFAULT_MMapStringOpenHashSet_MMAP() {
+        MMapStringOpenHashSet<HashFunction>::mmapFunc = mmap;
+    }
+}
@@ -33,6 +33,7 @@ SOFTWARE.
 #include<fstream>
 #include<string>
 #include<utility>
+#include<vector>
 
 #include"AltIntHash.hpp"
 #include"OpenHashMap.hpp"
@@ -73,6 +74,16 @@ namespace gradylib {
         void const * memoryMapping = nullptr;
         static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
 
+        decltype(auto) viewAt(int64_t offset) const {
+            std::byte const * ptr = valuePtr + offset;
+            if constexpr (viewable_global<Value>) {
+                Value const * typePtr = nullptr;
+                return makeView(ptr, typePtr);
+            } else {
+                return Value::makeView(ptr);
+            }
+        }
+
     public:
 
         MMapViewableOpenHashMap(std::filesystem::path filename) {
@@ -113,13 +124,7 @@ namespace gradylib {
                 sstr << "Map doesn't contain key";
                 throw gradylibMakeException(sstr.str());
             }
-            std::byte const * ptr = valuePtr + valueOffsets.at(key);
-            if constexpr (viewable_global<Value>) {
-                Value const * typePtr = nullptr;
-                return makeView(ptr, typePtr);
-            } else {
-                return Value::makeView(ptr);
-            }
+            return viewAt(valueOffsets.at(key));
         }
 
         ~MMapViewableOpenHashMap() {
@@ -175,6 +180,17 @@ namespace gradylib {
             return const_iterator(valueOffsets.end(), this);
         }
 
+        // k entries drawn uniformly at random, with replacement.  See SlotSampling.hpp.
+        template<typename UniformRandomBitGenerator>
+        auto sample(size_t k, UniformRandomBitGenerator & rng) const {
+            std::vector<std::pair<Key, std::remove_cvref_t<decltype(viewAt(0))>>> ret;
+            ret.reserve(valueOffsets.size() == 0 ? 0 : k);
+            for (auto const & entry : valueOffsets.sample(k, rng)) {
+                ret.emplace_back(entry.key(), viewAt(entry.value()));
+            }
+            return ret;
+        }
+
         class Builder {
             OpenHashMap<Key, Value, HashFunction> m;
 
@@ -0,0 +1,217 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * fingerprint and equals compare the contents of two maps without caring how they were built or stored.
+ *
+ * fingerprint hashes each entry with two independent 64 bit hashes and adds them up with parallelForEach.  Addition
+ * doesn't depend on order, so two maps with the same entries have the same 128 bit fingerprint whatever their table
+ * size, load factor or insertion history.  Entries are hashed by content: strings by their characters, whether the
+ * map holds std::string or std::string_view, and anything else by its object representation.  So an
+ * OpenHashMap<std::string, int> and the MMapS2IOpenHashMap<int> written from it have the same fingerprint.  Store
+ * the fingerprint of what is loaded, and a deploy can skip the reload when a new build has the same one.
+ *
+ * equals checks that every entry of one map is in the other, in parallel.  Once a task finds a difference the
+ * others stop looking entries up; they still walk the rest of their slots, which is cheap next to a lookup.
+ *
+ * Both work on any map with a parallelForEach: OpenHashMap, OpenHashMapTC, MMapS2IOpenHashMap, MMapI2SOpenHashMap
+ * and MMapI2HRSOpenHashMap.  Values that are trivially copyable structs must not have padding that differs between
+ * equal values.
+ */
+
+#pragma once
+
+#include<atomic>
+#include<bit>
+#include<cstdint>
+#include<cstring>
+#include<sstream>
+#include<string>
+#include<string_view>
+#include<type_traits>
+
+#include"ThreadPool.hpp"
+
+namespace gradylib {
+
+    struct MapFingerprint {
+        uint64_t low = 0;
+        uint64_t high = 0;
+
+        bool operator==(MapFingerprint const &) const = default;
+
+        // 32 hex digits, high word first, for keeping next to a deployed file.
+        std::string toString() const {
+            std::ostringstream sstr;
+            sstr << std::hex;
+            sstr.fill('0');
+            sstr.width(16);
+            sstr << high;
+            sstr.width(16);
+            sstr << low;
+            return sstr.str();
+        }
+    };
+
+    inline void mergePartials(MapFingerprint & f1, MapFingerprint const & f2) {
+        f1.low += f2.low;
+        f1.high += f2.high;
+    }
+}
+
+namespace gradylib_helpers {
+
+    inline constexpr uint64_t fingerprintSeedLow = 0x9e3779b97f4a7c15;
+    inline constexpr uint64_t fingerprintSeedHigh = 0xc2b2ae3d27d4eb4f;
+
+    // The murmur3 finalizer
+    inline uint64_t fingerprintMix(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccd;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53;
+        x ^= x >> 33;
+        return x;
+    }
+
+    inline uint64_t fingerprintBytes(void const * data, size_t len, uint64_t seed) {
+        unsigned char const * p = static_cast<unsigned char const *>(data);
+        uint64_t h = seed ^ (len * 0x87c37b91114253d5);
+        while (len >= 8) {
+            uint64_t w;
+            memcpy(&w, p, 8);
+            h = std::rotl(h ^ (w * 0x87c37b91114253d5), 31) * 0x4cf5ad432745937f;
+            p += 8;
+            len -= 8;
+        }
+        if (len > 0) {
+            uint64_t w = 0;
+            memcpy(&w, p, len);
+            h = std::rotl(h ^ (w * 0x87c37b91114253d5), 31) * 0x4cf5ad432745937f;
+        }
+        return fingerprintMix(h);
+    }
+
+    template<typename T>
+    concept FingerprintStringLike = std::is_convertible_v<T const &, std::string_view>;
+
+    template<typename T>
+    concept Fingerprintable = FingerprintStringLike<T> || std::is_trivially_copyable_v<T>;
+
+    template<Fingerprintable T>
+    uint64_t fingerprintValue(T const & t, uint64_t seed) {
+        if constexpr (FingerprintStringLike<T>) {
+            std::string_view s = t;
+            return fingerprintBytes(s.data(), s.size(), seed);
+        } else {
+            return fingerprintBytes(&t, sizeof(T), seed);
+        }
+    }
+
+    // The value hash is multiplied in so that swapping a key with its value changes the entry's hash.
+    template<typename Key, typename Value>
+    void addEntryFingerprint(gradylib::MapFingerprint & fp, Key const & key, Value const & value) {
+        uint64_t lowKey = fingerprintValue(key, fingerprintSeedLow);
+        uint64_t lowValue = fingerprintValue(value, ~fingerprintSeedLow);
+        uint64_t highKey = fingerprintValue(key, fingerprintSeedHigh);
+        uint64_t highValue = fingerprintValue(value, ~fingerprintSeedHigh);
+        fp.low += fingerprintMix(lowKey ^ (lowValue * 0x9fb21c651e98df25));
+        fp.high += fingerprintMix(highKey ^ (highValue * 0x9fb21c651e98df25));
+    }
+
+    // Whether m has key mapped to value, with a single probe when m has get.
+    template<typename Map, typename Key, typename Value>
+    bool containsEntry(Map const & m, Key const & key, Value const & value) {
+        if constexpr (requires { m.get(key).has_value(); }) {
+            auto lookup = m.get(key);
+            return lookup.has_value() && lookup.value() == value;
+        } else if constexpr (requires { m.at(key); }) {
+            return m.contains(key) && m.at(key) == value;
+        } else {
+            return m.contains(key) && m[key] == value;
+        }
+    }
+
+    struct EntriesMatch {
+        bool match = true;
+    };
+
+    inline void mergePartials(EntriesMatch & m1, EntriesMatch const & m2) {
+        m1.match = m1.match && m2.match;
+    }
+}
+
+namespace gradylib {
+
+    // The 128 bit content fingerprint of m.  Maps with the same entries have the same fingerprint.
+    template<typename MapType>
+    MapFingerprint fingerprint(MapType const & m, ThreadPool & tp) {
+        if (m.size() == 0) {
+            return MapFingerprint{};
+        }
+        return m.template parallelForEach<MapFingerprint>(tp, [](MapFingerprint & fp, auto const & key, auto const & value) {
+            gradylib_helpers::addEntryFingerprint(fp, key, value);
+        }).get();
+    }
+
+    template<typename MapType>
+    MapFingerprint fingerprint(MapType const & m) {
+        return fingerprint(m, gradylib_helpers::defaultThreadPool());
+    }
+
+    /*
+     * Whether m1 and m2 have the same entries.  The maps can be different types as long as m1's keys can be looked
+     * up in m2 and the values compare with ==.
+     */
+    template<typename MapType1, typename MapType2>
+    bool equals(MapType1 const & m1, MapType2 const & m2, ThreadPool & tp) {
+        if (m1.size() != m2.size()) {
+            return false;
+        }
+        if (m1.size() == 0) {
+            return true;
+        }
+        // Safe to point at since get() below waits for every task
+        std::atomic<bool> mismatch{false};
+        std::atomic<bool> * mismatchPtr = &mismatch;
+        MapType2 const * other = &m2;
+        auto check = [mismatchPtr, other](gradylib_helpers::EntriesMatch & result, auto const & key, auto const & value) {
+            if (mismatchPtr->load(std::memory_order_relaxed)) {
+                return;
+            }
+            // A compressed string value is a view into this thread's block cache.  The lookup in other reads one
+            // more block, which evicts the least recently used block, not the one value points into.
+            if (!gradylib_helpers::containsEntry(*other, key, value)) {
+                result.match = false;
+                mismatchPtr->store(true, std::memory_order_relaxed);
+            }
+        };
+        return m1.template parallelForEach<gradylib_helpers::EntriesMatch>(tp, check).get().match;
+    }
+
+    template<typename MapType1, typename MapType2>
+    bool equals(MapType1 const & m1, MapType2 const & m2) {
+        return equals(m1, m2, gradylib_helpers::defaultThreadPool());
+    }
+}
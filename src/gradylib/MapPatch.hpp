@@ -0,0 +1,679 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * diff and applyPatch ship a new version of a map file as a patch against the version the hosts already have.
+ *
+ * diff maps the old and new files and compares their slot arrays on a ThreadPool.  Every slot whose key, value or
+ * occupancy changed goes into the patch, which covers inserts, updates and deletes.  applyPatch rebuilds the new
+ * file from the old one.  Runs of unchanged slots are copied in large blocks and the patched slots are filled in
+ * from the patch.  The result is then checked against section checksums of the new file that the patch carries.
+ * The output is byte-identical to the new file, integrity trailer included.
+ *
+ * The patch is small when both versions have the same table size.  If the table was rehashed between the two
+ * versions, every slot is in the patch and it is about the size of the new file.
+ *
+ * The map type names the file format:
+ *     OpenHashMapTC<Key, Value>         files written by OpenHashMapTC::write
+ *     MMapS2IOpenHashMap<IndexType>     files written by writeMappable from an OpenHashMap<std::string, IndexType>
+ *
+ * Patch layout:
+ *     MapPatchHeader
+ *     the header of the new file
+ *     CRC32C of each section of the new file, padded to 8 bytes
+ *     records        (per slot: varint slot, flags byte, varint key length, key bytes, value bytes)
+ */
+
+#pragma once
+
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<unistd.h>
+
+#include<algorithm>
+#include<cstdint>
+#include<cstring>
+#include<filesystem>
+#include<fstream>
+#include<sstream>
+#include<string>
+#include<string_view>
+#include<vector>
+
+#include"Common.hpp"
+#include"Exception.hpp"
+#include"Integrity.hpp"
+#include"MMapS2IOpenHashMap.hpp"
+#include"OpenHashMapTC.hpp"
+#include"ParallelRead.hpp"
+#include"ThreadPool.hpp"
+
+namespace gradylib_helpers {
+
+    inline constexpr uint64_t mapPatchMagic = 0x3148435059445247; // "GRDYPCH1"
+    inline constexpr uint32_t mapPatchVersion = 1;
+    inline constexpr size_t mapPatchSlotsPerTask = 1 << 16;
+
+    enum class MapFileFormat : uint32_t {
+        OpenHashMapTC = 1,
+        S2I = 2,
+    };
+
+    struct MapPatchHeader {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t format;
+        uint32_t keyBytes;
+        uint32_t valueBytes;
+        uint64_t oldDataSize;
+        uint64_t newDataSize;
+        uint64_t newKeySize;
+        uint64_t fullRewrite;
+        uint64_t sealed;
+        uint64_t sectionSize;
+        uint64_t numSections;
+        uint64_t numRecords;
+        uint64_t fileHeaderSize;
+    };
+
+    inline size_t keyRecordSize(size_t len) {
+        return 4 + len + getPadLength<4>(len);
+    }
+
+    // Where the slot arrays of a map file start, read from the file's header.
+    struct MapFileLayout {
+        size_t keySize = 0;
+        size_t headerSize = 0;
+        size_t keysOffset = 0;
+        size_t valuesOffset = 0;
+        size_t bitPairSetOffset = 0;
+
+        MapFileLayout() = default;
+
+        MapFileLayout(std::byte const * header, MapFileFormat format) {
+            if (format == MapFileFormat::OpenHashMapTC) {
+                OpenHashMapTCHeader tcHeader(header);
+                keySize = tcHeader.keySize;
+                headerSize = tcHeader.size;
+                keysOffset = tcHeader.size;
+                valuesOffset = tcHeader.valueOffset;
+                bitPairSetOffset = tcHeader.bitPairSetOffset;
+            } else {
+                memcpy(&keySize, header + 8, 8);
+                headerSize = 32;
+                keysOffset = 32 + 8 * keySize;
+                memcpy(&valuesOffset, header + 16, 8);
+                memcpy(&bitPairSetOffset, header + 24, 8);
+            }
+        }
+    };
+
+    // A read-only mapping of a map file with access to its raw slots.
+    class MappedMapFile {
+        std::byte const * base = nullptr;
+        size_t mappingSize = 0;
+        MapFileFormat format;
+        size_t keyBytes = 0;
+        size_t valueBytes = 0;
+        size_t dataSize = 0;
+        size_t trailerSectionSize = 0;
+        size_t trailerSections = 0;
+        MapFileLayout layout;
+
+        uint64_t keyOffset(size_t i) const {
+            uint64_t offset;
+            memcpy(&offset, base + 32 + 8 * i, 8);
+            return offset;
+        }
+
+    public:
+        MappedMapFile(std::filesystem::path const & path, MapFileFormat format, size_t keyBytes, size_t valueBytes)
+            : format(format), keyBytes(keyBytes), valueBytes(valueBytes)
+        {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                std::ostringstream sstr;
+                sstr << "Couldn't open " << path << " to diff or patch it";
+                throw gradylibMakeException(sstr.str());
+            }
+            mappingSize = std::filesystem::file_size(path);
+            void * mapping = mappingSize == 0 ? MAP_FAILED : mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (mapping == MAP_FAILED) {
+                std::ostringstream sstr;
+                sstr << path << " is empty or can't be mapped";
+                throw gradylibMakeException(sstr.str());
+            }
+            base = static_cast<std::byte const *>(mapping);
+            try {
+                char const * what = format == MapFileFormat::OpenHashMapTC ? "OpenHashMapTC" : "MMapS2IOpenHashMap";
+                dataSize = mappingSize;
+                if (gradylib::IntegrityVerifier::hasTrailer(base, mappingSize)) {
+                    gradylib::IntegrityVerifier verifier(base, mappingSize);
+                    dataSize = verifier.size();
+                    trailerSections = verifier.numSections();
+                    memcpy(&trailerSectionSize, base + mappingSize - integrityFooterSize + 8, 8);
+                }
+                if (format == MapFileFormat::OpenHashMapTC) {
+                    checkMappedOpenHashMapTCHeader(base, dataSize, what);
+                } else {
+                    checkMappedExtent(32, dataSize, what);
+                }
+                layout = MapFileLayout(base, format);
+                checkMappedExtent(layout.keySize > dataSize ? SIZE_MAX : layout.keysOffset, dataSize, what);
+                if (format == MapFileFormat::OpenHashMapTC) {
+                    checkMappedExtent(layout.keysOffset + layout.keySize * keyBytes, dataSize, what);
+                }
+                checkMappedExtent(layout.valuesOffset + layout.keySize * valueBytes, dataSize, what);
+                checkMappedBitPairSet(base, layout.bitPairSetOffset, dataSize, what);
+                size_t setSize;
+                memcpy(&setSize, base + layout.bitPairSetOffset, 8);
+                if (setSize != layout.keySize) {
+                    std::ostringstream sstr;
+                    sstr << what << " file has " << setSize << " slot flags for " << layout.keySize << " slots";
+                    throw gradylibMakeException(sstr.str());
+                }
+                if (format == MapFileFormat::S2I) {
+                    checkMappedExtent(layout.keysOffset + keyRecordOffset(layout.keySize), layout.valuesOffset, what);
+                }
+            } catch (...) {
+                munmap(const_cast<std::byte *>(base), mappingSize);
+                throw;
+            }
+        }
+
+        MappedMapFile(MappedMapFile const &) = delete;
+
+        MappedMapFile & operator=(MappedMapFile const &) = delete;
+
+        ~MappedMapFile() {
+            munmap(const_cast<std::byte *>(base), mappingSize);
+        }
+
+        std::byte const * data() const {
+            return base;
+        }
+
+        // The bytes in front of the integrity trailer, or the whole file if it has none.
+        size_t size() const {
+            return dataSize;
+        }
+
+        bool sealed() const {
+            return trailerSections > 0 || dataSize != mappingSize;
+        }
+
+        size_t sectionSize() const {
+            return trailerSectionSize;
+        }
+
+        size_t numSections() const {
+            return trailerSections;
+        }
+
+        uint32_t sectionCrc(size_t section) const {
+            uint32_t crc;
+            memcpy(&crc, base + dataSize + 4 * section, 4);
+            return crc;
+        }
+
+        MapFileLayout const & fileLayout() const {
+            return layout;
+        }
+
+        size_t keySize() const {
+            return layout.keySize;
+        }
+
+        std::string_view header() const {
+            return std::string_view(charCast(base), layout.headerSize);
+        }
+
+        uint8_t flags(size_t i) const {
+            uint32_t word;
+            memcpy(&word, base + layout.bitPairSetOffset + 8 + 4 * (i / 16), 4);
+            return (word >> (2 * (i % 16))) & 3;
+        }
+
+        // The word of slot flags holding slot i
+        std::byte const * flagWords(size_t i) const {
+            return base + layout.bitPairSetOffset + 8 + 4 * (i / 16);
+        }
+
+        // S2I only: offset of slot i's key record from the start of the key records.  keyRecordOffset(keySize()) is
+        // the end of the last record.
+        size_t keyRecordOffset(size_t i) const {
+            if (i < layout.keySize) {
+                return keyOffset(i);
+            }
+            if (layout.keySize == 0) {
+                return 0;
+            }
+            size_t last = keyOffset(layout.keySize - 1);
+            checkMappedExtent(layout.keysOffset + last + 4, layout.valuesOffset, "MMapS2IOpenHashMap");
+            int32_t len;
+            memcpy(&len, base + layout.keysOffset + last, 4);
+            return last + keyRecordSize(len);
+        }
+
+        std::byte const * keyRecords() const {
+            return base + layout.keysOffset;
+        }
+
+        std::string_view key(size_t i) const {
+            if (format == MapFileFormat::OpenHashMapTC) {
+                return std::string_view(charCast(base + layout.keysOffset + i * keyBytes), keyBytes);
+            }
+            size_t offset = layout.keysOffset + keyOffset(i);
+            checkMappedExtent(offset + 4, layout.valuesOffset, "MMapS2IOpenHashMap");
+            int32_t len;
+            memcpy(&len, base + offset, 4);
+            checkMappedExtent(offset + 4 + static_cast<uint32_t>(len), layout.valuesOffset, "MMapS2IOpenHashMap");
+            return std::string_view(charCast(base + offset + 4), len);
+        }
+
+        std::string_view value(size_t i) const {
+            return std::string_view(charCast(base + layout.valuesOffset + i * valueBytes), valueBytes);
+        }
+    };
+
+    inline size_t diffMapFiles(std::filesystem::path const & oldFile, std::filesystem::path const & newFile,
+                               std::filesystem::path const & patchFile, MapFileFormat format,
+                               size_t keyBytes, size_t valueBytes, gradylib::ThreadPool & tp) {
+        MappedMapFile oldMap(oldFile, format, keyBytes, valueBytes);
+        MappedMapFile newMap(newFile, format, keyBytes, valueBytes);
+        size_t keySize = newMap.keySize();
+        bool fullRewrite = oldMap.keySize() != keySize;
+
+        // The patch carries the checksums the result has to match.  A sealed file already has them in its trailer.
+        size_t sectionSize = newMap.sealed() ? newMap.sectionSize() : 4 << 20;
+        size_t numSections = (newMap.size() + sectionSize - 1) / sectionSize;
+        std::vector<uint32_t> crcs(numSections);
+        if (newMap.sealed()) {
+            for (size_t s = 0; s < numSections; ++s) {
+                crcs[s] = newMap.sectionCrc(s);
+            }
+        } else {
+            runTasks(tp, numSections, [&](size_t s) {
+                size_t begin = s * sectionSize;
+                crcs[s] = crc32c(newMap.data() + begin, std::min(sectionSize, newMap.size() - begin));
+            });
+        }
+
+        size_t numTasks = (keySize + mapPatchSlotsPerTask - 1) / mapPatchSlotsPerTask;
+        std::vector<std::string> records(numTasks);
+        std::vector<size_t> counts(numTasks, 0);
+        runTasks(tp, numTasks, [&](size_t task) {
+            size_t begin = task * mapPatchSlotsPerTask;
+            size_t end = std::min(begin + mapPatchSlotsPerTask, keySize);
+            std::string & out = records[task];
+            for (size_t i = begin; i < end; ++i) {
+                uint8_t flags = newMap.flags(i);
+                std::string_view key = newMap.key(i);
+                std::string_view value = newMap.value(i);
+                if (!fullRewrite && flags == oldMap.flags(i) && key == oldMap.key(i) && value == oldMap.value(i)) {
+                    continue;
+                }
+                appendVarint(out, i);
+                out.push_back(static_cast<char>(flags));
+                appendVarint(out, key.size());
+                out.append(key);
+                out.append(value);
+                ++counts[task];
+            }
+        });
+
+        MapPatchHeader header{};
+        header.magic = mapPatchMagic;
+        header.version = mapPatchVersion;
+        header.format = static_cast<uint32_t>(format);
+        header.keyBytes = keyBytes;
+        header.valueBytes = valueBytes;
+        header.oldDataSize = oldMap.size();
+        header.newDataSize = newMap.size();
+        header.newKeySize = keySize;
+        header.fullRewrite = fullRewrite;
+        header.sealed = newMap.sealed();
+        header.sectionSize = sectionSize;
+        header.numSections = numSections;
+        for (size_t count : counts) {
+            header.numRecords += count;
+        }
+        header.fileHeaderSize = newMap.header().size();
+
+        std::ofstream ofs(patchFile, std::ios::binary);
+        if (ofs.fail()) {
+            std::ostringstream sstr;
+            sstr << "Couldn't open " << patchFile << " for writing the map patch";
+            throw gradylibMakeException(sstr.str());
+        }
+        ofs.write(charCast(&header), sizeof(header));
+        ofs.write(newMap.header().data(), newMap.header().size());
+        ofs.write(charCast(crcs.data()), 4 * numSections);
+        writePad<8>(ofs);
+        for (std::string const & r : records) {
+            ofs.write(r.data(), r.size());
+        }
+        ofs.close();
+        if (ofs.fail()) {
+            std::ostringstream sstr;
+            sstr << "Writing the map patch " << patchFile << " failed";
+            throw gradylibMakeException(sstr.str());
+        }
+        return header.numRecords;
+    }
+
+    struct MapPatchRecord {
+        size_t slot;
+        uint8_t flags;
+        std::string_view key;
+        std::string_view value;
+    };
+
+    inline void applyMapPatch(std::filesystem::path const & oldFile, std::filesystem::path const & patchFile,
+                              std::filesystem::path const & newFile, MapFileFormat format,
+                              size_t keyBytes, size_t valueBytes, gradylib::ThreadPool & tp) {
+        std::ifstream ifs(patchFile, std::ios::binary);
+        if (ifs.fail()) {
+            std::ostringstream sstr;
+            sstr << "Couldn't open the map patch " << patchFile;
+            throw gradylibMakeException(sstr.str());
+        }
+        size_t patchSize = std::filesystem::file_size(patchFile);
+        // Zero padding lets a truncated varint at the end run into the bounds check instead of off the buffer
+        std::string patch(patchSize + 16, '\0');
+        ifs.read(patch.data(), patchSize);
+        auto corrupt = [&patchFile](char const * why) {
+            std::ostringstream sstr;
+            sstr << "Map patch " << patchFile << " is corrupt: " << why;
+            return gradylibMakeException(sstr.str());
+        };
+        if (ifs.fail() || patchSize < sizeof(MapPatchHeader)) {
+            throw corrupt("too short");
+        }
+        MapPatchHeader header;
+        memcpy(&header, patch.data(), sizeof(header));
+        if (header.magic != mapPatchMagic || header.version != mapPatchVersion) {
+            throw corrupt("bad magic or version");
+        }
+        if (header.format != static_cast<uint32_t>(format) || header.keyBytes != keyBytes || header.valueBytes != valueBytes) {
+            std::ostringstream sstr;
+            sstr << "Map patch " << patchFile << " was made for a different map type";
+            throw gradylibMakeException(sstr.str());
+        }
+        bool knownHeaderSize = format == MapFileFormat::OpenHashMapTC
+                ? header.fileHeaderSize >= OpenHashMapTCHeader::unseededSize &&
+                  header.fileHeaderSize == OpenHashMapTCHeader::sizeOf(patch.data() + sizeof(header))
+                : header.fileHeaderSize == 32;
+        if (!knownHeaderSize || header.sectionSize == 0 ||
+            header.numSections != (header.newDataSize + header.sectionSize - 1) / header.sectionSize ||
+            header.numSections > patchSize) {
+            throw corrupt("inconsistent header");
+        }
+        std::byte const * ptr = static_cast<std::byte const *>(static_cast<void const *>(patch.data()));
+        std::byte const * fileHeader = ptr + sizeof(header);
+        std::byte const * crcTable = fileHeader + header.fileHeaderSize;
+        std::byte const * recordPtr = crcTable + (4 * header.numSections + 7) / 8 * 8;
+        std::byte const * end = ptr + patchSize;
+        if (recordPtr > end) {
+            throw corrupt("too short");
+        }
+        MapFileLayout layout(fileHeader, format);
+        size_t keySize = header.newKeySize;
+        if (layout.keySize != keySize ||
+            (format == MapFileFormat::S2I && keySize > header.newDataSize / 8) ||
+            (format == MapFileFormat::OpenHashMapTC && layout.keysOffset + keySize * keyBytes > header.newDataSize) ||
+            layout.valuesOffset + keySize * valueBytes > header.newDataSize ||
+            layout.bitPairSetOffset + 8 + (keySize + 15) / 16 * 4 > header.newDataSize) {
+            throw corrupt("the new file's header doesn't fit its size");
+        }
+
+        std::vector<MapPatchRecord> records;
+        records.reserve(std::min<size_t>(header.numRecords, patchSize));
+        for (size_t r = 0; r < header.numRecords; ++r) {
+            if (recordPtr >= end) {
+                throw corrupt("too short");
+            }
+            MapPatchRecord record;
+            record.slot = readVarint(recordPtr);
+            record.flags = static_cast<uint8_t>(*recordPtr++);
+            size_t keyLen = readVarint(recordPtr);
+            if (recordPtr > end || keyLen > static_cast<size_t>(end - recordPtr) ||
+                valueBytes > static_cast<size_t>(end - recordPtr) - keyLen) {
+                throw corrupt("too short");
+            }
+            record.key = std::string_view(charCast(recordPtr), keyLen);
+            record.value = std::string_view(charCast(recordPtr + keyLen), valueBytes);
+            recordPtr += keyLen + valueBytes;
+            if (record.slot >= keySize || (!records.empty() && record.slot <= records.back().slot) ||
+                record.flags > 3 || (format == MapFileFormat::OpenHashMapTC && keyLen != keyBytes)) {
+                throw corrupt("bad record");
+            }
+            records.push_back(record);
+        }
+        if (header.fullRewrite && records.size() != keySize) {
+            throw corrupt("a full rewrite doesn't cover every slot");
+        }
+
+        MappedMapFile oldMap(oldFile, format, keyBytes, valueBytes);
+        if (oldMap.size() != header.oldDataSize || (!header.fullRewrite && oldMap.keySize() != keySize)) {
+            std::ostringstream sstr;
+            sstr << "Map patch " << patchFile << " doesn't apply to " << oldFile;
+            throw gradylibMakeException(sstr.str());
+        }
+        bool copyOld = !header.fullRewrite;
+
+        size_t numTasks = (keySize + mapPatchSlotsPerTask - 1) / mapPatchSlotsPerTask;
+        std::vector<size_t> taskRecords(numTasks + 1, records.size());
+        for (size_t task = 0; task < numTasks; ++task) {
+            auto it = std::lower_bound(records.begin(), records.end(), task * mapPatchSlotsPerTask, [](MapPatchRecord const & r, size_t slot) {
+                return r.slot < slot;
+            });
+            taskRecords[task] = it - records.begin();
+        }
+
+        // S2I key records vary in length, so each task's place in the key region has to be worked out first
+        std::vector<size_t> keyBytesStart(numTasks + 1, 0);
+        if (format == MapFileFormat::S2I) {
+            std::vector<size_t> taskKeyBytes(numTasks, 0);
+            runTasks(tp, numTasks, [&](size_t task) {
+                size_t begin = task * mapPatchSlotsPerTask;
+                size_t end = std::min(begin + mapPatchSlotsPerTask, keySize);
+                size_t bytes = copyOld ? oldMap.keyRecordOffset(end) - oldMap.keyRecordOffset(begin) : 0;
+                for (size_t r = taskRecords[task]; r < taskRecords[task + 1]; ++r) {
+                    bytes += keyRecordSize(records[r].key.size());
+                    if (copyOld) {
+                        bytes -= keyRecordSize(oldMap.key(records[r].slot).size());
+                    }
+                }
+                taskKeyBytes[task] = bytes;
+            });
+            for (size_t task = 0; task < numTasks; ++task) {
+                keyBytesStart[task + 1] = keyBytesStart[task] + taskKeyBytes[task];
+            }
+            if (layout.keysOffset + keyBytesStart.back() > layout.valuesOffset) {
+                throw corrupt("the key records overrun the values");
+            }
+        }
+
+        int fd = open(newFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            std::ostringstream sstr;
+            sstr << "Couldn't create " << newFile << " to apply a map patch";
+            throw gradylibMakeException(sstr.str());
+        }
+        try {
+            if (ftruncate(fd, header.newDataSize) != 0) {
+                std::ostringstream sstr;
+                sstr << "Couldn't size " << newFile << " to " << header.newDataSize << " bytes: " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            pwriteFully(fd, fileHeader, header.fileHeaderSize, 0);
+            pwriteFully(fd, &keySize, 8, layout.bitPairSetOffset);
+
+            runTasks(tp, numTasks, [&](size_t task) {
+                size_t begin = task * mapPatchSlotsPerTask;
+                size_t end = std::min(begin + mapPatchSlotsPerTask, keySize);
+                size_t firstRecord = taskRecords[task];
+                size_t lastRecord = taskRecords[task + 1];
+                size_t numSlots = end - begin;
+                size_t numWords = (numSlots + 15) / 16;
+
+                std::vector<std::byte> values(numSlots * valueBytes);
+                std::vector<uint32_t> words(numWords, 0);
+                if (copyOld) {
+                    memcpy(values.data(), oldMap.value(begin).data(), values.size());
+                    memcpy(words.data(), oldMap.flagWords(begin), 4 * numWords);
+                }
+                for (size_t r = firstRecord; r < lastRecord; ++r) {
+                    MapPatchRecord const & record = records[r];
+                    size_t i = record.slot - begin;
+                    memcpy(values.data() + i * valueBytes, record.value.data(), valueBytes);
+                    uint32_t shift = 2 * (i % 16);
+                    words[i / 16] = (words[i / 16] & ~(3u << shift)) | (static_cast<uint32_t>(record.flags) << shift);
+                }
+
+                if (format == MapFileFormat::OpenHashMapTC) {
+                    std::vector<std::byte> keys(numSlots * keyBytes);
+                    if (copyOld) {
+                        memcpy(keys.data(), oldMap.key(begin).data(), keys.size());
+                    }
+                    for (size_t r = firstRecord; r < lastRecord; ++r) {
+                        memcpy(keys.data() + (records[r].slot - begin) * keyBytes, records[r].key.data(), keyBytes);
+                    }
+                    pwriteFully(fd, keys.data(), keys.size(), layout.keysOffset + begin * keyBytes);
+                } else {
+                    std::vector<uint64_t> keyOffsets(numSlots);
+                    std::string keyRecords;
+                    keyRecords.reserve(keyBytesStart[task + 1] - keyBytesStart[task]);
+                    size_t r = firstRecord;
+                    for (size_t i = begin; i < end; ) {
+                        if (r < lastRecord && records[r].slot == i) {
+                            keyOffsets[i - begin] = keyBytesStart[task] + keyRecords.size();
+                            int32_t len = records[r].key.size();
+                            keyRecords.append(charCast(&len), 4);
+                            keyRecords.append(records[r].key);
+                            keyRecords.append(getPadLength<4>(len), '\0');
+                            ++r;
+                            ++i;
+                            continue;
+                        }
+                        // Copy the run of unchanged key records up to the next patched slot in one piece
+                        size_t next = r < lastRecord ? records[r].slot : end;
+                        size_t oldStart = oldMap.keyRecordOffset(i);
+                        size_t shift = keyBytesStart[task] + keyRecords.size();
+                        for (size_t j = i; j < next; ++j) {
+                            keyOffsets[j - begin] = oldMap.keyRecordOffset(j) - oldStart + shift;
+                        }
+                        size_t oldEnd = oldMap.keyRecordOffset(next);
+                        keyRecords.append(charCast(oldMap.keyRecords() + oldStart), oldEnd - oldStart);
+                        i = next;
+                    }
+                    if (keyRecords.size() != keyBytesStart[task + 1] - keyBytesStart[task]) {
+                        throw corrupt("key records don't add up");
+                    }
+                    pwriteFully(fd, keyOffsets.data(), 8 * numSlots, 32 + 8 * begin);
+                    pwriteFully(fd, keyRecords.data(), keyRecords.size(), layout.keysOffset + keyBytesStart[task]);
+                }
+                pwriteFully(fd, values.data(), values.size(), layout.valuesOffset + begin * valueBytes);
+                pwriteFully(fd, words.data(), 4 * numWords, layout.bitPairSetOffset + 8 + 4 * (begin / 16));
+            });
+
+            std::vector<char> mismatch(header.numSections, 0);
+            runTasks(tp, header.numSections, [&](size_t s) {
+                size_t begin = s * header.sectionSize;
+                std::vector<std::byte> buffer(std::min<size_t>(header.sectionSize, header.newDataSize - begin));
+                preadFully(fd, buffer.data(), buffer.size(), begin);
+                uint32_t expected;
+                memcpy(&expected, crcTable + 4 * s, 4);
+                mismatch[s] = crc32c(buffer.data(), buffer.size()) != expected;
+            });
+            auto bad = std::find(mismatch.begin(), mismatch.end(), 1);
+            if (bad != mismatch.end()) {
+                std::ostringstream sstr;
+                sstr << "Applying " << patchFile << " to " << oldFile << " didn't reproduce the new file: bytes from "
+                     << (bad - mismatch.begin()) * header.sectionSize << " differ";
+                throw gradylibMakeException(sstr.str());
+            }
+        } catch (...) {
+            close(fd);
+            std::error_code ec;
+            std::filesystem::remove(newFile, ec);
+            throw;
+        }
+        close(fd);
+        if (header.sealed) {
+            appendIntegrityTrailer(newFile, tp, header.sectionSize);
+        }
+    }
+}
+
+namespace gradylib {
+
+    template<typename MapType>
+    struct MapPatchFormat;
+
+    template<typename Key, typename Value, template<typename> typename HashFunction>
+    struct MapPatchFormat<OpenHashMapTC<Key, Value, HashFunction>> {
+        static constexpr gradylib_helpers::MapFileFormat format = gradylib_helpers::MapFileFormat::OpenHashMapTC;
+        static constexpr size_t keyBytes = sizeof(Key);
+        static constexpr size_t valueBytes = sizeof(Value);
+    };
+
+    template<typename IndexType>
+    struct MapPatchFormat<MMapS2IOpenHashMap<IndexType>> {
+        static constexpr gradylib_helpers::MapFileFormat format = gradylib_helpers::MapFileFormat::S2I;
+        static constexpr size_t keyBytes = 0;
+        static constexpr size_t valueBytes = sizeof(IndexType);
+    };
+
+    // Write a patch that turns oldFile into newFile.  Returns the number of slots in the patch.
+    template<typename MapType>
+    size_t diff(std::filesystem::path const & oldFile, std::filesystem::path const & newFile,
+                std::filesystem::path const & patchFile, ThreadPool & tp) {
+        using F = MapPatchFormat<MapType>;
+        return gradylib_helpers::diffMapFiles(oldFile, newFile, patchFile, F::format, F::keyBytes, F::valueBytes, tp);
+    }
+
+    template<typename MapType>
+    size_t diff(std::filesystem::path const & oldFile, std::filesystem::path const & newFile,
+                std::filesystem::path const & patchFile) {
+        return diff<MapType>(oldFile, newFile, patchFile, gradylib_helpers::defaultThreadPool());
+    }
+
+    // Rebuild the new file from oldFile and a patch made by diff.  Throws, leaving nothing at newFile, if the patch
+    // is corrupt, doesn't belong to oldFile, or the result doesn't match the checksums in the patch.
+    template<typename MapType>
+    void applyPatch(std::filesystem::path const & oldFile, std::filesystem::path const & patchFile,
+                    std::filesystem::path const & newFile, ThreadPool & tp) {
+        using F = MapPatchFormat<MapType>;
+        gradylib_helpers::applyMapPatch(oldFile, patchFile, newFile, F::format, F::keyBytes, F::valueBytes, tp);
+    }
+
+    template<typename MapType>
+    void applyPatch(std::filesystem::path const & oldFile, std::filesystem::path const & patchFile,
+                    std::filesystem::path const & newFile) {
+        applyPatch<MapType>(oldFile, patchFile, newFile, gradylib_helpers::defaultThreadPool());
+    }
+}
@@ -0,0 +1,305 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * An append-only log of put and erase records for trivially copyable keys and values.
+ *
+ * Appends go to an in-memory buffer.  commit(seq) makes every record up to seq durable.  The first committing thread
+ * writes the whole buffer and calls fdatasync once.  Threads that commit while that sync is running wait, and the
+ * next one writes everything they appended as a single batch.  So concurrent writers share syncs instead of paying
+ * for one each.
+ *
+ * Layout: a 24 byte header (magic, version, sizeof(Key), sizeof(Value)), then records of
+ *     uint8_t op, Key, Value (puts only), uint32_t CRC32C of the preceding bytes of the record
+ * A crash can leave a partly written last batch.  Replay stops at the first incomplete or corrupt record and the
+ * log is cut back to the last good one.
+ */
+
+#pragma once
+
+#include<errno.h>
+#include<fcntl.h>
+#include<string.h>
+#include<unistd.h>
+
+#include<condition_variable>
+#include<cstdint>
+#include<filesystem>
+#include<fstream>
+#include<mutex>
+#include<sstream>
+#include<string>
+#include<type_traits>
+#include<vector>
+
+#include"Exception.hpp"
+#include"Integrity.hpp"
+
+namespace gradylib_helpers {
+
+    inline int syncFileData(int fd) {
+#ifdef __linux__
+        return fdatasync(fd);
+#else
+        return fsync(fd);
+#endif
+    }
+}
+
+namespace gradylib {
+
+    template<typename Key, typename Value>
+    requires std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>
+    class MutationLog {
+        static constexpr uint64_t magic = 0x314C415759445247; // "GRDYWAL1"
+        static constexpr uint32_t version = 1;
+        static constexpr size_t headerSize = 24;
+        static constexpr uint8_t putRecord = 1;
+        static constexpr uint8_t eraseRecord = 2;
+        static constexpr size_t putRecordSize = 1 + sizeof(Key) + sizeof(Value) + 4;
+        static constexpr size_t eraseRecordSize = 1 + sizeof(Key) + 4;
+
+        std::filesystem::path path;
+        int fd = -1;
+        mutable std::mutex mutex;
+        std::condition_variable synced;
+        std::string pending;
+        uint64_t appendedSeq = 0;
+        uint64_t durableSeq = 0;
+        bool syncing = false;
+        int writeError = 0;
+
+        [[noreturn]] void throwErrno(char const * what, int error) const {
+            std::ostringstream sstr;
+            sstr << what << " " << path << ": " << strerror(error);
+            throw gradylibMakeException(sstr.str());
+        }
+
+        // Returns 0, or the errno of the write that failed
+        int writeAll(char const * data, size_t size) {
+            while (size > 0) {
+                ssize_t n = ::write(fd, data, size);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n < 0) {
+                    return errno;
+                }
+                data += n;
+                size -= n;
+            }
+            return 0;
+        }
+
+        std::vector<char> makeHeader() const {
+            std::vector<char> header(headerSize);
+            uint32_t keySize = sizeof(Key);
+            uint32_t valueSize = sizeof(Value);
+            memcpy(header.data(), &magic, 8);
+            memcpy(header.data() + 8, &version, 4);
+            memcpy(header.data() + 12, &keySize, 4);
+            memcpy(header.data() + 16, &valueSize, 4);
+            return header;
+        }
+
+        // Returns the length of the good prefix of the log
+        template<typename PutFunction, typename EraseFunction>
+        size_t replay(PutFunction & onPut, EraseFunction & onErase) {
+            std::ifstream ifs(path, std::ios::binary);
+            std::vector<char> header(headerSize);
+            ifs.read(header.data(), headerSize);
+            if (ifs.gcount() == 0) {
+                return 0;
+            }
+            if (ifs.gcount() < static_cast<std::streamsize>(headerSize) || header != makeHeader()) {
+                std::ostringstream sstr;
+                sstr << path << " isn't a mutation log for these key and value types";
+                throw gradylibMakeException(sstr.str());
+            }
+            size_t goodLength = headerSize;
+            char record[putRecordSize];
+            while (true) {
+                ifs.read(record, 1);
+                if (ifs.gcount() != 1 || (record[0] != putRecord && record[0] != eraseRecord)) {
+                    break;
+                }
+                size_t recordSize = record[0] == putRecord ? putRecordSize : eraseRecordSize;
+                ifs.read(record + 1, recordSize - 1);
+                if (ifs.gcount() != static_cast<std::streamsize>(recordSize - 1)) {
+                    break;
+                }
+                uint32_t crc;
+                memcpy(&crc, record + recordSize - 4, 4);
+                if (crc != gradylib_helpers::crc32c(record, recordSize - 4)) {
+                    break;
+                }
+                Key key;
+                memcpy(&key, record + 1, sizeof(Key));
+                if (record[0] == putRecord) {
+                    Value value;
+                    memcpy(&value, record + 1 + sizeof(Key), sizeof(Value));
+                    onPut(key, value);
+                } else {
+                    onErase(key);
+                }
+                goodLength += recordSize;
+            }
+            return goodLength;
+        }
+
+        uint64_t append(char const * record, size_t size) {
+            std::lock_guard lg(mutex);
+            pending.append(record, size);
+            return ++appendedSeq;
+        }
+
+    public:
+        /*
+         * Opens the log at path, creating it if needed.  The records already in it are passed to onPut(key, value)
+         * and onErase(key) in order.
+         */
+        template<typename PutFunction, typename EraseFunction>
+        requires std::invocable<PutFunction &, Key const &, Value const &> && std::invocable<EraseFunction &, Key const &>
+        MutationLog(std::filesystem::path path, PutFunction onPut, EraseFunction onErase)
+            : path(path)
+        {
+            size_t goodLength = std::filesystem::exists(path) ? replay(onPut, onErase) : 0;
+            fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (fd < 0) {
+                throwErrno("Couldn't open mutation log", errno);
+            }
+            try {
+                if (goodLength == 0) {
+                    if (ftruncate(fd, 0) != 0) {
+                        throwErrno("Couldn't truncate mutation log", errno);
+                    }
+                    std::vector<char> header = makeHeader();
+                    if (int error = writeAll(header.data(), header.size()); error != 0) {
+                        throwErrno("Couldn't write mutation log", error);
+                    }
+                } else if (ftruncate(fd, goodLength) != 0) {
+                    throwErrno("Couldn't cut the torn tail off mutation log", errno);
+                }
+                if (gradylib_helpers::syncFileData(fd) != 0) {
+                    throwErrno("Couldn't sync mutation log", errno);
+                }
+            } catch (...) {
+                close(fd);
+                throw;
+            }
+        }
+
+        MutationLog(MutationLog const &) = delete;
+
+        MutationLog & operator=(MutationLog const &) = delete;
+
+        // Commits whatever is still pending.  Errors are dropped here; call commit() first to see them.
+        ~MutationLog() {
+            try {
+                commit();
+            } catch (...) {
+            }
+            close(fd);
+        }
+
+        // Returns the record's sequence number for commit.
+        uint64_t appendPut(Key const & key, Value const & value) {
+            char record[putRecordSize];
+            record[0] = putRecord;
+            memcpy(record + 1, &key, sizeof(Key));
+            memcpy(record + 1 + sizeof(Key), &value, sizeof(Value));
+            uint32_t crc = gradylib_helpers::crc32c(record, putRecordSize - 4);
+            memcpy(record + putRecordSize - 4, &crc, 4);
+            return append(record, putRecordSize);
+        }
+
+        uint64_t appendErase(Key const & key) {
+            char record[eraseRecordSize];
+            record[0] = eraseRecord;
+            memcpy(record + 1, &key, sizeof(Key));
+            uint32_t crc = gradylib_helpers::crc32c(record, eraseRecordSize - 4);
+            memcpy(record + eraseRecordSize - 4, &crc, 4);
+            return append(record, eraseRecordSize);
+        }
+
+        // Returns once every record up to and including seq is on disk.  Throws if a write or sync failed.
+        void commit(uint64_t seq) {
+            std::unique_lock lock(mutex);
+            while (durableSeq < seq && writeError == 0) {
+                if (syncing) {
+                    synced.wait(lock);
+                    continue;
+                }
+                syncing = true;
+                std::string batch;
+                batch.swap(pending);
+                uint64_t batchSeq = appendedSeq;
+                lock.unlock();
+                int error = writeAll(batch.data(), batch.size());
+                if (error == 0 && gradylib_helpers::syncFileData(fd) != 0) {
+                    error = errno;
+                }
+                lock.lock();
+                syncing = false;
+                if (error != 0) {
+                    writeError = error;
+                } else {
+                    durableSeq = batchSeq;
+                }
+                synced.notify_all();
+            }
+            if (writeError != 0) {
+                throwErrno("Couldn't write mutation log", writeError);
+            }
+        }
+
+        void commit() {
+            uint64_t seq;
+            {
+                std::lock_guard lg(mutex);
+                seq = appendedSeq;
+            }
+            commit(seq);
+        }
+
+        /*
+         * Drop every record, after a snapshot that includes them has been saved.  No appends may run concurrently.
+         * Replaying records that are already in the snapshot is harmless, so a crash between saving the snapshot and
+         * the reset loses nothing.
+         */
+        void reset() {
+            commit();
+            std::lock_guard lg(mutex);
+            if (ftruncate(fd, headerSize) != 0 || gradylib_helpers::syncFileData(fd) != 0) {
+                throwErrno("Couldn't reset mutation log", errno);
+            }
+        }
+
+        // The number of records appended since the log was opened
+        uint64_t numAppended() const {
+            std::lock_guard lg(mutex);
+            return appendedSeq;
+        }
+    };
+}
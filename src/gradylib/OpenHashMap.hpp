@@ -24,18 +24,32 @@ SOFTWARE.
 
 #pragma once
 
+#include<errno.h>
+#include<fcntl.h>
+#include<string.h>
+#include<sys/mman.h>
+#include<unistd.h>
+
+#include<algorithm>
 #include<filesystem>
 #include<fstream>
 #include<future>
 #include<string>
+#include<tuple>
 #include<type_traits>
 #include<vector>
 
 #include"AltIntHash.hpp"
 #include"Common.hpp"
 #include"BitPairSet.hpp"
+#include"Checkpoint.hpp"
+#include"BlockCompressedStrings.hpp"
+#include"Integrity.hpp"
+#include"ParallelRead.hpp"
 #include"ThreadPool.hpp"
+#include"ParallelSort.hpp"
 #include"ParallelTraversals.hpp"
+#include"SlotSampling.hpp"
 
 /*
  * To some extent OpenHashMap can be used as a drop in replacement for unordered_map.  It has:
@@ -55,6 +69,18 @@ SOFTWARE.
  *  - writeMappable (for integer -> string or string -> integer maps)
  */
 
+namespace gradylib_helpers {
+    /*
+     * OpenHashMap::write puts a table of record group starts after the header, so that the parallel read can hand
+     * groups of records to its tasks without walking the record chain first.  The table is marked by this bit in the
+     * keySize word; files written before it existed have no table and are still read.  Table layout:
+     *     recordsPerGroup, bitPairSetOffset, groupStart[ceil(mapSize / recordsPerGroup)]    (8 bytes each)
+     * The offsets are file positions, like the offsets in the records.
+     */
+    inline constexpr uint64_t openHashMapGroupTableFlag = uint64_t(1) << 63;
+    inline constexpr uint64_t openHashMapRecordsPerGroup = 4096;
+}
+
 namespace gradylib {
     template<typename Key, typename Value, template<typename> typename HashFunction = gradylib::AltHash>
     requires std::is_default_constructible_v<Key> && std::is_default_constructible_v<Value>
@@ -76,9 +102,20 @@ namespace gradylib {
         BitPairSet setFlags;
         double loadFactor = 0.8;
         double growthFactor = 1.2;
+        // See setMinLoadFactor
+        double minLoadFactor = 0;
         size_t mapSize = 0;
         HashFunction<Key> hashFunction = HashFunction<Key>{};
 
+        // One MapEntryRef per entry, in slot order.
+        std::vector<MapEntryRef<Key, Value>> entryRefs(ThreadPool & tp) const {
+            return gradylib_helpers::collectSlots<MapEntryRef<Key, Value>>(tp, keys.size(), mapSize, [this](size_t j) {
+                return setFlags.isFirstSet(j);
+            }, [this](size_t j) {
+                return MapEntryRef<Key, Value>(&keys[j], &values[j]);
+            });
+        }
+
         void rehash(size_t size = 0) {
             size_t newSize;
             if (size > 0) {
@@ -91,13 +128,30 @@ namespace gradylib {
                 // Increase the map size by a factor of growthFactor, ensuring the new size is at least one greater than the old size
                 newSize = std::max<size_t>(keys.size() + 1, keys.size() * growthFactor);
             }
+            rebuild(newSize);
+        }
+
+        // Big tables are rebuilt on tp when one is given.  See gradylib_helpers::rebuildSlots.
+        void rebuild(size_t newSize, ThreadPool * tp = nullptr) {
             // Use of vector here is one reason to require default constructibility in the Key and the Value. Vector's usage also
             // prevents us from using C style arrays as keys to their non-assignability. Maybe implement our own array container
             // to get around this.
             std::vector<Key> newKeys(newSize);
             std::vector<Value> newValues(newSize);
             BitPairSet newSetFlags(newSize);
-            if (mapSize > 0) {
+            if (tp && newSize >= gradylib_helpers::parallelRebuildSlots) {
+                gradylib_helpers::rebuildSlots(*tp, keys.size(), newSize, [this](size_t j) {
+                    return setFlags.isFirstSet(j);
+                }, [this, newSize](size_t j) {
+                    return hashFunction(keys[j]) % newSize;
+                }, [&newSetFlags](size_t idx) {
+                    return newSetFlags.isFirstSet(idx);
+                }, [&](size_t j, size_t idx) {
+                    newSetFlags.setBoth(idx);
+                    newKeys[idx] = std::move(keys[j]);
+                    newValues[idx] = std::move(values[j]);
+                });
+            } else if (mapSize > 0) {
                 for (size_t i = 0; i < keys.size(); ++i) {
                     if (!setFlags.isFirstSet(i)) {
                         // In the current map, this entry is empty
@@ -423,6 +477,9 @@ namespace gradylib {
                         --mapSize;
                         // Mark the slot as 'unset'
                         setFlags.unsetFirst(idx);
+                        if (mapSize < keys.size() * minLoadFactor) {
+                            rebuild(mapSize / ((minLoadFactor + loadFactor) / 2) + 1, nullptr);
+                        }
                     }
                     // We can't find a set slot with this key past this point.
                     return;
@@ -439,6 +496,35 @@ namespace gradylib {
             rehash(size);
         }
 
+        /*
+         * Shrink automatically when erases leave fewer than minLoadFactor * capacity entries.  The table is rebuilt
+         * for a load halfway between minLoadFactor and the load factor, so it takes many inserts or erases before
+         * it resizes again.  The default of 0 never shrinks.  An erase that shrinks invalidates iterators.  It
+         * rebuilds on the calling thread, so erase is safe inside thread pool tasks; use shrinkToFit(tp) to rebuild a
+         * big table in parallel.
+         */
+        void setMinLoadFactor(double f) {
+            if (!(f >= 0 && f <= loadFactor / 2)) {
+                std::ostringstream sstr;
+                sstr << "OpenHashMap minimum load factor " << f << " must be between 0 and half the load factor";
+                throw gradylibMakeException(sstr.str());
+            }
+            minLoadFactor = f;
+        }
+
+        // Rebuild at the smallest capacity that holds the entries, which also drops the slots of erased entries.
+        void shrinkToFit(ThreadPool & tp) {
+            rebuild(mapSize / loadFactor + 1, &tp);
+        }
+
+        void shrinkToFit() {
+            shrinkToFit(gradylib_helpers::defaultThreadPool());
+        }
+
+        size_t capacity() const {
+            return keys.size();
+        }
+
         void clear() {
             setFlags.clear();
             mapSize = 0;
@@ -559,20 +645,40 @@ namespace gradylib {
         }
 
         //template<typename = std::enable_if_t</* key has a serialize method or key has a serialize global and value has a serialize method or global */>
-        void write(std::filesystem::path path, std::function<void(std::ofstream &, Key const &)> serializeKey, std::function<void(std::ofstream &, Value const &)> serializeValue) {
+        void write(std::filesystem::path path, std::function<void(std::ofstream &, Key const &)> serializeKey, std::function<void(std::ofstream &, Value const &)> serializeValue) const {
             std::ofstream ofs(path, std::ios::binary);
             write(ofs, serializeKey, serializeValue);
         }
 
-        void write(std::ofstream & ofs, std::function<void(std::ofstream &, Key const &)> serializeKey, std::function<void(std::ofstream &, Value const &)> serializeValue) {
+        // Write a snapshot to path in the background while the map keeps changing.  See Checkpoint.hpp.
+        std::future<void> checkpointAsync(std::filesystem::path path, std::function<void(std::ofstream &, Key const &)> serializeKey, std::function<void(std::ofstream &, Value const &)> serializeValue, bool allowFork = true) const {
+            return gradylib::checkpointAsync(*this, path, [serializeKey, serializeValue](OpenHashMap const & m, std::filesystem::path const & p) {
+                m.write(p, serializeKey, serializeValue);
+            }, allowFork);
+        }
+
+        void write(std::ofstream & ofs, std::function<void(std::ofstream &, Key const &)> serializeKey, std::function<void(std::ofstream &, Value const &)> serializeValue) const {
             namespace gh = gradylib_helpers;
             ofs.write(gh::charCast(&mapSize), sizeof(size_t));
-            size_t keySize = keys.size();
-            ofs.write(gh::charCast(&keySize), sizeof(size_t));
+            uint64_t keySizeWord = keys.size() | gh::openHashMapGroupTableFlag;
+            ofs.write(gh::charCast(&keySizeWord), sizeof(size_t));
             ofs.write(gh::charCast(&loadFactor), 8);
             ofs.write(gh::charCast(&growthFactor), 8);
+
+            // The group table is filled in as the records are written and written over this placeholder at the end
+            uint64_t recordsPerGroup = gh::openHashMapRecordsPerGroup;
+            std::vector<uint64_t> groupTable(2 + (mapSize + recordsPerGroup - 1) / recordsPerGroup);
+            groupTable[0] = recordsPerGroup;
+            uint64_t groupTableOffset = ofs.tellp();
+            ofs.write(gh::charCast(groupTable.data()), groupTable.size() * 8);
+            size_t record = 0;
             for (size_t i = 0; i < keys.size(); ++i) {
                 if (setFlags.isFirstSet(i)) {
+                    if (record % recordsPerGroup == 0) {
+                        groupTable[2 + record / recordsPerGroup] = ofs.tellp();
+                    }
+                    ++record;
+
                     // Write the key/value array index of this element
                     ofs.write(gh::charCast(&i), sizeof(size_t));
 
@@ -601,7 +707,44 @@ namespace gradylib {
                 }
             }
 
+            groupTable[1] = ofs.tellp();
             setFlags.write(ofs);
+            ofs.seekp(groupTableOffset);
+            ofs.write(gh::charCast(groupTable.data()), groupTable.size() * 8);
+            ofs.seekp(0, std::ios::end);
+        }
+
+        // For files without a group table: follows the record chain through a memory mapping to find where each
+        // task's run of records starts, and where the set flags start.
+        static std::tuple<std::vector<size_t>, size_t, size_t> walkRecordChain(int fd, std::filesystem::path const & path, size_t mapSize,
+                                                                               size_t firstRecordOffset, size_t maxTasks) {
+            size_t fileSize = std::filesystem::file_size(path);
+            void * mapping = fileSize == 0 ? MAP_FAILED : mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+            if (mapping == MAP_FAILED) {
+                std::ostringstream sstr;
+                sstr << "memory map of " << path << " failed: " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            madvise(mapping, fileSize, MADV_SEQUENTIAL);
+            std::byte const * base = static_cast<std::byte const *>(mapping);
+            size_t numTasks = std::min(mapSize, maxTasks);
+            size_t recordsPerTask = numTasks == 0 ? 0 : (mapSize + numTasks - 1) / numTasks;
+            std::vector<size_t> taskStarts;
+            size_t recordOffset = firstRecordOffset;
+            for (size_t i = 0; i < mapSize; ++i) {
+                if (i % recordsPerTask == 0) {
+                    taskStarts.push_back(recordOffset);
+                }
+                if (recordOffset + 24 > fileSize) {
+                    munmap(mapping, fileSize);
+                    std::ostringstream sstr;
+                    sstr << "OpenHashMap file " << path << " is truncated";
+                    throw gradylibMakeException(sstr.str());
+                }
+                memcpy(&recordOffset, base + recordOffset + 16, 8);
+            }
+            munmap(mapping, fileSize);
+            return {std::move(taskStarts), recordsPerTask, recordOffset};
         }
 
         static OpenHashMap<Key, Value, HashFunction> read(std::ifstream & ifs, std::function<Key(std::ifstream &)> deserializeKey, std::function<Value(std::ifstream &)> deserializeValue) {
@@ -612,6 +755,13 @@ namespace gradylib {
             ifs.read(gh::charCast(&keySize), sizeof(size_t));
             ifs.read(gh::charCast(&ret.loadFactor), 8);
             ifs.read(gh::charCast(&ret.growthFactor), 8);
+            if (keySize & gh::openHashMapGroupTableFlag) {
+                // The records are read in order, so the group table is skipped
+                keySize &= ~gh::openHashMapGroupTableFlag;
+                uint64_t recordsPerGroup;
+                ifs.read(gh::charCast(&recordsPerGroup), 8);
+                ifs.seekg(8 + 8 * ((ret.mapSize + recordsPerGroup - 1) / recordsPerGroup), std::ios::cur);
+            }
             ret.keys = std::vector<Key>(keySize);
             ret.values = std::vector<Value>(keySize);
             for (size_t i = 0; i < ret.mapSize; ++i) {
@@ -636,6 +786,89 @@ namespace gradylib {
             return OpenHashMap<Key, Value, HashFunction>::read(ifs, deserializeKey, deserializeValue);
         }
 
+        /*
+         * Read a map written with write, deserializing on the thread pool.  The group table after the header says
+         * where each group of records starts, and each task deserializes a run of groups through its own ifstream.
+         * Files written without a group table have their record chain walked once through a memory mapping instead.
+         * The deserializers are called concurrently, so they must be thread safe.
+         */
+        static OpenHashMap<Key, Value, HashFunction> read(std::filesystem::path path, std::function<Key(std::ifstream &)> deserializeKey, std::function<Value(std::ifstream &)> deserializeValue, ThreadPool & tp, size_t fileOffset = 0) {
+            namespace gh = gradylib_helpers;
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                std::ostringstream sstr;
+                sstr << "Error opening file " << path;
+                throw gradylibMakeException(sstr.str());
+            }
+            OpenHashMap<Key, Value, HashFunction> ret;
+            size_t keySize;
+            std::vector<size_t> taskStarts;
+            size_t recordsPerTask = 0;
+            size_t bitPairSetOffset;
+            try {
+                uint64_t header[4];
+                gh::preadFully(fd, header, sizeof(header), fileOffset);
+                ret.mapSize = header[0];
+                keySize = header[1] & ~gh::openHashMapGroupTableFlag;
+                memcpy(&ret.loadFactor, &header[2], 8);
+                memcpy(&ret.growthFactor, &header[3], 8);
+                size_t maxTasks = 4 * std::max(1, tp.size());
+                if (header[1] & gh::openHashMapGroupTableFlag) {
+                    uint64_t tableHeader[2];
+                    gh::preadFully(fd, tableHeader, sizeof(tableHeader), fileOffset + sizeof(header));
+                    size_t recordsPerGroup = tableHeader[0];
+                    bitPairSetOffset = tableHeader[1];
+                    if (recordsPerGroup == 0) {
+                        std::ostringstream sstr;
+                        sstr << "OpenHashMap file " << path << " has a bad group table";
+                        throw gradylibMakeException(sstr.str());
+                    }
+                    size_t numGroups = (ret.mapSize + recordsPerGroup - 1) / recordsPerGroup;
+                    std::vector<uint64_t> groupStarts(numGroups);
+                    gh::preadFully(fd, groupStarts.data(), numGroups * 8, fileOffset + sizeof(header) + sizeof(tableHeader));
+                    size_t groupsPerTask = numGroups == 0 ? 0 : (numGroups + maxTasks - 1) / maxTasks;
+                    recordsPerTask = groupsPerTask * recordsPerGroup;
+                    for (size_t group = 0; group < numGroups; group += groupsPerTask) {
+                        taskStarts.push_back(groupStarts[group]);
+                    }
+                } else {
+                    std::tie(taskStarts, recordsPerTask, bitPairSetOffset) = walkRecordChain(fd, path, ret.mapSize, fileOffset + sizeof(header), maxTasks);
+                }
+            } catch (...) {
+                close(fd);
+                throw;
+            }
+            close(fd);
+
+            ret.keys = std::vector<Key>(keySize);
+            ret.values = std::vector<Value>(keySize);
+            gh::runTasks(tp, taskStarts.size(), [&](size_t task) {
+                std::ifstream ifs(path, std::ios::binary);
+                ifs.seekg(taskStarts[task]);
+                size_t end = std::min(ret.mapSize, (task + 1) * recordsPerTask);
+                for (size_t i = task * recordsPerTask; i < end; ++i) {
+                    size_t idx;
+                    ifs.read(gh::charCast(&idx), sizeof(size_t));
+                    uint64_t valueOffset, nextOffset;
+                    ifs.read(gh::charCast(&valueOffset), 8);
+                    ifs.read(gh::charCast(&nextOffset), 8);
+                    if (ifs.fail() || idx >= keySize) {
+                        std::ostringstream sstr;
+                        sstr << "Bad record in OpenHashMap file " << path;
+                        throw gradylibMakeException(sstr.str());
+                    }
+                    ret.keys[idx] = deserializeKey(ifs);
+                    ifs.seekg(valueOffset);
+                    ret.values[idx] = deserializeValue(ifs);
+                    ifs.seekg(nextOffset);
+                }
+            });
+            std::ifstream ifs(path, std::ios::binary);
+            ifs.seekg(bitPairSetOffset);
+            ret.setFlags = BitPairSet(ifs);
+            return ret;
+        }
+
 
         // This overload of parallelForEach uses the default thread pool.
         template<gradylib_helpers::Mergeable ReturnValue = OpenHashMap<Key, Value, HashFunction>,
@@ -717,12 +950,96 @@ namespace gradylib {
             return result->promise.get_future();
         }
 
+        /*
+         * The k entries that come first under compare, in order.  compare(a, b) takes two MapEntryRefs and is true
+         * when a comes before b, so comparing value() with > gives the k largest values.  Each thread keeps only a
+         * heap of k entries.  The entries refer into the map and are valid until it changes.
+         */
+        template<typename Compare>
+        std::vector<MapEntryRef<Key, Value>> topK(ThreadPool & tp, size_t k, Compare compare) const {
+            using Entry = MapEntryRef<Key, Value>;
+            using Heap = gradylib_helpers::BoundedHeap<Entry, Compare>;
+            if (mapSize == 0 || k == 0) {
+                return {};
+            }
+            auto newHeap = [k, compare](auto...) {
+                return Heap(k, compare);
+            };
+            return parallelForEach<Heap>(tp, [](Heap & heap, Key const & key, Value const & value) {
+                heap.push(Entry(&key, &value));
+            }, newHeap, newHeap).get().sorted();
+        }
+
+        template<typename Compare>
+        std::vector<MapEntryRef<Key, Value>> topK(size_t k, Compare compare) const {
+            return topK(gradylib_helpers::defaultThreadPool(), k, compare);
+        }
+
+        // Every entry, sorted by compare on the thread pool.  The entries are valid until the map changes.
+        template<typename Compare>
+        std::vector<MapEntryRef<Key, Value>> sortedEntries(ThreadPool & tp, Compare compare) const {
+            std::vector<MapEntryRef<Key, Value>> entries = entryRefs(tp);
+            gradylib_helpers::parallelSort(entries, tp, compare);
+            return entries;
+        }
+
+        template<typename Compare>
+        std::vector<MapEntryRef<Key, Value>> sortedEntries(Compare compare) const {
+            return sortedEntries(gradylib_helpers::defaultThreadPool(), compare);
+        }
+
+        // Every entry in ascending key order.  Integer keys are radix sorted.
+        std::vector<MapEntryRef<Key, Value>> sortedEntriesByKey(ThreadPool & tp) const {
+            std::vector<MapEntryRef<Key, Value>> entries = entryRefs(tp);
+            gradylib_helpers::parallelSortBy(entries, tp, [](MapEntryRef<Key, Value> const & e) -> Key const & {
+                return e.key();
+            });
+            return entries;
+        }
+
+        std::vector<MapEntryRef<Key, Value>> sortedEntriesByKey() const {
+            return sortedEntriesByKey(gradylib_helpers::defaultThreadPool());
+        }
+
+        // Every entry in ascending value order.  Integer values are radix sorted.
+        std::vector<MapEntryRef<Key, Value>> sortedEntriesByValue(ThreadPool & tp) const {
+            std::vector<MapEntryRef<Key, Value>> entries = entryRefs(tp);
+            gradylib_helpers::parallelSortBy(entries, tp, [](MapEntryRef<Key, Value> const & e) -> Value const & {
+                return e.value();
+            });
+            return entries;
+        }
+
+        std::vector<MapEntryRef<Key, Value>> sortedEntriesByValue() const {
+            return sortedEntriesByValue(gradylib_helpers::defaultThreadPool());
+        }
+
+        /*
+         * k entries drawn uniformly at random, with replacement, in O(k / load factor) time rather than a pass over
+         * the map.  See SlotSampling.hpp.  The entries are valid until the map changes.
+         */
+        template<typename UniformRandomBitGenerator>
+        std::vector<MapEntryRef<Key, Value>> sample(size_t k, UniformRandomBitGenerator & rng) const {
+            std::vector<MapEntryRef<Key, Value>> ret;
+            ret.reserve(mapSize == 0 ? 0 : k);
+            gradylib_helpers::sampleSlots(setFlags, keys.size(), mapSize, k, rng, [this](size_t j) {
+                __builtin_prefetch(&keys[j]);
+                __builtin_prefetch(&values[j]);
+            }, [&ret, this](size_t j) {
+                ret.emplace_back(&keys[j], &values[j]);
+            });
+            return ret;
+        }
+
         template<typename IndexType>
         friend void writeMappable(std::string filename, OpenHashMap<std::string, IndexType> const & m);
 
         template<typename IndexType, template<typename> typename HashFunc>
         friend void writeMappable(std::string filename, OpenHashMap<IndexType, std::string, HashFunc> const & m);
 
+        template<typename IndexType, template<typename> typename HashFunc>
+        friend void writeMappableCompressed(std::string filename, OpenHashMap<IndexType, std::string, HashFunc> const & m, size_t blockSize, size_t dictionarySize);
+
         template<typename IndexType, template<typename> typename HashFunc>
         friend void GRADY_LIB_MOCK_OpenHashMap_SET_SECOND_BITS(OpenHashMap<std::string, IndexType, HashFunc> &);
     };
@@ -781,6 +1098,13 @@ namespace gradylib {
         ofs.write(static_cast<char*>(static_cast<void*>(&valueOffset)), 8);
         ofs.seekp(bitPairSetOffsetWritePos, std::ios::beg);
         ofs.write(static_cast<char*>(static_cast<void*>(&bitPairSetOffset)), 8);
+        ofs.close();
+        if (ofs.fail()) {
+            std::ostringstream sstr;
+            sstr << "Writing " << filename << " failed in writeMappable.";
+            throw gradylibMakeException(sstr.str());
+        }
+        appendIntegrityTrailer(filename);
     }
 
     template<typename IndexType, template<typename> typename HashFunction>
@@ -826,6 +1150,68 @@ namespace gradylib {
         // Go back to the BitPairSet start position offset and write it
         ofs.seekp(bitPairSetOffsetWritePos, std::ios::beg);
         ofs.write(static_cast<char*>(static_cast<void*>(&bitPairSetOffset)), 8);
+        ofs.close();
+        if (ofs.fail()) {
+            std::ostringstream sstr;
+            sstr << "Writing " << filename << " failed in writeMappable.";
+            throw gradylibMakeException(sstr.str());
+        }
+        appendIntegrityTrailer(filename);
+    }
+
+    /*
+     * Like writeMappable, but the strings go in a block compressed section (see BlockCompressedStrings.hpp).  Load it
+     * with MMapI2SOpenHashMap as usual.  With a positive dictionarySize, a shared dictionary is trained on a sample
+     * of the strings.
+     */
+    template<typename IndexType, template<typename> typename HashFunction>
+    void writeMappableCompressed(std::string filename, OpenHashMap<IndexType, std::string, HashFunction> const & m, size_t blockSize = 8192, size_t dictionarySize = 0) {
+        std::ofstream ofs(filename, std::ios::binary);
+        if (ofs.fail()) {
+            std::ostringstream sstr;
+            sstr << "Couldn't open file " << filename << " in writeMappableCompressed.";
+            throw gradylibMakeException(sstr.str());
+        }
+        size_t mapSize = m.mapSize | gradylib_helpers::compressedStringsFlag;
+        ofs.write(static_cast<char*>(static_cast<void*>(&mapSize)), 8);
+        size_t keySize = m.keys.size();
+        ofs.write(static_cast<char*>(static_cast<void*>(&keySize)), 8);
+        size_t bitPairSetOffset = 0;
+        auto const bitPairSetOffsetWritePos = ofs.tellp();
+        ofs.write(static_cast<char*>(static_cast<void*>(&bitPairSetOffset)), 8);
+        std::string dictionary;
+        if (dictionarySize > 0) {
+            std::vector<std::string_view> samples;
+            size_t step = std::max<size_t>(1, m.mapSize / 10000);
+            for (size_t i = 0, n = 0; i < keySize; ++i) {
+                if (m.setFlags.isFirstSet(i) && n++ % step == 0) {
+                    samples.push_back(m.values[i]);
+                }
+            }
+            dictionary = BlockCompressedStringsWriter::trainDictionary(samples, dictionarySize);
+        }
+        // In place of byte offsets, each slot gets the ID of its string in the compressed section
+        BlockCompressedStringsWriter writer(blockSize, std::move(dictionary));
+        for (size_t i = 0; i < keySize; ++i) {
+            size_t stringId = m.setFlags.isFirstSet(i) ? writer.add(m.values[i]) : 0;
+            ofs.write(static_cast<char*>(static_cast<void*>(&stringId)), 8);
+        }
+        ofs.write(static_cast<char*>(const_cast<void*>(static_cast<void const *>(m.keys.data()))), sizeof(IndexType) * keySize);
+        gradylib_helpers::writePad<8>(ofs);
+        writer.write(ofs);
+
+        bitPairSetOffset = ofs.tellp();
+        m.setFlags.write(ofs);
+
+        ofs.seekp(bitPairSetOffsetWritePos, std::ios::beg);
+        ofs.write(static_cast<char*>(static_cast<void*>(&bitPairSetOffset)), 8);
+        ofs.close();
+        if (ofs.fail()) {
+            std::ostringstream sstr;
+            sstr << "Writing " << filename << " failed in writeMappableCompressed.";
+            throw gradylibMakeException(sstr.str());
+        }
+        appendIntegrityTrailer(filename);
     }
 
     // The following is for testing.
@@ -28,18 +28,100 @@ SOFTWARE.
 #include<sys/mman.h>
 #include<unistd.h>
 
+#include<array>
+#include<cstring>
 #include<filesystem>
 #include<fstream>
+#include<future>
 #include<memory>
 #include<type_traits>
+#include<utility>
 #include<vector>
 
 #include"AltIntHash.hpp"
 #include"BitPairSet.hpp"
+#include"Checkpoint.hpp"
 #include"Common.hpp"
+#include"CopyOnWriteStorage.hpp"
+#include"Integrity.hpp"
+#include"ParallelRead.hpp"
+#include"ParallelSort.hpp"
+#include"ParallelTraversals.hpp"
+#include"SlotSampling.hpp"
+#include"ThreadPool.hpp"
+
+namespace gradylib_helpers {
+
+    /*
+     * The header of an OpenHashMapTC file, which may be embedded in a bigger file.  Offsets are relative to the start
+     * of the header.
+     *     mapSize, keySize, loadFactor, growthFactor, valueOffset, bitPairSetOffset    (8 bytes each)
+     *     hashSeed                                                                     (8 bytes, see hashSeedHeaderFlag)
+     *     keys
+     * Files written before hash seeds have no seed word, so their keys start at byte 48 instead of 56.
+     */
+    struct OpenHashMapTCHeader {
+        static constexpr size_t unseededSize = 48;
+        static constexpr size_t seededSize = 56;
+
+        size_t mapSize = 0;
+        size_t keySize = 0;
+        double loadFactor = 0;
+        double growthFactor = 0;
+        size_t valueOffset = 0;
+        size_t bitPairSetOffset = 0;
+        uint64_t hashSeed = 0;
+        // Where the keys start
+        size_t size = unseededSize;
+
+        // Reads unseededSize bytes, plus the seed after them if the keySize word is flagged.
+        explicit OpenHashMapTCHeader(void const * header) {
+            uint64_t words[6];
+            memcpy(words, header, sizeof(words));
+            mapSize = words[0];
+            keySize = words[1] & ~hashSeedHeaderFlag;
+            memcpy(&loadFactor, &words[2], 8);
+            memcpy(&growthFactor, &words[3], 8);
+            valueOffset = words[4];
+            bitPairSetOffset = words[5];
+            if (words[1] & hashSeedHeaderFlag) {
+                size = seededSize;
+                memcpy(&hashSeed, static_cast<std::byte const *>(header) + unseededSize, 8);
+            }
+        }
+
+        // How many bytes the header starting with these unseededSize bytes takes.
+        static size_t sizeOf(void const * header) {
+            uint64_t keySizeWord;
+            memcpy(&keySizeWord, static_cast<std::byte const *>(header) + 8, 8);
+            return keySizeWord & hashSeedHeaderFlag ? seededSize : unseededSize;
+        }
+    };
+
+    // Checks that the header at the start of mapping fits in mappingSize bytes, then reads it.
+    inline OpenHashMapTCHeader checkMappedOpenHashMapTCHeader(void const * mapping, size_t mappingSize, char const * what) {
+        checkMappedExtent(OpenHashMapTCHeader::unseededSize, mappingSize, what);
+        checkMappedExtent(OpenHashMapTCHeader::sizeOf(mapping), mappingSize, what);
+        return OpenHashMapTCHeader(mapping);
+    }
+}
 
 namespace gradylib {
 
+    template<typename Key, typename Value, template<typename> typename HashFunction>
+    requires std::is_trivially_copyable_v<Key> &&
+             std::is_trivially_copyable_v<Value> &&
+             std::is_default_constructible_v<Key> &&
+             std::is_default_constructible_v<Value>
+    class OpenHashMapTC;
+
+    template<typename Key, typename Value, template<typename> typename HashFunction>
+    void mergePartials(OpenHashMapTC<Key, Value, HashFunction> & m1, OpenHashMapTC<Key, Value, HashFunction> const & m2) {
+        for (auto const & [key, value] : m2) {
+            m1.put(key, value);
+        }
+    }
+
     template<typename Key, typename Value, template<typename> typename HashFunction = gradylib::AltHash>
     requires std::is_trivially_copyable_v<Key> &&
              std::is_trivially_copyable_v<Value> &&
@@ -56,10 +138,62 @@ namespace gradylib {
         void const * memoryMapping = nullptr;
         size_t mappingSize = 0;
         HashFunction<Key> hashFunction = HashFunction<Key>{};
+        // See gradylib_helpers::probeLimit.  reseedKeySize is the table size of the last reseed, which happens at
+        // most once per table size.
+        uint64_t hashSeed = 0;
+        size_t reseedKeySize = 0;
+        // See setMinLoadFactor
+        double minLoadFactor = 0;
         BitPairSet setFlags;
         bool readOnly = false;
+        // Set when the slot arrays live in copy-on-write storage, see enableCopyOnWrite.  copyMapping is this map's
+        // private mapping when it is a copy, and null in the map that owns the storage.
+        std::shared_ptr<gradylib_helpers::CopyOnWriteStorage> cowStorage;
+        std::byte * copyMapping = nullptr;
+        // Set for a mapping opened with IntegrityCheck::lazy
+        std::unique_ptr<IntegrityVerifier> lazyVerifier;
         static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
 
+        // With IntegrityCheck::lazy, verifies the sections holding slot idx before a lookup reads it.
+        void checkSlot(size_t idx) const {
+            if (lazyVerifier) {
+                std::byte const * base = static_cast<std::byte const *>(memoryMapping);
+                lazyVerifier->verifyRange(static_cast<std::byte const *>(setFlags.wordOf(idx)) - base, sizeof(uint32_t));
+                lazyVerifier->verifyRange(static_cast<std::byte const *>(static_cast<void const *>(&keys[idx])) - base, sizeof(Key));
+                lazyVerifier->verifyRange(static_cast<std::byte const *>(static_cast<void const *>(&values[idx])) - base, sizeof(Value));
+            }
+        }
+
+        // Traversals read every slot, so they verify the sections left unverified first.  The overload without a
+        // pool verifies on the calling thread, which may itself be a pool task.
+        void checkAllSlots(ThreadPool & tp) const {
+            if (lazyVerifier) {
+                lazyVerifier->verifyAll(tp);
+            }
+        }
+
+        void checkAllSlots() const {
+            if (lazyVerifier) {
+                for (size_t section = 0; section < lazyVerifier->numSections(); ++section) {
+                    lazyVerifier->verifySection(section);
+                }
+            }
+        }
+
+        // One MapEntryRef per entry, in slot order.
+        std::vector<MapEntryRef<Key, Value>> entryRefs(ThreadPool & tp) const {
+            checkAllSlots(tp);
+            return gradylib_helpers::collectSlots<MapEntryRef<Key, Value>>(tp, keySize, mapSize, [this](size_t j) {
+                return setFlags.isFirstSet(j);
+            }, [this](size_t j) {
+                return MapEntryRef<Key, Value>(&keys[j], &values[j]);
+            });
+        }
+
+        size_t hashOf(Key const & key) const {
+            return gradylib_helpers::seededHash(hashFunction, key, hashSeed);
+        }
+
         void rehash(size_t size = 0) {
             size_t newSize;
             if (size > 0) {
@@ -70,80 +204,196 @@ namespace gradylib {
             } else {
                 newSize = std::max<size_t>(keySize + 1, std::max<size_t>(1, keySize) * growthFactor);
             }
-            Key * newKeys = new Key[newSize];
-            Value * newValues = new Value[newSize]{};
-            BitPairSet newSetFlags(newSize);
-            for (size_t i = 0; i < keySize; ++i) {
-                if (!setFlags.isFirstSet(i)) {
-                    continue;
-                }
-                Key const &k = keys[i];
-                size_t hash = hashFunction(k);
-                size_t idx = hash % newSize;
-                while (newSetFlags.isFirstSet(idx)) {
-                    ++idx;
-                    idx = idx == newSize ? 0 : idx;
+            rebuild(newSize);
+        }
+
+        // An insert probed past the limit, so rebuild at the same size with the next seed.
+        void reseed() {
+            hashSeed = gradylib_helpers::nextHashSeed(hashSeed);
+            reseedKeySize = keySize;
+            rebuild(keySize);
+        }
+
+        bool shouldReseed(size_t probes) const {
+            return probes > gradylib_helpers::probeLimit(keySize, loadFactor) && reseedKeySize != keySize;
+        }
+
+        // Big tables are rebuilt on tp when one is given.  See gradylib_helpers::rebuildSlots.
+        void rebuild(size_t newSize, ThreadPool * tp = nullptr) {
+            std::shared_ptr<gradylib_helpers::CopyOnWriteStorage> newStorage;
+            Key * newKeys;
+            Value * newValues;
+            BitPairSet newSetFlags;
+            if (cowStorage) {
+                newStorage = makeCopyOnWriteStorage(newSize);
+                pointAt(newStorage->data(), newSize, newKeys, newValues, newSetFlags);
+            } else {
+                newKeys = new Key[newSize];
+                newValues = new Value[newSize]{};
+                newSetFlags = BitPairSet(newSize);
+            }
+            if (tp && newSize >= gradylib_helpers::parallelRebuildSlots) {
+                gradylib_helpers::rebuildSlots(*tp, keySize, newSize, [this](size_t j) {
+                    return setFlags.isFirstSet(j);
+                }, [this, newSize](size_t j) {
+                    return hashOf(keys[j]) % newSize;
+                }, [&newSetFlags](size_t idx) {
+                    return newSetFlags.isFirstSet(idx);
+                }, [&](size_t j, size_t idx) {
+                    newSetFlags.setBoth(idx);
+                    newKeys[idx] = keys[j];
+                    newValues[idx] = values[j];
+                });
+            } else {
+                for (size_t i = 0; i < keySize; ++i) {
+                    if (!setFlags.isFirstSet(i)) {
+                        continue;
+                    }
+                    Key const &k = keys[i];
+                    size_t hash = hashOf(k);
+                    size_t idx = hash % newSize;
+                    while (newSetFlags.isFirstSet(idx)) {
+                        ++idx;
+                        idx = idx == newSize ? 0 : idx;
+                    }
+                    newSetFlags.setBoth(idx);
+                    newKeys[idx] = k;
+                    newValues[idx] = values[i];
                 }
-                newSetFlags.setBoth(idx);
-                newKeys[idx] = k;
-                newValues[idx] = values[i];
             }
-            delete [] keys;
+            releaseSlots();
             keys = newKeys;
             keySize = newSize;
-            delete [] values;
             values = newValues;
             std::swap(setFlags, newSetFlags);
+            cowStorage = std::move(newStorage);
         }
 
-        void setFromMemoryMapping(void const * startPtr) {
-            readOnly = true;
-            std::byte const *ptr = static_cast<std::byte const *>(startPtr);
-            std::byte const *base = ptr;
-            mapSize = *static_cast<size_t const *>(static_cast<void const *>(ptr));
-            ptr += 8;
-            keySize = *static_cast<size_t const *>(static_cast<void const *>(ptr));
-            ptr += 8;
-            loadFactor = *static_cast<double const *>(static_cast<void const *>(ptr));
-            ptr += 8;
-            growthFactor = *static_cast<double const *>(static_cast<void const *>(ptr));
-            ptr += 8;
-            size_t valueOffset = *static_cast<size_t const *>(static_cast<void const *>(ptr));
-            ptr += 8;
-            size_t bitPairSetOffset = *static_cast<size_t const *>(static_cast<void const *>(ptr));
-            ptr += 8;
-            keys = static_cast<Key *>(const_cast<void *>(static_cast<void const *>(ptr)));
-            ptr = base + valueOffset;
-            values = static_cast<Value *>(const_cast<void *>(static_cast<void const *>(ptr)));
-            ptr = base + bitPairSetOffset;
-            setFlags = BitPairSet(ptr);
+        // Where the values and set flags start in copy-on-write storage for n slots, and its size.
+        static std::array<size_t, 3> copyOnWriteLayout(size_t n) {
+            size_t valuesOffset = (sizeof(Key) * n + 63) / 64 * 64;
+            size_t setFlagsOffset = (valuesOffset + sizeof(Value) * n + 63) / 64 * 64;
+            return {valuesOffset, setFlagsOffset, setFlagsOffset + BitPairSet::storageBytes(n)};
         }
 
-    public:
-        typedef Key key_type;
-        typedef Value mapped_type;
+        static std::shared_ptr<gradylib_helpers::CopyOnWriteStorage> makeCopyOnWriteStorage(size_t n) {
+            auto storage = std::make_shared<gradylib_helpers::CopyOnWriteStorage>(copyOnWriteLayout(n)[2]);
+            if constexpr (!std::is_trivially_default_constructible_v<Value>) {
+                // new Value[n]{} would run the constructor.  The storage starts out as zeros.
+                Value * v = static_cast<Value *>(static_cast<void *>(storage->data() + copyOnWriteLayout(n)[0]));
+                std::uninitialized_value_construct_n(v, n);
+            }
+            return storage;
+        }
 
-        OpenHashMapTC() = default;
+        static void pointAt(std::byte * base, size_t n, Key * & k, Value * & v, BitPairSet & flags) {
+            auto [valuesOffset, setFlagsOffset, size] = copyOnWriteLayout(n);
+            k = static_cast<Key *>(static_cast<void *>(base));
+            v = static_cast<Value *>(static_cast<void *>(base + valuesOffset));
+            flags = BitPairSet::borrow(base + setFlagsOffset, n);
+        }
 
-        OpenHashMapTC(OpenHashMapTC const & m) {
+        // Frees or unmaps the slot arrays, whatever holds them.
+        void releaseSlots() {
+            if (cowStorage) {
+                if (copyMapping) {
+                    cowStorage->unmapCopy(copyMapping);
+                } else {
+                    cowStorage->release();
+                }
+                cowStorage.reset();
+                copyMapping = nullptr;
+            } else if (memoryMapping) {
+                munmap(const_cast<void *>(memoryMapping), mappingSize);
+                close(fd);
+                memoryMapping = nullptr;
+                fd = -1;
+            } else if (!readOnly) {
+                delete [] keys;
+                delete [] values;
+            }
+            keys = nullptr;
+            values = nullptr;
+        }
+
+        // Live copies of a copy-on-write map keep what [p, p + length) holds now.  See CopyOnWriteStorage.hpp.
+        void beforeWrite(void const * p, size_t length) {
+            if (cowStorage && !copyMapping) {
+                cowStorage->beforeWrite(p, length);
+            }
+        }
+
+        void beforeSlotWrite(size_t idx) {
+            beforeWrite(setFlags.wordOf(idx), sizeof(uint32_t));
+            beforeWrite(&keys[idx], sizeof(Key));
+            beforeWrite(&values[idx], sizeof(Value));
+        }
+
+        void copyFrom(OpenHashMapTC const & m) {
+            keySize = m.keySize;
+            mapSize = m.mapSize;
+            loadFactor = m.loadFactor;
+            growthFactor = m.growthFactor;
+            hashSeed = m.hashSeed;
+            reseedKeySize = m.reseedKeySize;
+            minLoadFactor = m.minLoadFactor;
+            readOnly = false;
+            if (m.cowStorage && !m.copyMapping) {
+                copyMapping = m.cowStorage->mapCopy();
+                cowStorage = m.cowStorage;
+                pointAt(copyMapping, keySize, keys, values, setFlags);
+                return;
+            }
+            if (m.cowStorage) {
+                // A copy of a copy has nothing to share, so it gets storage of its own.
+                std::shared_ptr<gradylib_helpers::CopyOnWriteStorage> storage = makeCopyOnWriteStorage(keySize);
+                pointAt(storage->data(), keySize, keys, values, setFlags);
+                memcpy(storage->data(), m.keys, copyOnWriteLayout(keySize)[2]);
+                cowStorage = std::move(storage);
+                return;
+            }
+            m.checkAllSlots();
             BitPairSet tmpSetFlags = m.setFlags;
             std::unique_ptr<Key[]> tmpKeys(new Key[m.keySize]);
             values = new Value[m.keySize];
             keys = tmpKeys.release();
             std::swap(setFlags, tmpSetFlags);
-            keySize = m.keySize;
-            mapSize = m.mapSize;
-            loadFactor = m.loadFactor;
-            growthFactor = m.growthFactor;
             memcpy(keys, m.keys, sizeof(Key) * keySize);
             memcpy(values, m.values, sizeof(Value) * keySize);
         }
 
+        void setFromMemoryMapping(void const * startPtr) {
+            readOnly = true;
+            std::byte const * base = static_cast<std::byte const *>(startPtr);
+            gradylib_helpers::OpenHashMapTCHeader header(startPtr);
+            mapSize = header.mapSize;
+            keySize = header.keySize;
+            loadFactor = header.loadFactor;
+            growthFactor = header.growthFactor;
+            hashSeed = header.hashSeed;
+            keys = static_cast<Key *>(const_cast<void *>(static_cast<void const *>(base + header.size)));
+            values = static_cast<Value *>(const_cast<void *>(static_cast<void const *>(base + header.valueOffset)));
+            setFlags = BitPairSet(base + header.bitPairSetOffset);
+        }
+
+    public:
+        typedef Key key_type;
+        typedef Value mapped_type;
+
+        OpenHashMapTC() = default;
+
+        // O(1) when m is copy-on-write, see enableCopyOnWrite.  Otherwise the arrays are copied.
+        OpenHashMapTC(OpenHashMapTC const & m) {
+            copyFrom(m);
+        }
+
         OpenHashMapTC(OpenHashMapTC && m) noexcept
             : keys(m.keys), values(m.values), keySize(m.keySize), mapSize(m.mapSize),
             loadFactor(m.loadFactor), growthFactor(m.growthFactor), fd(m.fd),
-            memoryMapping(m.memoryMapping), mappingSize(m.mappingSize), setFlags(std::move(m.setFlags)),
-            readOnly(m.readOnly)
+            memoryMapping(m.memoryMapping), mappingSize(m.mappingSize), hashSeed(m.hashSeed),
+            reseedKeySize(m.reseedKeySize), minLoadFactor(m.minLoadFactor), setFlags(std::move(m.setFlags)),
+            readOnly(m.readOnly), cowStorage(std::move(m.cowStorage)), copyMapping(m.copyMapping),
+            lazyVerifier(std::move(m.lazyVerifier))
         {
             m.keys = nullptr;
             m.values = nullptr;
@@ -153,23 +403,15 @@ namespace gradylib {
             m.memoryMapping = nullptr;
             m.mappingSize = 0;
             m.readOnly = false;
+            m.copyMapping = nullptr;
         }
 
         OpenHashMapTC & operator=(OpenHashMapTC const & m) {
             if (this == &m) {
                 return *this;
             }
-            BitPairSet tmpSetFlags = m.setFlags;
-            std::unique_ptr<Key[]> tmpKeys(new Key[m.keySize]);
-            values = new Value[m.keySize];
-            keys = tmpKeys.release();
-            std::swap(setFlags, tmpSetFlags);
-            keySize = m.keySize;
-            mapSize = m.mapSize;
-            loadFactor = m.loadFactor;
-            growthFactor = m.growthFactor;
-            memcpy(keys, m.keys, sizeof(Key) * keySize);
-            memcpy(values, m.values, sizeof(Value) * keySize);
+            releaseSlots();
+            copyFrom(m);
             return *this;
         }
 
@@ -177,17 +419,24 @@ namespace gradylib {
             if (this == &m) {
                 return *this;
             }
+            releaseSlots();
             keys = m.keys;
             values = m.values;
             keySize = m.keySize;
             mapSize = m.mapSize;
             loadFactor = m.loadFactor;
             growthFactor = m.growthFactor;
+            hashSeed = m.hashSeed;
+            reseedKeySize = m.reseedKeySize;
+            minLoadFactor = m.minLoadFactor;
             fd = m.fd;
             memoryMapping = m.memoryMapping;
             mappingSize = m.mappingSize;
             setFlags = std::move(m.setFlags);
             readOnly = m.readOnly;
+            cowStorage = std::move(m.cowStorage);
+            copyMapping = m.copyMapping;
+            lazyVerifier = std::move(m.lazyVerifier);
             m.keys = nullptr;
             m.values = nullptr;
             m.keySize = 0;
@@ -196,20 +445,38 @@ namespace gradylib {
             m.memoryMapping = nullptr;
             m.mappingSize = 0;
             m.readOnly = false;
+            m.copyMapping = nullptr;
             return *this;
         }
 
         ~OpenHashMapTC() {
-            if (memoryMapping) {
-                munmap(const_cast<void *>(memoryMapping), mappingSize);
-                close(fd);
-            } else if (!readOnly) {
-                delete [] keys;
-                delete [] values;
-            }
+            releaseSlots();
+        }
+
+        /*
+         * Checks that the header, the key and value arrays and the set flags of a map written with write at the
+         * start of mapping fit in mappingSize bytes.  Readers of formats that embed a map call this before viewing it.
+         */
+        static void checkMapping(void const * mapping, size_t mappingSize, char const * what) {
+            namespace gh = gradylib_helpers;
+            gh::OpenHashMapTCHeader header = gh::checkMappedOpenHashMapTCHeader(mapping, mappingSize, what);
+            size_t keySize = header.keySize;
+            size_t valueOffset = header.valueOffset;
+            gh::checkMappedExtent(keySize > mappingSize ? SIZE_MAX : header.size + keySize * sizeof(Key), mappingSize, what);
+            gh::checkMappedExtent(keySize > mappingSize || valueOffset > mappingSize ? SIZE_MAX : valueOffset + keySize * sizeof(Value),
+                                  mappingSize, what);
+            gh::checkMappedBitPairSet(mapping, header.bitPairSetOffset, mappingSize, what);
+        }
+
+        // If verify is true, the file's integrity trailer is checked in parallel before the constructor returns.
+        explicit OpenHashMapTC(std::filesystem::path filename, bool verify = false)
+            : OpenHashMapTC(filename, verify ? IntegrityCheck::eager : IntegrityCheck::none)
+        {
         }
 
-        explicit OpenHashMapTC(std::filesystem::path filename) {
+        // With IntegrityCheck::lazy, lookups verify each section of the file the first time they read from it, and
+        // traversals and copies verify whatever is left first.
+        OpenHashMapTC(std::filesystem::path filename, IntegrityCheck check) {
             fd = open(filename.c_str(), O_RDONLY);
             if (fd < 0) {
                 std::ostringstream ostr;
@@ -219,31 +486,111 @@ namespace gradylib {
             mappingSize = std::filesystem::file_size(filename);
             memoryMapping = mmapFunc(0, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
             if (memoryMapping == MAP_FAILED) {
+                close(fd);
                 std::ostringstream sstr;
                 sstr << "memory map failed: " << strerror(errno);
                 throw gradylibMakeException(sstr.str());
             }
+            try {
+                if (check == IntegrityCheck::eager) {
+                    IntegrityVerifier(memoryMapping, mappingSize).verifyAll();
+                } else if (check == IntegrityCheck::lazy) {
+                    lazyVerifier = std::make_unique<IntegrityVerifier>(memoryMapping, mappingSize);
+                    lazyVerifier->verifyRange(0, gradylib_helpers::OpenHashMapTCHeader::seededSize);
+                }
+                gradylib_helpers::checkMappedExtent(gradylib_helpers::OpenHashMapTCHeader::unseededSize, mappingSize, "OpenHashMapTC");
+                size_t bitPairSetOffset;
+                memcpy(&bitPairSetOffset, static_cast<std::byte const *>(memoryMapping) + 40, 8);
+                if (lazyVerifier) {
+                    lazyVerifier->verifyRange(bitPairSetOffset, 8);
+                }
+                checkMapping(memoryMapping, mappingSize, "OpenHashMapTC");
+            } catch (...) {
+                munmap(const_cast<void *>(memoryMapping), mappingSize);
+                close(fd);
+                memoryMapping = nullptr;
+                fd = -1;
+                throw;
+            }
             setFromMemoryMapping(memoryMapping);
         }
 
         explicit OpenHashMapTC(std::ifstream & ifs) {
-            ifs.read(static_cast<char*>(static_cast<void*>(&mapSize)), sizeof(mapSize));
-            ifs.read(static_cast<char*>(static_cast<void*>(&keySize)), sizeof(keySize));
-            ifs.read(static_cast<char*>(static_cast<void*>(&loadFactor)), sizeof(loadFactor));
-            ifs.read(static_cast<char*>(static_cast<void*>(&growthFactor)), sizeof(growthFactor));
-            size_t valueOffset;
-            ifs.read(static_cast<char*>(static_cast<void*>(&valueOffset)), sizeof(valueOffset));
-            size_t bitPairSetOffset;
-            ifs.read(static_cast<char*>(static_cast<void*>(&bitPairSetOffset)), sizeof(bitPairSetOffset));
+            // The offsets in the header are relative to the start of the map
+            size_t startOffset = ifs.tellg();
+            std::byte headerBytes[gradylib_helpers::OpenHashMapTCHeader::seededSize];
+            ifs.read(static_cast<char*>(static_cast<void*>(headerBytes)), gradylib_helpers::OpenHashMapTCHeader::unseededSize);
+            size_t headerSize = gradylib_helpers::OpenHashMapTCHeader::sizeOf(headerBytes);
+            ifs.read(static_cast<char*>(static_cast<void*>(headerBytes + gradylib_helpers::OpenHashMapTCHeader::unseededSize)),
+                     headerSize - gradylib_helpers::OpenHashMapTCHeader::unseededSize);
+            gradylib_helpers::OpenHashMapTCHeader header(headerBytes);
+            mapSize = header.mapSize;
+            keySize = header.keySize;
+            loadFactor = header.loadFactor;
+            growthFactor = header.growthFactor;
+            hashSeed = header.hashSeed;
+            size_t valueOffset = header.valueOffset;
+            size_t bitPairSetOffset = header.bitPairSetOffset;
             keys = new Key[keySize];
             ifs.read(static_cast<char*>(static_cast<void*>(keys)), sizeof(Key) * keySize);
             values = new Value[keySize];
-            ifs.seekg(valueOffset);
+            ifs.seekg(startOffset + valueOffset);
             ifs.read(static_cast<char*>(static_cast<void*>(values)), sizeof(Value) * keySize);
-            ifs.seekg(bitPairSetOffset);
+            ifs.seekg(startOffset + bitPairSetOffset);
             setFlags = BitPairSet(ifs);
         }
 
+        /*
+         * Load a modifiable copy of a map written with write, starting at fileOffset in the file.  The key and value
+         * arrays are read with large preads spread over the thread pool, which keeps a fast drive busy where the
+         * ifstream constructor can't.
+         */
+        static OpenHashMapTC read(std::filesystem::path filename, ThreadPool & tp, size_t fileOffset = 0) {
+            namespace gh = gradylib_helpers;
+            int readFd = open(filename.c_str(), O_RDONLY);
+            if (readFd < 0) {
+                std::ostringstream sstr;
+                sstr << "Error opening file " << filename;
+                throw gradylibMakeException(sstr.str());
+            }
+            OpenHashMapTC ret;
+            try {
+                std::byte headerBytes[gh::OpenHashMapTCHeader::seededSize];
+                gh::preadFully(readFd, headerBytes, gh::OpenHashMapTCHeader::unseededSize, fileOffset);
+                size_t headerSize = gh::OpenHashMapTCHeader::sizeOf(headerBytes);
+                gh::preadFully(readFd, headerBytes + gh::OpenHashMapTCHeader::unseededSize,
+                               headerSize - gh::OpenHashMapTCHeader::unseededSize, fileOffset + gh::OpenHashMapTCHeader::unseededSize);
+                gh::OpenHashMapTCHeader header(headerBytes);
+                ret.mapSize = header.mapSize;
+                ret.keySize = header.keySize;
+                ret.loadFactor = header.loadFactor;
+                ret.growthFactor = header.growthFactor;
+                size_t valueOffset = header.valueOffset;
+                size_t bitPairSetOffset = header.bitPairSetOffset;
+                ret.hashSeed = header.hashSeed;
+                ret.keys = new Key[ret.keySize];
+                ret.values = new Value[ret.keySize];
+                gh::parallelPread(readFd, ret.keys, sizeof(Key) * ret.keySize, fileOffset + header.size, tp);
+                gh::parallelPread(readFd, ret.values, sizeof(Value) * ret.keySize, fileOffset + valueOffset, tp);
+                size_t setSize;
+                gh::preadFully(readFd, &setSize, 8, fileOffset + bitPairSetOffset);
+                std::vector<std::byte> setFlagsBuffer(8 + (setSize + 15) / 16 * 4);
+                gh::parallelPread(readFd, setFlagsBuffer.data(), setFlagsBuffer.size(), fileOffset + bitPairSetOffset, tp);
+                // Copying the view gives the map its own BitPairSet
+                BitPairSet view(static_cast<void const *>(setFlagsBuffer.data()));
+                ret.setFlags = BitPairSet(view);
+            } catch (...) {
+                close(readFd);
+                throw;
+            }
+            close(readFd);
+            return ret;
+        }
+
+        static OpenHashMapTC read(std::filesystem::path filename, size_t fileOffset = 0) {
+            return read(filename, gradylib_helpers::defaultThreadPool(), fileOffset);
+        }
+
         explicit OpenHashMapTC(char const * startPtr)
             : OpenHashMapTC(std::string(startPtr))
         {
@@ -259,13 +606,14 @@ namespace gradylib {
                 sstr << "Cannot modify mmap";
                 throw gradylibMakeException(sstr.str());
             }
-            size_t hash;
-            size_t idx;
-            size_t startIdx;
+            size_t hash = 0;
+            size_t idx = 0;
+            size_t startIdx = idx;
             size_t firstUnsetIdx = -1;
             bool isFirstUnsetIdxSet = false;
+            size_t probes = 0;
             if (keySize > 0) {
-                hash = hashFunction(key);
+                hash = hashOf(key);
                 idx = hash % keySize;
                 startIdx = idx;
                 for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
@@ -274,19 +622,26 @@ namespace gradylib {
                         isFirstUnsetIdxSet = true;
                     }
                     if (isSet && keys[idx] == key) {
+                        beforeWrite(&values[idx], sizeof(Value));
                         return values[idx];
                     }
                     if (wasSet && keys[idx] == key) {
                         break;
                     }
                     ++idx;
+                    ++probes;
                     idx = idx == keySize ? 0 : idx;
                     if (startIdx == idx) break;
                 }
             }
-            if (mapSize >= keySize * loadFactor) {
-                rehash();
-                hash = hashFunction(key);
+            bool grow = mapSize >= keySize * loadFactor;
+            if (grow || shouldReseed(probes)) {
+                if (grow) {
+                    rehash();
+                } else {
+                    reseed();
+                }
+                hash = hashOf(key);
                 idx = hash % keySize;
                 startIdx = idx;
                 while (setFlags.isFirstSet(idx)) {
@@ -297,6 +652,7 @@ namespace gradylib {
             } else {
                 idx = isFirstUnsetIdxSet ? firstUnsetIdx : idx;
             }
+            beforeSlotWrite(idx);
             setFlags.setBoth(idx);
             keys[idx] = key;
             ++mapSize;
@@ -315,15 +671,18 @@ namespace gradylib {
             size_t firstUnsetIdx = -1;
             bool isFirstUnsetIdxSet = false;
             size_t startIdx = idx;
+            size_t probes = 0;
             if (keySize > 0) {
-                hash = hashFunction(key);
+                hash = hashOf(key);
                 idx = hash % keySize;
+                startIdx = idx;
                 for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
                     if (!isFirstUnsetIdxSet && !isSet) {
                         firstUnsetIdx = idx;
                         isFirstUnsetIdxSet = true;
                     }
                     if (isSet && keys[idx] == key) {
+                        beforeWrite(&values[idx], sizeof(Value));
                         values[idx] = value;
                         doesContain = true;
                         break;
@@ -333,6 +692,7 @@ namespace gradylib {
                         break;
                     }
                     ++idx;
+                    ++probes;
                     idx = idx == keySize ? 0 : idx;
                     if (startIdx == idx) break;
                 }
@@ -340,9 +700,14 @@ namespace gradylib {
             if (doesContain) {
                 return;
             }
-            if (mapSize >= keySize * loadFactor) {
-                rehash();
-                hash = hashFunction(key);
+            bool grow = mapSize >= keySize * loadFactor;
+            if (grow || shouldReseed(probes)) {
+                if (grow) {
+                    rehash();
+                } else {
+                    reseed();
+                }
+                hash = hashOf(key);
                 idx = hash % keySize;
                 startIdx = idx;
                 while (setFlags.isFirstSet(idx)) {
@@ -353,25 +718,29 @@ namespace gradylib {
             } else {
                 idx = isFirstUnsetIdxSet ? firstUnsetIdx : idx;
             }
+            beforeSlotWrite(idx);
             setFlags.setBoth(idx);
             keys[idx] = key;
             values[idx] = value;
             ++mapSize;
         }
 
-        Value const & at(Key const &key) const {
-            return const_cast<OpenHashMapTC *>(this)->at(key);
+        Value & at(Key const &key) {
+            Value & value = const_cast<Value &>(std::as_const(*this).at(key));
+            beforeWrite(&value, sizeof(Value));
+            return value;
         }
 
-        Value & at(Key const &key) {
+        Value const & at(Key const &key) const {
             if (keySize == 0) {
                 std::ostringstream sstr;
                 sstr << "key not found in map";
                 throw gradylibMakeException(sstr.str());
             }
-            size_t hash = hashFunction(key);
+            size_t hash = hashOf(key);
             size_t idx = hash % keySize;
             size_t startIdx = idx;
+            checkSlot(idx);
             for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
                 if (isSet && keys[idx] == key) {
                     return values[idx];
@@ -384,6 +753,7 @@ namespace gradylib {
                 ++idx;
                 idx = idx == keySize ? 0 : idx;
                 if (startIdx == idx) break;
+                checkSlot(idx);
             }
             std::ostringstream sstr;
             sstr << "key not found in map";
@@ -391,38 +761,46 @@ namespace gradylib {
         }
 
         gradylib_helpers::MapLookup<Value> get(Key const &key) {
-            if (keySize == 0) {
+            gradylib_helpers::MapLookup<Value const> found = std::as_const(*this).get(key);
+            if (!found.has_value()) {
                 return gradylib_helpers::MapLookup<Value>();
             }
-            size_t hash = hashFunction(key);
+            Value & value = const_cast<Value &>(found.value());
+            beforeWrite(&value, sizeof(Value));
+            return gradylib_helpers::MapLookup<Value>(&value);
+        }
+
+        gradylib_helpers::MapLookup<Value const> get(Key const &key) const {
+            if (keySize == 0) {
+                return gradylib_helpers::MapLookup<Value const>();
+            }
+            size_t hash = hashOf(key);
             size_t idx = hash % keySize;
             size_t startIdx = idx;
+            checkSlot(idx);
             for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
                 if (isSet && keys[idx] == key) {
-                    return gradylib_helpers::MapLookup<Value>(&values[idx]);
+                    return gradylib_helpers::MapLookup<Value const>(&values[idx]);
                 }
                 if (wasSet && keys[idx] == key) {
-                    return gradylib_helpers::MapLookup<Value>();
+                    return gradylib_helpers::MapLookup<Value const>();
                 }
                 ++idx;
                 idx = idx == keySize ? 0 : idx;
                 if (startIdx == idx) break;
+                checkSlot(idx);
             }
-            return gradylib_helpers::MapLookup<Value>();
-        }
-
-        gradylib_helpers::MapLookup<Value const> get(Key const &key) const {
-            OpenHashMapTC<Key, Value, HashFunction> * p = const_cast<OpenHashMapTC<Key, Value, HashFunction> *>(this);
-            return p->get(key).makeConst();
+            return gradylib_helpers::MapLookup<Value const>();
         }
 
         bool contains(Key const &key) const {
             if (mapSize == 0) {
                 return false;
             }
-            size_t hash = hashFunction(key);
+            size_t hash = hashOf(key);
             size_t idx = hash % keySize;
             size_t startIdx = idx;
+            checkSlot(idx);
             for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
                 if (isSet && keys[idx] == key) {
                     return true;
@@ -433,6 +811,7 @@ namespace gradylib {
                 ++idx;
                 idx = idx == keySize ? 0 : idx;
                 if (startIdx == idx) break;
+                checkSlot(idx);
             }
             return false;
         }
@@ -443,14 +822,18 @@ namespace gradylib {
                 sstr << "Cannot modify mmap";
                 throw gradylibMakeException(sstr.str());
             }
-            size_t hash = hashFunction(key);
+            size_t hash = hashOf(key);
             size_t idx = hash % keySize;
             size_t startIdx = idx;
             for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
                 if (keys[idx] == key) {
                     if (isSet) {
                         --mapSize;
+                        beforeWrite(setFlags.wordOf(idx), sizeof(uint32_t));
                         setFlags.unsetFirst(idx);
+                        if (mapSize < keySize * minLoadFactor) {
+                            rebuild(mapSize / ((minLoadFactor + loadFactor) / 2) + 1, nullptr);
+                        }
                     }
                     return;
                 }
@@ -470,6 +853,75 @@ namespace gradylib {
             rehash(size);
         }
 
+        // Shrink once erases leave fewer than minLoadFactor * capacity entries.  See OpenHashMap::setMinLoadFactor.
+        void setMinLoadFactor(double f) {
+            if (!(f >= 0 && f <= loadFactor / 2)) {
+                std::ostringstream sstr;
+                sstr << "OpenHashMapTC minimum load factor " << f << " must be between 0 and half the load factor";
+                throw gradylibMakeException(sstr.str());
+            }
+            minLoadFactor = f;
+        }
+
+        // Rebuild at the smallest capacity that holds the entries, which also drops the slots of erased entries.
+        void shrinkToFit(ThreadPool & tp) {
+            if (readOnly) {
+                std::ostringstream sstr;
+                sstr << "Cannot modify mmap";
+                throw gradylibMakeException(sstr.str());
+            }
+            rebuild(mapSize / loadFactor + 1, &tp);
+        }
+
+        void shrinkToFit() {
+            shrinkToFit(gradylib_helpers::defaultThreadPool());
+        }
+
+        size_t capacity() const {
+            return keySize;
+        }
+
+        /*
+         * Move the slot arrays into a memfd so that copying the map costs O(1).  A copy maps the same pages
+         * private and reads and writes like any other map.  The kernel duplicates a page once for each side that
+         * writes it, so memory grows with the pages that change while copies are alive, not with the map.  Copies
+         * can be destroyed on any thread and outlive the original.  Rebuilds of either keep using memfd storage.
+         * See CopyOnWriteStorage.hpp.
+         *
+         * The original preserves a slot for its copies when at, get, operator[] or an iterator's value hands out a
+         * reference to it, not when the reference is written through.  Writing through a reference kept from before
+         * a copy was made changes the copy too, so look values up again after copying.
+         */
+        void enableCopyOnWrite() {
+            if (readOnly) {
+                std::ostringstream sstr;
+                sstr << "Cannot modify mmap";
+                throw gradylibMakeException(sstr.str());
+            }
+            if (cowStorage) {
+                return;
+            }
+            std::shared_ptr<gradylib_helpers::CopyOnWriteStorage> storage = makeCopyOnWriteStorage(keySize);
+            Key * newKeys;
+            Value * newValues;
+            BitPairSet newSetFlags;
+            pointAt(storage->data(), keySize, newKeys, newValues, newSetFlags);
+            if (keySize > 0) {
+                memcpy(newKeys, keys, sizeof(Key) * keySize);
+                memcpy(newValues, values, sizeof(Value) * keySize);
+                memcpy(storage->data() + copyOnWriteLayout(keySize)[1], setFlags.wordOf(0), BitPairSet::storageBytes(keySize));
+            }
+            releaseSlots();
+            keys = newKeys;
+            values = newValues;
+            std::swap(setFlags, newSetFlags);
+            cowStorage = std::move(storage);
+        }
+
+        bool isCopyOnWrite() const {
+            return cowStorage != nullptr;
+        }
+
         class iterator {
             size_t idx;
             OpenHashMapTC *container;
@@ -487,6 +939,7 @@ namespace gradylib {
             }
 
             std::pair<Key const &, Value &> operator*() const {
+                container->beforeWrite(&container->values[idx], sizeof(Value));
                 return {container->keys[idx], container->values[idx]};
             }
 
@@ -495,6 +948,7 @@ namespace gradylib {
             }
 
             Value &value() {
+                container->beforeWrite(&container->values[idx], sizeof(Value));
                 return container->values[idx];
             }
 
@@ -514,6 +968,7 @@ namespace gradylib {
             if (mapSize == 0) {
                 return iterator(keySize, this);
             }
+            checkAllSlots();
             size_t idx = 0;
             while (idx < keySize && !setFlags.isFirstSet(idx)) {
                 ++idx;
@@ -569,6 +1024,7 @@ namespace gradylib {
             if (mapSize == 0) {
                 return const_iterator(keySize, this);
             }
+            checkAllSlots();
             size_t idx = 0;
             while (idx < keySize && !setFlags.isFirstSet(idx)) {
                 ++idx;
@@ -584,16 +1040,150 @@ namespace gradylib {
             return mapSize;
         }
 
+        // 0 until an insert probes too far and the map rehashes with a new seed.  It's written with the map.
+        uint64_t seed() const {
+            return hashSeed;
+        }
+
         void clear() {
             if (readOnly) {
                 std::ostringstream sstr;
                 sstr << "Can't clear a readonly set";
                 throw gradylibMakeException(sstr.str());
             }
+            if (keySize > 0) {
+                beforeWrite(setFlags.wordOf(0), BitPairSet::storageBytes(keySize));
+            }
             setFlags.clear();
             mapSize = 0;
         }
 
+        // This overload of parallelForEach uses the default thread pool.
+        template<gradylib_helpers::Mergeable ReturnValue = OpenHashMapTC<Key, Value, HashFunction>,
+                typename Callable,
+                typename PartialInitializer = gradylib_helpers::PartialDefaultConstructor<ReturnValue>,
+                typename FinalInitializer = gradylib_helpers::FinalDefaultConstructor<ReturnValue>>
+        requires std::is_invocable_r_v<void, Callable, ReturnValue &, Key const &, Value const &> &&
+                 std::is_copy_constructible_v<Callable> &&
+                 std::is_invocable_r_v<ReturnValue, PartialInitializer, int, int> &&
+                 std::is_invocable_r_v<ReturnValue, FinalInitializer, int>
+        std::future<ReturnValue> parallelForEach(Callable && f,
+                                                 PartialInitializer && partialInitializer = PartialInitializer{},
+                                                 FinalInitializer && finalInitializer = FinalInitializer{},
+                                                 size_t numThreads = 0) const {
+            return parallelForEach<ReturnValue>(gradylib_helpers::defaultThreadPool(),
+                                                std::forward<Callable>(f),
+                                                std::forward<PartialInitializer>(partialInitializer),
+                                                std::forward<FinalInitializer>(finalInitializer),
+                                                numThreads);
+        }
+
+        // This overload of parallelForEach takes a thread pool argument
+        template<gradylib_helpers::Mergeable ReturnValue = OpenHashMapTC<Key, Value, HashFunction>,
+                typename Callable,
+                typename PartialInitializer = gradylib_helpers::PartialDefaultConstructor<ReturnValue>,
+                typename FinalInitializer = gradylib_helpers::FinalDefaultConstructor<ReturnValue>>
+        requires std::is_invocable_r_v<void, Callable, ReturnValue &, Key const &, Value const &> &&
+                 std::is_copy_constructible_v<Callable> &&
+                 std::is_invocable_r_v<ReturnValue, PartialInitializer, int, int> &&
+                 std::is_invocable_r_v<ReturnValue, FinalInitializer, int>
+        std::future<ReturnValue> parallelForEach(ThreadPool & tp,
+                                                 Callable && f,
+                                                 PartialInitializer && partialInitializer = PartialInitializer{},
+                                                 FinalInitializer && finalInitializer = FinalInitializer{},
+                                                 size_t numThreads = 0) const {
+            if (mapSize > 0) {
+                checkAllSlots(tp);
+            }
+            auto visit = [f, this](ReturnValue & partial, size_t j) mutable {
+                if (setFlags.isFirstSet(j)) {
+                    f(partial, keys[j], values[j]);
+                }
+            };
+            return gradylib_helpers::parallelForEachSlot<ReturnValue>(tp, mapSize == 0 ? 0 : keySize, numThreads, visit,
+                                                                      partialInitializer, finalInitializer);
+        }
+
+        /*
+         * The k entries that come first under compare, in order.  compare(a, b) takes two MapEntryRefs and is true
+         * when a comes before b, so comparing value() with > gives the k largest values.  Each thread keeps only a
+         * heap of k entries.  The entries refer into the map and are valid until it changes.
+         */
+        template<typename Compare>
+        std::vector<MapEntryRef<Key, Value>> topK(ThreadPool & tp, size_t k, Compare compare) const {
+            using Entry = MapEntryRef<Key, Value>;
+            using Heap = gradylib_helpers::BoundedHeap<Entry, Compare>;
+            if (mapSize == 0 || k == 0) {
+                return {};
+            }
+            auto newHeap = [k, compare](auto...) {
+                return Heap(k, compare);
+            };
+            return parallelForEach<Heap>(tp, [](Heap & heap, Key const & key, Value const & value) {
+                heap.push(Entry(&key, &value));
+            }, newHeap, newHeap).get().sorted();
+        }
+
+        template<typename Compare>
+        std::vector<MapEntryRef<Key, Value>> topK(size_t k, Compare compare) const {
+            return topK(gradylib_helpers::defaultThreadPool(), k, compare);
+        }
+
+        // Every entry, sorted by compare on the thread pool.  The entries are valid until the map changes.
+        template<typename Compare>
+        std::vector<MapEntryRef<Key, Value>> sortedEntries(ThreadPool & tp, Compare compare) const {
+            std::vector<MapEntryRef<Key, Value>> entries = entryRefs(tp);
+            gradylib_helpers::parallelSort(entries, tp, compare);
+            return entries;
+        }
+
+        template<typename Compare>
+        std::vector<MapEntryRef<Key, Value>> sortedEntries(Compare compare) const {
+            return sortedEntries(gradylib_helpers::defaultThreadPool(), compare);
+        }
+
+        // Every entry in ascending key order.  Integer keys are radix sorted.
+        std::vector<MapEntryRef<Key, Value>> sortedEntriesByKey(ThreadPool & tp) const {
+            std::vector<MapEntryRef<Key, Value>> entries = entryRefs(tp);
+            gradylib_helpers::parallelSortBy(entries, tp, [](MapEntryRef<Key, Value> const & e) -> Key const & {
+                return e.key();
+            });
+            return entries;
+        }
+
+        std::vector<MapEntryRef<Key, Value>> sortedEntriesByKey() const {
+            return sortedEntriesByKey(gradylib_helpers::defaultThreadPool());
+        }
+
+        // Every entry in ascending value order.  Integer values are radix sorted.
+        std::vector<MapEntryRef<Key, Value>> sortedEntriesByValue(ThreadPool & tp) const {
+            std::vector<MapEntryRef<Key, Value>> entries = entryRefs(tp);
+            gradylib_helpers::parallelSortBy(entries, tp, [](MapEntryRef<Key, Value> const & e) -> Value const & {
+                return e.value();
+            });
+            return entries;
+        }
+
+        std::vector<MapEntryRef<Key, Value>> sortedEntriesByValue() const {
+            return sortedEntriesByValue(gradylib_helpers::defaultThreadPool());
+        }
+
+        // k entries drawn uniformly at random, with replacement.  See SlotSampling.hpp.
+        template<typename UniformRandomBitGenerator>
+        std::vector<MapEntryRef<Key, Value>> sample(size_t k, UniformRandomBitGenerator & rng) const {
+            std::vector<MapEntryRef<Key, Value>> ret;
+            ret.reserve(mapSize == 0 ? 0 : k);
+            gradylib_helpers::sampleSlots(setFlags, keySize, mapSize, k, rng, [this](size_t j) {
+                __builtin_prefetch(&keys[j]);
+                __builtin_prefetch(&values[j]);
+            }, [&ret, this](size_t j) {
+                // Only the sections holding the drawn slot are verified, so sampling stays O(k)
+                checkSlot(j);
+                ret.emplace_back(&keys[j], &values[j]);
+            });
+            return ret;
+        }
+
         void write(std::string filename, int alignment = alignof(void*)) const {
             std::ofstream ofs(filename, std::ios::binary);
             if (ofs.fail()) {
@@ -602,14 +1192,32 @@ namespace gradylib {
                 throw gradylibMakeException(sstr.str());
             }
             write(ofs, alignment);
+            ofs.close();
+            if (ofs.fail()) {
+                std::ostringstream sstr;
+                sstr << "Writing " << filename << " failed in OpenHashMapTC::write.";
+                throw gradylibMakeException(sstr.str());
+            }
+            appendIntegrityTrailer(filename);
+        }
+
+        // Write a snapshot to filename in the background while the map keeps changing.  See Checkpoint.hpp.
+        // A copy-on-write map isn't forked, because the child would see the owner's later writes through the memfd.
+        // Its in-process copy is O(1) anyway.
+        std::future<void> checkpointAsync(std::filesystem::path filename, bool allowFork = true) const {
+            return gradylib::checkpointAsync(*this, filename, [](OpenHashMapTC const & m, std::filesystem::path const & p) {
+                m.write(p.string());
+            }, allowFork && !cowStorage);
         }
 
         void write(std::ofstream & ofs, int alignment = alignof(void*)) const {
+            checkAllSlots();
             size_t startFileOffset = ofs.tellp();
             size_t t;
             t = mapSize;
             ofs.write(static_cast<char*>(static_cast<void *>(&t)), 8);
-            t = keySize;
+            // The flag says the seed follows the offsets
+            t = keySize | gradylib_helpers::hashSeedHeaderFlag;
             ofs.write(static_cast<char*>(static_cast<void *>(&t)), 8);
             double d = loadFactor;
             ofs.write(static_cast<char*>(static_cast<void *>(&d)), 8);
@@ -621,6 +1229,7 @@ namespace gradylib {
             ofs.write(static_cast<char*>(static_cast<void*>(&valuesOffset)), 8);
             auto bitPairSetOffsetPos = ofs.tellp();
             ofs.write(static_cast<char*>(static_cast<void*>(&bitPairSetOffset)), 8);
+            ofs.write(static_cast<char const *>(static_cast<void const *>(&hashSeed)), 8);
             ofs.write(static_cast<char*>(static_cast<void*>(keys)), sizeof(Key) * keySize);
             int valuePad = alignment - ofs.tellp() % alignment;
             for (int i = 0; i < valuePad; ++i) {
@@ -636,12 +1245,16 @@ namespace gradylib {
             }
             bitPairSetOffset = static_cast<size_t>(ofs.tellp()) - startFileOffset;
             setFlags.write(ofs);
+            auto endPos = ofs.tellp();
 
             ofs.seekp(valueOffsetPos);
             ofs.write(static_cast<char*>(static_cast<void*>(&valuesOffset)), 8);
 
             ofs.seekp(bitPairSetOffsetPos);
             ofs.write(static_cast<char*>(static_cast<void*>(&bitPairSetOffset)), 8);
+
+            // Leave the stream after the map so more can be written behind it
+            ofs.seekp(endPos);
         }
 
         template<typename, typename, template<typename> typename>
@@ -0,0 +1,478 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include<errno.h>
+#include<fcntl.h>
+#include<string.h>
+#include<sys/mman.h>
+#include<unistd.h>
+
+#include<algorithm>
+#include<cstdint>
+#include<filesystem>
+#include<fstream>
+#include<span>
+#include<sstream>
+#include<type_traits>
+#include<utility>
+#include<vector>
+
+#include"AltIntHash.hpp"
+#include"Common.hpp"
+#include"Exception.hpp"
+#include"Integrity.hpp"
+#include"OpenHashMapTC.hpp"
+#include"ThreadPool.hpp"
+
+namespace gradylib {
+
+    /*
+     * OpenHashMultiMap keeps every value of a key in one contiguous run, in a compressed sparse row layout: the
+     * values of all keys are in one array, grouped by key, and an OpenHashMapTC maps each key to its run number.
+     * Run r is values[runOffsets[r]] up to values[runOffsets[r + 1]].  Lookups return a std::span over the run, so
+     * there is no allocation per key and no pointer chasing when reading the values of a key.
+     *
+     * The map is built with OpenHashMultiMap::Builder.  add() counts the values of each key as they arrive.  build()
+     * prefix sums the counts into run offsets and scatters the values into place on a ThreadPool.  The values of a
+     * key keep the order in which they were added.
+     *
+     * write() saves the map in a format that MMapOpenHashMultiMap maps.  File layout:
+     *     numKeys, numValues, runOffsetsOffset, valuesOffset, indexOffset    (8 bytes each)
+     *     runOffsets   (numKeys + 1 uint64_t)
+     *     values       (numValues Value, aligned for Value)
+     *     index        (OpenHashMapTC<Key, uint64_t> from key to run number)
+     *     integrity trailer
+     */
+    template<typename Key, typename Value, template<typename> typename HashFunction = gradylib::AltHash>
+    requires std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value> &&
+             std::is_default_constructible_v<Key> && std::is_default_constructible_v<Value>
+    class OpenHashMultiMap;
+
+    template<typename Key, typename Value, template<typename> typename HashFunction = gradylib::AltHash>
+    requires std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value> &&
+             std::is_default_constructible_v<Key> && std::is_default_constructible_v<Value>
+    class MMapOpenHashMultiMap;
+}
+
+namespace gradylib_helpers {
+    inline constexpr size_t multiMapHeaderSize = 40;
+    inline constexpr size_t multiMapEntriesPerTask = 1 << 16;
+
+    // Iterates the keys of a multimap's index and pairs each with its run of values.
+    template<typename Index, typename Value>
+    class MultiMapConstIterator {
+        typename Index::const_iterator iter;
+        uint64_t const * runOffsets;
+        Value const * values;
+
+    public:
+        MultiMapConstIterator(typename Index::const_iterator iter, uint64_t const * runOffsets, Value const * values)
+            : iter(iter), runOffsets(runOffsets), values(values)
+        {
+        }
+
+        bool operator==(MultiMapConstIterator const & other) const {
+            return iter == other.iter;
+        }
+
+        bool operator!=(MultiMapConstIterator const & other) const {
+            return iter != other.iter;
+        }
+
+        auto operator*() const {
+            return std::pair<decltype(iter.key()), std::span<Value const>>(iter.key(), value());
+        }
+
+        decltype(auto) key() const {
+            return iter.key();
+        }
+
+        std::span<Value const> value() const {
+            uint64_t run = iter.value();
+            return std::span<Value const>(values + runOffsets[run], runOffsets[run + 1] - runOffsets[run]);
+        }
+
+        MultiMapConstIterator & operator++() {
+            ++iter;
+            return *this;
+        }
+    };
+}
+
+namespace gradylib {
+
+    template<typename Key, typename Value, template<typename> typename HashFunction>
+    requires std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value> &&
+             std::is_default_constructible_v<Key> && std::is_default_constructible_v<Value>
+    class OpenHashMultiMap {
+        using Index = OpenHashMapTC<Key, uint64_t, HashFunction>;
+
+        Index runIndex;
+        std::vector<uint64_t> runOffsets{0};
+        std::vector<Value> values;
+
+    public:
+        typedef Key key_type;
+        typedef Value mapped_type;
+
+        using const_iterator = gradylib_helpers::MultiMapConstIterator<Index, Value>;
+
+        OpenHashMultiMap() = default;
+
+        // The number of keys
+        size_t size() const {
+            return runIndex.size();
+        }
+
+        size_t valueCount() const {
+            return values.size();
+        }
+
+        bool contains(Key const & key) const {
+            return runIndex.contains(key);
+        }
+
+        // The values of key, or an empty span if the map doesn't contain it.
+        std::span<Value const> get(Key const & key) const {
+            auto run = runIndex.get(key);
+            if (!run.has_value()) {
+                return {};
+            }
+            uint64_t r = run.value();
+            return std::span<Value const>(values.data() + runOffsets[r], runOffsets[r + 1] - runOffsets[r]);
+        }
+
+        std::span<Value const> at(Key const & key) const {
+            if (!runIndex.contains(key)) {
+                std::ostringstream sstr;
+                sstr << "OpenHashMultiMap doesn't contain key";
+                throw gradylibMakeException(sstr.str());
+            }
+            return get(key);
+        }
+
+        size_t count(Key const & key) const {
+            return get(key).size();
+        }
+
+        const_iterator begin() const {
+            return const_iterator(runIndex.begin(), runOffsets.data(), values.data());
+        }
+
+        const_iterator end() const {
+            return const_iterator(runIndex.end(), runOffsets.data(), values.data());
+        }
+
+        void write(std::filesystem::path filename) const {
+            namespace gh = gradylib_helpers;
+            std::ofstream ofs(filename, std::ios::binary);
+            if (ofs.fail()) {
+                std::ostringstream sstr;
+                sstr << "Couldn't open " << filename << " for writing in OpenHashMultiMap::write";
+                throw gradylibMakeException(sstr.str());
+            }
+            constexpr int alignment = std::max<int>(8, std::max(alignof(Key), alignof(Value)));
+            size_t numKeys = runIndex.size();
+            size_t numValues = values.size();
+            size_t runOffsetsOffset = 0;
+            size_t valuesOffset = 0;
+            size_t indexOffset = 0;
+            ofs.write(gh::charCast(&numKeys), 8);
+            ofs.write(gh::charCast(&numValues), 8);
+            ofs.write(gh::charCast(&runOffsetsOffset), 8);
+            ofs.write(gh::charCast(&valuesOffset), 8);
+            ofs.write(gh::charCast(&indexOffset), 8);
+            runOffsetsOffset = ofs.tellp();
+            ofs.write(gh::charCast(runOffsets.data()), runOffsets.size() * sizeof(uint64_t));
+            gh::writePad<alignment>(ofs);
+            valuesOffset = ofs.tellp();
+            ofs.write(gh::charCast(values.data()), values.size() * sizeof(Value));
+            gh::writePad<alignment>(ofs);
+            indexOffset = ofs.tellp();
+            runIndex.write(ofs, alignment);
+            ofs.seekp(16, std::ios::beg);
+            ofs.write(gh::charCast(&runOffsetsOffset), 8);
+            ofs.write(gh::charCast(&valuesOffset), 8);
+            ofs.write(gh::charCast(&indexOffset), 8);
+            ofs.close();
+            if (ofs.fail()) {
+                std::ostringstream sstr;
+                sstr << "Writing " << filename << " failed in OpenHashMultiMap::write.";
+                throw gradylibMakeException(sstr.str());
+            }
+            appendIntegrityTrailer(filename);
+        }
+
+        class Builder {
+            // Run number plus one, so that a zero from operator[] means a new key
+            Index runIds;
+            std::vector<uint64_t> runCounts;
+            std::vector<uint64_t> pairRuns;
+            std::vector<uint64_t> pairRanks;
+            std::vector<Value> pairValues;
+
+        public:
+
+            void add(Key const & key, Value const & value) {
+                uint64_t & id = runIds[key];
+                if (id == 0) {
+                    runCounts.push_back(0);
+                    id = runCounts.size();
+                }
+                pairRuns.push_back(id - 1);
+                pairRanks.push_back(runCounts[id - 1]++);
+                pairValues.push_back(value);
+            }
+
+            void reserve(size_t numKeys, size_t numValues) {
+                runIds.reserve(numKeys);
+                runCounts.reserve(numKeys);
+                pairRuns.reserve(numValues);
+                pairRanks.reserve(numValues);
+                pairValues.reserve(numValues);
+            }
+
+            // The number of distinct keys added so far
+            size_t size() const {
+                return runIds.size();
+            }
+
+            size_t valueCount() const {
+                return pairValues.size();
+            }
+
+            // Builds the map on tp and leaves the builder empty.
+            OpenHashMultiMap build(ThreadPool & tp) {
+                using gradylib_helpers::multiMapEntriesPerTask;
+                OpenHashMultiMap m;
+                size_t numRuns = runCounts.size();
+                size_t numValues = pairValues.size();
+
+                // Exclusive prefix sum of the run lengths: sum blocks of runs in parallel, scan the block sums, then
+                // fill in each block from its starting offset in parallel.
+                size_t numBlocks = (numRuns + multiMapEntriesPerTask - 1) / multiMapEntriesPerTask;
+                std::vector<uint64_t> blockStarts(numBlocks, 0);
+                gradylib_helpers::runTasks(tp, numBlocks, [&](size_t b) {
+                    size_t end = std::min(numRuns, (b + 1) * multiMapEntriesPerTask);
+                    uint64_t sum = 0;
+                    for (size_t r = b * multiMapEntriesPerTask; r < end; ++r) {
+                        sum += runCounts[r];
+                    }
+                    blockStarts[b] = sum;
+                });
+                uint64_t total = 0;
+                for (auto & start : blockStarts) {
+                    uint64_t sum = start;
+                    start = total;
+                    total += sum;
+                }
+                m.runOffsets.resize(numRuns + 1);
+                m.runOffsets[numRuns] = numValues;
+                gradylib_helpers::runTasks(tp, numBlocks, [&](size_t b) {
+                    size_t end = std::min(numRuns, (b + 1) * multiMapEntriesPerTask);
+                    uint64_t offset = blockStarts[b];
+                    for (size_t r = b * multiMapEntriesPerTask; r < end; ++r) {
+                        m.runOffsets[r] = offset;
+                        offset += runCounts[r];
+                    }
+                });
+
+                // Every pair knows its run and its rank within the run, so each one has a fixed destination.
+                m.values.resize(numValues);
+                size_t numTasks = (numValues + multiMapEntriesPerTask - 1) / multiMapEntriesPerTask;
+                gradylib_helpers::runTasks(tp, numTasks, [&](size_t t) {
+                    size_t end = std::min(numValues, (t + 1) * multiMapEntriesPerTask);
+                    for (size_t i = t * multiMapEntriesPerTask; i < end; ++i) {
+                        m.values[m.runOffsets[pairRuns[i]] + pairRanks[i]] = pairValues[i];
+                    }
+                });
+
+                for (auto it = runIds.begin(); it != runIds.end(); ++it) {
+                    --it.value();
+                }
+                m.runIndex = std::move(runIds);
+                *this = Builder();
+                return m;
+            }
+
+            OpenHashMultiMap build() {
+                return build(gradylib_helpers::defaultThreadPool());
+            }
+
+            void write(std::filesystem::path filename, ThreadPool & tp) {
+                build(tp).write(filename);
+            }
+
+            void write(std::filesystem::path filename) {
+                build().write(filename);
+            }
+        };
+    };
+
+    // Read only, memory mapped view of a file written by OpenHashMultiMap::write.  Lookups return spans into the mapping.
+    template<typename Key, typename Value, template<typename> typename HashFunction>
+    requires std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value> &&
+             std::is_default_constructible_v<Key> && std::is_default_constructible_v<Value>
+    class MMapOpenHashMultiMap {
+        using Index = OpenHashMapTC<Key, uint64_t, HashFunction>;
+
+        Index runIndex;
+        uint64_t const * runOffsets = nullptr;
+        Value const * values = nullptr;
+        size_t numValues = 0;
+        int fd = -1;
+        size_t mappingSize = 0;
+        void * memoryMapping = nullptr;
+        static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
+
+    public:
+        typedef Key key_type;
+        typedef Value mapped_type;
+
+        using const_iterator = gradylib_helpers::MultiMapConstIterator<Index, Value>;
+
+        // If verify is true, the file's integrity trailer is checked in parallel before the constructor returns.
+        explicit MMapOpenHashMultiMap(std::filesystem::path filename, bool verify = false) {
+            namespace gh = gradylib_helpers;
+            fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                std::ostringstream sstr;
+                sstr << "Error opening file " << filename;
+                throw gradylibMakeException(sstr.str());
+            }
+            mappingSize = std::filesystem::file_size(filename);
+            memoryMapping = mmapFunc(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+            if (memoryMapping == MAP_FAILED) {
+                close(fd);
+                memoryMapping = nullptr;
+                std::ostringstream sstr;
+                sstr << "memory map failed: " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            std::byte const * base = static_cast<std::byte const *>(memoryMapping);
+            try {
+                if (verify) {
+                    IntegrityVerifier(memoryMapping, mappingSize).verifyAll();
+                }
+                gh::checkMappedExtent(gh::multiMapHeaderSize, mappingSize, "MMapOpenHashMultiMap");
+                size_t header[5];
+                memcpy(header, base, sizeof(header));
+                size_t numKeys = header[0];
+                numValues = header[1];
+                char const * what = "MMapOpenHashMultiMap";
+                gh::checkMappedExtent(numKeys > mappingSize || header[2] > mappingSize ? SIZE_MAX : header[2] + (numKeys + 1) * sizeof(uint64_t),
+                                      mappingSize, what);
+                gh::checkMappedExtent(numValues > mappingSize || header[3] > mappingSize ? SIZE_MAX : header[3] + numValues * sizeof(Value),
+                                      mappingSize, what);
+                gh::checkMappedExtent(header[4], mappingSize, what);
+                Index::checkMapping(base + header[4], mappingSize - header[4], what);
+                runOffsets = static_cast<uint64_t const *>(static_cast<void const *>(base + header[2]));
+                values = static_cast<Value const *>(static_cast<void const *>(base + header[3]));
+                runIndex = Index(static_cast<void const *>(base + header[4]));
+                if (runIndex.size() != numKeys || runOffsets[numKeys] != numValues) {
+                    throw gradylibMakeException("MMapOpenHashMultiMap header doesn't match its index and run offsets");
+                }
+            } catch (...) {
+                munmap(memoryMapping, mappingSize);
+                close(fd);
+                throw;
+            }
+        }
+
+        MMapOpenHashMultiMap(MMapOpenHashMultiMap const &) = delete;
+
+        MMapOpenHashMultiMap & operator=(MMapOpenHashMultiMap const &) = delete;
+
+        ~MMapOpenHashMultiMap() {
+            if (memoryMapping) {
+                munmap(memoryMapping, mappingSize);
+                close(fd);
+            }
+        }
+
+        // The number of keys
+        size_t size() const {
+            return runIndex.size();
+        }
+
+        size_t valueCount() const {
+            return numValues;
+        }
+
+        bool contains(Key const & key) const {
+            return runIndex.contains(key);
+        }
+
+        // The values of key, or an empty span if the map doesn't contain it.
+        std::span<Value const> get(Key const & key) const {
+            auto run = runIndex.get(key);
+            if (!run.has_value()) {
+                return {};
+            }
+            uint64_t r = run.value();
+            return std::span<Value const>(values + runOffsets[r], runOffsets[r + 1] - runOffsets[r]);
+        }
+
+        std::span<Value const> at(Key const & key) const {
+            if (!runIndex.contains(key)) {
+                std::ostringstream sstr;
+                sstr << "MMapOpenHashMultiMap doesn't contain key";
+                throw gradylibMakeException(sstr.str());
+            }
+            return get(key);
+        }
+
+        size_t count(Key const & key) const {
+            return get(key).size();
+        }
+
+        const_iterator begin() const {
+            return const_iterator(runIndex.begin(), runOffsets, values);
+        }
+
+        const_iterator end() const {
+            return const_iterator(runIndex.end(), runOffsets, values);
+        }
+
+        template<typename, typename, template<typename> typename>
+        friend void GRADY_LIB_MOCK_MMapOpenHashMultiMap_MMAP();
+
+        template<typename, typename, template<typename> typename>
+        friend void GRADY_LIB_DEFAULT_MMapOpenHashMultiMap_MMAP();
+    };
+
+    template<typename Key, typename Value, template<typename> typename HashFunction = gradylib::AltHash>
+    void GRADY_LIB_MOCK_MMapOpenHashMultiMap_MMAP() {
+        MMapOpenHashMultiMap<Key, Value, HashFunction>::mmapFunc = [](void *, size_t, int, int, int, off_t) -> void *{
+            return MAP_FAILED;
+        };
+    }
+
+    template<typename Key, typename Value, template<typename> typename HashFunction = gradylib::AltHash>
+    void GRADY_LIB_DEFAULT_MMapOpenHashMultiMap_MMAP() {
+        MMapOpenHashMultiMap<Key, Value, HashFunction>::mmapFunc = mmap;
+    }
+}
@@ -26,6 +26,7 @@ SOFTWARE.
 
 #include<filesystem>
 #include<fstream>
+#include<functional>
 #include<future>
 #include<string>
 #include<type_traits>
@@ -33,8 +34,10 @@ SOFTWARE.
 
 #include"Common.hpp"
 #include"BitPairSet.hpp"
+#include"Integrity.hpp"
 #include"ThreadPool.hpp"
 #include"ParallelTraversals.hpp"
+#include"SlotSampling.hpp"
 
 namespace gradylib {
 
@@ -44,8 +47,8 @@ namespace gradylib {
 
     template<typename Key, template<typename> typename HashFunction>
     void mergePartials(OpenHashSet<Key, HashFunction> & m1, OpenHashSet<Key, HashFunction> const & m2) {
-        for (auto const & [key] : m2) {
-            m1.inset(key);
+        for (auto const & key : m2) {
+            m1.insert(key);
         }
     }
 
@@ -57,6 +60,8 @@ namespace gradylib {
         BitPairSet setFlags;
         double loadFactor = 0.8;
         double growthFactor = 1.2;
+        // See setMinLoadFactor
+        double minLoadFactor = 0;
         size_t setSize = 0;
         HashFunction<Key> hashFunction = HashFunction<Key>{};
 
@@ -70,9 +75,25 @@ namespace gradylib {
             } else {
                 newSize = std::max<size_t>(keys.size() + 1, std::max<size_t>(1, keys.size()) * growthFactor);
             }
+            rebuild(newSize);
+        }
+
+        // Big tables are rebuilt on tp when one is given.  See gradylib_helpers::rebuildSlots.
+        void rebuild(size_t newSize, ThreadPool * tp = nullptr) {
             std::vector<Key> newKeys(newSize);
             BitPairSet newSetFlags(newSize);
-            if (setSize > 0) {
+            if (tp && newSize >= gradylib_helpers::parallelRebuildSlots) {
+                gradylib_helpers::rebuildSlots(*tp, keys.size(), newSize, [this](size_t j) {
+                    return setFlags.isFirstSet(j);
+                }, [this, newSize](size_t j) {
+                    return hashFunction(keys[j]) % newSize;
+                }, [&newSetFlags](size_t idx) {
+                    return newSetFlags.isFirstSet(idx);
+                }, [&](size_t j, size_t idx) {
+                    newSetFlags.setBoth(idx);
+                    newKeys[idx] = std::move(keys[j]);
+                });
+            } else if (setSize > 0) {
                 for (size_t i = 0; i < keys.size(); ++i) {
                     if (!setFlags.isFirstSet(i)) {
                         continue;
@@ -213,6 +234,9 @@ namespace gradylib {
                     if (isSet) {
                         --setSize;
                         setFlags.unsetFirst(idx);
+                        if (setSize < keys.size() * minLoadFactor) {
+                            rebuild(setSize / ((minLoadFactor + loadFactor) / 2) + 1, nullptr);
+                        }
                     }
                     return;
                 }
@@ -226,6 +250,29 @@ namespace gradylib {
             rehash(size);
         }
 
+        // Shrink once erases leave fewer than minLoadFactor * capacity keys.  See OpenHashMap::setMinLoadFactor.
+        void setMinLoadFactor(double f) {
+            if (!(f >= 0 && f <= loadFactor / 2)) {
+                std::ostringstream sstr;
+                sstr << "OpenHashSet minimum load factor " << f << " must be between 0 and half the load factor";
+                throw gradylibMakeException(sstr.str());
+            }
+            minLoadFactor = f;
+        }
+
+        // Rebuild at the smallest capacity that holds the keys, which also drops the slots of erased keys.
+        void shrinkToFit(ThreadPool & tp) {
+            rebuild(setSize / loadFactor + 1, &tp);
+        }
+
+        void shrinkToFit() {
+            shrinkToFit(gradylib_helpers::defaultThreadPool());
+        }
+
+        size_t capacity() const {
+            return keys.size();
+        }
+
         void clear() {
             setFlags.clear();
             setSize = 0;
@@ -477,8 +524,21 @@ namespace gradylib {
             return result->promise.get_future();
         }
 
+        // k keys drawn uniformly at random, with replacement.  See SlotSampling.hpp.
+        template<typename UniformRandomBitGenerator>
+        std::vector<std::reference_wrapper<Key const>> sample(size_t k, UniformRandomBitGenerator & rng) const {
+            std::vector<std::reference_wrapper<Key const>> ret;
+            ret.reserve(setSize == 0 ? 0 : k);
+            gradylib_helpers::sampleSlots(setFlags, keys.size(), setSize, k, rng, [this](size_t j) {
+                __builtin_prefetch(&keys[j]);
+            }, [&ret, this](size_t j) {
+                ret.emplace_back(keys[j]);
+            });
+            return ret;
+        }
+
         template<template<typename> typename HashFunc>
-        friend void writeMappable(std::string filename, OpenHashSet<std::string, HashFunc> const & m);
+        friend void writeMappable(std::filesystem::path filename, OpenHashSet<std::string, HashFunc> const & m);
 
         template<std::integral IndexType, template<typename> typename HashFunc>
         friend void writeMappable(std::string filename, OpenHashSet<IndexType, HashFunc> const & m);
@@ -487,7 +547,7 @@ namespace gradylib {
 
     template<template<typename> typename HashFunc>
     void writeMappable(std::filesystem::path filename, OpenHashSet<std::string, HashFunc> const & m) {
-        std::ofstream ofs(filename);
+        std::ofstream ofs(filename, std::ios::binary);
         if (ofs.fail()) {
             std::ostringstream sstr;
             sstr << "Couldn't open file " << filename << " in writeMappable.";
@@ -514,17 +574,25 @@ namespace gradylib {
             ofs.write(m.keys[i].data(), len);
             ofs.write(pad.data(), 4 - len % 4);
         }
+        gradylib_helpers::writePad<8>(ofs);
 
         bitPairSetOffset = ofs.tellp();
         m.setFlags.write(ofs);
 
         ofs.seekp(bitPairSetOffsetWritePos, std::ios::beg);
         ofs.write(static_cast<char*>(static_cast<void*>(&bitPairSetOffset)), 8);
+        ofs.close();
+        if (ofs.fail()) {
+            std::ostringstream sstr;
+            sstr << "Writing " << filename << " failed in writeMappable.";
+            throw gradylibMakeException(sstr.str());
+        }
+        appendIntegrityTrailer(filename);
     }
 
     template<std::integral IndexType, template<typename> typename HashFunc>
     void writeMappable(std::string filename, OpenHashSet<IndexType, HashFunc> const & m) {
-        std::ofstream ofs(filename);
+        std::ofstream ofs(filename, std::ios::binary);
         if (ofs.fail()) {
             std::ostringstream sstr;
             sstr << "Couldn't open file " << filename << " in writeMappable.";
@@ -538,13 +606,20 @@ namespace gradylib {
         auto const bitPairSetOffsetWritePos = ofs.tellp();
         ofs.write(static_cast<char*>(static_cast<void*>(&bitPairSetOffset)), 8);
         ofs.write(static_cast<char*>(const_cast<void*>(static_cast<void const *>(m.keys.data()))), sizeof(IndexType) * keySize);
-        std::vector<char> pad(4, 0);
+        gradylib_helpers::writePad<8>(ofs);
 
         bitPairSetOffset = ofs.tellp();
         m.setFlags.write(ofs);
 
         ofs.seekp(bitPairSetOffsetWritePos, std::ios::beg);
         ofs.write(static_cast<char*>(static_cast<void*>(&bitPairSetOffset)), 8);
+        ofs.close();
+        if (ofs.fail()) {
+            std::ostringstream sstr;
+            sstr << "Writing " << filename << " failed in writeMappable.";
+            throw gradylibMakeException(sstr.str());
+        }
+        appendIntegrityTrailer(filename);
     }
 
 }
@@ -61,6 +61,9 @@ SOFTWARE.
 
 #include"AltIntHash.hpp"
 #include"BitPairSet.hpp"
+#include"ParallelTraversals.hpp"
+#include"SlotSampling.hpp"
+#include"ThreadPool.hpp"
 
 namespace gradylib {
 
@@ -79,6 +82,12 @@ namespace gradylib {
         void *memoryMapping = nullptr;
         bool readOnly = false;
         HashFunction<Key> hashFunction = HashFunction<Key>{};
+        // See gradylib_helpers::probeLimit.  reseedKeySize is the table size of the last reseed, which happens at
+        // most once per table size.
+        uint64_t hashSeed = 0;
+        size_t reseedKeySize = 0;
+        // See setMinLoadFactor
+        double minLoadFactor = 0;
         static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
 
         void freeResources() {
@@ -93,6 +102,10 @@ namespace gradylib {
             }
         }
 
+        size_t hashOf(Key const & key) const {
+            return gradylib_helpers::seededHash(hashFunction, key, hashSeed);
+        }
+
         void rehash(size_t size = 0) {
             size_t newSize;
             if (size > 0) {
@@ -103,21 +116,50 @@ namespace gradylib {
             } else {
                 newSize = std::max<size_t>(keySize + 1, std::max<size_t>(1, keySize) * growthFactor);
             }
+            rebuild(newSize);
+        }
+
+        // An insert probed past the limit, so rebuild at the same size with the next seed.
+        void reseed() {
+            hashSeed = gradylib_helpers::nextHashSeed(hashSeed);
+            reseedKeySize = keySize;
+            rebuild(keySize);
+        }
+
+        bool shouldReseed(size_t probes) const {
+            return probes > gradylib_helpers::probeLimit(keySize, loadFactor) && reseedKeySize != keySize;
+        }
+
+        // Big tables are rebuilt on tp when one is given.  See gradylib_helpers::rebuildSlots.
+        void rebuild(size_t newSize, ThreadPool * tp = nullptr) {
             Key *newKeys = new Key[newSize];
             BitPairSet newSetFlags(newSize);
-            for (size_t i = 0; i < keySize; ++i) {
-                if (!setFlags.isFirstSet(i)) {
-                    continue;
-                }
-                Key const &k = keys[i];
-                size_t hash = hashFunction(k);
-                size_t idx = hash % newSize;
-                while (newSetFlags.isFirstSet(idx)) {
-                    ++idx;
-                    idx = idx == newSize ? 0 : idx;
+            if (tp && newSize >= gradylib_helpers::parallelRebuildSlots) {
+                gradylib_helpers::rebuildSlots(*tp, keySize, newSize, [this](size_t j) {
+                    return setFlags.isFirstSet(j);
+                }, [this, newSize](size_t j) {
+                    return hashOf(keys[j]) % newSize;
+                }, [&newSetFlags](size_t idx) {
+                    return newSetFlags.isFirstSet(idx);
+                }, [&](size_t j, size_t idx) {
+                    newSetFlags.setBoth(idx);
+                    newKeys[idx] = keys[j];
+                });
+            } else {
+                for (size_t i = 0; i < keySize; ++i) {
+                    if (!setFlags.isFirstSet(i)) {
+                        continue;
+                    }
+                    Key const &k = keys[i];
+                    size_t hash = hashOf(k);
+                    size_t idx = hash % newSize;
+                    while (newSetFlags.isFirstSet(idx)) {
+                        ++idx;
+                        idx = idx == newSize ? 0 : idx;
+                    }
+                    newSetFlags.setBoth(idx);
+                    newKeys[idx] = k;
                 }
-                newSetFlags.setBoth(idx);
-                newKeys[idx] = k;
             }
             delete[] keys;
             keys = newKeys;
@@ -133,13 +175,15 @@ namespace gradylib {
 
         OpenHashSetTC(OpenHashSetTC const &s)
                 : keys(new Key[s.keySize]), keySize(s.keySize), setFlags(s.setFlags), loadFactor(s.loadFactor),
-                  growthFactor(s.growthFactor), setSize(s.setSize) {
+                  growthFactor(s.growthFactor), setSize(s.setSize), hashSeed(s.hashSeed), reseedKeySize(s.reseedKeySize),
+                  minLoadFactor(s.minLoadFactor) {
             memcpy(keys, s.keys, sizeof(Key) * keySize);
         }
 
         OpenHashSetTC(OpenHashSetTC &&s)
                 : keys(s.keys), keySize(s.keySize), setFlags(std::move(s.setFlags)), loadFactor(s.loadFactor),
-                  growthFactor(s.growthFactor), setSize(s.setSize) {
+                  growthFactor(s.growthFactor), setSize(s.setSize), hashSeed(s.hashSeed), reseedKeySize(s.reseedKeySize),
+                  minLoadFactor(s.minLoadFactor) {
             s.keys = nullptr;
             s.keySize = 0;
             s.setSize = 0;
@@ -162,7 +206,8 @@ namespace gradylib {
             std::byte *ptr = static_cast<std::byte *>(memoryMapping);
             setSize = *static_cast<size_t *>(static_cast<void *>(ptr));
             ptr += 8;
-            keySize = *static_cast<size_t *>(static_cast<void *>(ptr));
+            size_t keySizeWord = *static_cast<size_t *>(static_cast<void *>(ptr));
+            keySize = keySizeWord & ~gradylib_helpers::hashSeedHeaderFlag;
             ptr += 8;
             loadFactor = *static_cast<double *>(static_cast<void *>(ptr));
             ptr += 8;
@@ -170,6 +215,10 @@ namespace gradylib {
             ptr += 8;
             size_t bitPairSetOffset = *static_cast<size_t *>(static_cast<void *>(ptr));
             ptr += 8;
+            if (keySizeWord & gradylib_helpers::hashSeedHeaderFlag) {
+                hashSeed = *static_cast<uint64_t *>(static_cast<void *>(ptr));
+                ptr += 8;
+            }
             keys = static_cast<Key *>(static_cast<void *>(ptr));
             setFlags = BitPairSet(static_cast<void *>(bitPairSetOffset + static_cast<std::byte *>(memoryMapping)));
             readOnly = true;
@@ -177,11 +226,16 @@ namespace gradylib {
 
         explicit OpenHashSetTC(std::ifstream & ifs) {
             ifs.read(static_cast<char*>(static_cast<void*>(&setSize)), sizeof(setSize));
-            ifs.read(static_cast<char*>(static_cast<void*>(&keySize)), sizeof(keySize));
+            size_t keySizeWord;
+            ifs.read(static_cast<char*>(static_cast<void*>(&keySizeWord)), sizeof(keySizeWord));
+            keySize = keySizeWord & ~gradylib_helpers::hashSeedHeaderFlag;
             ifs.read(static_cast<char*>(static_cast<void*>(&loadFactor)), sizeof(loadFactor));
             ifs.read(static_cast<char*>(static_cast<void*>(&growthFactor)), sizeof(growthFactor));
             size_t bitPairSetOffset;
             ifs.read(static_cast<char*>(static_cast<void*>(&bitPairSetOffset)), sizeof(bitPairSetOffset));
+            if (keySizeWord & gradylib_helpers::hashSeedHeaderFlag) {
+                ifs.read(static_cast<char*>(static_cast<void*>(&hashSeed)), sizeof(hashSeed));
+            }
             keys = new Key[keySize];
             ifs.read(static_cast<char*>(static_cast<void*>(keys)), sizeof(Key) * keySize);
             ifs.seekg(bitPairSetOffset);
@@ -209,6 +263,9 @@ namespace gradylib {
             loadFactor = s.loadFactor;
             growthFactor = s.growthFactor;
             setSize = s.setSize;
+            hashSeed = s.hashSeed;
+            reseedKeySize = s.reseedKeySize;
+            minLoadFactor = s.minLoadFactor;
             return *this;
         }
 
@@ -219,6 +276,9 @@ namespace gradylib {
             loadFactor = s.loadFactor;
             growthFactor = s.growthFactor;
             setSize = s.setSize;
+            hashSeed = s.hashSeed;
+            reseedKeySize = s.reseedKeySize;
+            minLoadFactor = s.minLoadFactor;
             readOnly = s.readOnly;
             fd = s.fd;
             memoryMapping = s.memoryMapping;
@@ -248,8 +308,9 @@ namespace gradylib {
             bool doesContain = false;
             size_t firstUnsetIdx = -1;
             bool isFirstUnsetIdxSet = false;
+            size_t probes = 0;
             if (keySize > 0) {
-                hash = hashFunction(key);
+                hash = hashOf(key);
                 idx = hash % keySize;
                 startIdx = idx;
                 for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
@@ -266,6 +327,7 @@ namespace gradylib {
                         break;
                     }
                     ++idx;
+                    ++probes;
                     idx = idx == keySize ? 0 : idx;
                     if (startIdx == idx) break;
                 }
@@ -273,9 +335,14 @@ namespace gradylib {
             if (doesContain) {
                 return;
             }
-            if (setSize >= keySize * loadFactor) {
-                rehash();
-                hash = hashFunction(key);
+            bool grow = setSize >= keySize * loadFactor;
+            if (grow || shouldReseed(probes)) {
+                if (grow) {
+                    rehash();
+                } else {
+                    reseed();
+                }
+                hash = hashOf(key);
                 idx = hash % keySize;
                 startIdx = idx;
                 while (setFlags.isFirstSet(idx)) {
@@ -293,7 +360,7 @@ namespace gradylib {
 
         bool contains(Key const &key) const {
             if (keySize == 0) return false;
-            size_t hash = hashFunction(key);
+            size_t hash = hashOf(key);
             size_t idx = hash % keySize;
             size_t startIdx = idx;
             for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
@@ -316,7 +383,7 @@ namespace gradylib {
                 sstr << "Cannot modify mmap";
                 throw gradylibMakeException(sstr.str());
             }
-            size_t hash = hashFunction(key);
+            size_t hash = hashOf(key);
             size_t idx = hash % keySize;
             size_t startIdx = idx;
             for (auto [isSet, wasSet] = setFlags[idx]; isSet || wasSet; std::tie(isSet, wasSet) = setFlags[idx]) {
@@ -324,6 +391,9 @@ namespace gradylib {
                     if (isSet) {
                         --setSize;
                         setFlags.unsetFirst(idx);
+                        if (setSize < keySize * minLoadFactor) {
+                            rebuild(setSize / ((minLoadFactor + loadFactor) / 2) + 1, nullptr);
+                        }
                     }
                     return;
                 }
@@ -342,6 +412,34 @@ namespace gradylib {
             rehash(size);
         }
 
+        // Shrink once erases leave fewer than minLoadFactor * capacity keys.  See OpenHashMap::setMinLoadFactor.
+        void setMinLoadFactor(double f) {
+            if (!(f >= 0 && f <= loadFactor / 2)) {
+                std::ostringstream sstr;
+                sstr << "OpenHashSetTC minimum load factor " << f << " must be between 0 and half the load factor";
+                throw gradylibMakeException(sstr.str());
+            }
+            minLoadFactor = f;
+        }
+
+        // Rebuild at the smallest capacity that holds the keys, which also drops the slots of erased keys.
+        void shrinkToFit(ThreadPool & tp) {
+            if (readOnly) {
+                std::ostringstream sstr;
+                sstr << "Cannot modify set";
+                throw gradylibMakeException(sstr.str());
+            }
+            rebuild(setSize / loadFactor + 1, &tp);
+        }
+
+        void shrinkToFit() {
+            shrinkToFit(gradylib_helpers::defaultThreadPool());
+        }
+
+        size_t capacity() const {
+            return keySize;
+        }
+
         class const_iterator {
             size_t idx;
             OpenHashSetTC const * container;
@@ -393,6 +491,24 @@ namespace gradylib {
             return setSize;
         }
 
+        // 0 until an insert probes too far and the set rehashes with a new seed.  It's written with the set.
+        uint64_t seed() const {
+            return hashSeed;
+        }
+
+        // k keys drawn uniformly at random, with replacement.  See SlotSampling.hpp.
+        template<typename UniformRandomBitGenerator>
+        std::vector<Key> sample(size_t k, UniformRandomBitGenerator & rng) const {
+            std::vector<Key> ret;
+            ret.reserve(setSize == 0 ? 0 : k);
+            gradylib_helpers::sampleSlots(setFlags, keySize, setSize, k, rng, [this](size_t j) {
+                __builtin_prefetch(&keys[j]);
+            }, [&ret, this](size_t j) {
+                ret.push_back(keys[j]);
+            });
+            return ret;
+        }
+
         void clear() {
             if (readOnly) {
                 std::ostringstream sstr;
@@ -405,10 +521,11 @@ namespace gradylib {
 
         /*
          * 8 set size
-         * 8 key size
+         * 8 key size, with gradylib_helpers::hashSeedHeaderFlag set
          * 8 load factor
          * 8 growth factor
          * 8 file offset from beg for the BitPairSet
+         * 8 hash seed (absent in files written before hash seeds, which have no flag and are read with seed 0)
          * sizeof(Key)*key size
          * (possible 4 byte pad, use offset above to skip over it)
          * 8 bit pair set size
@@ -418,19 +535,21 @@ namespace gradylib {
         void write(std::filesystem::path filename, int alignment = alignof(void*)) {
             std::ofstream ofs(filename, std::ios::binary);
             ofs.write((char *) &setSize, 8);
-            ofs.write((char *) &keySize, 8);
+            size_t keySizeWord = keySize | gradylib_helpers::hashSeedHeaderFlag;
+            ofs.write((char *) &keySizeWord, 8);
             ofs.write((char *) &loadFactor, 8);
             ofs.write((char *) &growthFactor, 8);
             size_t keyArraySize = sizeof(Key) * keySize;
             size_t bitPairSetOffset = ofs.tellp();
             int padLength = 0;
             if (keyArraySize % 8 == 0) {
-                bitPairSetOffset += 8 + keyArraySize;
+                bitPairSetOffset += 16 + keyArraySize;
             } else {
                 padLength = 8 - keyArraySize % 8;
-                bitPairSetOffset += 8 + keyArraySize + padLength;
+                bitPairSetOffset += 16 + keyArraySize + padLength;
             }
             ofs.write((char *) &bitPairSetOffset, 8);
+            ofs.write((char *) &hashSeed, 8);
             ofs.write((char *) keys, sizeof(Key) * keySize);
             if (padLength > 0) {
                 for (int i = 0; i < padLength; ++i) {
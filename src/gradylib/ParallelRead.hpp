@@ -0,0 +1,98 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * Helpers for loading large files into memory with pread from several threads at once.  One thread issuing
+ * ifstream reads is limited to a fraction of what an NVMe drive can deliver.  pwriteFully is the matching helper
+ * for filling a preallocated file from several threads.
+ */
+
+#pragma once
+
+#include<errno.h>
+#include<string.h>
+#include<unistd.h>
+
+#include<algorithm>
+#include<cstddef>
+#include<filesystem>
+#include<sstream>
+
+#include"Exception.hpp"
+#include"ThreadPool.hpp"
+
+namespace gradylib_helpers {
+
+    // Read exactly size bytes at offset, throwing on error or end of file.
+    inline void preadFully(int fd, void * dst, size_t size, size_t offset) {
+        char * p = static_cast<char *>(dst);
+        while (size > 0) {
+            ssize_t numRead = pread(fd, p, size, offset);
+            if (numRead < 0 && errno == EINTR) {
+                continue;
+            }
+            if (numRead <= 0) {
+                std::ostringstream sstr;
+                sstr << "pread of " << size << " bytes at offset " << offset << " failed: " << (numRead < 0 ? strerror(errno) : "end of file");
+                throw gradylibMakeException(sstr.str());
+            }
+            p += numRead;
+            offset += numRead;
+            size -= numRead;
+        }
+    }
+
+    // Write exactly size bytes at offset, throwing on error.
+    inline void pwriteFully(int fd, void const * src, size_t size, size_t offset) {
+        char const * p = static_cast<char const *>(src);
+        while (size > 0) {
+            ssize_t numWritten = pwrite(fd, p, size, offset);
+            if (numWritten < 0 && errno == EINTR) {
+                continue;
+            }
+            if (numWritten < 0) {
+                std::ostringstream sstr;
+                sstr << "pwrite of " << size << " bytes at offset " << offset << " failed: " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            p += numWritten;
+            offset += numWritten;
+            size -= numWritten;
+        }
+    }
+
+    // Read size bytes at offset into dst in chunks spread over the pool, returning when all of them are in.
+    inline void parallelPread(int fd, void * dst, size_t size, size_t offset, gradylib::ThreadPool & tp, size_t chunkSize = 8 << 20) {
+        size_t numChunks = (size + chunkSize - 1) / chunkSize;
+        if (numChunks <= 1) {
+            preadFully(fd, dst, size, offset);
+            return;
+        }
+        runTasks(tp, numChunks, [&](size_t chunk) {
+            size_t begin = chunk * chunkSize;
+            size_t len = std::min(chunkSize, size - begin);
+            preadFully(fd, static_cast<std::byte *>(dst) + begin, len, offset + begin);
+        });
+    }
+}
@@ -0,0 +1,290 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * Helpers behind the topK and sortedEntries methods of OpenHashMap and OpenHashMapTC.
+ *
+ * MapEntryRef points at a key and value inside a map.  It stays valid until the map is modified.
+ *
+ * topK keeps a heap of at most k entries per thread in parallelForEach and merges the heaps, so it needs O(k) memory
+ * per thread whatever the size of the map.  sortedEntries fills a vector with one MapEntryRef per entry, each task
+ * writing its own slot range straight into place, and sorts it in parallel.  Integer keys and values are sorted by
+ * a parallel LSD radix sort; anything else is sorted in chunks that are then merged in parallel.
+ */
+
+#pragma once
+
+#include<algorithm>
+#include<array>
+#include<concepts>
+#include<cstdint>
+#include<functional>
+#include<type_traits>
+#include<vector>
+
+#include"ThreadPool.hpp"
+
+namespace gradylib {
+
+    template<typename Key, typename Value>
+    class MapEntryRef {
+        Key const * keyPtr = nullptr;
+        Value const * valuePtr = nullptr;
+
+    public:
+        MapEntryRef() = default;
+
+        MapEntryRef(Key const * keyPtr, Value const * valuePtr)
+            : keyPtr(keyPtr), valuePtr(valuePtr)
+        {
+        }
+
+        Key const & key() const {
+            return *keyPtr;
+        }
+
+        Value const & value() const {
+            return *valuePtr;
+        }
+    };
+}
+
+namespace gradylib_helpers {
+
+    inline constexpr size_t minSortTaskSize = 1 << 14;
+
+    // How many tasks to split n items of work into.
+    inline size_t sortTaskCount(gradylib::ThreadPool & tp, size_t n) {
+        size_t maxTasks = 4 * static_cast<size_t>(std::max(1, tp.size()));
+        return std::max<size_t>(1, std::min(maxTasks, n / minSortTaskSize));
+    }
+
+    /*
+     * The k first elements under compare, where compare(a, b) is true when a comes before b.  The heap's front is
+     * the last of the kept elements, so a new element only has to beat that one to get in.
+     */
+    template<typename T, typename Compare>
+    class BoundedHeap {
+        std::vector<T> heap;
+        size_t k;
+        Compare compare;
+
+    public:
+        BoundedHeap(size_t k, Compare compare)
+            : k(k), compare(compare)
+        {
+            heap.reserve(k);
+        }
+
+        void push(T const & t) {
+            if (heap.size() < k) {
+                heap.push_back(t);
+                std::push_heap(heap.begin(), heap.end(), compare);
+            } else if (k > 0 && compare(t, heap.front())) {
+                std::pop_heap(heap.begin(), heap.end(), compare);
+                heap.back() = t;
+                std::push_heap(heap.begin(), heap.end(), compare);
+            }
+        }
+
+        std::vector<T> const & elements() const {
+            return heap;
+        }
+
+        std::vector<T> sorted() && {
+            std::sort_heap(heap.begin(), heap.end(), compare);
+            return std::move(heap);
+        }
+    };
+
+    template<typename T, typename Compare>
+    void mergePartials(BoundedHeap<T, Compare> & h1, BoundedHeap<T, Compare> const & h2) {
+        for (T const & t : h2.elements()) {
+            h1.push(t);
+        }
+    }
+
+    /*
+     * One element per set slot of [0, numSlots), in slot order, written into a vector of numSet elements.  The
+     * slots are counted per task first so that each task knows where its range starts in the output.
+     */
+    template<typename T, typename IsSet, typename MakeElement>
+    std::vector<T> collectSlots(gradylib::ThreadPool & tp, size_t numSlots, size_t numSet, IsSet isSet, MakeElement makeElement) {
+        std::vector<T> ret(numSet);
+        if (numSet == 0) {
+            return ret;
+        }
+        size_t numTasks = sortTaskCount(tp, numSlots);
+        std::vector<size_t> offsets(numTasks + 1, 0);
+        auto taskBegin = [&](size_t task) {
+            return numSlots * task / numTasks;
+        };
+        runTasks(tp, numTasks, [&](size_t task) {
+            size_t count = 0;
+            for (size_t j = taskBegin(task); j < taskBegin(task + 1); ++j) {
+                count += isSet(j) ? 1 : 0;
+            }
+            offsets[task + 1] = count;
+        });
+        for (size_t task = 0; task < numTasks; ++task) {
+            offsets[task + 1] += offsets[task];
+        }
+        runTasks(tp, numTasks, [&](size_t task) {
+            size_t out = offsets[task];
+            for (size_t j = taskBegin(task); j < taskBegin(task + 1); ++j) {
+                if (isSet(j)) {
+                    ret[out++] = makeElement(j);
+                }
+            }
+        });
+        return ret;
+    }
+
+    // Sort chunks of v on the pool, then merge pairs of runs until one is left.  Each merge is split between tasks
+    // at points found by binary search, so the last merge is as parallel as the first.
+    template<typename T, typename Compare>
+    void parallelSort(std::vector<T> & v, gradylib::ThreadPool & tp, Compare compare) {
+        size_t numChunks = sortTaskCount(tp, v.size());
+        if (numChunks == 1) {
+            std::sort(v.begin(), v.end(), compare);
+            return;
+        }
+        std::vector<size_t> runStarts;
+        for (size_t c = 0; c <= numChunks; ++c) {
+            runStarts.push_back(v.size() * c / numChunks);
+        }
+        runTasks(tp, numChunks, [&](size_t c) {
+            std::sort(v.begin() + runStarts[c], v.begin() + runStarts[c + 1], compare);
+        });
+        std::vector<T> buffer(v.size());
+        while (runStarts.size() > 2) {
+            struct MergeTask {
+                size_t aBegin, aEnd, bBegin, bEnd, out;
+            };
+            std::vector<MergeTask> tasks;
+            std::vector<size_t> nextRunStarts;
+            size_t numRuns = runStarts.size() - 1;
+            size_t splitsPerMerge = std::max<size_t>(1, numChunks / (numRuns / 2));
+            for (size_t r = 0; r < numRuns; r += 2) {
+                nextRunStarts.push_back(runStarts[r]);
+                size_t aBegin = runStarts[r];
+                size_t aEnd = runStarts[r + 1];
+                size_t bEnd = r + 2 <= numRuns ? runStarts[r + 2] : aEnd;
+                size_t prevA = aBegin;
+                size_t prevB = aEnd;
+                for (size_t s = 1; s <= splitsPerMerge; ++s) {
+                    size_t splitA = s == splitsPerMerge ? aEnd : aBegin + (aEnd - aBegin) * s / splitsPerMerge;
+                    size_t splitB = splitA == aEnd ? bEnd :
+                                    std::lower_bound(v.begin() + aEnd, v.begin() + bEnd, v[splitA], compare) - v.begin();
+                    tasks.push_back({prevA, splitA, prevB, splitB, prevA + (prevB - aEnd)});
+                    prevA = splitA;
+                    prevB = splitB;
+                }
+            }
+            nextRunStarts.push_back(v.size());
+            runTasks(tp, tasks.size(), [&](size_t t) {
+                MergeTask const & m = tasks[t];
+                std::merge(v.begin() + m.aBegin, v.begin() + m.aEnd, v.begin() + m.bBegin, v.begin() + m.bEnd,
+                           buffer.begin() + m.out, compare);
+            });
+            std::swap(v, buffer);
+            runStarts = std::move(nextRunStarts);
+        }
+    }
+
+    // The unsigned integer with the same order as t.
+    template<std::integral T>
+    uint64_t radixKey(T t) {
+        uint64_t u = static_cast<std::make_unsigned_t<T>>(t);
+        if constexpr (std::is_signed_v<T>) {
+            u ^= uint64_t{1} << (8 * sizeof(T) - 1);
+        }
+        return u;
+    }
+
+    /*
+     * A stable LSD radix sort on the integer key(t), a byte per pass.  Each pass counts digits per task, turns the
+     * counts into output positions, and scatters every task's elements to its own positions.  A pass where every
+     * element has the same digit is skipped.
+     */
+    template<typename T, typename KeyFunction>
+    void parallelRadixSort(std::vector<T> & v, gradylib::ThreadPool & tp, KeyFunction key) {
+        using K = std::remove_cvref_t<decltype(key(v[0]))>;
+        if (v.size() < 2) {
+            return;
+        }
+        size_t numTasks = sortTaskCount(tp, v.size());
+        auto taskBegin = [&](size_t task) {
+            return v.size() * task / numTasks;
+        };
+        std::vector<T> buffer(v.size());
+        std::vector<std::array<size_t, 256>> counts(numTasks);
+        for (size_t pass = 0; pass < sizeof(K); ++pass) {
+            int shift = 8 * pass;
+            runTasks(tp, numTasks, [&](size_t task) {
+                counts[task].fill(0);
+                for (size_t i = taskBegin(task); i < taskBegin(task + 1); ++i) {
+                    ++counts[task][(radixKey(key(v[i])) >> shift) & 0xff];
+                }
+            });
+            size_t position = 0;
+            bool oneDigit = false;
+            for (size_t digit = 0; digit < 256; ++digit) {
+                size_t total = 0;
+                for (size_t task = 0; task < numTasks; ++task) {
+                    total += counts[task][digit];
+                }
+                oneDigit = oneDigit || total == v.size();
+                for (size_t task = 0; task < numTasks; ++task) {
+                    size_t c = counts[task][digit];
+                    counts[task][digit] = position;
+                    position += c;
+                }
+            }
+            if (oneDigit) {
+                continue;
+            }
+            runTasks(tp, numTasks, [&](size_t task) {
+                std::array<size_t, 256> & out = counts[task];
+                for (size_t i = taskBegin(task); i < taskBegin(task + 1); ++i) {
+                    buffer[out[(radixKey(key(v[i])) >> shift) & 0xff]++] = v[i];
+                }
+            });
+            std::swap(v, buffer);
+        }
+    }
+
+    // Sort by key(t) ascending, with the radix sort when the key is an integer.
+    template<typename T, typename KeyFunction>
+    void parallelSortBy(std::vector<T> & v, gradylib::ThreadPool & tp, KeyFunction key) {
+        using K = std::remove_cvref_t<decltype(key(std::declval<T const &>()))>;
+        if constexpr (std::is_integral_v<K> && !std::same_as<K, bool>) {
+            parallelRadixSort(v, tp, key);
+        } else {
+            parallelSort(v, tp, [&key](T const & a, T const & b) {
+                return key(a) < key(b);
+            });
+        }
+    }
+}
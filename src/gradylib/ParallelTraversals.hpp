@@ -24,10 +24,15 @@ SOFTWARE.
 
 #pragma once
 
+#include<algorithm>
 #include<concepts>
 #include<future>
+#include<memory>
+#include<mutex>
 #include<vector>
 
+#include"ThreadPool.hpp"
+
 namespace gradylib_helpers {
 
     template<typename T>
@@ -44,4 +49,118 @@ namespace gradylib_helpers {
         }
     };
 
+    /*
+     * The body of a parallelForEach over an open address slot array.  The slots are split into numThreads equal
+     * ranges, visit(partial, slot) is called for every slot of a range in one task, and the partials are merged into
+     * the final value as the tasks finish.  visit is copied into each task, so the future may outlive this call.
+     */
+    template<typename ReturnValue, typename Visit, typename PartialInitializer, typename FinalInitializer>
+    std::future<ReturnValue> parallelForEachSlot(gradylib::ThreadPool & tp,
+                                                 size_t numSlots,
+                                                 size_t numThreads,
+                                                 Visit visit,
+                                                 PartialInitializer & partialInitializer,
+                                                 FinalInitializer & finalInitializer) {
+        if (numThreads == 0) {
+            numThreads = tp.size();
+        }
+        numThreads = std::min(numThreads, numSlots);
+        struct Result {
+            ReturnValue final;
+            std::mutex finalMutex;
+            std::promise<ReturnValue> promise;
+            size_t remainingThreads;
+
+            Result(ReturnValue && final, size_t remainingThreads)
+                    : final(std::move(final)), remainingThreads(remainingThreads)
+            {
+            }
+        };
+        std::shared_ptr<Result> result = std::make_shared<Result>(finalInitializer(numThreads), numThreads);
+        std::future<ReturnValue> future = result->promise.get_future();
+        if (numThreads == 0) {
+            result->promise.set_value(std::move(result->final));
+            return future;
+        }
+        size_t start = 0;
+        for (size_t threadIdx = 0; threadIdx < numThreads; ++threadIdx) {
+            size_t stop = start + numSlots / numThreads + (threadIdx < numSlots % numThreads ? 1 : 0);
+            tp.add([start, stop, visit, result, partial = partialInitializer(threadIdx, numThreads)]() mutable {
+                for (size_t j = start; j < stop; ++j) {
+                    visit(partial, j);
+                }
+                std::lock_guard lg(result->finalMutex);
+                mergePartials(result->final, partial);
+                if (result->remainingThreads == 1) {
+                    result->promise.set_value(std::move(result->final));
+                }
+                --result->remainingThreads;
+            });
+            start = stop;
+        }
+        return future;
+    }
+
+    // Shrinking rebuilds of tables with at least this many slots run on a thread pool.
+    inline constexpr size_t parallelRebuildSlots = size_t(1) << 20;
+
+    /*
+     * Move the set slots of an open address table into a new linear probing table of numNewSlots slots, on the pool.
+     * home(j) is the new home slot of the entry in old slot j, move(j, idx) moves that entry to new slot idx and marks
+     * idx set, and isNewSet(idx) says whether new slot idx is taken.  The new table is split into one range of whole
+     * 64 slot blocks per task, so no two tasks write the same BitPairSet word.  Each task places the entries whose
+     * home is in its range by probing within the range.  The few entries that probe off the end of a range are placed
+     * afterwards on the calling thread.  Every slot from an entry's home to its slot is set once all are placed,
+     * which is all a linear probing lookup needs.
+     */
+    template<typename IsSet, typename Home, typename IsNewSet, typename Move>
+    void rebuildSlots(gradylib::ThreadPool & tp, size_t numOldSlots, size_t numNewSlots, IsSet isSet, Home home,
+                      IsNewSet isNewSet, Move move) {
+        size_t numBlocks = (numNewSlots + 63) / 64;
+        size_t numTasks = std::max<size_t>(1, std::min<size_t>(tp.size(), numBlocks));
+        std::vector<size_t> rangeStarts(numTasks + 1);
+        for (size_t r = 0; r <= numTasks; ++r) {
+            rangeStarts[r] = std::min(numNewSlots, numBlocks * r / numTasks * 64);
+        }
+        // entries[t][r] holds the (old slot, home) pairs that task t found with a home in range r
+        using Entry = std::pair<size_t, size_t>;
+        std::vector<std::vector<std::vector<Entry>>> entries(numTasks, std::vector<std::vector<Entry>>(numTasks));
+        runTasks(tp, numTasks, [&](size_t t) {
+            for (size_t j = numOldSlots * t / numTasks; j < numOldSlots * (t + 1) / numTasks; ++j) {
+                if (isSet(j)) {
+                    size_t h = home(j);
+                    size_t r = std::upper_bound(rangeStarts.begin(), rangeStarts.end(), h) - rangeStarts.begin() - 1;
+                    entries[t][r].emplace_back(j, h);
+                }
+            }
+        });
+        std::vector<std::vector<Entry>> overflow(numTasks);
+        runTasks(tp, numTasks, [&](size_t r) {
+            size_t stop = rangeStarts[r + 1];
+            for (size_t t = 0; t < numTasks; ++t) {
+                for (auto [j, h] : entries[t][r]) {
+                    size_t idx = h;
+                    while (idx < stop && isNewSet(idx)) {
+                        ++idx;
+                    }
+                    if (idx == stop) {
+                        overflow[r].emplace_back(j, h);
+                    } else {
+                        move(j, idx);
+                    }
+                }
+                std::vector<Entry>().swap(entries[t][r]);
+            }
+        });
+        for (auto const & rangeOverflow : overflow) {
+            for (auto [j, h] : rangeOverflow) {
+                size_t idx = h;
+                while (isNewSet(idx)) {
+                    ++idx;
+                    idx = idx == numNewSlots ? 0 : idx;
+                }
+                move(j, idx);
+            }
+        }
+    }
 }
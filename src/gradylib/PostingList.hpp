@@ -0,0 +1,359 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * PostingList is a value type for MMapViewableOpenHashMap that stores a sorted list of non-negative int32_t, such as
+ * the document ids of a posting list, compressed.  Use MMapViewableOpenHashMap<Key, PostingList>; its Builder writes
+ * the lists and at() returns a PostingListView straight out of the mapping.
+ *
+ * The list is delta coded.  Full blocks of 128 deltas are bit packed at the width of the largest delta in the block.
+ * Within a block, delta i goes to lane i % 4 and the lanes are packed side by side, as in SIMD-BP128, so the pack and
+ * unpack loops do the same thing to four lanes at every step and the compiler turns them into vector instructions.
+ * The remaining deltas, fewer than 128, are stored as varints.  A skip table holds the last value of every block,
+ * which lets a cursor's advanceTo pass over whole blocks without decoding them.
+ *
+ * Serialized layout, starting 8 byte aligned:
+ *     size, numBlocks                       (uint32_t each)
+ *     skip table                            (numBlocks PostingBlockHeader: last value, offset of the block's data)
+ *     block widths                          (numBlocks uint8_t, postingVarintBlock for the varint tail)
+ *     padding to 4 bytes
+ *     block data                            (bit packed blocks, 16 * width bytes each, then the varint tail)
+ */
+
+#pragma once
+
+#include<algorithm>
+#include<bit>
+#include<cstdint>
+#include<cstring>
+#include<fstream>
+#include<sstream>
+#include<string>
+#include<utility>
+#include<vector>
+
+#include"Common.hpp"
+#include"Exception.hpp"
+
+namespace gradylib_helpers {
+    inline constexpr size_t postingBlockSize = 128;
+    inline constexpr uint8_t postingVarintBlock = 0xff;
+
+    struct PostingBlockHeader {
+        uint32_t lastValue;
+        uint32_t dataOffset;
+    };
+
+    // Packs 128 values of at most width bits into 4 * width words.  Word j of lane l is out[4 * j + l].
+    inline void packPostingBlock(uint32_t const * in, int width, uint32_t * out) {
+        if (width == 0) {
+            return;
+        }
+        uint32_t acc[4] = {0, 0, 0, 0};
+        int bits = 0;
+        for (size_t k = 0; k < postingBlockSize / 4; ++k) {
+            for (size_t l = 0; l < 4; ++l) {
+                acc[l] |= in[4 * k + l] << bits;
+            }
+            bits += width;
+            if (bits >= 32) {
+                bits -= 32;
+                for (size_t l = 0; l < 4; ++l) {
+                    *out++ = acc[l];
+                    acc[l] = bits == 0 ? 0 : in[4 * k + l] >> (width - bits);
+                }
+            }
+        }
+    }
+
+    inline void unpackPostingBlock(uint32_t const * in, int width, uint32_t * out) {
+        if (width == 0) {
+            std::fill(out, out + postingBlockSize, 0);
+            return;
+        }
+        uint32_t mask = width == 32 ? ~uint32_t{0} : (uint32_t{1} << width) - 1;
+        uint32_t cur[4];
+        std::copy(in, in + 4, cur);
+        in += 4;
+        int bits = 0;
+        for (size_t k = 0; k < postingBlockSize / 4; ++k) {
+            if (bits + width <= 32) {
+                for (size_t l = 0; l < 4; ++l) {
+                    out[4 * k + l] = (cur[l] >> bits) & mask;
+                }
+                bits += width;
+                if (bits == 32 && k + 1 < postingBlockSize / 4) {
+                    std::copy(in, in + 4, cur);
+                    in += 4;
+                    bits = 0;
+                }
+            } else {
+                // The value straddles two words of its lane
+                for (size_t l = 0; l < 4; ++l) {
+                    out[4 * k + l] = ((cur[l] >> bits) | (in[l] << (32 - bits))) & mask;
+                }
+                std::copy(in, in + 4, cur);
+                in += 4;
+                bits += width - 32;
+            }
+        }
+    }
+
+    inline std::string encodePostings(std::vector<int32_t> const & ids) {
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (ids[i] < 0 || (i > 0 && ids[i] < ids[i - 1])) {
+                std::ostringstream sstr;
+                sstr << "PostingList values must be sorted and non-negative, found " << ids[i] << " at position " << i;
+                throw gradylibMakeException(sstr.str());
+            }
+        }
+        size_t numFull = ids.size() / postingBlockSize;
+        size_t numBlocks = numFull + (ids.size() % postingBlockSize == 0 ? 0 : 1);
+        std::vector<PostingBlockHeader> headers(numBlocks);
+        std::vector<uint8_t> widths(numBlocks);
+        std::string data;
+        uint32_t deltas[postingBlockSize];
+        uint32_t packed[postingBlockSize];
+        uint32_t prev = 0;
+        for (size_t b = 0; b < numBlocks; ++b) {
+            size_t begin = b * postingBlockSize;
+            size_t end = std::min(ids.size(), begin + postingBlockSize);
+            headers[b] = {static_cast<uint32_t>(ids[end - 1]), static_cast<uint32_t>(data.size())};
+            if (b < numFull) {
+                uint32_t all = 0;
+                for (size_t i = begin; i < end; ++i) {
+                    deltas[i - begin] = static_cast<uint32_t>(ids[i]) - prev;
+                    all |= deltas[i - begin];
+                    prev = static_cast<uint32_t>(ids[i]);
+                }
+                int width = std::bit_width(all);
+                widths[b] = static_cast<uint8_t>(width);
+                packPostingBlock(deltas, width, packed);
+                data.append(charCast(packed), 16 * width);
+            } else {
+                widths[b] = postingVarintBlock;
+                for (size_t i = begin; i < end; ++i) {
+                    appendVarint(data, static_cast<uint32_t>(ids[i]) - prev);
+                    prev = static_cast<uint32_t>(ids[i]);
+                }
+            }
+        }
+        std::string out;
+        uint32_t counts[2] = {static_cast<uint32_t>(ids.size()), static_cast<uint32_t>(numBlocks)};
+        out.append(charCast(counts), sizeof(counts));
+        out.append(charCast(headers.data()), numBlocks * sizeof(PostingBlockHeader));
+        out.append(charCast(widths.data()), numBlocks);
+        out.resize((out.size() + 3) / 4 * 4, 0);
+        out.append(data);
+        return out;
+    }
+}
+
+namespace gradylib {
+
+    class PostingListCursor;
+
+    // A compressed posting list in a mapping.  Valid as long as the map it came from.
+    class PostingListView {
+        using PostingBlockHeader = gradylib_helpers::PostingBlockHeader;
+
+        uint32_t count = 0;
+        uint32_t blocks = 0;
+        PostingBlockHeader const * headers = nullptr;
+        uint8_t const * widths = nullptr;
+        std::byte const * data = nullptr;
+
+    public:
+        PostingListView() = default;
+
+        explicit PostingListView(std::byte const * ptr) {
+            uint32_t counts[2];
+            memcpy(counts, ptr, sizeof(counts));
+            count = counts[0];
+            blocks = counts[1];
+            headers = static_cast<PostingBlockHeader const *>(static_cast<void const *>(ptr + sizeof(counts)));
+            widths = static_cast<uint8_t const *>(static_cast<void const *>(headers + blocks));
+            size_t dataOffset = (sizeof(counts) + blocks * (sizeof(PostingBlockHeader) + 1) + 3) / 4 * 4;
+            data = ptr + dataOffset;
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        bool empty() const {
+            return count == 0;
+        }
+
+        size_t numBlocks() const {
+            return blocks;
+        }
+
+        int32_t blockLastValue(size_t block) const {
+            return static_cast<int32_t>(headers[block].lastValue);
+        }
+
+        // Decodes block into out, which must have room for 128 values, and returns the number of values.
+        size_t decodeBlock(size_t block, int32_t * out) const {
+            namespace gh = gradylib_helpers;
+            uint32_t * uout = static_cast<uint32_t *>(static_cast<void *>(out));
+            uint32_t value = block == 0 ? 0 : headers[block - 1].lastValue;
+            std::byte const * ptr = data + headers[block].dataOffset;
+            if (widths[block] == gh::postingVarintBlock) {
+                size_t n = count - block * gh::postingBlockSize;
+                for (size_t i = 0; i < n; ++i) {
+                    value += static_cast<uint32_t>(gh::readVarint(ptr));
+                    uout[i] = value;
+                }
+                return n;
+            }
+            gh::unpackPostingBlock(static_cast<uint32_t const *>(static_cast<void const *>(ptr)), widths[block], uout);
+            for (size_t i = 0; i < gh::postingBlockSize; ++i) {
+                value += uout[i];
+                uout[i] = value;
+            }
+            return gh::postingBlockSize;
+        }
+
+        // Decodes the whole list into out, which must have room for size() values.
+        void decode(int32_t * out) const {
+            for (size_t b = 0; b < blocks; ++b) {
+                out += decodeBlock(b, out);
+            }
+        }
+
+        std::vector<int32_t> toVector() const {
+            std::vector<int32_t> ret(count);
+            decode(ret.data());
+            return ret;
+        }
+
+        PostingListCursor cursor() const;
+    };
+
+    // Walks the list one block at a time.
+    class PostingListCursor {
+        PostingListView view;
+        size_t block = 0;
+        size_t pos = 0;
+        size_t n = 0;
+        int32_t buffer[gradylib_helpers::postingBlockSize];
+
+        void load(size_t b) {
+            block = b;
+            pos = 0;
+            n = b < view.numBlocks() ? view.decodeBlock(b, buffer) : 0;
+        }
+
+    public:
+        explicit PostingListCursor(PostingListView view)
+            : view(view)
+        {
+            load(0);
+        }
+
+        bool atEnd() const {
+            return pos == n;
+        }
+
+        int32_t value() const {
+            return buffer[pos];
+        }
+
+        void next() {
+            if (++pos == n) {
+                load(block + 1);
+            }
+        }
+
+        // Moves to the first value that is at least target, or to the end.  Blocks whose last value is below
+        // target are found by binary search on the skip table and never decoded.
+        void advanceTo(int32_t target) {
+            if (atEnd() || buffer[pos] >= target) {
+                return;
+            }
+            if (view.blockLastValue(block) < target) {
+                size_t lo = block + 1;
+                size_t hi = view.numBlocks();
+                while (lo < hi) {
+                    size_t mid = lo + (hi - lo) / 2;
+                    if (view.blockLastValue(mid) < target) {
+                        lo = mid + 1;
+                    } else {
+                        hi = mid;
+                    }
+                }
+                load(lo);
+                if (atEnd()) {
+                    return;
+                }
+            }
+            while (buffer[pos] < target) {
+                ++pos;
+            }
+        }
+    };
+
+    inline PostingListCursor PostingListView::cursor() const {
+        return PostingListCursor(*this);
+    }
+
+    class PostingList {
+    public:
+        std::vector<int32_t> ids;
+
+        PostingList() = default;
+
+        PostingList(std::vector<int32_t> ids)
+            : ids(std::move(ids))
+        {
+        }
+
+        void serialize(std::ofstream & ofs) const {
+            std::string encoded = gradylib_helpers::encodePostings(ids);
+            ofs.write(encoded.data(), encoded.size());
+        }
+
+        static PostingListView makeView(std::byte const * ptr) {
+            return PostingListView(ptr);
+        }
+    };
+
+    // Appends the values common to a and b to out, in order, with the same multiplicity as std::set_intersection.
+    inline void intersect(PostingListView const & a, PostingListView const & b, std::vector<int32_t> & out) {
+        PostingListCursor ca = a.cursor();
+        PostingListCursor cb = b.cursor();
+        while (!ca.atEnd() && !cb.atEnd()) {
+            if (ca.value() < cb.value()) {
+                ca.advanceTo(cb.value());
+            } else if (cb.value() < ca.value()) {
+                cb.advanceTo(ca.value());
+            } else {
+                out.push_back(ca.value());
+                ca.next();
+                cb.next();
+            }
+        }
+    }
+}
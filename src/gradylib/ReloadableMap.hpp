@@ -0,0 +1,340 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * ReloadableMap holds a read-only map loaded from a file (MMapS2IOpenHashMap, OpenHashMapTC, MMapI2HRSOpenHashMap,
+ * etc.) and swaps in a new one whenever the file is republished.
+ *
+ * The file is watched with inotify (polling its modification time on other systems).  When it changes, a
+ * background thread constructs the new map, reads the file through the page cache to warm it, and atomically
+ * publishes it.  Readers never block on a reload.
+ *
+ * The old map is destroyed, and so unmapped, only after every reader that could have seen it has released its
+ * Handle.  This uses a two-epoch scheme: a reader registers in the counter of the current epoch's parity, the
+ * reloader flips the epoch after publishing and then waits for the old parity's counters to drain.  The counters
+ * are striped across cache lines and each thread sticks to one stripe, so acquiring a handle costs two
+ * uncontended atomic increments.
+ *
+ * Publish new files by writing to a temporary name and renaming over the watched path.  Rewriting the file in
+ * place changes the bytes under the readers of the old mapping.
+ *
+ * Handles should be short-lived.  A reload waits for all the handles taken out before it.
+ */
+
+#pragma once
+
+#include<fcntl.h>
+#include<poll.h>
+#include<unistd.h>
+
+#ifdef __linux__
+#include<sys/inotify.h>
+#endif
+
+#include<atomic>
+#include<chrono>
+#include<filesystem>
+#include<memory>
+#include<mutex>
+#include<sstream>
+#include<string>
+#include<thread>
+#include<type_traits>
+#include<vector>
+
+#include"Exception.hpp"
+
+namespace gradylib {
+
+    template<typename MapType>
+    requires std::is_constructible_v<MapType, std::filesystem::path>
+    class ReloadableMap {
+        static constexpr size_t numStripes = 64;
+
+        struct alignas(64) Stripe {
+            std::atomic<int64_t> readers{0};
+        };
+
+        std::filesystem::path path;
+        std::atomic<MapType *> current{nullptr};
+        std::atomic<uint64_t> epoch{0};
+        std::unique_ptr<Stripe[]> stripes[2];
+        std::mutex reloadMutex;
+        std::thread watcher;
+        std::atomic<bool> stop{false};
+        std::atomic<size_t> numReloads{0};
+        std::atomic<size_t> numFailedReloads{0};
+        std::string lastErrorMessage;
+        mutable std::mutex errorMutex;
+        bool warmOnReload = true;
+        int inotifyFd = -1;
+        std::filesystem::file_time_type lastWriteTime;
+
+        static size_t stripeIndex() {
+            static std::atomic<size_t> nextStripe{0};
+            static thread_local size_t stripe = nextStripe.fetch_add(1, std::memory_order_relaxed) % numStripes;
+            return stripe;
+        }
+
+        // Pull the whole file into the page cache so the first lookups after the swap don't fault on disk reads.
+        static void warm(std::filesystem::path const & p) {
+            int fd = open(p.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return;
+            }
+#ifdef __linux__
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+            std::vector<char> buffer(1 << 20);
+            while (read(fd, buffer.data(), buffer.size()) > 0) {
+            }
+            close(fd);
+        }
+
+        void publish(std::unique_ptr<MapType> newMap) {
+            std::lock_guard lg(reloadMutex);
+            MapType * old = current.exchange(newMap.release(), std::memory_order_seq_cst);
+            // Readers arriving from here on register under the other parity.  Wait for the ones that registered
+            // under the old parity, since they may be holding the old map.
+            uint64_t oldEpoch = epoch.fetch_add(1, std::memory_order_seq_cst);
+            Stripe * oldStripes = stripes[oldEpoch & 1].get();
+            for (size_t i = 0; i < numStripes; ++i) {
+                while (oldStripes[i].readers.load(std::memory_order_acquire) != 0) {
+                    std::this_thread::yield();
+                }
+            }
+            delete old;
+        }
+
+        void recordError(std::string const & message) {
+            std::lock_guard lg(errorMutex);
+            lastErrorMessage = message;
+            numFailedReloads.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Set up the watch before the initial load so that no republish can slip in between the two.
+        void startWatching() {
+#ifdef __linux__
+            inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (inotifyFd >= 0) {
+                std::filesystem::path dir = path.parent_path().empty() ? std::filesystem::path(".") : path.parent_path();
+                // Watch the directory rather than the file so that renames over the path are seen
+                if (inotify_add_watch(inotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+                    close(inotifyFd);
+                    inotifyFd = -1;
+                }
+            }
+#endif
+            std::error_code ec;
+            lastWriteTime = std::filesystem::last_write_time(path, ec);
+        }
+
+        void watch() {
+#ifdef __linux__
+            if (inotifyFd >= 0) {
+                watchInotify();
+                return;
+            }
+#endif
+            pollForChanges();
+        }
+
+#ifdef __linux__
+        void watchInotify() {
+            std::string filename = path.filename().string();
+            alignas(inotify_event) char buffer[4096];
+            while (!stop.load(std::memory_order_relaxed)) {
+                pollfd pfd{inotifyFd, POLLIN, 0};
+                if (poll(&pfd, 1, 200) <= 0) {
+                    continue;
+                }
+                bool changed = false;
+                ssize_t len;
+                while ((len = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+                    for (char * p = buffer; p < buffer + len; ) {
+                        inotify_event const * event = static_cast<inotify_event const *>(static_cast<void const *>(p));
+                        if (event->len > 0 && filename == event->name) {
+                            changed = true;
+                        }
+                        p += sizeof(inotify_event) + event->len;
+                    }
+                }
+                if (changed) {
+                    reload();
+                }
+            }
+        }
+#endif
+
+        void pollForChanges() {
+            std::error_code ec;
+            while (!stop.load(std::memory_order_relaxed)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                auto t = std::filesystem::last_write_time(path, ec);
+                if (!ec && t != lastWriteTime) {
+                    lastWriteTime = t;
+                    reload();
+                }
+            }
+        }
+
+    public:
+
+        class Handle {
+            MapType const * map = nullptr;
+            std::atomic<int64_t> * readers = nullptr;
+
+        public:
+            Handle(MapType const * map, std::atomic<int64_t> * readers)
+                : map(map), readers(readers)
+            {
+            }
+
+            Handle(Handle const &) = delete;
+
+            Handle & operator=(Handle const &) = delete;
+
+            Handle(Handle && h) noexcept
+                : map(h.map), readers(h.readers)
+            {
+                h.map = nullptr;
+                h.readers = nullptr;
+            }
+
+            Handle & operator=(Handle && h) noexcept {
+                if (this == &h) {
+                    return *this;
+                }
+                if (readers) {
+                    readers->fetch_sub(1, std::memory_order_release);
+                }
+                map = h.map;
+                readers = h.readers;
+                h.map = nullptr;
+                h.readers = nullptr;
+                return *this;
+            }
+
+            ~Handle() {
+                if (readers) {
+                    readers->fetch_sub(1, std::memory_order_release);
+                }
+            }
+
+            MapType const & operator*() const {
+                return *map;
+            }
+
+            MapType const * operator->() const {
+                return map;
+            }
+        };
+
+        // Loads the map now, throwing if that fails.  If watchFile is true, a background thread reloads the map
+        // whenever the file is replaced.
+        explicit ReloadableMap(std::filesystem::path path, bool watchFile = true, bool warmOnReload = true)
+            : path(path), warmOnReload(warmOnReload)
+        {
+            stripes[0] = std::make_unique<Stripe[]>(numStripes);
+            stripes[1] = std::make_unique<Stripe[]>(numStripes);
+            if (watchFile) {
+                startWatching();
+            }
+            try {
+                current.store(new MapType(path), std::memory_order_release);
+            } catch (...) {
+                if (inotifyFd >= 0) {
+                    close(inotifyFd);
+                }
+                throw;
+            }
+            if (watchFile) {
+                watcher = std::thread([this]() {
+                    watch();
+                });
+            }
+        }
+
+        ReloadableMap(ReloadableMap const &) = delete;
+
+        ReloadableMap & operator=(ReloadableMap const &) = delete;
+
+        // All handles must be released before the ReloadableMap is destroyed.
+        ~ReloadableMap() {
+            stop.store(true, std::memory_order_relaxed);
+            if (watcher.joinable()) {
+                watcher.join();
+            }
+            if (inotifyFd >= 0) {
+                close(inotifyFd);
+            }
+            delete current.load(std::memory_order_acquire);
+        }
+
+        Handle acquire() const {
+            size_t stripe = stripeIndex();
+            while (true) {
+                uint64_t e = epoch.load(std::memory_order_seq_cst);
+                std::atomic<int64_t> & readers = stripes[e & 1][stripe].readers;
+                readers.fetch_add(1, std::memory_order_seq_cst);
+                // If a reload flipped the epoch in between, the reloader may already have finished waiting on this
+                // counter.  Back out and register under the new epoch.
+                if (epoch.load(std::memory_order_seq_cst) == e) {
+                    return Handle(current.load(std::memory_order_seq_cst), &readers);
+                }
+                readers.fetch_sub(1, std::memory_order_release);
+            }
+        }
+
+        // Load the file again and swap it in.  Returns false, keeping the current map, if the file can't be loaded.
+        bool reload() {
+            std::unique_ptr<MapType> newMap;
+            try {
+                newMap = std::make_unique<MapType>(path);
+            } catch (std::exception const & e) {
+                recordError(e.what());
+                return false;
+            }
+            if (warmOnReload) {
+                warm(path);
+            }
+            publish(std::move(newMap));
+            numReloads.fetch_add(1, std::memory_order_release);
+            return true;
+        }
+
+        size_t reloadCount() const {
+            return numReloads.load(std::memory_order_acquire);
+        }
+
+        size_t failedReloadCount() const {
+            return numFailedReloads.load(std::memory_order_relaxed);
+        }
+
+        std::string lastError() const {
+            std::lock_guard lg(errorMutex);
+            return lastErrorMessage;
+        }
+    };
+}
@@ -0,0 +1,844 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * RoaringSet is a compressed set of uint32_t in the style of Roaring bitmaps, for large, dense sets such as document
+ * ids where OpenHashSetTC<uint32_t> spends more than five bytes per element.
+ *
+ * The values are split by their high 16 bits into chunks, kept in key order.  Each chunk holds the low 16 bits of its
+ * values in one of three containers:
+ *     array    sorted uint16_t, for chunks of at most 4096 values
+ *     bitset   1024 uint64_t words, for fuller chunks
+ *     run      sorted (start, length - 1) pairs of uint16_t, for values that come in long runs
+ * insert and erase keep arrays and bitsets on the right side of 4096 values.  Run containers are only made by
+ * runOptimize and by the constructors that take a batch of values, and a run container that is modified turns back
+ * into an array or a bitset.
+ *
+ * setUnion and setIntersection work on RoaringSet and MMapRoaringSet in any combination.  Bitset containers are
+ * combined a word at a time in loops the compiler vectorizes, and arrays are merged or probed against the other
+ * container.
+ *
+ * write() saves the set in a format that MMapRoaringSet maps.  File layout:
+ *     numChunks, size                       (8 bytes each)
+ *     chunk headers                         (numChunks RoaringChunkHeader)
+ *     container data                        (8 byte aligned, at the offsets in the chunk headers)
+ *     integrity trailer
+ */
+
+#pragma once
+
+#include<errno.h>
+#include<fcntl.h>
+#include<string.h>
+#include<sys/mman.h>
+#include<unistd.h>
+
+#include<algorithm>
+#include<bit>
+#include<cstdint>
+#include<filesystem>
+#include<fstream>
+#include<iterator>
+#include<sstream>
+#include<utility>
+#include<vector>
+
+#include"AltIntHash.hpp"
+#include"Common.hpp"
+#include"Exception.hpp"
+#include"Integrity.hpp"
+#include"OpenHashSetTC.hpp"
+
+namespace gradylib_helpers {
+
+    enum class RoaringContainerType : uint8_t {
+        Array = 0,
+        Bitset = 1,
+        Run = 2,
+    };
+
+    inline constexpr uint32_t roaringArrayMax = 4096;
+    inline constexpr size_t roaringBitsetWords = 1024;
+    inline constexpr uint32_t roaringChunkRange = 1 << 16;
+
+    struct RoaringContainerView {
+        RoaringContainerType type;
+        uint32_t cardinality;
+        // Array values or run pairs, numValues uint16_t in either case
+        uint16_t const * values;
+        size_t numValues;
+        uint64_t const * bits;
+    };
+
+    struct RoaringContainer {
+        RoaringContainerType type = RoaringContainerType::Array;
+        uint32_t cardinality = 0;
+        std::vector<uint16_t> values;
+        std::vector<uint64_t> bits;
+
+        RoaringContainerView view() const {
+            return {type, cardinality, values.data(), values.size(), bits.data()};
+        }
+    };
+
+    struct RoaringChunkHeader {
+        uint64_t offset;
+        uint32_t cardinality;
+        uint32_t count;
+        uint16_t key;
+        RoaringContainerType type;
+        uint8_t pad[5];
+    };
+    static_assert(sizeof(RoaringChunkHeader) == 24);
+
+    // Returns the first bit at or after from that is set, or clear if set is false, or roaringChunkRange if there is none.
+    inline uint32_t roaringNextBit(uint64_t const * words, uint32_t from, bool set) {
+        if (from >= roaringChunkRange) {
+            return roaringChunkRange;
+        }
+        size_t w = from >> 6;
+        uint64_t word = (set ? words[w] : ~words[w]) & (~uint64_t{0} << (from & 63));
+        while (word == 0) {
+            if (++w == roaringBitsetWords) {
+                return roaringChunkRange;
+            }
+            word = set ? words[w] : ~words[w];
+        }
+        return static_cast<uint32_t>(w * 64 + std::countr_zero(word));
+    }
+
+    inline bool roaringContains(RoaringContainerView const & c, uint16_t low) {
+        switch (c.type) {
+            case RoaringContainerType::Array:
+                return std::binary_search(c.values, c.values + c.numValues, low);
+            case RoaringContainerType::Bitset:
+                return (c.bits[low >> 6] >> (low & 63)) & 1;
+            case RoaringContainerType::Run: {
+                // Find the last run that starts at or before low
+                size_t lo = 0;
+                size_t hi = c.numValues / 2;
+                while (lo < hi) {
+                    size_t mid = lo + (hi - lo) / 2;
+                    if (c.values[2 * mid] <= low) {
+                        lo = mid + 1;
+                    } else {
+                        hi = mid;
+                    }
+                }
+                return lo > 0 && low - c.values[2 * (lo - 1)] <= c.values[2 * (lo - 1) + 1];
+            }
+        }
+        return false;
+    }
+
+    // ORs the members of c into 1024 bitset words.
+    inline void roaringOrInto(RoaringContainerView const & c, uint64_t * words) {
+        switch (c.type) {
+            case RoaringContainerType::Array:
+                for (size_t i = 0; i < c.numValues; ++i) {
+                    words[c.values[i] >> 6] |= uint64_t{1} << (c.values[i] & 63);
+                }
+                break;
+            case RoaringContainerType::Bitset:
+                for (size_t i = 0; i < roaringBitsetWords; ++i) {
+                    words[i] |= c.bits[i];
+                }
+                break;
+            case RoaringContainerType::Run:
+                for (size_t r = 0; r < c.numValues; r += 2) {
+                    uint32_t begin = c.values[r];
+                    uint32_t end = begin + c.values[r + 1] + 1;
+                    while (begin < end) {
+                        uint32_t bit = begin & 63;
+                        uint32_t n = std::min<uint32_t>(64 - bit, end - begin);
+                        uint64_t mask = n == 64 ? ~uint64_t{0} : ((uint64_t{1} << n) - 1) << bit;
+                        words[begin >> 6] |= mask;
+                        begin += n;
+                    }
+                }
+                break;
+        }
+    }
+
+    inline std::vector<uint64_t> roaringToBits(RoaringContainerView const & c) {
+        std::vector<uint64_t> words(roaringBitsetWords, 0);
+        roaringOrInto(c, words.data());
+        return words;
+    }
+
+    // Makes an array or a bitset container from bitset words, whichever fits the cardinality.
+    inline RoaringContainer roaringFromBits(std::vector<uint64_t> && words) {
+        RoaringContainer c;
+        for (uint64_t w : words) {
+            c.cardinality += std::popcount(w);
+        }
+        if (c.cardinality > roaringArrayMax) {
+            c.type = RoaringContainerType::Bitset;
+            c.bits = std::move(words);
+            return c;
+        }
+        c.values.reserve(c.cardinality);
+        for (size_t i = 0; i < roaringBitsetWords; ++i) {
+            for (uint64_t w = words[i]; w != 0; w &= w - 1) {
+                c.values.push_back(static_cast<uint16_t>(i * 64 + std::countr_zero(w)));
+            }
+        }
+        return c;
+    }
+
+    // Makes an array or a bitset container from sorted, distinct values.
+    inline RoaringContainer roaringFromArray(std::vector<uint16_t> && values) {
+        if (values.size() > roaringArrayMax) {
+            std::vector<uint64_t> words(roaringBitsetWords, 0);
+            for (uint16_t v : values) {
+                words[v >> 6] |= uint64_t{1} << (v & 63);
+            }
+            return roaringFromBits(std::move(words));
+        }
+        RoaringContainer c;
+        c.cardinality = static_cast<uint32_t>(values.size());
+        c.values = std::move(values);
+        return c;
+    }
+
+    inline RoaringContainer roaringCopy(RoaringContainerView const & c) {
+        RoaringContainer ret;
+        ret.type = c.type;
+        ret.cardinality = c.cardinality;
+        if (c.type == RoaringContainerType::Bitset) {
+            ret.bits.assign(c.bits, c.bits + roaringBitsetWords);
+        } else {
+            ret.values.assign(c.values, c.values + c.numValues);
+        }
+        return ret;
+    }
+
+    // Rewrites c as runs if that takes less space than its current form.
+    inline void roaringRunOptimize(RoaringContainer & c) {
+        if (c.type == RoaringContainerType::Run || c.cardinality == 0) {
+            return;
+        }
+        std::vector<uint16_t> runs;
+        if (c.type == RoaringContainerType::Array) {
+            for (uint16_t v : c.values) {
+                if (!runs.empty() && runs[runs.size() - 2] + runs.back() + 1 == v) {
+                    ++runs.back();
+                } else {
+                    runs.push_back(v);
+                    runs.push_back(0);
+                }
+            }
+        } else {
+            uint32_t start = roaringNextBit(c.bits.data(), 0, true);
+            while (start < roaringChunkRange) {
+                uint32_t end = roaringNextBit(c.bits.data(), start, false);
+                runs.push_back(static_cast<uint16_t>(start));
+                runs.push_back(static_cast<uint16_t>(end - start - 1));
+                start = roaringNextBit(c.bits.data(), end, true);
+            }
+        }
+        size_t currentBytes = c.type == RoaringContainerType::Array ? 2 * c.values.size() : 8 * roaringBitsetWords;
+        if (2 * runs.size() < currentBytes) {
+            c.type = RoaringContainerType::Run;
+            c.values = std::move(runs);
+            c.values.shrink_to_fit();
+            c.bits = std::vector<uint64_t>();
+        }
+    }
+
+    inline RoaringContainer roaringIntersect(RoaringContainerView const & a, RoaringContainerView const & b) {
+        if (a.type == RoaringContainerType::Array || b.type == RoaringContainerType::Array) {
+            RoaringContainerView const & arr = a.type == RoaringContainerType::Array ? a : b;
+            RoaringContainerView const & other = a.type == RoaringContainerType::Array ? b : a;
+            std::vector<uint16_t> out;
+            if (other.type == RoaringContainerType::Array) {
+                std::set_intersection(arr.values, arr.values + arr.numValues, other.values, other.values + other.numValues, std::back_inserter(out));
+            } else {
+                for (size_t i = 0; i < arr.numValues; ++i) {
+                    if (roaringContains(other, arr.values[i])) {
+                        out.push_back(arr.values[i]);
+                    }
+                }
+            }
+            return roaringFromArray(std::move(out));
+        }
+        std::vector<uint64_t> words;
+        std::vector<uint64_t> other;
+        if (a.type == RoaringContainerType::Bitset) {
+            words.assign(a.bits, a.bits + roaringBitsetWords);
+        } else {
+            words = roaringToBits(a);
+        }
+        uint64_t const * bits = b.bits;
+        if (b.type != RoaringContainerType::Bitset) {
+            other = roaringToBits(b);
+            bits = other.data();
+        }
+        for (size_t i = 0; i < roaringBitsetWords; ++i) {
+            words[i] &= bits[i];
+        }
+        return roaringFromBits(std::move(words));
+    }
+
+    inline RoaringContainer roaringUnion(RoaringContainerView const & a, RoaringContainerView const & b) {
+        if (a.type == RoaringContainerType::Array && b.type == RoaringContainerType::Array) {
+            std::vector<uint16_t> out;
+            out.reserve(a.numValues + b.numValues);
+            std::set_union(a.values, a.values + a.numValues, b.values, b.values + b.numValues, std::back_inserter(out));
+            return roaringFromArray(std::move(out));
+        }
+        std::vector<uint64_t> words = roaringToBits(a);
+        roaringOrInto(b, words.data());
+        return roaringFromBits(std::move(words));
+    }
+
+    // Iterates the values of a RoaringSet or an MMapRoaringSet in increasing order.
+    template<typename Set>
+    class RoaringConstIterator {
+        Set const * set;
+        size_t chunk;
+        size_t idx = 0;
+        uint32_t low = 0;
+        RoaringContainerView view{};
+
+        void enter() {
+            idx = 0;
+            low = 0;
+            if (chunk == set->numChunks()) {
+                return;
+            }
+            view = set->container(chunk);
+            if (view.type == RoaringContainerType::Bitset) {
+                low = roaringNextBit(view.bits, 0, true);
+            } else {
+                low = view.values[0];
+            }
+        }
+
+        void nextChunk() {
+            ++chunk;
+            enter();
+        }
+
+    public:
+        RoaringConstIterator(Set const * set, size_t chunk)
+            : set(set), chunk(chunk)
+        {
+            enter();
+        }
+
+        bool operator==(RoaringConstIterator const & other) const {
+            return chunk == other.chunk && idx == other.idx && low == other.low;
+        }
+
+        bool operator!=(RoaringConstIterator const & other) const {
+            return !(*this == other);
+        }
+
+        uint32_t operator*() const {
+            return (static_cast<uint32_t>(set->chunkKey(chunk)) << 16) | low;
+        }
+
+        RoaringConstIterator & operator++() {
+            switch (view.type) {
+                case RoaringContainerType::Array:
+                    if (++idx == view.numValues) {
+                        nextChunk();
+                    } else {
+                        low = view.values[idx];
+                    }
+                    break;
+                case RoaringContainerType::Bitset:
+                    low = roaringNextBit(view.bits, low + 1, true);
+                    if (low == roaringChunkRange) {
+                        nextChunk();
+                    }
+                    break;
+                case RoaringContainerType::Run:
+                    if (low < static_cast<uint32_t>(view.values[2 * idx]) + view.values[2 * idx + 1]) {
+                        ++low;
+                    } else if (++idx == view.numValues / 2) {
+                        nextChunk();
+                    } else {
+                        low = view.values[2 * idx];
+                    }
+                    break;
+            }
+            return *this;
+        }
+    };
+}
+
+namespace gradylib {
+
+    template<typename Set>
+    concept roaring_set = requires (Set const & s, size_t i) {
+        { s.numChunks() } -> std::convertible_to<size_t>;
+        { s.chunkKey(i) } -> std::convertible_to<uint16_t>;
+        { s.container(i) } -> std::same_as<gradylib_helpers::RoaringContainerView>;
+    };
+
+    class RoaringSet;
+
+    template<roaring_set A, roaring_set B>
+    RoaringSet setUnion(A const & a, B const & b);
+
+    template<roaring_set A, roaring_set B>
+    RoaringSet setIntersection(A const & a, B const & b);
+
+    // Copies any roaring set into an OpenHashSetTC.
+    template<template<typename> typename HashFunction = gradylib::AltHash, roaring_set Set>
+    OpenHashSetTC<uint32_t, HashFunction> toOpenHashSetTC(Set const & s) {
+        OpenHashSetTC<uint32_t, HashFunction> ret;
+        ret.reserve(s.size());
+        for (uint32_t v : s) {
+            ret.insert(v);
+        }
+        return ret;
+    }
+
+    class RoaringSet {
+        using Container = gradylib_helpers::RoaringContainer;
+        using ContainerType = gradylib_helpers::RoaringContainerType;
+
+        std::vector<uint16_t> keys;
+        std::vector<Container> containers;
+        size_t setSize = 0;
+
+        void appendChunk(uint16_t key, Container && c) {
+            setSize += c.cardinality;
+            keys.push_back(key);
+            containers.push_back(std::move(c));
+        }
+
+        // Builds from sorted, distinct values.
+        void buildSorted(std::vector<uint32_t> const & values) {
+            size_t i = 0;
+            while (i < values.size()) {
+                uint16_t key = static_cast<uint16_t>(values[i] >> 16);
+                std::vector<uint16_t> lows;
+                for (; i < values.size() && (values[i] >> 16) == key; ++i) {
+                    lows.push_back(static_cast<uint16_t>(values[i]));
+                }
+                Container c = gradylib_helpers::roaringFromArray(std::move(lows));
+                gradylib_helpers::roaringRunOptimize(c);
+                appendChunk(key, std::move(c));
+            }
+        }
+
+        template<roaring_set A, roaring_set B>
+        friend RoaringSet setUnion(A const & a, B const & b);
+
+        template<roaring_set A, roaring_set B>
+        friend RoaringSet setIntersection(A const & a, B const & b);
+
+    public:
+        typedef uint32_t key_type;
+        typedef uint32_t value_type;
+
+        using const_iterator = gradylib_helpers::RoaringConstIterator<RoaringSet>;
+
+        RoaringSet() = default;
+
+        explicit RoaringSet(std::vector<uint32_t> values) {
+            std::sort(values.begin(), values.end());
+            values.erase(std::unique(values.begin(), values.end()), values.end());
+            buildSorted(values);
+        }
+
+        template<template<typename> typename HashFunction>
+        explicit RoaringSet(OpenHashSetTC<uint32_t, HashFunction> const & s) {
+            std::vector<uint32_t> values;
+            values.reserve(s.size());
+            for (uint32_t v : s) {
+                values.push_back(v);
+            }
+            std::sort(values.begin(), values.end());
+            buildSorted(values);
+        }
+
+        void insert(uint32_t value) {
+            namespace gh = gradylib_helpers;
+            uint16_t key = static_cast<uint16_t>(value >> 16);
+            uint16_t low = static_cast<uint16_t>(value);
+            auto keyIter = std::lower_bound(keys.begin(), keys.end(), key);
+            size_t i = keyIter - keys.begin();
+            if (keyIter == keys.end() || *keyIter != key) {
+                keys.insert(keyIter, key);
+                containers.insert(containers.begin() + i, Container());
+            }
+            Container & c = containers[i];
+            if (c.type == ContainerType::Run) {
+                c = gh::roaringFromBits(gh::roaringToBits(c.view()));
+            }
+            if (c.type == ContainerType::Array) {
+                auto pos = std::lower_bound(c.values.begin(), c.values.end(), low);
+                if (pos != c.values.end() && *pos == low) {
+                    return;
+                }
+                c.values.insert(pos, low);
+                ++c.cardinality;
+                ++setSize;
+                if (c.cardinality > gh::roaringArrayMax) {
+                    c = gh::roaringFromArray(std::move(c.values));
+                }
+            } else {
+                uint64_t mask = uint64_t{1} << (low & 63);
+                uint64_t & word = c.bits[low >> 6];
+                if (word & mask) {
+                    return;
+                }
+                word |= mask;
+                ++c.cardinality;
+                ++setSize;
+            }
+        }
+
+        void erase(uint32_t value) {
+            namespace gh = gradylib_helpers;
+            uint16_t key = static_cast<uint16_t>(value >> 16);
+            uint16_t low = static_cast<uint16_t>(value);
+            auto keyIter = std::lower_bound(keys.begin(), keys.end(), key);
+            if (keyIter == keys.end() || *keyIter != key) {
+                return;
+            }
+            size_t i = keyIter - keys.begin();
+            Container & c = containers[i];
+            if (!gh::roaringContains(c.view(), low)) {
+                return;
+            }
+            if (c.type == ContainerType::Run) {
+                c = gh::roaringFromBits(gh::roaringToBits(c.view()));
+            }
+            if (c.type == ContainerType::Array) {
+                c.values.erase(std::lower_bound(c.values.begin(), c.values.end(), low));
+                --c.cardinality;
+            } else {
+                c.bits[low >> 6] &= ~(uint64_t{1} << (low & 63));
+                --c.cardinality;
+                if (c.cardinality <= gh::roaringArrayMax) {
+                    c = gh::roaringFromBits(std::move(c.bits));
+                }
+            }
+            --setSize;
+            if (c.cardinality == 0) {
+                keys.erase(keyIter);
+                containers.erase(containers.begin() + i);
+            }
+        }
+
+        bool contains(uint32_t value) const {
+            uint16_t key = static_cast<uint16_t>(value >> 16);
+            auto keyIter = std::lower_bound(keys.begin(), keys.end(), key);
+            if (keyIter == keys.end() || *keyIter != key) {
+                return false;
+            }
+            return gradylib_helpers::roaringContains(containers[keyIter - keys.begin()].view(), static_cast<uint16_t>(value));
+        }
+
+        size_t size() const {
+            return setSize;
+        }
+
+        bool empty() const {
+            return setSize == 0;
+        }
+
+        void clear() {
+            keys.clear();
+            containers.clear();
+            setSize = 0;
+        }
+
+        // Converts every container to runs where that is smaller.
+        void runOptimize() {
+            for (auto & c : containers) {
+                gradylib_helpers::roaringRunOptimize(c);
+            }
+        }
+
+        // Bytes allocated by the set, not counting the RoaringSet object itself
+        size_t memoryUsage() const {
+            size_t bytes = keys.capacity() * sizeof(uint16_t) + containers.capacity() * sizeof(Container);
+            for (auto const & c : containers) {
+                bytes += c.values.capacity() * sizeof(uint16_t) + c.bits.capacity() * sizeof(uint64_t);
+            }
+            return bytes;
+        }
+
+        size_t numChunks() const {
+            return keys.size();
+        }
+
+        uint16_t chunkKey(size_t chunk) const {
+            return keys[chunk];
+        }
+
+        gradylib_helpers::RoaringContainerView container(size_t chunk) const {
+            return containers[chunk].view();
+        }
+
+        const_iterator begin() const {
+            return const_iterator(this, 0);
+        }
+
+        const_iterator end() const {
+            return const_iterator(this, keys.size());
+        }
+
+        template<template<typename> typename HashFunction = gradylib::AltHash>
+        OpenHashSetTC<uint32_t, HashFunction> toOpenHashSetTC() const {
+            return gradylib::toOpenHashSetTC<HashFunction>(*this);
+        }
+
+        void write(std::filesystem::path filename) const {
+            namespace gh = gradylib_helpers;
+            std::ofstream ofs(filename, std::ios::binary);
+            if (ofs.fail()) {
+                std::ostringstream sstr;
+                sstr << "Couldn't open " << filename << " for writing in RoaringSet::write";
+                throw gradylibMakeException(sstr.str());
+            }
+            size_t numChunks = keys.size();
+            ofs.write(gh::charCast(&numChunks), 8);
+            ofs.write(gh::charCast(&setSize), 8);
+            std::vector<gh::RoaringChunkHeader> headers(numChunks);
+            size_t offset = 16 + numChunks * sizeof(gh::RoaringChunkHeader);
+            for (size_t i = 0; i < numChunks; ++i) {
+                Container const & c = containers[i];
+                headers[i] = {};
+                headers[i].offset = offset;
+                headers[i].cardinality = c.cardinality;
+                headers[i].count = static_cast<uint32_t>(c.type == ContainerType::Bitset ? c.bits.size() : c.values.size());
+                headers[i].key = keys[i];
+                headers[i].type = c.type;
+                size_t bytes = c.type == ContainerType::Bitset ? c.bits.size() * 8 : c.values.size() * 2;
+                offset += (bytes + 7) / 8 * 8;
+            }
+            ofs.write(gh::charCast(headers.data()), numChunks * sizeof(gh::RoaringChunkHeader));
+            for (auto const & c : containers) {
+                if (c.type == ContainerType::Bitset) {
+                    ofs.write(gh::charCast(c.bits.data()), c.bits.size() * 8);
+                } else {
+                    ofs.write(gh::charCast(c.values.data()), c.values.size() * 2);
+                }
+                gh::writePad<8>(ofs);
+            }
+            ofs.close();
+            if (ofs.fail()) {
+                std::ostringstream sstr;
+                sstr << "Writing " << filename << " failed in RoaringSet::write.";
+                throw gradylibMakeException(sstr.str());
+            }
+            appendIntegrityTrailer(filename);
+        }
+    };
+
+    // Read only, memory mapped view of a file written by RoaringSet::write.
+    class MMapRoaringSet {
+        using ChunkHeader = gradylib_helpers::RoaringChunkHeader;
+
+        ChunkHeader const * headers = nullptr;
+        size_t chunks = 0;
+        size_t setSize = 0;
+        std::byte const * base = nullptr;
+        int fd = -1;
+        size_t mappingSize = 0;
+        void * memoryMapping = nullptr;
+        static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
+
+        void checkContainers() const {
+            namespace gh = gradylib_helpers;
+            for (size_t i = 0; i < chunks; ++i) {
+                ChunkHeader const & h = headers[i];
+                size_t unit = h.type == gh::RoaringContainerType::Bitset ? 8 : 2;
+                bool validCount = h.type == gh::RoaringContainerType::Bitset ? h.count == gh::roaringBitsetWords : h.count > 0;
+                if (static_cast<uint8_t>(h.type) > 2 || !validCount || (h.type == gh::RoaringContainerType::Run && h.count % 2 != 0)) {
+                    std::ostringstream sstr;
+                    sstr << "MMapRoaringSet file has a corrupt header for chunk " << i;
+                    throw gradylibMakeException(sstr.str());
+                }
+                gh::checkMappedExtent(h.offset + h.count * unit, mappingSize, "MMapRoaringSet");
+            }
+        }
+
+    public:
+        typedef uint32_t key_type;
+        typedef uint32_t value_type;
+
+        using const_iterator = gradylib_helpers::RoaringConstIterator<MMapRoaringSet>;
+
+        // If verify is true, the file's integrity trailer is checked in parallel before the constructor returns.
+        explicit MMapRoaringSet(std::filesystem::path filename, bool verify = false) {
+            namespace gh = gradylib_helpers;
+            fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                std::ostringstream sstr;
+                sstr << "Error opening file " << filename;
+                throw gradylibMakeException(sstr.str());
+            }
+            mappingSize = std::filesystem::file_size(filename);
+            memoryMapping = mmapFunc(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+            if (memoryMapping == MAP_FAILED) {
+                close(fd);
+                memoryMapping = nullptr;
+                std::ostringstream sstr;
+                sstr << "memory map failed: " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            base = static_cast<std::byte const *>(memoryMapping);
+            try {
+                if (verify) {
+                    IntegrityVerifier(memoryMapping, mappingSize).verifyAll();
+                }
+                gh::checkMappedExtent(16, mappingSize, "MMapRoaringSet");
+                memcpy(&chunks, base, 8);
+                memcpy(&setSize, base + 8, 8);
+                gh::checkMappedExtent(chunks > gh::roaringChunkRange ? SIZE_MAX : 16 + chunks * sizeof(ChunkHeader), mappingSize, "MMapRoaringSet");
+                headers = static_cast<ChunkHeader const *>(static_cast<void const *>(base + 16));
+                checkContainers();
+            } catch (...) {
+                munmap(memoryMapping, mappingSize);
+                close(fd);
+                throw;
+            }
+        }
+
+        MMapRoaringSet(MMapRoaringSet const &) = delete;
+
+        MMapRoaringSet & operator=(MMapRoaringSet const &) = delete;
+
+        ~MMapRoaringSet() {
+            if (memoryMapping) {
+                munmap(memoryMapping, mappingSize);
+                close(fd);
+            }
+        }
+
+        bool contains(uint32_t value) const {
+            uint16_t key = static_cast<uint16_t>(value >> 16);
+            ChunkHeader const * h = std::lower_bound(headers, headers + chunks, key, [](ChunkHeader const & header, uint16_t k) {
+                return header.key < k;
+            });
+            if (h == headers + chunks || h->key != key) {
+                return false;
+            }
+            return gradylib_helpers::roaringContains(container(h - headers), static_cast<uint16_t>(value));
+        }
+
+        size_t size() const {
+            return setSize;
+        }
+
+        bool empty() const {
+            return setSize == 0;
+        }
+
+        size_t numChunks() const {
+            return chunks;
+        }
+
+        uint16_t chunkKey(size_t chunk) const {
+            return headers[chunk].key;
+        }
+
+        gradylib_helpers::RoaringContainerView container(size_t chunk) const {
+            ChunkHeader const & h = headers[chunk];
+            void const * data = base + h.offset;
+            return {h.type, h.cardinality, static_cast<uint16_t const *>(data), h.count, static_cast<uint64_t const *>(data)};
+        }
+
+        const_iterator begin() const {
+            return const_iterator(this, 0);
+        }
+
+        const_iterator end() const {
+            return const_iterator(this, chunks);
+        }
+
+        template<template<typename> typename HashFunction = gradylib::AltHash>
+        OpenHashSetTC<uint32_t, HashFunction> toOpenHashSetTC() const {
+            return gradylib::toOpenHashSetTC<HashFunction>(*this);
+        }
+
+        friend void GRADY_LIB_MOCK_MMapRoaringSet_MMAP();
+
+        friend void GRADY_LIB_DEFAULT_MMapRoaringSet_MMAP();
+    };
+
+    inline void GRADY_LIB_MOCK_MMapRoaringSet_MMAP() {
+        MMapRoaringSet::mmapFunc = [](void *, size_t, int, int, int, off_t) -> void *{
+            return MAP_FAILED;
+        };
+    }
+
+    inline void GRADY_LIB_DEFAULT_MMapRoaringSet_MMAP() {
+        MMapRoaringSet::mmapFunc = mmap;
+    }
+
+    template<roaring_set A, roaring_set B>
+    RoaringSet setUnion(A const & a, B const & b) {
+        namespace gh = gradylib_helpers;
+        RoaringSet ret;
+        size_t i = 0;
+        size_t j = 0;
+        while (i < a.numChunks() || j < b.numChunks()) {
+            if (j == b.numChunks() || (i < a.numChunks() && a.chunkKey(i) < b.chunkKey(j))) {
+                ret.appendChunk(a.chunkKey(i), gh::roaringCopy(a.container(i)));
+                ++i;
+            } else if (i == a.numChunks() || b.chunkKey(j) < a.chunkKey(i)) {
+                ret.appendChunk(b.chunkKey(j), gh::roaringCopy(b.container(j)));
+                ++j;
+            } else {
+                ret.appendChunk(a.chunkKey(i), gh::roaringUnion(a.container(i), b.container(j)));
+                ++i;
+                ++j;
+            }
+        }
+        return ret;
+    }
+
+    template<roaring_set A, roaring_set B>
+    RoaringSet setIntersection(A const & a, B const & b) {
+        namespace gh = gradylib_helpers;
+        RoaringSet ret;
+        size_t i = 0;
+        size_t j = 0;
+        while (i < a.numChunks() && j < b.numChunks()) {
+            if (a.chunkKey(i) < b.chunkKey(j)) {
+                ++i;
+            } else if (b.chunkKey(j) < a.chunkKey(i)) {
+                ++j;
+            } else {
+                gh::RoaringContainer c = gh::roaringIntersect(a.container(i), b.container(j));
+                if (c.cardinality > 0) {
+                    ret.appendChunk(a.chunkKey(i), std::move(c));
+                }
+                ++i;
+                ++j;
+            }
+        }
+        return ret;
+    }
+}
@@ -0,0 +1,78 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * Uniform random sampling of the entries of an open address container without iterating it.  A random slot is drawn
+ * and kept if it holds an entry, otherwise another one is drawn.  At load factor f a sample takes 1 / f draws on
+ * average, so k samples cost O(k / f) however big the container is.  Draws are made in groups: the set flags of a
+ * whole group are prefetched before any is tested, then the slots that hold entries are prefetched before any is
+ * read, so the cache misses of a group overlap.
+ *
+ * Samples are drawn with replacement.  A container that has had most of its entries erased without shrinking has a
+ * low load factor and takes correspondingly more draws.
+ */
+
+#pragma once
+
+#include<cstddef>
+#include<random>
+
+#include"BitPairSet.hpp"
+
+namespace gradylib_helpers {
+
+    inline constexpr size_t sampleGroupSize = 16;
+
+    /*
+     * Calls emit(slot) k times with uniformly random set slots of [0, numSlots).  prefetchSlot(slot) should prefetch
+     * whatever emit will read.  Nothing is emitted if numSet is 0.
+     */
+    template<typename UniformRandomBitGenerator, typename PrefetchSlot, typename Emit>
+    void sampleSlots(gradylib::BitPairSet const & setFlags, size_t numSlots, size_t numSet, size_t k,
+                     UniformRandomBitGenerator & rng, PrefetchSlot prefetchSlot, Emit emit) {
+        if (numSet == 0 || numSlots == 0) {
+            return;
+        }
+        std::uniform_int_distribution<size_t> slotDistribution(0, numSlots - 1);
+        size_t slots[sampleGroupSize];
+        size_t numEmitted = 0;
+        while (numEmitted < k) {
+            for (size_t i = 0; i < sampleGroupSize; ++i) {
+                slots[i] = slotDistribution(rng);
+                setFlags.prefetch(slots[i]);
+            }
+            size_t numHits = 0;
+            for (size_t i = 0; i < sampleGroupSize; ++i) {
+                if (setFlags.isFirstSet(slots[i])) {
+                    slots[numHits++] = slots[i];
+                    prefetchSlot(slots[i]);
+                }
+            }
+            for (size_t i = 0; i < numHits && numEmitted < k; ++i) {
+                emit(slots[i]);
+                ++numEmitted;
+            }
+        }
+    }
+}
@@ -0,0 +1,405 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * SmallOpenHashMap<Key, Value, N> is for programs that keep a very large number of maps, most of which hold only a
+ * few entries, such as one map per document.
+ *
+ * Up to N entries are stored inline in the object, in insertion order with no hash table, and found with a linear
+ * scan.  For arithmetic keys the scan compares all N slots without branching so the compiler can vectorize it.  An
+ * empty or small map allocates nothing.  When an insertion would make the map hold more than N entries, the entries
+ * move into an OpenHashMap on the heap and every later operation goes to it.  The map stays in that form until
+ * clear() is called.
+ *
+ * sizeof(SmallOpenHashMap<int32_t, float, 8>) is 80 bytes.
+ *
+ * Erasing an inline entry moves the last inline entry into its place, so references and iterators are invalidated by
+ * any change to the map, as with OpenHashMap.
+ */
+
+#pragma once
+
+#include<array>
+#include<bit>
+#include<cstdint>
+#include<memory>
+#include<optional>
+#include<sstream>
+#include<type_traits>
+#include<utility>
+
+#include"AltIntHash.hpp"
+#include"Exception.hpp"
+#include"OpenHashMap.hpp"
+
+namespace gradylib {
+
+    template<typename Key, typename Value, size_t N = 8, template<typename> typename HashFunction = gradylib::AltHash>
+    requires std::is_default_constructible_v<Key> && std::is_default_constructible_v<Value> && (N > 0 && N <= 64)
+    class SmallOpenHashMap {
+        using SpilledMap = OpenHashMap<Key, Value, HashFunction>;
+
+        std::array<Key, N> keys{};
+        std::array<Value, N> values{};
+        uint32_t inlineSize = 0;
+        std::unique_ptr<SpilledMap> spilled;
+
+        // Returns the inline index of key, or inlineSize if it isn't inline.
+        template<typename KeyType>
+        size_t findInline(KeyType const & key) const {
+            if constexpr (std::is_arithmetic_v<Key> && std::same_as<Key, std::remove_cvref_t<KeyType>>) {
+                // Compare every slot, unused ones included, and mask off the unused ones afterward.  There are no
+                // branches in the loop so it compiles to a few vector compares.
+                uint64_t matches = 0;
+                for (size_t i = 0; i < N; ++i) {
+                    matches |= static_cast<uint64_t>(keys[i] == key) << i;
+                }
+                if (inlineSize < 64) {
+                    matches &= (uint64_t{1} << inlineSize) - 1;
+                }
+                return matches == 0 ? inlineSize : std::countr_zero(matches);
+            } else {
+                size_t idx = 0;
+                while (idx < inlineSize && !(keys[idx] == key)) {
+                    ++idx;
+                }
+                return idx;
+            }
+        }
+
+        void spill() {
+            spilled = std::make_unique<SpilledMap>(2 * N);
+            for (size_t i = 0; i < inlineSize; ++i) {
+                spilled->put(std::move(keys[i]), std::move(values[i]));
+                keys[i] = Key{};
+                values[i] = Value{};
+            }
+            inlineSize = 0;
+        }
+
+    public:
+        typedef Key key_type;
+        typedef Value mapped_type;
+
+        static constexpr size_t inlineCapacity = N;
+
+        SmallOpenHashMap() = default;
+
+        SmallOpenHashMap(SmallOpenHashMap const & other)
+            : keys(other.keys), values(other.values), inlineSize(other.inlineSize)
+        {
+            if (other.spilled) {
+                spilled = std::make_unique<SpilledMap>(*other.spilled);
+            }
+        }
+
+        SmallOpenHashMap(SmallOpenHashMap &&) = default;
+
+        SmallOpenHashMap & operator=(SmallOpenHashMap const & other) {
+            if (this != &other) {
+                SmallOpenHashMap tmp(other);
+                *this = std::move(tmp);
+            }
+            return *this;
+        }
+
+        SmallOpenHashMap & operator=(SmallOpenHashMap &&) = default;
+
+        // True once the map has grown past N entries and moved to an OpenHashMap.
+        bool isSpilled() const {
+            return spilled != nullptr;
+        }
+
+        template<typename KeyType>
+        requires std::is_same_v<std::remove_cvref_t<KeyType>, Key> ||
+                 std::is_convertible_v<Key, std::remove_cvref_t<KeyType>> ||
+                 (std::is_constructible_v<Key, KeyType> && std::is_assignable_v<Key, KeyType>)
+        Value &operator[](KeyType && key) {
+            if (spilled) {
+                return (*spilled)[std::forward<KeyType>(key)];
+            }
+            size_t idx = findInline(key);
+            if (idx < inlineSize) {
+                return values[idx];
+            }
+            if (inlineSize == N) {
+                spill();
+                return (*spilled)[std::forward<KeyType>(key)];
+            }
+            keys[idx] = std::forward<KeyType>(key);
+            values[idx] = Value{};
+            ++inlineSize;
+            return values[idx];
+        }
+
+        template<typename KeyType, typename ValueType>
+        requires (std::is_same_v<std::remove_cvref_t<KeyType>, Key> ||
+                 std::is_convertible_v<Key, std::remove_cvref_t<KeyType>> ||
+                 (std::is_constructible_v<Key, KeyType> && std::is_assignable_v<Key, KeyType>)) &&
+                 std::is_same_v<std::remove_cvref_t<ValueType>, Value>
+        void put(KeyType && key, ValueType && value) {
+            if (spilled) {
+                spilled->put(std::forward<KeyType>(key), std::forward<ValueType>(value));
+                return;
+            }
+            size_t idx = findInline(key);
+            if (idx < inlineSize) {
+                values[idx] = std::forward<ValueType>(value);
+                return;
+            }
+            if (inlineSize == N) {
+                spill();
+                spilled->put(std::forward<KeyType>(key), std::forward<ValueType>(value));
+                return;
+            }
+            keys[idx] = std::forward<KeyType>(key);
+            values[idx] = std::forward<ValueType>(value);
+            ++inlineSize;
+        }
+
+        template<typename KeyType>
+        requires (std::is_convertible_v<Key, std::remove_cvref_t<KeyType>> ||
+                 std::is_constructible_v<Key, KeyType>) &&
+                 gradylib_helpers::equality_comparable<KeyType, Key>
+        bool contains(KeyType const &key) const {
+            if (spilled) {
+                return spilled->contains(key);
+            }
+            return findInline(key) < inlineSize;
+        }
+
+        template<typename KeyType>
+        requires (std::is_constructible_v<Key, KeyType> ||
+                 std::is_convertible_v<Key, std::remove_cvref_t<KeyType>>) &&
+                 gradylib_helpers::equality_comparable<KeyType, Key>
+        Value & at(KeyType const &key) {
+            if (spilled) {
+                return spilled->at(key);
+            }
+            size_t idx = findInline(key);
+            if (idx == inlineSize) {
+                std::ostringstream sstr;
+                sstr << "SmallOpenHashMap doesn't contain key";
+                throw gradylibMakeException(sstr.str());
+            }
+            return values[idx];
+        }
+
+        template<typename KeyType>
+        requires (std::is_constructible_v<Key, KeyType> ||
+                 std::is_convertible_v<Key, std::remove_cvref_t<KeyType>>) &&
+                 gradylib_helpers::equality_comparable<KeyType, Key>
+        Value const & at(KeyType const &key) const {
+            return const_cast<SmallOpenHashMap*>(this)->at(key);
+        }
+
+        template<typename KeyType>
+        requires (std::is_constructible_v<Key, KeyType> ||
+                 std::is_convertible_v<Key, std::remove_cvref_t<KeyType>>) &&
+                 gradylib_helpers::equality_comparable<KeyType, Key>
+        gradylib_helpers::MapLookup<Value> get(KeyType const &key) {
+            if (spilled) {
+                return spilled->get(key);
+            }
+            size_t idx = findInline(key);
+            if (idx == inlineSize) {
+                return gradylib_helpers::MapLookup<Value>();
+            }
+            return gradylib_helpers::MapLookup<Value>(&values[idx]);
+        }
+
+        template<typename KeyType>
+        requires (std::is_constructible_v<Key, KeyType> ||
+                 std::is_convertible_v<Key, std::remove_cvref_t<KeyType>>) &&
+                 gradylib_helpers::equality_comparable<KeyType, Key>
+        gradylib_helpers::MapLookup<Value const> get(KeyType const &key) const {
+            return const_cast<SmallOpenHashMap*>(this)->get(key).makeConst();
+        }
+
+        template<typename KeyType>
+        requires (std::is_constructible_v<Key, KeyType> ||
+                  std::is_convertible_v<Key, std::remove_cvref_t<KeyType>>) &&
+                  gradylib_helpers::equality_comparable<KeyType, Key>
+        void erase(KeyType const &key) {
+            if (spilled) {
+                spilled->erase(key);
+                return;
+            }
+            size_t idx = findInline(key);
+            if (idx == inlineSize) {
+                return;
+            }
+            size_t last = inlineSize - 1;
+            if (idx != last) {
+                keys[idx] = std::move(keys[last]);
+                values[idx] = std::move(values[last]);
+            }
+            // Reset the vacated slot so it doesn't hold on to the resources of a removed key or value.
+            keys[last] = Key{};
+            values[last] = Value{};
+            --inlineSize;
+        }
+
+        // Only a size greater than N does anything: the map moves to an OpenHashMap with room for size entries.
+        void reserve(size_t size) {
+            if (size <= N && !spilled) {
+                return;
+            }
+            if (!spilled) {
+                spill();
+            }
+            spilled->reserve(size);
+        }
+
+        // Releases the spilled OpenHashMap, if there is one, and returns the map to inline storage.
+        void clear() {
+            spilled.reset();
+            for (size_t i = 0; i < inlineSize; ++i) {
+                keys[i] = Key{};
+                values[i] = Value{};
+            }
+            inlineSize = 0;
+        }
+
+        size_t size() const {
+            return spilled ? spilled->size() : inlineSize;
+        }
+
+        bool empty() const {
+            return size() == 0;
+        }
+
+        class iterator {
+            size_t idx;
+            SmallOpenHashMap *container;
+            typename SpilledMap::iterator spilledIter;
+        public:
+            iterator(size_t idx, SmallOpenHashMap *container, typename SpilledMap::iterator spilledIter)
+                    : idx(idx), container(container), spilledIter(spilledIter) {
+            }
+
+            bool operator==(iterator const &other) const {
+                return idx == other.idx && container == other.container && spilledIter == other.spilledIter;
+            }
+
+            bool operator!=(iterator const &other) const {
+                return !(*this == other);
+            }
+
+            std::pair<Key const &, Value &> operator*() {
+                if (container->spilled) {
+                    return *spilledIter;
+                }
+                return {container->keys[idx], container->values[idx]};
+            }
+
+            Key const &key() const {
+                return container->spilled ? spilledIter.key() : container->keys[idx];
+            }
+
+            Value &value() {
+                return container->spilled ? spilledIter.value() : container->values[idx];
+            }
+
+            iterator &operator++() {
+                if (container->spilled) {
+                    ++spilledIter;
+                } else if (idx < container->inlineSize) {
+                    ++idx;
+                }
+                return *this;
+            }
+        };
+
+        iterator begin() {
+            if (spilled) {
+                return iterator(0, this, spilled->begin());
+            }
+            return iterator(0, this, typename SpilledMap::iterator(0, nullptr));
+        }
+
+        iterator end() {
+            if (spilled) {
+                return iterator(0, this, spilled->end());
+            }
+            return iterator(inlineSize, this, typename SpilledMap::iterator(0, nullptr));
+        }
+
+        class const_iterator {
+            size_t idx;
+            SmallOpenHashMap const *container;
+            typename SpilledMap::const_iterator spilledIter;
+        public:
+            const_iterator(size_t idx, SmallOpenHashMap const *container, typename SpilledMap::const_iterator spilledIter)
+                    : idx(idx), container(container), spilledIter(spilledIter) {
+            }
+
+            bool operator==(const_iterator const &other) const {
+                return idx == other.idx && container == other.container && spilledIter == other.spilledIter;
+            }
+
+            bool operator!=(const_iterator const &other) const {
+                return !(*this == other);
+            }
+
+            std::pair<Key const &, Value const &> operator*() const {
+                if (container->spilled) {
+                    return *spilledIter;
+                }
+                return {container->keys[idx], container->values[idx]};
+            }
+
+            Key const &key() const {
+                return container->spilled ? spilledIter.key() : container->keys[idx];
+            }
+
+            Value const &value() const {
+                return container->spilled ? spilledIter.value() : container->values[idx];
+            }
+
+            const_iterator &operator++() {
+                if (container->spilled) {
+                    ++spilledIter;
+                } else if (idx < container->inlineSize) {
+                    ++idx;
+                }
+                return *this;
+            }
+        };
+
+        const_iterator begin() const {
+            if (spilled) {
+                return const_iterator(0, this, static_cast<SpilledMap const &>(*spilled).begin());
+            }
+            return const_iterator(0, this, typename SpilledMap::const_iterator(0, nullptr));
+        }
+
+        const_iterator end() const {
+            if (spilled) {
+                return const_iterator(0, this, static_cast<SpilledMap const &>(*spilled).end());
+            }
+            return const_iterator(inlineSize, this, typename SpilledMap::const_iterator(0, nullptr));
+        }
+    };
+}
@@ -0,0 +1,437 @@
+/*
+MIT License
+
+Copyright (c) 2024 Grady Schofield
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * StringDictionary assigns dense IDs 0, 1, 2, ... to strings and looks them up in both directions.  Every string is
+ * stored once, in a single arena.  An offset array maps an ID to its bytes and an open address index of IDs maps a
+ * string back to its ID.
+ *
+ * Build one with StringDictionary::Builder, or StringDictionary::ConcurrentBuilder when many threads are interning,
+ * then write it to a file.  The StringDictionary itself memory maps that file and does no copying in either
+ * direction: at() returns a string_view into the mapping and id() probes the mapped index.
+ *
+ * File layout:
+ *     numStrings, indexSize, offsetsOffset, indexOffset    (8 bytes each)
+ *     arena                                                (the strings back to back)
+ *     offsets                                              (numStrings + 1 uint64_t, 8 byte aligned)
+ *     index                                                (indexSize IdType, 8 byte aligned, empty slots are max IdType)
+ */
+
+#pragma once
+
+#include<fcntl.h>
+#include<errno.h>
+#include<string.h>
+#include<sys/mman.h>
+#include<unistd.h>
+
+#include<atomic>
+#include<filesystem>
+#include<fstream>
+#include<limits>
+#include<memory>
+#include<mutex>
+#include<sstream>
+#include<string>
+#include<string_view>
+#include<type_traits>
+#include<vector>
+
+#include"Common.hpp"
+#include"Exception.hpp"
+#include"Integrity.hpp"
+#include"OpenHashMap.hpp"
+
+namespace gradylib_helpers {
+
+    // Returns the index slot holding str, or the empty slot where it would be inserted.  The index must have at
+    // least one empty slot.
+    template<typename IdType>
+    size_t findDictionarySlot(char const * arena, uint64_t const * offsets, IdType const * index, size_t indexSize,
+                              std::string_view str, size_t hash) {
+        constexpr IdType empty = std::numeric_limits<IdType>::max();
+        size_t idx = hash % indexSize;
+        while (index[idx] != empty) {
+            IdType id = index[idx];
+            std::string_view s(arena + offsets[id], offsets[id + 1] - offsets[id]);
+            if (s == str) {
+                return idx;
+            }
+            ++idx;
+            idx = idx == indexSize ? 0 : idx;
+        }
+        return idx;
+    }
+}
+
+namespace gradylib {
+
+    template<typename IdType = uint32_t>
+    requires std::is_integral_v<IdType> && std::is_unsigned_v<IdType>
+    class StringDictionary {
+        static constexpr IdType emptySlot = std::numeric_limits<IdType>::max();
+
+        char const * arena = nullptr;
+        uint64_t const * offsets = nullptr;
+        IdType const * index = nullptr;
+        size_t numStrings = 0;
+        size_t indexSize = 0;
+        int fd = -1;
+        void * memoryMapping = nullptr;
+        size_t mappingSize = 0;
+        static inline void* (*mmapFunc)(void *, size_t, int, int, int, off_t) = mmap;
+
+        static size_t hashString(std::string_view str) {
+            return std::hash<std::string_view>{}(str);
+        }
+
+        static void writeDictionary(std::filesystem::path const & filename, std::string_view arena,
+                                    std::vector<uint64_t> const & offsets, std::vector<IdType> const & index) {
+            std::ofstream ofs(filename, std::ios::binary);
+            if (ofs.fail()) {
+                std::ostringstream sstr;
+                sstr << "Problem opening file " << filename;
+                throw gradylibMakeException(sstr.str());
+            }
+            size_t numStrings = offsets.size() - 1;
+            size_t indexSize = index.size();
+            size_t offsetsOffset = 0;
+            size_t indexOffset = 0;
+            ofs.write(gradylib_helpers::charCast(&numStrings), 8);
+            ofs.write(gradylib_helpers::charCast(&indexSize), 8);
+            ofs.write(gradylib_helpers::charCast(&offsetsOffset), 8);
+            ofs.write(gradylib_helpers::charCast(&indexOffset), 8);
+            ofs.write(arena.data(), arena.size());
+            gradylib_helpers::writePad<8>(ofs);
+            offsetsOffset = ofs.tellp();
+            ofs.write(gradylib_helpers::charCast(offsets.data()), offsets.size() * sizeof(uint64_t));
+            indexOffset = ofs.tellp();
+            ofs.write(gradylib_helpers::charCast(index.data()), index.size() * sizeof(IdType));
+            gradylib_helpers::writePad<8>(ofs);
+            ofs.seekp(16, std::ios::beg);
+            ofs.write(gradylib_helpers::charCast(&offsetsOffset), 8);
+            ofs.write(gradylib_helpers::charCast(&indexOffset), 8);
+            if (ofs.fail()) {
+                std::ostringstream sstr;
+                sstr << "Problem writing file " << filename;
+                throw gradylibMakeException(sstr.str());
+            }
+        }
+
+    public:
+        StringDictionary() = default;
+
+        StringDictionary(StringDictionary const &) = delete;
+
+        StringDictionary & operator=(StringDictionary const &) = delete;
+
+        StringDictionary(StringDictionary && d) noexcept {
+            *this = std::move(d);
+        }
+
+        StringDictionary & operator=(StringDictionary && d) noexcept {
+            if (this == &d) {
+                return *this;
+            }
+            if (memoryMapping) {
+                munmap(memoryMapping, mappingSize);
+                close(fd);
+            }
+            arena = d.arena;
+            offsets = d.offsets;
+            index = d.index;
+            numStrings = d.numStrings;
+            indexSize = d.indexSize;
+            fd = d.fd;
+            memoryMapping = d.memoryMapping;
+            mappingSize = d.mappingSize;
+            d.arena = nullptr;
+            d.offsets = nullptr;
+            d.index = nullptr;
+            d.numStrings = 0;
+            d.indexSize = 0;
+            d.fd = -1;
+            d.memoryMapping = nullptr;
+            d.mappingSize = 0;
+            return *this;
+        }
+
+        explicit StringDictionary(std::filesystem::path filename) {
+            fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                std::ostringstream sstr;
+                sstr << "Couldn't open " << filename << " in StringDictionary";
+                throw gradylibMakeException(sstr.str());
+            }
+            mappingSize = std::filesystem::file_size(filename);
+            memoryMapping = mmapFunc(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+            if (memoryMapping == MAP_FAILED) {
+                close(fd);
+                memoryMapping = nullptr;
+                std::ostringstream sstr;
+                sstr << "mmap failed " << strerror(errno);
+                throw gradylibMakeException(sstr.str());
+            }
+            try {
+                namespace gh = gradylib_helpers;
+                gh::checkMappedExtent(32, mappingSize, "StringDictionary");
+                std::byte const * base = static_cast<std::byte const *>(memoryMapping);
+                size_t const * header = static_cast<size_t const *>(memoryMapping);
+                numStrings = header[0];
+                indexSize = header[1];
+                size_t offsetsOffset = header[2];
+                size_t indexOffset = header[3];
+                gh::checkMappedExtent(offsetsOffset < 32 || numStrings > mappingSize ? SIZE_MAX : offsetsOffset + (numStrings + 1) * sizeof(uint64_t),
+                                      mappingSize, "StringDictionary");
+                gh::checkMappedExtent(indexOffset > mappingSize || indexSize > mappingSize ? SIZE_MAX : indexOffset + indexSize * sizeof(IdType),
+                                      mappingSize, "StringDictionary");
+                arena = static_cast<char const *>(static_cast<void const *>(base + 32));
+                offsets = static_cast<uint64_t const *>(static_cast<void const *>(base + offsetsOffset));
+                index = static_cast<IdType const *>(static_cast<void const *>(base + indexOffset));
+                // The strings must end inside the arena, which ends where the offsets start
+                gh::checkMappedExtent(offsets[numStrings] > mappingSize ? SIZE_MAX : 32 + offsets[numStrings], offsetsOffset, "StringDictionary");
+            } catch (...) {
+                munmap(memoryMapping, mappingSize);
+                close(fd);
+                memoryMapping = nullptr;
+                throw;
+            }
+        }
+
+        ~StringDictionary() {
+            if (memoryMapping) {
+                munmap(memoryMapping, mappingSize);
+                close(fd);
+            }
+        }
+
+        bool contains(std::string_view str) const {
+            if (indexSize == 0) {
+                return false;
+            }
+            size_t slot = gradylib_helpers::findDictionarySlot(arena, offsets, index, indexSize, str, hashString(str));
+            return index[slot] != emptySlot;
+        }
+
+        IdType id(std::string_view str) const {
+            if (indexSize > 0) {
+                size_t slot = gradylib_helpers::findDictionarySlot(arena, offsets, index, indexSize, str, hashString(str));
+                if (index[slot] != emptySlot) {
+                    return index[slot];
+                }
+            }
+            std::ostringstream sstr;
+            sstr << str << " not found in StringDictionary";
+            throw gradylibMakeException(sstr.str());
+        }
+
+        std::string_view at(IdType id) const {
+            if (id >= numStrings) {
+                std::ostringstream sstr;
+                sstr << "StringDictionary doesn't contain id " << id;
+                throw gradylibMakeException(sstr.str());
+            }
+            return std::string_view(arena + offsets[id], offsets[id + 1] - offsets[id]);
+        }
+
+        std::string_view operator[](IdType id) const {
+            return std::string_view(arena + offsets[id], offsets[id + 1] - offsets[id]);
+        }
+
+        size_t size() const {
+            return numStrings;
+        }
+
+        class Builder {
+            std::string arena;
+            std::vector<uint64_t> offsets{0};
+            std::vector<IdType> index;
+
+            void rehash(size_t newIndexSize) {
+                index.assign(newIndexSize, emptySlot);
+                for (size_t id = 0; id + 1 < offsets.size(); ++id) {
+                    std::string_view s(arena.data() + offsets[id], offsets[id + 1] - offsets[id]);
+                    size_t slot = gradylib_helpers::findDictionarySlot(arena.data(), offsets.data(), index.data(), index.size(), s, hashString(s));
+                    index[slot] = id;
+                }
+            }
+
+        public:
+            // Returns the ID of str, assigning the next ID if str hasn't been seen before.
+            IdType intern(std::string_view str) {
+                // Keep the index at most half full so probe sequences stay short
+                if (2 * (size() + 1) > index.size()) {
+                    rehash(std::max<size_t>(16, 2 * index.size()));
+                }
+                size_t slot = gradylib_helpers::findDictionarySlot(arena.data(), offsets.data(), index.data(), index.size(), str, hashString(str));
+                if (index[slot] != emptySlot) {
+                    return index[slot];
+                }
+                if (size() >= emptySlot) {
+                    std::ostringstream sstr;
+                    sstr << "StringDictionary is out of IDs at " << size() << " strings";
+                    throw gradylibMakeException(sstr.str());
+                }
+                IdType id = size();
+                arena.append(str);
+                offsets.push_back(arena.size());
+                index[slot] = id;
+                return id;
+            }
+
+            bool contains(std::string_view str) const {
+                if (index.empty()) {
+                    return false;
+                }
+                size_t slot = gradylib_helpers::findDictionarySlot(arena.data(), offsets.data(), index.data(), index.size(), str, hashString(str));
+                return index[slot] != emptySlot;
+            }
+
+            IdType id(std::string_view str) const {
+                if (!index.empty()) {
+                    size_t slot = gradylib_helpers::findDictionarySlot(arena.data(), offsets.data(), index.data(), index.size(), str, hashString(str));
+                    if (index[slot] != emptySlot) {
+                        return index[slot];
+                    }
+                }
+                std::ostringstream sstr;
+                sstr << str << " not found in StringDictionary::Builder";
+                throw gradylibMakeException(sstr.str());
+            }
+
+            std::string_view at(IdType id) const {
+                if (id >= size()) {
+                    std::ostringstream sstr;
+                    sstr << "StringDictionary::Builder doesn't contain id " << id;
+                    throw gradylibMakeException(sstr.str());
+                }
+                return std::string_view(arena.data() + offsets[id], offsets[id + 1] - offsets[id]);
+            }
+
+            size_t size() const {
+                return offsets.size() - 1;
+            }
+
+            void reserve(size_t numStrings, size_t arenaBytes = 0) {
+                offsets.reserve(numStrings + 1);
+                arena.reserve(arenaBytes);
+                if (2 * numStrings > index.size()) {
+                    rehash(std::max<size_t>(16, 2 * numStrings));
+                }
+            }
+
+            void write(std::filesystem::path filename) const {
+                writeDictionary(filename, arena, offsets, index);
+            }
+        };
+
+        /*
+         * Interning from many threads.  Strings are hashed to shards, each with its own lock, so threads only contend
+         * when they hit the same shard.  IDs come from a shared counter, so they are dense but their order depends on
+         * thread timing.
+         */
+        class ConcurrentBuilder {
+            struct alignas(64) Shard {
+                std::mutex mutex;
+                OpenHashMap<std::string, IdType> ids;
+            };
+
+            size_t numShards;
+            std::unique_ptr<Shard[]> shards;
+            std::atomic<size_t> nextId{0};
+
+        public:
+            explicit ConcurrentBuilder(size_t numShards = 64)
+                : numShards(std::max<size_t>(1, numShards)), shards(std::make_unique<Shard[]>(this->numShards))
+            {
+            }
+
+            IdType intern(std::string_view str) {
+                size_t hash = hashString(str);
+                // Use the high bits to pick the shard; the shard's own map uses the low bits.
+                Shard & shard = shards[(hash >> 32) % numShards];
+                std::lock_guard lg(shard.mutex);
+                auto lookup = shard.ids.get(str);
+                if (lookup.has_value()) {
+                    return lookup.value();
+                }
+                // Insert before taking an ID, so a failed insert doesn't leave a hole in the IDs
+                IdType & slot = shard.ids[str];
+                size_t id = nextId.load(std::memory_order_relaxed);
+                do {
+                    if (id >= emptySlot) {
+                        shard.ids.erase(str);
+                        std::ostringstream sstr;
+                        sstr << "StringDictionary is out of IDs at " << id << " strings";
+                        throw gradylibMakeException(sstr.str());
+                    }
+                } while (!nextId.compare_exchange_weak(id, id + 1, std::memory_order_relaxed));
+                slot = static_cast<IdType>(id);
+                return slot;
+            }
+
+            size_t size() const {
+                return nextId.load(std::memory_order_relaxed);
+            }
+
+            // Gather the shards into a Builder with the same IDs.  No interning may be in flight.
+            Builder toBuilder() const {
+                std::vector<std::string const *> byId(size());
+                for (size_t i = 0; i < numShards; ++i) {
+                    for (auto const & [str, id] : shards[i].ids) {
+                        byId[id] = &str;
+                    }
+                }
+                Builder builder;
+                builder.reserve(byId.size());
+                for (std::string const * str : byId) {
+                    builder.intern(*str);
+                }
+                return builder;
+            }
+
+            void write(std::filesystem::path filename) const {
+                toBuilder().write(filename);
+            }
+        };
+
+        template<typename>
+        friend void GRADY_LIB_MOCK_StringDictionary_MMAP();
+
+        template<typename>
+        friend void GRADY_LIB_DEFAULT_StringDictionary_MMAP();
+    };
+
+    template<typename IdType = uint32_t>
+    void GRADY_LIB_MOCK_StringDictionary_MMAP() {
+        StringDictionary<IdType>::mmapFunc = [](void *, size_t, int, int, int, off_t) -> void *{
+            return MAP_FAILED;
+        };
+    }
+
+    template<typename IdType = uint32_t>
+    void GRADY_LIB_DEFAULT_StringDictionary_MMAP() {
+        StringDictionary<IdType>::mmapFunc = mmap;
+    }
+}
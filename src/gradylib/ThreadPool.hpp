@@ -26,12 +26,16 @@ SOFTWARE.
 
 #include<concepts>
 #include<condition_variable>
+#include<exception>
 #include<functional>
 #include<iostream>
+#include<memory>
 #include<mutex>
 #include<queue>
 #include<thread>
 
+#include"Exception.hpp"
+
 namespace gradylib {
 
     class ThreadPool {
@@ -42,6 +46,8 @@ namespace gradylib {
         std::condition_variable waiterConditionVariable;
         std::atomic<int> freeThreads{0};
         std::atomic<bool> stop{false};
+        // The pool whose worker is running on this thread, if any
+        inline static thread_local ThreadPool const * workerOf = nullptr;
 
     public:
 
@@ -49,11 +55,17 @@ namespace gradylib {
             return threads.size();
         }
 
+        // True when called from one of this pool's tasks
+        bool onWorkerThread() const {
+            return workerOf == this;
+        }
+
         ThreadPool(int numThreads = std::thread::hardware_concurrency())
             : freeThreads(numThreads)
         {
             for (int i = 0; i < numThreads; ++i) {
                 threads.emplace_back([this]() {
+                    workerOf = this;
                     while (true) {
                         std::unique_lock lock(workMutex);
                         workerConditionVariable.wait_for(lock, std::chrono::milliseconds(500), [this]{
@@ -113,5 +125,64 @@ namespace gradylib {
 namespace gradylib_helpers {
     inline std::unique_ptr<gradylib::ThreadPool> GRADY_LIB_DEFAULT_THREADPOOL;
     inline std::mutex GRADY_LIB_DEFAULT_THREADPOOL_MUTEX;
+    // Set in the child of a checkpoint fork, which must stay on the one thread it has.  See Checkpoint.hpp.
+    inline bool GRADY_LIB_SINGLE_THREADED_CHILD = false;
+
+    // The default thread pool, created on first use.
+    inline gradylib::ThreadPool & defaultThreadPool() {
+        if (GRADY_LIB_SINGLE_THREADED_CHILD) {
+            throw gradylibMakeException("The default thread pool can't be used while writing a forked checkpoint");
+        }
+        if (!GRADY_LIB_DEFAULT_THREADPOOL) {
+            std::lock_guard lg(GRADY_LIB_DEFAULT_THREADPOOL_MUTEX);
+            if (!GRADY_LIB_DEFAULT_THREADPOOL) {
+                GRADY_LIB_DEFAULT_THREADPOOL = std::make_unique<gradylib::ThreadPool>();
+            }
+        }
+        return *GRADY_LIB_DEFAULT_THREADPOOL;
+    }
+
+    /*
+     * Run f(0) ... f(numTasks - 1) on the pool and wait for just those tasks, unlike ThreadPool::wait which waits
+     * for the whole pool.  The first exception thrown by a task is rethrown here.  Called from a task running on the
+     * same pool, the tasks run inline instead, since waiting there could leave no worker free to run them.
+     */
+    template<typename F>
+    void runTasks(gradylib::ThreadPool & tp, size_t numTasks, F && f) {
+        if (tp.onWorkerThread()) {
+            for (size_t i = 0; i < numTasks; ++i) {
+                f(i);
+            }
+            return;
+        }
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t remaining = numTasks;
+        std::exception_ptr error;
+        for (size_t i = 0; i < numTasks; ++i) {
+            tp.add([&, i]() {
+                std::exception_ptr e;
+                try {
+                    f(i);
+                } catch (...) {
+                    e = std::current_exception();
+                }
+                std::lock_guard lg(mutex);
+                if (e && !error) {
+                    error = e;
+                }
+                if (--remaining == 0) {
+                    done.notify_all();
+                }
+            });
+        }
+        std::unique_lock lock(mutex);
+        done.wait(lock, [&]() {
+            return remaining == 0;
+        });
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
 }
 
@@ -0,0 +1,251 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<filesystem>
+#include<fstream>
+#include<random>
+#include<string>
+#include<thread>
+#include<unordered_map>
+#include<vector>
+
+#include"gradylib/BlockCompressedStrings.hpp"
+#include"gradylib/MMapI2HRSOpenHashMap.hpp"
+#include"gradylib/MMapI2SOpenHashMap.hpp"
+#include"gradylib/OpenHashMap.hpp"
+
+using namespace std;
+using namespace gradylib;
+namespace fs = std::filesystem;
+
+namespace {
+    string productTitle(int i) {
+        static vector<string> brands = {"Acme", "Globex", "Initech", "Umbrella", "Hooli"};
+        static vector<string> things = {"Stainless Steel Water Bottle", "Wireless Bluetooth Headphones",
+                                        "Cotton Crew Neck T-Shirt", "Non-Stick Frying Pan", "LED Desk Lamp"};
+        return brands[i % 5] + " " + things[(i / 5) % 5] + ", " + to_string(i % 37) + " Pack, Model " + to_string(i);
+    }
+
+    string roundTrip(string_view dictionary, string const & input) {
+        string compressed;
+        gradylib_helpers::lzCompress(dictionary, input, compressed);
+        string output(input.size(), '\0');
+        gradylib_helpers::lzDecompress(dictionary, compressed.data(), compressed.size(), output.data(), output.size());
+        return output;
+    }
+}
+
+TEST_CASE("LZ codec round trips") {
+    REQUIRE(roundTrip("", "").empty());
+    REQUIRE(roundTrip("", "abc") == "abc");
+    REQUIRE(roundTrip("", string(100000, 'x')) == string(100000, 'x'));
+    string text;
+    for (int i = 0; i < 2000; ++i) {
+        text += productTitle(i) + "\n";
+    }
+    REQUIRE(roundTrip("", text) == text);
+    string compressed;
+    gradylib_helpers::lzCompress("", text, compressed);
+    REQUIRE(compressed.size() * 3 < text.size());
+
+    string noise;
+    uint64_t x = 12345;
+    for (int i = 0; i < 5000; ++i) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        noise.push_back(static_cast<char>(x >> 56));
+    }
+    REQUIRE(roundTrip("", noise) == noise);
+
+    // Matches that start in the dictionary and run on into the output
+    string dictionary = "Wireless Bluetooth Headphones";
+    REQUIRE(roundTrip(dictionary, "Wireless Bluetooth HeadphonesWireless Bluetooth") == "Wireless Bluetooth HeadphonesWireless Bluetooth");
+    REQUIRE(roundTrip(dictionary, productTitle(6)) == productTitle(6));
+    // A match that lies wholly in the dictionary
+    REQUIRE(roundTrip(dictionary, "Bluetooth Head") == "Bluetooth Head");
+}
+
+TEST_CASE("LZ decompression stops at the end of its input") {
+    string text;
+    for (int i = 0; i < 200; ++i) {
+        text += productTitle(i) + "\n";
+    }
+    string compressed;
+    gradylib_helpers::lzCompress("", text, compressed);
+    string output(text.size(), '\0');
+    for (size_t len : {size_t(0), size_t(1), compressed.size() / 2, compressed.size() - 1}) {
+        REQUIRE_THROWS(gradylib_helpers::lzDecompress("", compressed.data(), len, output.data(), output.size()));
+    }
+    gradylib_helpers::lzDecompress("", compressed.data(), compressed.size(), output.data(), output.size());
+    REQUIRE(output == text);
+}
+
+TEST_CASE("Block compressed string section") {
+    vector<string> strings;
+    for (int i = 0; i < 20000; ++i) {
+        strings.push_back(i % 100 == 0 ? string() : productTitle(i));
+    }
+    vector<string_view> samples(strings.begin(), strings.begin() + 1000);
+    string dictionary = BlockCompressedStringsWriter::trainDictionary(samples, 4096);
+    REQUIRE(!dictionary.empty());
+    REQUIRE(dictionary.size() <= 4096);
+
+    for (string const & dict : {string(), dictionary}) {
+        BlockCompressedStringsWriter writer(4096, dict);
+        for (size_t i = 0; i < strings.size(); ++i) {
+            REQUIRE(writer.add(strings[i]) == i);
+        }
+        fs::path tmpFile = fs::temp_directory_path() / "block_compressed_strings.bin";
+        {
+            ofstream ofs(tmpFile, ios::binary);
+            writer.write(ofs);
+        }
+        vector<char> buffer(fs::file_size(tmpFile) + 8);
+        void * aligned = buffer.data() + gradylib_helpers::getPadLength<8>(reinterpret_cast<uintptr_t>(buffer.data()));
+        {
+            ifstream ifs(tmpFile, ios::binary);
+            ifs.read(static_cast<char *>(aligned), fs::file_size(tmpFile));
+        }
+        BlockCompressedStrings section(aligned, fs::file_size(tmpFile));
+        REQUIRE(section.size() == strings.size());
+        for (size_t i = 0; i < strings.size(); i += 7) {
+            REQUIRE(section.at(i) == strings[i]);
+        }
+        vector<thread> threads;
+        vector<int> mismatches(4, 0);
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&, t]() {
+                for (size_t i = t; i < strings.size(); i += 3) {
+                    if (section.at(strings.size() - 1 - i) != strings[strings.size() - 1 - i]) {
+                        ++mismatches[t];
+                    }
+                }
+            });
+        }
+        for (auto & t : threads) {
+            t.join();
+        }
+        REQUIRE(mismatches == vector<int>(4, 0));
+        REQUIRE_THROWS(section.at(strings.size()));
+        fs::remove(tmpFile);
+    }
+}
+
+TEST_CASE("Block compressed string section rejects corrupt sections") {
+    // Random strings don't compress, so the blocks are stored raw
+    mt19937_64 gen(5);
+    BlockCompressedStringsWriter writer(256);
+    for (int i = 0; i < 1000; ++i) {
+        string s(20 + i % 30, ' ');
+        for (char & c : s) {
+            c = gen();
+        }
+        writer.add(s);
+    }
+    fs::path tmpFile = fs::temp_directory_path() / "block_compressed_corrupt.bin";
+    {
+        ofstream ofs(tmpFile, ios::binary);
+        writer.write(ofs);
+    }
+    size_t size = fs::file_size(tmpFile);
+    vector<uint64_t> words(size / 8);
+    ifstream(tmpFile, ios::binary).read(reinterpret_cast<char *>(words.data()), size);
+    fs::remove(tmpFile);
+
+    REQUIRE(BlockCompressedStrings(words.data(), size).size() == 1000);
+    REQUIRE_THROWS(BlockCompressedStrings(words.data(), 16));
+    REQUIRE_THROWS(BlockCompressedStrings(words.data(), size - 8));
+    auto corrupt = [&](size_t word, uint64_t value) {
+        auto copy = words;
+        copy[word] = value;
+        REQUIRE_THROWS(BlockCompressedStrings(copy.data(), size));
+    };
+    // numStrings, numBlocks, dictionarySize, dataSize, then the second block's first string
+    corrupt(0, 1001);
+    corrupt(1, uint64_t(1) << 60);
+    corrupt(2, size);
+    corrupt(3, size);
+    corrupt(5, 0);
+
+    // A string offset in the first raw block that points past the block
+    size_t numBlocks = words[1];
+    char * bytes = reinterpret_cast<char *>(words.data());
+    uint32_t rawSize;
+    memcpy(&rawSize, bytes + 32 + 16 * (numBlocks + 1), 4);
+    REQUIRE((rawSize & gradylib_helpers::rawBlockFlag) != 0);
+    size_t dataOffset = 32 + 16 * (numBlocks + 1) + (4 * numBlocks + 7) / 8 * 8;
+    uint32_t badOffset = 1 << 20;
+    memcpy(bytes + dataOffset + 4, &badOffset, 4);
+    BlockCompressedStrings section(words.data(), size);
+    REQUIRE_THROWS(section.at(0));
+    string buffer;
+    REQUIRE_THROWS(section.at(0, buffer));
+}
+
+TEST_CASE("Compressed MMapI2SOpenHashMap") {
+    OpenHashMap<int64_t, string> m;
+    for (int i = 0; i < 30000; ++i) {
+        m[i * 13] = productTitle(i);
+    }
+    m.erase(13);
+    fs::path rawFile = fs::temp_directory_path() / "i2s_raw.bin";
+    fs::path compressedFile = fs::temp_directory_path() / "i2s_compressed.bin";
+    writeMappable(rawFile, m);
+    writeMappableCompressed(compressedFile, m, 8192, 8192);
+    REQUIRE(fs::file_size(compressedFile) * 10 < fs::file_size(rawFile) * 6);
+
+    MMapI2SOpenHashMap<int64_t> mm(compressedFile);
+    REQUIRE(mm.size() == m.size());
+    for (auto const & [key, value] : m) {
+        REQUIRE(mm[key] == value);
+    }
+    REQUIRE(!mm.contains(13));
+    size_t count = 0;
+    for (auto const & [key, value] : mm) {
+        REQUIRE(string(value) == m.at(key));
+        ++count;
+    }
+    REQUIRE(count == m.size());
+    // Views read through a buffer outlast reads from other blocks
+    vector<string> buffers(m.size());
+    vector<string_view> views;
+    for (int i = 0; i < 30000; i += 300) {
+        views.push_back(mm.at(i * 13 + 26, buffers[views.size()]));
+    }
+    for (size_t j = 0; j < views.size(); ++j) {
+        REQUIRE(views[j] == m.at(static_cast<int64_t>(j * 300 * 13 + 26)));
+    }
+    auto reader = mm.cachedReader(64);
+    for (int i = 0; i < 1000; ++i) {
+        REQUIRE(reader[(i % 10) * 13 + 26] == m.at((i % 10) * 13 + 26));
+    }
+    fs::remove(rawFile);
+    fs::remove(compressedFile);
+}
+
+TEST_CASE("Compressed MMapI2HRSOpenHashMap") {
+    MMapI2HRSOpenHashMap<int64_t>::Builder b;
+    unordered_map<int64_t, string> test;
+    for (int i = 0; i < 50000; ++i) {
+        string s = productTitle(i % 3000);
+        b.put(i * 7, s);
+        test[i * 7] = s;
+    }
+    fs::path tmpFile = fs::temp_directory_path() / "i2hrs_compressed.bin";
+    b.writeCompressed(tmpFile, 4096, 4096);
+    MMapI2HRSOpenHashMap<int64_t> m(tmpFile);
+    REQUIRE(m.size() == test.size());
+    for (auto const & [key, value] : test) {
+        REQUIRE(m.at(key) == value);
+    }
+    REQUIRE_THROWS(m.at(1));
+    vector<string> buffers(500);
+    vector<string_view> views;
+    for (int i = 0; i < 50000; i += 100) {
+        views.push_back(m.at(i * 7, buffers[views.size()]));
+    }
+    for (size_t j = 0; j < views.size(); ++j) {
+        REQUIRE(views[j] == test.at(static_cast<int64_t>(j * 100 * 7)));
+    }
+    string buffer;
+    REQUIRE_THROWS(m.at(1, buffer));
+    fs::remove(tmpFile);
+}
@@ -0,0 +1,113 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<filesystem>
+#include<fstream>
+#include<string>
+
+#include"gradylib/Checkpoint.hpp"
+#include"gradylib/MMapS2IOpenHashMap.hpp"
+#include"gradylib/OpenHashMap.hpp"
+#include"gradylib/OpenHashMapTC.hpp"
+
+using namespace std;
+using namespace gradylib;
+namespace fs = std::filesystem;
+
+TEST_CASE("OpenHashMapTC checkpointAsync") {
+    fs::path tmpFile = fs::temp_directory_path() / "checkpoint.bin";
+    for (bool allowFork : {true, false}) {
+        OpenHashMapTC<int64_t, int64_t> m;
+        for (int64_t i = 0; i < 100000; ++i) {
+            m[i] = i;
+        }
+        auto done = m.checkpointAsync(tmpFile, allowFork);
+        // Keep writing while the checkpoint runs
+        for (int64_t i = 0; i < 100000; ++i) {
+            m[i] = -1;
+            m[i + 100000] = i;
+        }
+        done.get();
+        OpenHashMapTC<int64_t, int64_t> snapshot(tmpFile, true);
+        REQUIRE(snapshot.size() == 100000);
+        for (int64_t i = 0; i < 100000; ++i) {
+            REQUIRE(snapshot.at(i) == i);
+        }
+        REQUIRE(!fs::exists(gradylib_helpers::checkpointTemporaryPath(tmpFile)));
+        fs::remove(tmpFile);
+    }
+}
+
+TEST_CASE("OpenHashMap checkpointAsync") {
+    fs::path tmpFile = fs::temp_directory_path() / "checkpoint.bin";
+    auto serializeString = [](ofstream & ofs, string const & s) {
+        size_t len = s.size();
+        ofs.write(gradylib_helpers::charCast(&len), 8);
+        ofs.write(s.data(), len);
+    };
+    auto deserializeString = [](ifstream & ifs) {
+        size_t len;
+        ifs.read(gradylib_helpers::charCast(&len), 8);
+        string s(len, ' ');
+        ifs.read(s.data(), len);
+        return s;
+    };
+    OpenHashMap<string, string> m;
+    for (int i = 0; i < 1000; ++i) {
+        m[to_string(i)] = "v" + to_string(i);
+    }
+    auto done = m.checkpointAsync(tmpFile, serializeString, serializeString);
+    m.clear();
+    done.get();
+    auto snapshot = OpenHashMap<string, string>::read(tmpFile, deserializeString, deserializeString);
+    REQUIRE(snapshot.size() == 1000);
+    REQUIRE(snapshot.at("7") == "v7");
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("checkpointAsync with a custom writer") {
+    fs::path tmpFile = fs::temp_directory_path() / "checkpoint.bin";
+    OpenHashMap<string, int64_t> m;
+    m["a"] = 1;
+    m["b"] = 2;
+    auto done = checkpointAsync(m, tmpFile, [](OpenHashMap<string, int64_t> const & map, fs::path const & p) {
+        writeMappable(p, map);
+    });
+    m["c"] = 3;
+    done.get();
+    MMapS2IOpenHashMap<int64_t> snapshot(tmpFile);
+    REQUIRE(snapshot.size() == 2);
+    REQUIRE(snapshot["b"] == 2);
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("checkpointAsync reports failures") {
+    fs::path badFile = fs::temp_directory_path() / "gradylib_no_such_directory" / "checkpoint.bin";
+    OpenHashMapTC<int, int> m;
+    m[1] = 1;
+    for (bool allowFork : {true, false}) {
+        auto done = m.checkpointAsync(badFile, allowFork);
+        REQUIRE_THROWS(done.get());
+    }
+    auto done = checkpointAsync(m, fs::temp_directory_path() / "checkpoint.bin", [](OpenHashMapTC<int, int> const &, fs::path const &) {
+        throw gradylibMakeException("writer failed");
+    });
+    REQUIRE_THROWS(done.get());
+}
+
+TEST_CASE("checkpointAsync keeps the forked writer on one thread") {
+    fs::path tmpFile = fs::temp_directory_path() / "checkpoint.bin";
+    OpenHashMapTC<int, int> m;
+    m[1] = 1;
+    // Start the parent's default pool so its threads exist at the fork
+    gradylib_helpers::defaultThreadPool();
+    auto done = checkpointAsync(m, tmpFile, [](OpenHashMapTC<int, int> const &, fs::path const &) {
+        gradylib_helpers::defaultThreadPool();
+    });
+    REQUIRE_THROWS(done.get());
+    REQUIRE(!gradylib_helpers::GRADY_LIB_SINGLE_THREADED_CHILD);
+    done = m.checkpointAsync(tmpFile);
+    done.get();
+    OpenHashMapTC<int, int> snapshot(tmpFile, true);
+    REQUIRE(snapshot.at(1) == 1);
+    fs::remove(tmpFile);
+}
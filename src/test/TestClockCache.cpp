@@ -0,0 +1,169 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<atomic>
+#include<string>
+#include<string_view>
+#include<thread>
+#include<unordered_map>
+#include<vector>
+
+#include"gradylib/ClockCache.hpp"
+
+using namespace std;
+using namespace gradylib;
+
+TEST_CASE("ClockCache put and get") {
+    ClockCache<int, int> c(10);
+    for (int i = 0; i < 10; ++i) {
+        c.put(i, i * 10);
+    }
+    REQUIRE(c.size() == 10);
+    REQUIRE(c.capacity() == 10);
+    for (int i = 0; i < 10; ++i) {
+        auto lookup = c.get(i);
+        REQUIRE(lookup.has_value());
+        REQUIRE(lookup.value() == i * 10);
+    }
+    REQUIRE(!c.get(10).has_value());
+    c.put(3, 333);
+    REQUIRE(c.size() == 10);
+    REQUIRE(c.get(3).value() == 333);
+}
+
+TEST_CASE("ClockCache never exceeds capacity") {
+    ClockCache<int64_t, int64_t> c(100);
+    for (int64_t i = 0; i < 10000; ++i) {
+        c.put(i, i);
+        REQUIRE(c.size() <= 100);
+    }
+    REQUIRE(c.size() == 100);
+    // The most recent insertion must still be there
+    REQUIRE(c.contains(9999));
+}
+
+TEST_CASE("ClockCache evicts unreferenced entries first") {
+    ClockCache<int, int> c(4);
+    c.put(0, 0);
+    c.put(1, 1);
+    c.put(2, 2);
+    c.put(3, 3);
+    REQUIRE(c.get(0).has_value());
+    REQUIRE(c.get(2).has_value());
+    c.put(4, 4);
+    REQUIRE(c.contains(0));
+    REQUIRE(c.contains(2));
+    REQUIRE(c.contains(1) != c.contains(3));
+    REQUIRE(c.get(0).has_value());
+    REQUIRE(c.get(2).has_value());
+    c.put(5, 5);
+    REQUIRE(c.size() == 4);
+    REQUIRE(c.contains(0));
+    REQUIRE(c.contains(2));
+    REQUIRE(c.contains(5));
+}
+
+TEST_CASE("ClockCache erase keeps probe chains intact") {
+    // Identity hashing on a small table forces long clusters so the backward shift deletion gets exercised
+    ClockCache<int, int, std::hash> c(64);
+    unordered_map<int, int> test;
+    uint64_t x = 12345;
+    for (int i = 0; i < 20000; ++i) {
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+        int key = (x >> 33) % 200;
+        if ((x >> 20) % 3 == 0) {
+            c.erase(key);
+            test.erase(key);
+        } else {
+            c.put(key, i);
+            test[key] = i;
+        }
+        REQUIRE(c.size() <= 64);
+        // Anything the cache holds must agree with the model
+        auto lookup = c.get(key);
+        if (lookup.has_value()) {
+            REQUIRE(test.contains(key));
+            REQUIRE(test.at(key) == lookup.value());
+        }
+    }
+    size_t found = 0;
+    for (auto & [key, value] : test) {
+        if (c.contains(key)) {
+            REQUIRE(c.get(key).value() == value);
+            ++found;
+        }
+    }
+    REQUIRE(found == c.size());
+}
+
+TEST_CASE("ClockCache string keys with string_view lookups") {
+    ClockCache<string, int> c(8);
+    c.put(string_view("abc"), 1);
+    c.put(string("def"), 2);
+    REQUIRE(c.contains(string_view("abc")));
+    REQUIRE(c.get(string_view("def")).value() == 2);
+    c.erase(string_view("abc"));
+    REQUIRE(!c.contains("abc"));
+    REQUIRE(c.size() == 1);
+}
+
+TEST_CASE("ClockCache getOrCompute") {
+    ClockCache<int, string> c(2);
+    int calls = 0;
+    auto f = [&calls](int k) {
+        ++calls;
+        return to_string(k);
+    };
+    REQUIRE(c.getOrCompute(1, f) == "1");
+    REQUIRE(c.getOrCompute(1, f) == "1");
+    REQUIRE(calls == 1);
+    c.getOrCompute(2, f);
+    c.getOrCompute(3, f);
+    REQUIRE(c.size() == 2);
+    REQUIRE(calls == 3);
+}
+
+TEST_CASE("ClockCache clear") {
+    ClockCache<int, int> c(4);
+    c.put(1, 1);
+    c.put(2, 2);
+    c.clear();
+    REQUIRE(c.size() == 0);
+    REQUIRE(!c.contains(1));
+    c.put(3, 3);
+    REQUIRE(c.get(3).value() == 3);
+}
+
+TEST_CASE("ClockCache throws on bad construction") {
+    REQUIRE_THROWS(ClockCache<int, int>(0));
+    REQUIRE_THROWS(ClockCache<int, int>(10, 1.5));
+    ClockCache<int, int> c;
+    REQUIRE_THROWS(c.put(1, 1));
+    REQUIRE(!c.contains(1));
+}
+
+TEST_CASE("ShardedClockCache concurrent use") {
+    ShardedClockCache<int64_t, int64_t> c(10000, 16);
+    vector<thread> threads;
+    atomic<int> mismatches{0};
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&c, &mismatches, t]() {
+            for (int64_t i = 0; i < 50000; ++i) {
+                int64_t key = (i * 7 + t) % 20000;
+                int64_t value = c.getOrCompute(key, [](int64_t k) { return k * 3; });
+                if (value != key * 3) {
+                    ++mismatches;
+                }
+            }
+        });
+    }
+    for (auto & t : threads) {
+        t.join();
+    }
+    REQUIRE(mismatches == 0);
+    REQUIRE(c.size() <= c.capacity());
+    c.put(int64_t{5}, int64_t{6});
+    REQUIRE(c.get(int64_t{5}).value() == 6);
+    c.erase(int64_t{5});
+    REQUIRE(!c.contains(int64_t{5}));
+    REQUIRE_THROWS(ShardedClockCache<int, int>(4, 8));
+}
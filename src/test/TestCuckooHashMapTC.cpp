@@ -0,0 +1,118 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<cstdint>
+#include<filesystem>
+#include<random>
+#include<unordered_map>
+
+#include"gradylib/CuckooHashMapTC.hpp"
+
+using namespace std;
+using namespace gradylib;
+namespace fs = std::filesystem;
+
+TEST_CASE("CuckooHashMapTC matches unordered_map") {
+    mt19937_64 rng(43);
+    uniform_int_distribution<int64_t> keyDist(0, 200000);
+    uniform_int_distribution<int> opDist(0, 3);
+    CuckooHashMapTC<int64_t, int32_t> m;
+    unordered_map<int64_t, int32_t> expected;
+    for (int i = 0; i < 300000; ++i) {
+        int64_t key = keyDist(rng);
+        switch (opDist(rng)) {
+            case 0:
+                m.erase(key);
+                expected.erase(key);
+                break;
+            case 1:
+                m[key] += 1;
+                expected[key] += 1;
+                break;
+            default:
+                m.put(key, i);
+                expected[key] = i;
+        }
+    }
+    REQUIRE(m.size() == expected.size());
+    for (auto const & [key, value] : expected) {
+        REQUIRE(m.at(key) == value);
+    }
+    size_t seen = 0;
+    for (auto const & [key, value] : m) {
+        REQUIRE(expected.at(key) == value);
+        ++seen;
+    }
+    REQUIRE(seen == expected.size());
+    REQUIRE(!m.contains(-1));
+    REQUIRE(!m.get(-1).has_value());
+    REQUIRE_THROWS(m.at(-1));
+
+    CuckooHashMapTC<int64_t, int32_t> copy = m;
+    m.clear();
+    REQUIRE(m.size() == 0);
+    REQUIRE(copy.size() == expected.size());
+    REQUIRE(copy.at(expected.begin()->first) == expected.begin()->second);
+}
+
+TEST_CASE("CuckooHashMapTC fills to its maximum load factor") {
+    CuckooHashMapTC<int64_t, int32_t> m;
+    REQUIRE(m.slotsPerBucket == 5);
+    m.reserve(1000000);
+    size_t capacity = m.capacity();
+    mt19937_64 rng(47);
+    for (int32_t i = 0; i < 1000000; ++i) {
+        m.put(static_cast<int64_t>(rng()), i);
+    }
+    // No growth was needed to hold the reserved size at 95% occupancy
+    REQUIRE(m.capacity() == capacity);
+    REQUIRE(static_cast<double>(m.size()) / m.capacity() > 0.94);
+    REQUIRE(m.memoryUsage() == m.capacity() / 5 * 64);
+}
+
+TEST_CASE("CuckooHashMapTC grows at its maximum load factor from empty") {
+    CuckooHashMapTC<int64_t, int32_t> m;
+    mt19937_64 rng(48);
+    size_t capacity = m.capacity();
+    size_t evenGrowths = 0;
+    for (int32_t i = 0; i < 2000000; ++i) {
+        size_t sizeBefore = m.size();
+        m.put(static_cast<int64_t>(rng()), i);
+        if (m.capacity() != capacity) {
+            // Growth should come from the load factor, not from a failed search for a free slot
+            if (capacity >= 5000) {
+                REQUIRE(static_cast<double>(sizeBefore) / capacity > 0.94);
+                evenGrowths += capacity / 5 % 2 == 0 ? 1 : 0;
+            }
+            capacity = m.capacity();
+        }
+    }
+    REQUIRE(evenGrowths > 0);
+}
+
+TEST_CASE("CuckooHashMapTC write and memory map") {
+    CuckooHashMapTC<int64_t, int32_t> m;
+    for (int64_t i = 0; i < 50000; ++i) {
+        m.put(i * 31, static_cast<int32_t>(-i));
+    }
+    fs::path tmpFile = fs::temp_directory_path() / "cuckoo.bin";
+    m.write(tmpFile);
+    {
+        CuckooHashMapTC<int64_t, int32_t> mm(tmpFile, true);
+        REQUIRE(mm.size() == m.size());
+        for (int64_t i = 0; i < 50000; ++i) {
+            REQUIRE(mm.at(i * 31) == -i);
+            REQUIRE(!mm.contains(i * 31 + 1));
+        }
+        REQUIRE_THROWS(mm.put(1, 1));
+        CuckooHashMapTC<int64_t, int32_t> copy = mm;
+        copy.put(1, 1);
+        REQUIRE(copy.size() == m.size() + 1);
+    }
+    REQUIRE_THROWS(CuckooHashMapTC<int32_t, int32_t>(tmpFile));
+    GRADY_LIB_MOCK_CuckooHashMapTC_MMAP<int64_t, int32_t>();
+    REQUIRE_THROWS(CuckooHashMapTC<int64_t, int32_t>(tmpFile));
+    GRADY_LIB_DEFAULT_CuckooHashMapTC_MMAP<int64_t, int32_t>();
+    fs::resize_file(tmpFile, 1000);
+    REQUIRE_THROWS(CuckooHashMapTC<int64_t, int32_t>(tmpFile));
+    fs::remove(tmpFile);
+}
@@ -0,0 +1,172 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<filesystem>
+#include<fstream>
+#include<thread>
+#include<vector>
+
+#include"gradylib/DurableOpenHashMapTC.hpp"
+#include"gradylib/MutationLog.hpp"
+
+using namespace std;
+using namespace gradylib;
+namespace fs = std::filesystem;
+
+namespace {
+    struct DurableFiles {
+        fs::path snapshot = fs::temp_directory_path() / "durable_snapshot.bin";
+        fs::path log = fs::temp_directory_path() / "durable_log.bin";
+
+        DurableFiles() {
+            fs::remove(snapshot);
+            fs::remove(log);
+        }
+
+        ~DurableFiles() {
+            fs::remove(snapshot);
+            fs::remove(log);
+        }
+    };
+}
+
+TEST_CASE("DurableOpenHashMapTC replays the log") {
+    DurableFiles files;
+    {
+        DurableOpenHashMapTC<int64_t, double> m(files.snapshot, files.log);
+        for (int64_t i = 0; i < 1000; ++i) {
+            m.put(i, i * 0.5, i % 10 == 0);
+        }
+        m.erase(3);
+        m.erase(5000);
+        m.put(4, -1.0);
+        REQUIRE(m.size() == 999);
+    }
+    DurableOpenHashMapTC<int64_t, double> m(files.snapshot, files.log);
+    REQUIRE(!fs::exists(files.snapshot));
+    REQUIRE(m.size() == 999);
+    REQUIRE(!m.contains(3));
+    REQUIRE(m.get(4).value() == -1.0);
+    REQUIRE(m.get(999).value() == 499.5);
+    REQUIRE(!m.get(3).has_value());
+}
+
+TEST_CASE("DurableOpenHashMapTC checkpoint") {
+    DurableFiles files;
+    {
+        DurableOpenHashMapTC<int64_t, int64_t> m(files.snapshot, files.log);
+        for (int64_t i = 0; i < 1000; ++i) {
+            m.put(i, i);
+        }
+        size_t logSize = fs::file_size(files.log);
+        m.checkpoint();
+        REQUIRE(fs::file_size(files.log) < logSize);
+        m.put(1000, 1000);
+        m.erase(0);
+    }
+    DurableOpenHashMapTC<int64_t, int64_t> m(files.snapshot, files.log);
+    REQUIRE(m.size() == 1000);
+    REQUIRE(!m.contains(0));
+    REQUIRE(m.get(1000).value() == 1000);
+    REQUIRE(m.get(500).value() == 500);
+}
+
+TEST_CASE("DurableOpenHashMapTC keeps the old snapshot and log when a checkpoint fails") {
+    DurableFiles files;
+    fs::path tmp = files.snapshot;
+    tmp += ".tmp";
+    {
+        DurableOpenHashMapTC<int64_t, int64_t> m(files.snapshot, files.log);
+        for (int64_t i = 0; i < 1000; ++i) {
+            m.put(i, i);
+        }
+        m.checkpoint();
+        for (int64_t i = 1000; i < 2000; ++i) {
+            m.put(i, i);
+        }
+        // Every write to /dev/full fails with ENOSPC, like a full disk
+        if (fs::exists("/dev/full")) {
+            fs::create_symlink("/dev/full", tmp);
+            size_t logSize = fs::file_size(files.log);
+            REQUIRE_THROWS(m.checkpoint());
+            REQUIRE(!fs::exists(fs::symlink_status(tmp)));
+            REQUIRE(fs::file_size(files.log) == logSize);
+        }
+    }
+    DurableOpenHashMapTC<int64_t, int64_t> m(files.snapshot, files.log);
+    REQUIRE(m.size() == 2000);
+    REQUIRE(m.get(1999).value() == 1999);
+}
+
+TEST_CASE("MutationLog drops a torn tail") {
+    DurableFiles files;
+    auto ignorePut = [](int32_t, int32_t) {};
+    auto ignoreErase = [](int32_t) {};
+    {
+        MutationLog<int32_t, int32_t> log(files.log, ignorePut, ignoreErase);
+        log.appendPut(1, 10);
+        log.appendErase(2);
+        log.appendPut(3, 30);
+        log.commit();
+    }
+    size_t goodSize = fs::file_size(files.log);
+    {
+        // A partly written record
+        ofstream ofs(files.log, ios::binary | ios::app);
+        char partial[] = {1, 7, 0};
+        ofs.write(partial, sizeof(partial));
+    }
+    vector<pair<int32_t, int32_t>> puts;
+    vector<int32_t> erases;
+    auto collectPut = [&](int32_t k, int32_t v) {
+        puts.emplace_back(k, v);
+    };
+    auto collectErase = [&](int32_t k) {
+        erases.push_back(k);
+    };
+    {
+        MutationLog<int32_t, int32_t> log(files.log, collectPut, collectErase);
+        REQUIRE(fs::file_size(files.log) == goodSize);
+        REQUIRE(puts == vector<pair<int32_t, int32_t>>{{1, 10}, {3, 30}});
+        REQUIRE(erases == vector<int32_t>{2});
+        log.commit(log.appendPut(4, 40));
+    }
+    {
+        fstream f(files.log, ios::in | ios::out | ios::binary);
+        f.seekp(goodSize - 2);
+        f.put(0x55);
+    }
+    puts.clear();
+    erases.clear();
+    // Replay stops at the corrupt record, dropping it and everything after it
+    MutationLog<int32_t, int32_t> log(files.log, collectPut, collectErase);
+    REQUIRE(puts == vector<pair<int32_t, int32_t>>{{1, 10}});
+    REQUIRE(erases == vector<int32_t>{2});
+    REQUIRE(fs::file_size(files.log) == goodSize - 13);
+    REQUIRE_THROWS(MutationLog<int32_t, int64_t>(files.log, [](int32_t, int64_t) {}, ignoreErase));
+}
+
+TEST_CASE("DurableOpenHashMapTC concurrent writers") {
+    DurableFiles files;
+    int numThreads = 8;
+    int perThread = 300;
+    {
+        DurableOpenHashMapTC<int32_t, int32_t> m(files.snapshot, files.log);
+        vector<thread> threads;
+        for (int t = 0; t < numThreads; ++t) {
+            threads.emplace_back([&m, t, perThread]() {
+                for (int i = 0; i < perThread; ++i) {
+                    m.put(t * perThread + i, t);
+                }
+            });
+        }
+        for (auto & t : threads) {
+            t.join();
+        }
+        REQUIRE(m.size() == static_cast<size_t>(numThreads * perThread));
+    }
+    DurableOpenHashMapTC<int32_t, int32_t> m(files.snapshot, files.log);
+    REQUIRE(m.size() == static_cast<size_t>(numThreads * perThread));
+    for (int i = 0; i < numThreads * perThread; ++i) {
+        REQUIRE(m.get(i).value() == i / perThread);
+    }
+}
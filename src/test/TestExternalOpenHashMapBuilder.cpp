@@ -0,0 +1,171 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<sys/resource.h>
+
+#include<filesystem>
+#include<fstream>
+#include<random>
+#include<string>
+#include<unordered_map>
+
+#include"gradylib/ExternalOpenHashMapBuilder.hpp"
+#include"gradylib/MMapS2IOpenHashMap.hpp"
+#include"gradylib/OpenHashMapTC.hpp"
+
+using namespace std;
+using namespace gradylib;
+namespace fs = std::filesystem;
+
+TEST_CASE("ExternalOpenHashMapBuilder trivially copyable keys") {
+    fs::path spillDir = "external_builder_spill";
+    unordered_map<int64_t, int32_t> test;
+    {
+        // Small ranges so that probes run across range boundaries and wrap from the last range to the first
+        ExternalOpenHashMapBuilder<int64_t, int32_t> builder(spillDir, 20000, 128, 0.9);
+        REQUIRE(builder.numRanges() > 100);
+        mt19937_64 gen(17);
+        for (int i = 0; i < 25000; ++i) {
+            int64_t key = gen() % 20000;
+            int32_t value = gen();
+            builder.put(key, value);
+            test[key] = value;
+        }
+        builder.write("external_tc.bin");
+        REQUIRE_THROWS(builder.put(1, 1));
+    }
+    REQUIRE(fs::is_empty(spillDir));
+
+    OpenHashMapTC<int64_t, int32_t> m("external_tc.bin");
+    REQUIRE(m.size() == test.size());
+    for (auto & [k, v] : test) {
+        REQUIRE(m.contains(k));
+        REQUIRE(m.at(k) == v);
+    }
+    REQUIRE(!m.contains(-1));
+    size_t count = 0;
+    for (auto it = m.begin(); it != m.end(); ++it) {
+        REQUIRE(test.at(it.key()) == it.value());
+        ++count;
+    }
+    REQUIRE(count == test.size());
+    fs::remove("external_tc.bin");
+    fs::remove(spillDir);
+}
+
+TEST_CASE("ExternalOpenHashMapBuilder string keys") {
+    fs::path spillDir = "external_builder_spill";
+    unordered_map<string, int64_t> test;
+    {
+        ExternalOpenHashMapBuilder<string, int64_t> builder(spillDir, 10000, 64);
+        for (int i = 0; i < 15000; ++i) {
+            string key = "key" + to_string(i * 7919 % 10000);
+            if (i % 1000 == 0) {
+                key = "";
+            }
+            builder.put(key, i);
+            test[key] = i;
+        }
+        ThreadPool tp(4);
+        builder.write("external_s2i.bin", tp);
+    }
+    MMapS2IOpenHashMap<int64_t> m("external_s2i.bin");
+    REQUIRE(m.size() == test.size());
+    for (auto & [k, v] : test) {
+        REQUIRE(m.contains(k));
+        REQUIRE(m[k] == v);
+    }
+    REQUIRE(!m.contains("missing"));
+    size_t count = 0;
+    for (auto it = m.begin(); it != m.end(); ++it) {
+        REQUIRE(test.at(string(it.key())) == it.value());
+        ++count;
+    }
+    REQUIRE(count == test.size());
+    fs::remove("external_s2i.bin");
+    fs::remove(spillDir);
+}
+
+TEST_CASE("ExternalOpenHashMapBuilder too many keys") {
+    fs::path spillDir = "external_builder_spill";
+    {
+        ExternalOpenHashMapBuilder<int32_t, int32_t> builder(spillDir, 10, 64);
+        for (int i = 0; i < 1000; ++i) {
+            builder.put(i, i);
+        }
+        REQUIRE_THROWS(builder.write("external_full.bin"));
+    }
+    fs::remove("external_full.bin");
+    fs::remove(spillDir);
+}
+
+TEST_CASE("ExternalOpenHashMapBuilder nearly full table") {
+    fs::path spillDir = "external_builder_spill";
+    {
+        // One range of 64 slots holding 63 keys, so probes have to wrap from the end of the table to the start
+        ExternalOpenHashMapBuilder<int32_t, int32_t> builder(spillDir, 63, 64, 63.0 / 64);
+        for (int i = 0; i < 63; ++i) {
+            builder.put(i * 31, i);
+        }
+        builder.write("external_full.bin");
+    }
+    OpenHashMapTC<int32_t, int32_t> m("external_full.bin");
+    REQUIRE(m.size() == 63);
+    for (int i = 0; i < 63; ++i) {
+        REQUIRE(m.at(i * 31) == i);
+    }
+    REQUIRE(!m.contains(1));
+    fs::remove("external_full.bin");
+    fs::remove(spillDir);
+}
+
+TEST_CASE("ExternalOpenHashMapBuilder writes its growth factor") {
+    fs::path spillDir = "external_builder_spill";
+    {
+        ExternalOpenHashMapBuilder<int32_t, int32_t> builder(spillDir, 100, 64, 0.5, 2.0);
+        for (int i = 0; i < 100; ++i) {
+            builder.put(i, i);
+        }
+        builder.write("external_growth.bin");
+    }
+    double header[2];
+    {
+        ifstream ifs("external_growth.bin", ios::binary);
+        ifs.seekg(16);
+        ifs.read(reinterpret_cast<char *>(header), sizeof(header));
+    }
+    REQUIRE(header[0] == 0.5);
+    REQUIRE(header[1] == 2.0);
+    OpenHashMapTC<int32_t, int32_t> m("external_growth.bin");
+    REQUIRE(m.size() == 100);
+    fs::remove("external_growth.bin");
+    fs::remove(spillDir);
+}
+
+TEST_CASE("ExternalOpenHashMapBuilder keeps few spill files open") {
+    fs::path spillDir = "external_builder_spill_limit";
+    rlimit saved;
+    getrlimit(RLIMIT_NOFILE, &saved);
+    rlimit lowered = saved;
+    lowered.rlim_cur = 128;
+    setrlimit(RLIMIT_NOFILE, &lowered);
+    // 1000 ranges have more spill files than can be open at once
+    bool threw = false;
+    try {
+        ThreadPool tp(4);
+        ExternalOpenHashMapBuilder<int32_t, int32_t> builder(spillDir, 64000, 64, 1.0);
+        for (int32_t i = 0; i < 64000; ++i) {
+            builder.put(i, -i);
+        }
+        builder.write("external_limit.bin", tp);
+    } catch (...) {
+        threw = true;
+    }
+    setrlimit(RLIMIT_NOFILE, &saved);
+    REQUIRE(!threw);
+    REQUIRE(fs::is_empty(spillDir));
+    OpenHashMapTC<int32_t, int32_t> m("external_limit.bin");
+    REQUIRE(m.size() == 64000);
+    REQUIRE(m.at(63999) == -63999);
+    fs::remove("external_limit.bin");
+    fs::remove(spillDir);
+}
@@ -0,0 +1,112 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<cmath>
+#include<filesystem>
+#include<string>
+#include<vector>
+
+#include"gradylib/HotKeyCache.hpp"
+#include"gradylib/MMapI2SOpenHashMap.hpp"
+#include"gradylib/MMapS2IOpenHashMap.hpp"
+#include"gradylib/OpenHashMap.hpp"
+
+using namespace std;
+using namespace gradylib;
+namespace fs = std::filesystem;
+
+TEST_CASE("FrequencySketch counts") {
+    FrequencySketch sketch(1024);
+    for (int i = 0; i < 10; ++i) {
+        sketch.increment(12345);
+    }
+    sketch.increment(999);
+    REQUIRE(sketch.frequency(12345) >= 10);
+    REQUIRE(sketch.frequency(999) >= 1);
+    REQUIRE(sketch.frequency(12345) > sketch.frequency(999));
+    for (int i = 0; i < 100; ++i) {
+        sketch.increment(12345);
+    }
+    // Counters saturate at 15
+    REQUIRE(sketch.frequency(12345) == 15);
+}
+
+TEST_CASE("HotKeyCache admits frequent keys over one-off keys") {
+    HotKeyCache<int, int> cache(4);
+    auto access = [&cache](int key) {
+        size_t hash = std::hash<int>{}(key) * 0x9E3779B97F4A7C15ull;
+        if (cache.find(key, hash)) {
+            return true;
+        }
+        cache.admit(key, hash, key * 2);
+        return false;
+    };
+    for (int rep = 0; rep < 20; ++rep) {
+        for (int key = 0; key < 4; ++key) {
+            access(key);
+        }
+    }
+    // A scan of cold keys shouldn't displace the hot ones
+    for (int key = 1000; key < 2000; ++key) {
+        access(key);
+    }
+    int hotHits = 0;
+    for (int key = 0; key < 4; ++key) {
+        hotHits += access(key) ? 1 : 0;
+    }
+    REQUIRE(hotHits >= 3);
+    REQUIRE(cache.hits() > 0);
+    REQUIRE(cache.capacity() >= 4);
+}
+
+TEST_CASE("MMapS2IOpenHashMap CachedReader") {
+    fs::path tmpFile = fs::temp_directory_path() / "hotkeys2i.bin";
+    OpenHashMap<string, int64_t> m;
+    int num = 20000;
+    for (int i = 0; i < num; ++i) {
+        m[to_string(i) + "_key"] = i;
+    }
+    m.erase("7_key");
+    writeMappable(tmpFile, m);
+    MMapS2IOpenHashMap<int64_t> mm(tmpFile);
+    auto reader = mm.cachedReader(256);
+    // Zipf-ish access pattern
+    uint64_t x = 1;
+    for (int i = 0; i < 100000; ++i) {
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+        double u = static_cast<double>(x >> 11) / static_cast<double>(1ull << 53);
+        int key = static_cast<int>(pow(static_cast<double>(num), u)) - 1;
+        if (key == 7) {
+            REQUIRE(!reader.contains("7_key"));
+            REQUIRE_THROWS(reader["7_key"]);
+            continue;
+        }
+        string k = to_string(key) + "_key";
+        REQUIRE(reader[k] == key);
+        REQUIRE(reader.contains(k));
+    }
+    REQUIRE(reader.hits() > reader.misses());
+    REQUIRE(!reader.contains("missing"));
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("MMapI2SOpenHashMap CachedReader") {
+    fs::path tmpFile = fs::temp_directory_path() / "hotkeyi2s.bin";
+    OpenHashMap<int64_t, string> m;
+    for (int64_t i = 0; i < 5000; ++i) {
+        m[i] = to_string(i * 3);
+    }
+    writeMappable(tmpFile, m);
+    MMapI2SOpenHashMap<int64_t> mm(tmpFile);
+    auto reader = mm.cachedReader(64);
+    for (int rep = 0; rep < 50; ++rep) {
+        for (int64_t i = 0; i < 40; ++i) {
+            REQUIRE(reader[i] == to_string(i * 3));
+        }
+        REQUIRE(reader[rep * 97] == to_string(rep * 97 * 3));
+    }
+    REQUIRE(reader.contains(3));
+    REQUIRE(!reader.contains(5000));
+    REQUIRE_THROWS(reader[5001]);
+    REQUIRE(reader.hits() > reader.misses());
+    fs::remove(tmpFile);
+}
@@ -0,0 +1,248 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<filesystem>
+#include<fstream>
+#include<random>
+#include<string>
+#include<vector>
+
+#include"gradylib/Integrity.hpp"
+#include"gradylib/MMapI2HRSOpenHashMap.hpp"
+#include"gradylib/MMapI2SOpenHashMap.hpp"
+#include"gradylib/MMapS2IOpenHashMap.hpp"
+#include"gradylib/MMapStringOpenHashSet.hpp"
+#include"gradylib/OpenHashMapTC.hpp"
+
+using namespace std;
+using namespace gradylib;
+namespace fs = std::filesystem;
+
+namespace {
+    void flipByte(fs::path const & path, size_t offset) {
+        fstream f(path, ios::in | ios::out | ios::binary);
+        f.seekg(offset);
+        char c;
+        f.read(&c, 1);
+        c ^= 0x20;
+        f.seekp(offset);
+        f.write(&c, 1);
+    }
+}
+
+TEST_CASE("CRC32C") {
+    string check = "123456789";
+    REQUIRE(gradylib_helpers::crc32c(check.data(), check.size()) == 0xE3069283);
+    REQUIRE(gradylib_helpers::crc32c(nullptr, 0) == 0);
+
+    vector<unsigned char> data(100003);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = i * 131 + (i >> 7);
+    }
+    uint32_t whole = gradylib_helpers::crc32c(data.data(), data.size());
+    uint32_t pieces = gradylib_helpers::crc32c(data.data(), 12345);
+    pieces = gradylib_helpers::crc32c(pieces, data.data() + 12345, data.size() - 12345);
+    REQUIRE(whole == pieces);
+    uint32_t software = ~gradylib_helpers::crc32cSoftware(~0u, data.data(), data.size());
+    REQUIRE(whole == software);
+}
+
+TEST_CASE("Integrity trailer on a raw file") {
+    fs::path tmpFile = fs::temp_directory_path() / "integrity.bin";
+    {
+        ofstream ofs(tmpFile, ios::binary);
+        for (int i = 0; i < 100000; ++i) {
+            ofs.write(gradylib_helpers::charCast(&i), 4);
+        }
+    }
+    ThreadPool tp(4);
+    appendIntegrityTrailer(tmpFile, tp, 4096);
+    verifyIntegrity(tmpFile, tp);
+
+    flipByte(tmpFile, 200000);
+    REQUIRE_THROWS(verifyIntegrity(tmpFile, tp));
+    flipByte(tmpFile, 200000);
+    verifyIntegrity(tmpFile, tp);
+
+    fs::resize_file(tmpFile, fs::file_size(tmpFile) - 1);
+    REQUIRE_THROWS(verifyIntegrity(tmpFile, tp));
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("IntegrityVerifier lazy sections") {
+    vector<std::byte> file(10000);
+    for (size_t i = 0; i < file.size(); ++i) {
+        file[i] = std::byte(i * 7);
+    }
+    fs::path tmpFile = fs::temp_directory_path() / "integrity.bin";
+    {
+        ofstream ofs(tmpFile, ios::binary);
+        ofs.write(gradylib_helpers::charCast(file.data()), file.size());
+    }
+    appendIntegrityTrailer(tmpFile, gradylib_helpers::defaultThreadPool(), 1024);
+    flipByte(tmpFile, 5000);
+    vector<char> contents(fs::file_size(tmpFile));
+    ifstream(tmpFile, ios::binary).read(contents.data(), contents.size());
+
+    REQUIRE(IntegrityVerifier::hasTrailer(contents.data(), contents.size()));
+    REQUIRE(!IntegrityVerifier::hasTrailer(contents.data(), contents.size() - 1));
+    IntegrityVerifier verifier(contents.data(), contents.size());
+    REQUIRE(verifier.numSections() == 10);
+    REQUIRE(verifier.size() == 10000);
+    verifier.verifyRange(0, 4096);
+    verifier.verifyRange(6144, 100000);
+    REQUIRE_THROWS(verifier.verifyRange(4096, 1024));
+    REQUIRE_THROWS(verifier.verifySection(4));
+    REQUIRE_THROWS(verifier.verifyAll());
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("Mapped readers verify and reject truncated files") {
+    fs::path tmpFile = fs::temp_directory_path() / "integrity_map.bin";
+
+    OpenHashMap<string, int64_t> s2i;
+    OpenHashMap<int64_t, string> i2s;
+    OpenHashMapTC<int64_t, int64_t> tc;
+    MMapI2HRSOpenHashMap<int64_t>::Builder i2hrs;
+    OpenHashSet<string> strings;
+    for (int64_t i = 0; i < 5000; ++i) {
+        strings.insert(to_string(i));
+        s2i[to_string(i)] = i;
+        i2s[i] = to_string(i * 3);
+        tc[i] = -i;
+        i2hrs.put(i, to_string(i % 10));
+    }
+
+    auto check = [&](auto load, auto write) {
+        write();
+        verifyIntegrity(tmpFile);
+        load(true);
+        size_t size = fs::file_size(tmpFile);
+        flipByte(tmpFile, size / 3);
+        load(false);
+        REQUIRE_THROWS(load(true));
+        fs::resize_file(tmpFile, size / 2);
+        REQUIRE_THROWS(load(false));
+        fs::resize_file(tmpFile, 4);
+        REQUIRE_THROWS(load(false));
+        fs::remove(tmpFile);
+    };
+    check([&](bool verify) {
+        MMapS2IOpenHashMap<int64_t> m(tmpFile, verify);
+        REQUIRE(m.size() == 5000);
+    }, [&]() {
+        writeMappable(tmpFile, s2i);
+    });
+    check([&](bool verify) {
+        MMapI2SOpenHashMap<int64_t> m(tmpFile, verify);
+        REQUIRE(m.size() == 5000);
+    }, [&]() {
+        writeMappable(tmpFile, i2s);
+    });
+    check([&](bool verify) {
+        OpenHashMapTC<int64_t, int64_t> m(tmpFile, verify);
+        REQUIRE(m.size() == 5000);
+    }, [&]() {
+        tc.write(tmpFile);
+    });
+    check([&](bool verify) {
+        MMapStringOpenHashSet<> m(tmpFile, verify);
+        REQUIRE(m.size() == 5000);
+    }, [&]() {
+        writeMappable(tmpFile, strings);
+    });
+    check([&](bool verify) {
+        MMapI2HRSOpenHashMap<int64_t> m(tmpFile, verify);
+        REQUIRE(m.size() == 5000);
+    }, [&]() {
+        auto builder = i2hrs;
+        builder.write(tmpFile);
+    });
+}
+
+TEST_CASE("OpenHashMapTC verifies sections lazily") {
+    fs::path tmpFile = fs::temp_directory_path() / "integrity_lazy.bin";
+    OpenHashMapTC<int64_t, int64_t> tc;
+    for (int64_t i = 0; i < 1000000; ++i) {
+        tc[i] = -i;
+    }
+    tc.write(tmpFile);
+    // Corrupt one value in the middle of the values array, which is in one 4MB section
+    size_t valuesOffset;
+    ifstream(tmpFile, ios::binary).seekg(32).read(gradylib_helpers::charCast(&valuesOffset), 8);
+    flipByte(tmpFile, valuesOffset + 8 * tc.capacity() / 2);
+
+    OpenHashMapTC<int64_t, int64_t> m(tmpFile, IntegrityCheck::lazy);
+    size_t good = 0;
+    size_t bad = 0;
+    for (int64_t i = 0; i < 1000000; i += 97) {
+        try {
+            int64_t v = m.at(i);
+            bool contained = m.contains(i);
+            REQUIRE(v == -i);
+            REQUIRE(contained);
+            ++good;
+        } catch (gradylib::Exception const &) {
+            ++bad;
+        }
+    }
+    REQUIRE(good > 0);
+    REQUIRE(bad > 0);
+    REQUIRE_THROWS(m.begin());
+    REQUIRE_THROWS(m.parallelForEach([](OpenHashMapTC<int64_t, int64_t> &, int64_t, int64_t) {}).get());
+
+    tc.write(tmpFile);
+    OpenHashMapTC<int64_t, int64_t> intact(tmpFile, IntegrityCheck::lazy);
+    REQUIRE(intact.at(12345) == -12345);
+    size_t count = 0;
+    for (auto const & entry : intact) {
+        (void)entry;
+        ++count;
+    }
+    REQUIRE(count == 1000000);
+
+    OpenHashMapTC<int64_t, int64_t> sampled(tmpFile, IntegrityCheck::lazy);
+    mt19937_64 rng(17);
+    for (auto const & entry : sampled.sample(100, rng)) {
+        REQUIRE(entry.value() == -entry.key());
+    }
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("Maps written from default pool tasks get a trailer") {
+    ThreadPool & tp = gradylib_helpers::defaultThreadPool();
+    int numTasks = std::max(tp.size(), 1);
+    gradylib_helpers::runTasks(tp, numTasks, [](size_t task) {
+        fs::path tmpFile = fs::temp_directory_path() / ("integrity_task" + to_string(task) + ".bin");
+        OpenHashMapTC<int64_t, int64_t> tc;
+        for (int64_t i = 0; i < 1000; ++i) {
+            tc[i] = i * task;
+        }
+        tc.write(tmpFile);
+    });
+    for (int task = 0; task < numTasks; ++task) {
+        fs::path tmpFile = fs::temp_directory_path() / ("integrity_task" + to_string(task) + ".bin");
+        OpenHashMapTC<int64_t, int64_t> m(tmpFile, true);
+        REQUIRE(m.size() == 1000);
+        fs::remove(tmpFile);
+    }
+}
+
+TEST_CASE("Writers don't seal a file they failed to write") {
+    // Every write to /dev/full fails with ENOSPC, like a full disk
+    fs::path full = "/dev/full";
+    if (!fs::exists(full)) {
+        return;
+    }
+    OpenHashMap<int64_t, string> i2s;
+    OpenHashMapTC<int64_t, int64_t> tc;
+    MMapI2HRSOpenHashMap<int64_t>::Builder i2hrs;
+    for (int64_t i = 0; i < 5000; ++i) {
+        i2s[i] = to_string(i * 3);
+        tc[i] = -i;
+        i2hrs.put(i, to_string(i % 10));
+    }
+    REQUIRE_THROWS(tc.write(full));
+    REQUIRE_THROWS(writeMappable(full, i2s));
+    REQUIRE_THROWS(writeMappableCompressed(full, i2s));
+    REQUIRE_THROWS(i2hrs.writeCompressed(full));
+}
@@ -0,0 +1,128 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<algorithm>
+#include<filesystem>
+#include<map>
+#include<string>
+
+#include"gradylib/MMapFrontCodedStringMap.hpp"
+#include"gradylib/OpenHashMap.hpp"
+
+using namespace std;
+using namespace gradylib;
+namespace fs = std::filesystem;
+
+TEST_CASE("Front coded string map lookups and iteration") {
+    OpenHashMap<string, int> m;
+    map<string, int> test;
+    for (int i = 0; i < 20000; ++i) {
+        string s = "https://example.com/path/" + to_string(i % 97) + "/item" + to_string(i);
+        m[s] = i;
+        test[s] = i;
+    }
+    m[""] = -1;
+    test[""] = -1;
+    fs::path tmpFile = fs::temp_directory_path() / "front_coded.bin";
+    writeFrontCoded(tmpFile, m, 16);
+    REQUIRE(fs::file_size(tmpFile) < 20000 * 35);
+
+    MMapFrontCodedStringMap<int> fc(tmpFile);
+    REQUIRE(fc.size() == test.size());
+    for (auto const & [key, value] : test) {
+        REQUIRE(fc.contains(key));
+        REQUIRE(fc[key] == value);
+    }
+    REQUIRE(!fc.contains("https://example.com/path/1/item"));
+    REQUIRE(!fc.contains("zzz"));
+    REQUIRE(!fc.contains("https://example.com/path/0/item0a"));
+    REQUIRE_THROWS(fc["zzz"]);
+
+    size_t rank = 0;
+    auto testIter = test.begin();
+    for (auto const & [key, value] : fc) {
+        REQUIRE(key == testIter->first);
+        REQUIRE(value == testIter->second);
+        REQUIRE(fc.keyAt(rank) == key);
+        REQUIRE(fc.valueAt(rank) == value);
+        ++testIter;
+        ++rank;
+    }
+    REQUIRE(rank == test.size());
+    REQUIRE_THROWS(fc.keyAt(rank));
+
+    OpenHashMap<string, int> c = fc.clone();
+    REQUIRE(c.size() == m.size());
+    REQUIRE(c.at("https://example.com/path/3/item100") == 100);
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("Front coded string map prefix and range queries") {
+    OpenHashMap<string, int> m;
+    map<string, int> test;
+    for (int i = 0; i < 5000; ++i) {
+        string s = "/usr/" + to_string(i % 13) + "/lib" + to_string(i);
+        m[s] = i;
+        test[s] = i;
+    }
+    fs::path tmpFile = fs::temp_directory_path() / "front_coded_prefix.bin";
+    writeFrontCoded(tmpFile, m, 64);
+    MMapFrontCodedStringMap<int> fc(tmpFile);
+
+    for (string prefix : {"/usr/1", "/usr/1/", "/usr/12/lib4", "/usr/", "", "/usr/9/lib99", "/opt", "/zzz", "/usr/5/lib5000"}) {
+        auto [first, last] = fc.prefixRange(prefix);
+        auto lo = test.lower_bound(prefix);
+        size_t expectedFirst = distance(test.begin(), lo);
+        size_t expectedCount = 0;
+        for (auto iter = lo; iter != test.end() && iter->first.starts_with(prefix); ++iter) {
+            ++expectedCount;
+        }
+        REQUIRE(first == expectedFirst);
+        REQUIRE(last - first == expectedCount);
+        auto iter = fc.iteratorAt(first);
+        for (size_t r = first; r < last; ++r, ++iter) {
+            REQUIRE(iter.key().starts_with(prefix));
+        }
+    }
+
+    for (string key : {"/usr/3/lib3", "/usr/3/lib30", "/usr/3/lib", "a", ""}) {
+        REQUIRE(fc.lowerBound(key) == static_cast<size_t>(distance(test.begin(), test.lower_bound(key))));
+        REQUIRE(fc.upperBound(key) == static_cast<size_t>(distance(test.begin(), test.upper_bound(key))));
+    }
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("Front coded string map empty and errors") {
+    OpenHashMap<string, int64_t> m;
+    fs::path tmpFile = fs::temp_directory_path() / "front_coded_empty.bin";
+    writeFrontCoded(tmpFile, m);
+    MMapFrontCodedStringMap<int64_t> fc(tmpFile);
+    REQUIRE(fc.size() == 0);
+    REQUIRE(!fc.contains(""));
+    REQUIRE(fc.begin() == fc.end());
+    REQUIRE(fc.prefixRange("a") == pair<size_t, size_t>(0, 0));
+    REQUIRE_THROWS(writeFrontCoded(tmpFile, m, 0));
+    m["a"] = 1;
+    REQUIRE_THROWS(writeFrontCoded("/dev/full", m));
+
+    GRADY_LIB_MOCK_MMapFrontCodedStringMap_MMAP<int64_t>();
+    REQUIRE_THROWS(MMapFrontCodedStringMap<int64_t>(tmpFile));
+    GRADY_LIB_DEFAULT_MMapFrontCodedStringMap_MMAP<int64_t>();
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("Front coded string map rejects truncated files") {
+    OpenHashMap<string, int64_t> m;
+    for (int i = 0; i < 1000; ++i) {
+        m["key" + to_string(i)] = i;
+    }
+    fs::path tmpFile = fs::temp_directory_path() / "front_coded_truncated.bin";
+    writeFrontCoded(tmpFile, m);
+    size_t size = fs::file_size(tmpFile);
+    fs::resize_file(tmpFile, size - 8);
+    REQUIRE_THROWS(MMapFrontCodedStringMap<int64_t>(tmpFile));
+    fs::resize_file(tmpFile, size / 2);
+    REQUIRE_THROWS(MMapFrontCodedStringMap<int64_t>(tmpFile));
+    fs::resize_file(tmpFile, 24);
+    REQUIRE_THROWS(MMapFrontCodedStringMap<int64_t>(tmpFile));
+    fs::remove(tmpFile);
+}
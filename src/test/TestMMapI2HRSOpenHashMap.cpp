@@ -107,6 +107,39 @@ TEST_CASE("Integer to highly redundant string open hash map") {
     cout << "test time: " << chrono::duration_cast<chrono::milliseconds>(endTime-startTime).count() << "\n";
 }
 
+TEST_CASE("MMapI2HRSOpenHashMap Builder parallel write") {
+    fs::path tmpFile = filesystem::temp_directory_path() / "hrsmap_parallel.bin";
+    MMapI2HRSOpenHashMap<int64_t>::Builder b;
+    b.reserve(200000, 20000, 20000 * 16);
+    unordered_map<int64_t, string> test;
+    // One string longer than a write chunk, and lengths covering every padding case
+    string big(5 << 20, 'q');
+    b.put(-1, big);
+    test[-1] = big;
+    for (int64_t i = 0; i < 200000; ++i) {
+        string s = "s" + to_string(i % 20000) + string(i % 4, 'x');
+        b.put(i, s);
+        test[i] = s;
+    }
+    b.put(5, "replaced");
+    test[5] = "replaced";
+    REQUIRE(b.at(5) == "replaced");
+    // A failed write leaves the builder as it was
+    REQUIRE_THROWS(b.write("/dev/full"));
+    REQUIRE(b.size() == test.size());
+    REQUIRE(b.at(5) == "replaced");
+    ThreadPool tp(3);
+    b.write(tmpFile, tp, alignof(void*), 4);
+    REQUIRE(b.size() == 0);
+
+    MMapI2HRSOpenHashMap<int64_t> m(tmpFile);
+    REQUIRE(m.size() == test.size());
+    for (auto const & [key, str] : test) {
+        REQUIRE(m.at(key) == str);
+    }
+    fs::remove(tmpFile);
+}
+
 TEST_CASE("MMapI2HRSOpenHashMap at throws on missing element") {
     fs::path tmpPath = filesystem::temp_directory_path();
     fs::path tmpFile = tmpPath / "map.bin";
@@ -127,6 +160,29 @@ TEST_CASE("MMapI2HRSOpenHashMap Builder write throws on bad filename") {
     REQUIRE_THROWS( builder.write(tmpFile));
 }
 
+TEST_CASE("MMapI2HRSOpenHashMap Builder keeps its strings when a write fails") {
+    MMapI2HRSOpenHashMap<int>::Builder builder;
+    for (int i = 0; i < 5000; ++i) {
+        builder.put(i, string(i % 7, 'a' + i % 26));
+    }
+    // Every write to /dev/full fails with ENOSPC, like a full disk
+    if (fs::exists("/dev/full")) {
+        REQUIRE_THROWS(builder.write("/dev/full"));
+    }
+    REQUIRE(builder.size() == 5000);
+    for (int i = 0; i < 5000; ++i) {
+        REQUIRE(builder.at(i) == string(i % 7, 'a' + i % 26));
+    }
+    fs::path tmpFile = filesystem::temp_directory_path() / "map.bin";
+    builder.write(tmpFile);
+    MMapI2HRSOpenHashMap<int> m(tmpFile, true);
+    REQUIRE(m.size() == 5000);
+    for (int i = 0; i < 5000; ++i) {
+        REQUIRE(m.at(i) == string(i % 7, 'a' + i % 26));
+    }
+    fs::remove(tmpFile);
+}
+
 TEST_CASE("MMapI2HRSOpenHashMap constructor throws on nonexistent file") {
     fs::path tmpPath = "/__gradylib_nonexistent_dir";
     fs::path tmpFile = tmpPath / "map.bin";
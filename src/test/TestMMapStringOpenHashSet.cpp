@@ -0,0 +1,112 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<filesystem>
+#include<memory>
+#include<string>
+#include<vector>
+
+#include"gradylib/MMapStringOpenHashSet.hpp"
+#include"gradylib/OpenHashSet.hpp"
+
+using namespace std;
+using namespace gradylib;
+namespace fs = std::filesystem;
+
+namespace {
+    struct Count {
+        size_t count = 0;
+        size_t totalLength = 0;
+    };
+
+    void mergePartials(Count & c1, Count const & c2) {
+        c1.count += c2.count;
+        c1.totalLength += c2.totalLength;
+    }
+}
+
+TEST_CASE("MMapStringOpenHashSet lookups and iteration") {
+    OpenHashSet<string> s;
+    size_t totalLength = 0;
+    for (int i = 0; i < 10000; ++i) {
+        string str = "word" + to_string(i);
+        totalLength += str.size();
+        s.insert(str);
+    }
+    s.insert("");
+    s.insert("gone");
+    s.erase("gone");
+    fs::path tmpFile = fs::temp_directory_path() / "mmap_string_set.bin";
+    writeMappable(tmpFile, s);
+
+    MMapStringOpenHashSet<> m(tmpFile);
+    REQUIRE(m.size() == s.size());
+    for (int i = 0; i < 10000; ++i) {
+        REQUIRE(m.contains("word" + to_string(i)));
+    }
+    REQUIRE(m.contains(""));
+    REQUIRE(!m.contains("gone"));
+    REQUIRE(!m.contains("word10000"));
+
+    size_t count = 0;
+    for (string_view key : m) {
+        REQUIRE(s.contains(string(key)));
+        ++count;
+    }
+    REQUIRE(count == s.size());
+
+    vector<string> queryStrings = {"word1", "nope", "", "word9999", "gone", "word5000"};
+    vector<string_view> queries(queryStrings.begin(), queryStrings.end());
+    for (int i = 0; i < 100; ++i) {
+        queries.push_back(i % 2 == 0 ? "word7" : "missing");
+    }
+    unique_ptr<bool[]> results(new bool[queries.size()]);
+    m.containsBatch(queries, span<bool>(results.get(), queries.size()));
+    for (size_t i = 0; i < queries.size(); ++i) {
+        REQUIRE(results[i] == m.contains(queries[i]));
+    }
+    REQUIRE_THROWS(m.containsBatch(queries, span<bool>(results.get(), 1)));
+
+    Count c = m.parallelForEach<Count>([](Count & partial, string_view key) {
+        ++partial.count;
+        partial.totalLength += key.size();
+    }).get();
+    REQUIRE(c.count == s.size());
+    REQUIRE(c.totalLength == totalLength);
+
+    ThreadPool tp(4);
+    Count c3 = m.parallelForEach<Count>(tp, [](Count & partial, string_view) {
+        ++partial.count;
+    }, {}, {}, 3).get();
+    REQUIRE(c3.count == s.size());
+
+    OpenHashSet<string> filtered = m.parallelForEach([](OpenHashSet<string> & partial, string_view key) {
+        if (key.ends_with("7")) {
+            partial.insert(string(key));
+        }
+    }).get();
+    REQUIRE(filtered.size() == 1000);
+    REQUIRE(filtered.contains(string("word17")));
+
+    OpenHashSet<string> c2 = m.clone();
+    REQUIRE(c2.size() == s.size());
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("MMapStringOpenHashSet empty and errors") {
+    OpenHashSet<string> s;
+    fs::path tmpFile = fs::temp_directory_path() / "mmap_string_set_empty.bin";
+    writeMappable(tmpFile, s);
+    MMapStringOpenHashSet<> m(tmpFile);
+    REQUIRE(m.size() == 0);
+    REQUIRE(!m.contains("a"));
+    REQUIRE(m.begin() == m.end());
+    REQUIRE(m.parallelForEach<Count>([](Count & partial, string_view) {
+        ++partial.count;
+    }).get().count == 0);
+
+    GRADY_LIB_MOCK_MMapStringOpenHashSet_MMAP<>();
+    REQUIRE_THROWS(MMapStringOpenHashSet<>(tmpFile));
+    GRADY_LIB_DEFAULT_MMapStringOpenHashSet_MMAP<>();
+    REQUIRE_THROWS(MMapStringOpenHashSet<>("/nonexistent/set.bin"));
+    fs::remove(tmpFile);
+}
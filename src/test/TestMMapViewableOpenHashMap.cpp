@@ -4,6 +4,7 @@
 #include<catch2/catch_test_macros.hpp>
 
 #include<fstream>
+#include<random>
 #include<span>
 #include<vector>
 
@@ -162,3 +163,21 @@ TEST_CASE("MMapViewableOpenHashMap::Builder::write throws on bad file") {
     gradylib::MMapViewableOpenHashMap<int, vector<int>>::Builder builder;
     REQUIRE_THROWS(builder.write("/gradylib_nonexistent_file"));
 }
+
+TEST_CASE("MMapViewableOpenHashMap sample") {
+    MMapViewableOpenHashMap<int, vector<int>>::Builder z;
+    for (int i = 0; i < 1000; ++i) {
+        z.put(i, vector<int>{i, i + 1});
+    }
+    z.write("viewable_sample.bin");
+    MMapViewableOpenHashMap<int, vector<int>> dz("viewable_sample.bin");
+    mt19937 rng(1);
+    auto entries = dz.sample(50, rng);
+    REQUIRE(entries.size() == 50);
+    for (auto const & [key, view] : entries) {
+        REQUIRE(view.size() == 2);
+        REQUIRE(view[0] == key);
+        REQUIRE(view[1] == key + 1);
+    }
+    fs::remove("viewable_sample.bin");
+}
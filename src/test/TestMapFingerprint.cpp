@@ -0,0 +1,122 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<filesystem>
+#include<string>
+
+#include"gradylib/MapFingerprint.hpp"
+#include"gradylib/MMapI2HRSOpenHashMap.hpp"
+#include"gradylib/MMapI2SOpenHashMap.hpp"
+#include"gradylib/MMapS2IOpenHashMap.hpp"
+#include"gradylib/OpenHashMap.hpp"
+#include"gradylib/OpenHashMapTC.hpp"
+
+using namespace std;
+using namespace gradylib;
+namespace fs = std::filesystem;
+
+TEST_CASE("Map fingerprint ignores build order") {
+    ThreadPool tp(4);
+    OpenHashMap<string, int64_t> m1;
+    for (int64_t i = 0; i < 100000; ++i) {
+        m1.put(to_string(i), i * 7);
+    }
+    OpenHashMap<string, int64_t> m2;
+    m2.reserve(300000);
+    for (int64_t i = 100000 + 500; i-- > 0;) {
+        m2.put(to_string(i), i * 7);
+    }
+    for (int64_t i = 100000; i < 100000 + 500; ++i) {
+        m2.erase(to_string(i));
+    }
+    REQUIRE(fingerprint(m1, tp) == fingerprint(m2, tp));
+    REQUIRE(equals(m1, m2, tp));
+    REQUIRE(fingerprint(m1, tp).toString().size() == 32);
+
+    m2["777"] = 1;
+    REQUIRE(fingerprint(m1, tp) != fingerprint(m2, tp));
+    REQUIRE(!equals(m1, m2, tp));
+    REQUIRE(!equals(m2, m1, tp));
+
+    m2["777"] = 777 * 7;
+    m2.erase("123");
+    REQUIRE(fingerprint(m1, tp) != fingerprint(m2, tp));
+    REQUIRE(!equals(m1, m2, tp));
+    m2["123456789"] = 123 * 7;
+    REQUIRE(m1.size() == m2.size());
+    REQUIRE(!equals(m1, m2, tp));
+
+    OpenHashMap<string, int64_t> empty1, empty2;
+    REQUIRE(fingerprint(empty1, tp) == MapFingerprint{});
+    REQUIRE(equals(empty1, empty2, tp));
+    REQUIRE(!equals(empty1, m1, tp));
+}
+
+TEST_CASE("Map fingerprint across heap and mapped maps") {
+    fs::path s2iFile = fs::temp_directory_path() / "fingerprint_s2i.bin";
+    fs::path i2sFile = fs::temp_directory_path() / "fingerprint_i2s.bin";
+    fs::path i2hrsFile = fs::temp_directory_path() / "fingerprint_i2hrs.bin";
+    fs::path tcFile = fs::temp_directory_path() / "fingerprint_tc.bin";
+    ThreadPool tp(4);
+
+    OpenHashMap<string, int> s2i;
+    OpenHashMap<int, string> i2s;
+    OpenHashMapTC<int, int> tc;
+    MMapI2HRSOpenHashMap<int>::Builder i2hrsBuilder;
+    for (int i = 0; i < 50000; ++i) {
+        s2i.put("key" + to_string(i), i);
+        i2s.put(i, "value" + to_string(i % 100));
+        tc.put(i, -i);
+        i2hrsBuilder.put(i, "value" + to_string(i % 100));
+    }
+    writeMappable(s2iFile.string(), s2i);
+    writeMappable(i2sFile.string(), i2s);
+    tc.write(tcFile.string());
+    i2hrsBuilder.write(i2hrsFile.string());
+
+    MMapS2IOpenHashMap<int> s2iMapped(s2iFile);
+    REQUIRE(fingerprint(s2iMapped, tp) == fingerprint(s2i, tp));
+    REQUIRE(equals(s2i, s2iMapped, tp));
+    REQUIRE(equals(s2iMapped, s2i, tp));
+
+    MMapI2SOpenHashMap<int> i2sMapped(i2sFile);
+    MMapI2HRSOpenHashMap<int> i2hrsMapped(i2hrsFile);
+    REQUIRE(fingerprint(i2sMapped, tp) == fingerprint(i2s, tp));
+    REQUIRE(fingerprint(i2hrsMapped, tp) == fingerprint(i2s, tp));
+    REQUIRE(equals(i2sMapped, i2hrsMapped, tp));
+    REQUIRE(equals(i2hrsMapped, i2s, tp));
+
+    OpenHashMapTC<int, int> tcMapped(tcFile);
+    REQUIRE(fingerprint(tcMapped, tp) == fingerprint(tc, tp));
+    REQUIRE(equals(tc, tcMapped, tp));
+    tc.put(49999, 0);
+    REQUIRE(fingerprint(tcMapped, tp) != fingerprint(tc, tp));
+    REQUIRE(!equals(tcMapped, tc, tp));
+
+    // A key and value swapped is a different entry
+    OpenHashMapTC<int, int> a, b;
+    a.put(1, 2);
+    b.put(2, 1);
+    REQUIRE(fingerprint(a, tp) != fingerprint(b, tp));
+
+    fs::remove(s2iFile);
+    fs::remove(i2sFile);
+    fs::remove(i2hrsFile);
+    fs::remove(tcFile);
+}
+
+TEST_CASE("OpenHashMapTC parallelForEach") {
+    OpenHashMapTC<int, int> m;
+    for (int i = 0; i < 10000; ++i) {
+        m.put(i, 2 * i);
+    }
+    auto copy = m.parallelForEach([](OpenHashMapTC<int, int> & partial, int const & key, int const & value) {
+        partial.put(value, key);
+    }).get();
+    REQUIRE(copy.size() == m.size());
+    REQUIRE(copy.at(19998) == 9999);
+
+    OpenHashMapTC<int, int> empty;
+    REQUIRE(empty.parallelForEach([](OpenHashMapTC<int, int> & partial, int const & key, int const & value) {
+        partial.put(key, value);
+    }).get().size() == 0);
+}
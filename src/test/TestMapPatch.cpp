@@ -0,0 +1,129 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<filesystem>
+#include<fstream>
+#include<iterator>
+#include<string>
+
+#include"gradylib/MapPatch.hpp"
+#include"gradylib/MMapS2IOpenHashMap.hpp"
+#include"gradylib/OpenHashMap.hpp"
+#include"gradylib/OpenHashMapTC.hpp"
+
+using namespace std;
+using namespace gradylib;
+namespace fs = std::filesystem;
+
+namespace {
+    string readFile(fs::path const & path) {
+        ifstream ifs(path, ios::binary);
+        return string(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+    }
+}
+
+TEST_CASE("Map patch OpenHashMapTC") {
+    fs::path oldFile = fs::temp_directory_path() / "patch_old.bin";
+    fs::path newFile = fs::temp_directory_path() / "patch_new.bin";
+    fs::path patchFile = fs::temp_directory_path() / "patch.bin";
+    fs::path rebuiltFile = fs::temp_directory_path() / "patch_rebuilt.bin";
+    ThreadPool tp(4);
+
+    OpenHashMapTC<int64_t, int64_t> m;
+    m.reserve(400000);
+    for (int64_t i = 0; i < 200000; ++i) {
+        m.put(i, i * 3);
+    }
+    m.write(oldFile.string());
+    for (int64_t i = 0; i < 1000; ++i) {
+        m.put(i * 97, -i);
+        m.erase(i * 89 + 5);
+        m.put(1000000 + i, i);
+    }
+    m.write(newFile.string());
+
+    size_t numSlots = diff<OpenHashMapTC<int64_t, int64_t>>(oldFile, newFile, patchFile, tp);
+    REQUIRE(numSlots > 0);
+    REQUIRE(numSlots <= 3000);
+    REQUIRE(fs::file_size(patchFile) * 20 < fs::file_size(newFile));
+
+    applyPatch<OpenHashMapTC<int64_t, int64_t>>(oldFile, patchFile, rebuiltFile, tp);
+    REQUIRE(readFile(rebuiltFile) == readFile(newFile));
+    verifyIntegrity(rebuiltFile, tp);
+
+    OpenHashMapTC<int64_t, int64_t> rebuilt(rebuiltFile.string());
+    REQUIRE(rebuilt.size() == m.size());
+    REQUIRE(rebuilt.at(97) == -1);
+    REQUIRE(!rebuilt.contains(94));
+    REQUIRE(rebuilt.at(1000999) == 999);
+
+    // A patch only applies to the file it was made against
+    fs::path otherFile = fs::temp_directory_path() / "patch_other.bin";
+    auto other = OpenHashMapTC<int64_t, int64_t>::read(oldFile);
+    other.put(199999, 7);
+    other.write(otherFile.string());
+    REQUIRE_THROWS(applyPatch<OpenHashMapTC<int64_t, int64_t>>(otherFile, patchFile, rebuiltFile, tp));
+    REQUIRE(!fs::exists(rebuiltFile));
+    REQUIRE_THROWS(applyPatch<OpenHashMapTC<int32_t, int64_t>>(oldFile, patchFile, rebuiltFile, tp));
+}
+
+TEST_CASE("Map patch OpenHashMapTC across a rehash") {
+    fs::path oldFile = fs::temp_directory_path() / "patch_old.bin";
+    fs::path newFile = fs::temp_directory_path() / "patch_new.bin";
+    fs::path patchFile = fs::temp_directory_path() / "patch.bin";
+    fs::path rebuiltFile = fs::temp_directory_path() / "patch_rebuilt.bin";
+    ThreadPool tp(4);
+
+    OpenHashMapTC<int32_t, double> m;
+    for (int32_t i = 0; i < 1000; ++i) {
+        m.put(i, i / 2.0);
+    }
+    m.write(oldFile.string());
+    for (int32_t i = 1000; i < 50000; ++i) {
+        m.put(i, i / 2.0);
+    }
+    m.write(newFile.string());
+
+    // The table grew, so every slot is in the patch
+    REQUIRE(diff<OpenHashMapTC<int32_t, double>>(oldFile, newFile, patchFile, tp) >= m.size());
+    applyPatch<OpenHashMapTC<int32_t, double>>(oldFile, patchFile, rebuiltFile, tp);
+    REQUIRE(readFile(rebuiltFile) == readFile(newFile));
+}
+
+TEST_CASE("Map patch MMapS2IOpenHashMap") {
+    fs::path oldFile = fs::temp_directory_path() / "patch_old.bin";
+    fs::path newFile = fs::temp_directory_path() / "patch_new.bin";
+    fs::path patchFile = fs::temp_directory_path() / "patch.bin";
+    fs::path rebuiltFile = fs::temp_directory_path() / "patch_rebuilt.bin";
+    ThreadPool tp(4);
+
+    OpenHashMap<string, int64_t> m;
+    m.reserve(300000);
+    for (int64_t i = 0; i < 150000; ++i) {
+        m.put(to_string(i), i);
+    }
+    writeMappable(oldFile.string(), m);
+    for (int64_t i = 0; i < 500; ++i) {
+        m.put(to_string(i * 211), -i);
+        m.erase(to_string(i * 199 + 7));
+        m.put("a much longer key than the others " + to_string(i), i);
+    }
+    writeMappable(newFile.string(), m);
+
+    diff<MMapS2IOpenHashMap<int64_t>>(oldFile, newFile, patchFile, tp);
+    REQUIRE(fs::file_size(patchFile) * 20 < fs::file_size(newFile));
+    applyPatch<MMapS2IOpenHashMap<int64_t>>(oldFile, patchFile, rebuiltFile, tp);
+    REQUIRE(readFile(rebuiltFile) == readFile(newFile));
+
+    MMapS2IOpenHashMap<int64_t> rebuilt(rebuiltFile);
+    REQUIRE(rebuilt.size() == m.size());
+    REQUIRE(rebuilt["211"] == -1);
+    REQUIRE(!rebuilt.contains("206"));
+    REQUIRE(rebuilt["a much longer key than the others 499"] == 499);
+
+    // Damage the patch's copy of a record and the checksum check catches it
+    string patch = readFile(patchFile);
+    patch[patch.size() - 3] ^= 0x10;
+    ofstream(patchFile, ios::binary).write(patch.data(), patch.size());
+    REQUIRE_THROWS(applyPatch<MMapS2IOpenHashMap<int64_t>>(oldFile, patchFile, rebuiltFile, tp));
+    REQUIRE(!fs::exists(rebuiltFile));
+}
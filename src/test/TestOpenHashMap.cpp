@@ -6,6 +6,7 @@
 
 #include<chrono>
 #include<filesystem>
+#include<fstream>
 #include<string>
 #include<unordered_map>
 #include<unordered_set>
@@ -863,3 +864,104 @@ TEST_CASE("OpenHashMap write") {
     }
     filesystem::remove(tmpFile);
 }
+
+TEST_CASE("OpenHashMap parallel read") {
+    gradylib::OpenHashMap<string, StringIntFloat> m;
+    for (int i = 0; i < 10000; ++i) {
+        m[to_string(i)] = StringIntFloat{string(i % 17, 'x'), i, i * 0.5f};
+    }
+    fs::path tmpPath = filesystem::temp_directory_path();
+    fs::path tmpFile = tmpPath / "map.bin";
+    m.write(tmpFile, serializeString, serializeStringIntFloat);
+    gradylib::ThreadPool tp(4);
+    auto m2 = gradylib::OpenHashMap<string, StringIntFloat>::read(tmpFile, deserializeString, deserializeStringIntFloat, tp);
+    REQUIRE(m.size() == m2.size());
+    for (auto && [k, v] : m) {
+        REQUIRE(m2.contains(k));
+        REQUIRE(v == m2[k]);
+    }
+    gradylib::OpenHashMap<string, StringIntFloat> empty;
+    empty.write(tmpFile, serializeString, serializeStringIntFloat);
+    auto m3 = gradylib::OpenHashMap<string, StringIntFloat>::read(tmpFile, deserializeString, deserializeStringIntFloat, tp);
+    REQUIRE(m3.size() == 0);
+    m3["a"] = StringIntFloat{"b", 1, 1};
+    REQUIRE(m3.size() == 1);
+    filesystem::remove(tmpFile);
+    REQUIRE_THROWS(gradylib::OpenHashMap<string, StringIntFloat>::read(tmpFile, deserializeString, deserializeStringIntFloat, tp));
+}
+
+TEST_CASE("OpenHashMap reads files written without a group table") {
+    gradylib::OpenHashMap<string, StringIntFloat> m;
+    for (int i = 0; i < 10000; ++i) {
+        m[to_string(i)] = StringIntFloat{string(i % 17, 'x'), i, i * 0.5f};
+    }
+    fs::path tmpFile = filesystem::temp_directory_path() / "map_old_layout.bin";
+    m.write(tmpFile, serializeString, serializeStringIntFloat);
+
+    // Rewrite the file in the layout used before the group table: drop the table, clear the flag in the keySize
+    // word and move every record offset back by the size of the table.
+    vector<char> bytes(fs::file_size(tmpFile));
+    ifstream(tmpFile, ios::binary).read(bytes.data(), bytes.size());
+    auto word = [&](size_t offset) -> uint64_t & {
+        return *reinterpret_cast<uint64_t *>(bytes.data() + offset);
+    };
+    REQUIRE((word(8) & gradylib_helpers::openHashMapGroupTableFlag) != 0);
+    word(8) &= ~gradylib_helpers::openHashMapGroupTableFlag;
+    size_t recordsPerGroup = word(32);
+    size_t tableSize = 16 + 8 * ((m.size() + recordsPerGroup - 1) / recordsPerGroup);
+    size_t recordOffset = 32 + tableSize;
+    for (size_t i = 0; i < m.size(); ++i) {
+        size_t nextOffset = word(recordOffset + 16);
+        word(recordOffset + 8) -= tableSize;
+        word(recordOffset + 16) -= tableSize;
+        recordOffset = nextOffset;
+    }
+    bytes.erase(bytes.begin() + 32, bytes.begin() + 32 + tableSize);
+    ofstream(tmpFile, ios::binary).write(bytes.data(), bytes.size());
+
+    gradylib::ThreadPool tp(4);
+    auto serial = gradylib::OpenHashMap<string, StringIntFloat>::read(tmpFile, deserializeString, deserializeStringIntFloat);
+    auto parallel = gradylib::OpenHashMap<string, StringIntFloat>::read(tmpFile, deserializeString, deserializeStringIntFloat, tp);
+    REQUIRE(serial.size() == m.size());
+    REQUIRE(parallel.size() == m.size());
+    for (auto && [k, v] : m) {
+        REQUIRE(serial.at(k) == v);
+        REQUIRE(parallel.at(k) == v);
+    }
+    filesystem::remove(tmpFile);
+}
+
+TEST_CASE("OpenHashMap shrinkToFit") {
+    gradylib::ThreadPool tp(4);
+    gradylib::OpenHashMap<int64_t, int8_t> m;
+    for (int64_t i = 0; i < 2400000; ++i) {
+        m[i] = i % 3 == 0;
+    }
+    for (int64_t i = 0; i < 2400000; i += 2) {
+        m.erase(i);
+    }
+    m.shrinkToFit(tp);
+    REQUIRE(m.size() == 1200000);
+    REQUIRE(m.capacity() == 1500001);
+    for (int64_t i = 0; i < 2400000; ++i) {
+        if (i % 2 == 0) {
+            REQUIRE(!m.contains(i));
+        } else {
+            REQUIRE(m.at(i) == (i % 3 == 0));
+        }
+    }
+
+    gradylib::OpenHashMap<std::string, int> strings;
+    strings.setMinLoadFactor(0.25);
+    for (int i = 0; i < 10000; ++i) {
+        strings[std::to_string(i)] = i;
+    }
+    size_t fullCapacity = strings.capacity();
+    for (int i = 0; i < 9000; ++i) {
+        strings.erase(std::to_string(i));
+    }
+    REQUIRE(strings.capacity() < fullCapacity / 2);
+    for (int i = 9000; i < 10000; ++i) {
+        REQUIRE(strings.at(std::to_string(i)) == i);
+    }
+}
@@ -0,0 +1,100 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<cstdint>
+#include<filesystem>
+#include<fstream>
+#include<map>
+#include<random>
+#include<vector>
+
+#include"gradylib/OpenHashMultiMap.hpp"
+#include"gradylib/ThreadPool.hpp"
+
+using namespace std;
+using namespace gradylib;
+namespace fs = std::filesystem;
+
+namespace {
+    template<typename MultiMap>
+    void checkMultiMap(MultiMap const & m, map<int64_t, vector<int32_t>> const & expected, size_t numValues) {
+        REQUIRE(m.size() == expected.size());
+        REQUIRE(m.valueCount() == numValues);
+        for (auto const & [key, values] : expected) {
+            REQUIRE(m.contains(key));
+            auto run = m.at(key);
+            REQUIRE(vector<int32_t>(run.begin(), run.end()) == values);
+            REQUIRE(m.count(key) == values.size());
+        }
+        REQUIRE(!m.contains(-1));
+        REQUIRE(m.get(-1).empty());
+        REQUIRE_THROWS(m.at(-1));
+        size_t seen = 0;
+        for (auto [key, run] : m) {
+            REQUIRE(vector<int32_t>(run.begin(), run.end()) == expected.at(key));
+            ++seen;
+        }
+        REQUIRE(seen == expected.size());
+    }
+}
+
+TEST_CASE("OpenHashMultiMap keeps each key's values contiguous and in order") {
+    mt19937_64 rng(5);
+    // Skewed keys so that some runs are long and most are short
+    geometric_distribution<int64_t> keyDist(0.001);
+    OpenHashMultiMap<int64_t, int32_t>::Builder builder;
+    map<int64_t, vector<int32_t>> expected;
+    size_t numValues = 300000;
+    for (size_t i = 0; i < numValues; ++i) {
+        int64_t key = keyDist(rng);
+        builder.add(key, static_cast<int32_t>(i));
+        expected[key].push_back(static_cast<int32_t>(i));
+    }
+    REQUIRE(builder.size() == expected.size());
+    REQUIRE(builder.valueCount() == numValues);
+
+    ThreadPool tp(4);
+    auto m = builder.build(tp);
+    REQUIRE(builder.size() == 0);
+    checkMultiMap(m, expected, numValues);
+
+    fs::path tmpFile = fs::temp_directory_path() / "multimap.bin";
+    m.write(tmpFile);
+    {
+        MMapOpenHashMultiMap<int64_t, int32_t> mm(tmpFile, true);
+        checkMultiMap(mm, expected, numValues);
+    }
+    GRADY_LIB_MOCK_MMapOpenHashMultiMap_MMAP<int64_t, int32_t>();
+    REQUIRE_THROWS(MMapOpenHashMultiMap<int64_t, int32_t>(tmpFile));
+    GRADY_LIB_DEFAULT_MMapOpenHashMultiMap_MMAP<int64_t, int32_t>();
+
+    // An index whose key and value arrays run past the end of the file
+    size_t indexOffset;
+    ifstream(tmpFile, ios::binary).seekg(32).read(gradylib_helpers::charCast(&indexOffset), 8);
+    size_t hugeKeySize = size_t(1) << 30;
+    {
+        fstream fs(tmpFile, ios::binary | ios::in | ios::out);
+        fs.seekp(indexOffset + 8).write(gradylib_helpers::charCast(&hugeKeySize), 8);
+    }
+    REQUIRE_THROWS(MMapOpenHashMultiMap<int64_t, int32_t>(tmpFile));
+    fs::resize_file(tmpFile, 100);
+    REQUIRE_THROWS(MMapOpenHashMultiMap<int64_t, int32_t>(tmpFile));
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("OpenHashMultiMap empty map round trips") {
+    OpenHashMultiMap<int64_t, int32_t>::Builder builder;
+    auto m = builder.build();
+    REQUIRE(m.size() == 0);
+    REQUIRE(m.begin() == m.end());
+    REQUIRE(m.get(3).empty());
+
+    fs::path tmpFile = fs::temp_directory_path() / "multimap_empty.bin";
+    builder.write(tmpFile);
+    {
+        MMapOpenHashMultiMap<int64_t, int32_t> mm(tmpFile);
+        REQUIRE(mm.size() == 0);
+        REQUIRE(mm.valueCount() == 0);
+        REQUIRE(!mm.contains(3));
+    }
+    fs::remove(tmpFile);
+}
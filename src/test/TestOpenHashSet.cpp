@@ -217,3 +217,23 @@ TEST_CASE("OpenHashSet write") {
     }
     filesystem::remove(tmpFile);
 }
+
+TEST_CASE("OpenHashSet shrinks after mass erasure"){
+    OpenHashSet<std::string> s;
+    s.setMinLoadFactor(0.2);
+    for (int i = 0; i < 20000; ++i) {
+        s.insert(std::to_string(i));
+    }
+    size_t fullCapacity = s.capacity();
+    for (int i = 0; i < 18000; ++i) {
+        s.erase(std::to_string(i));
+    }
+    REQUIRE(s.size() == 2000);
+    REQUIRE(s.capacity() < fullCapacity / 3);
+    for (int i = 0; i < 20000; ++i) {
+        REQUIRE(s.contains(std::to_string(i)) == (i >= 18000));
+    }
+    s.shrinkToFit();
+    REQUIRE(s.capacity() == 2501);
+    REQUIRE(s.contains("19999"));
+}
@@ -407,3 +407,91 @@ TEST_CASE("OpenHashSetTC ifstream constructor"){
     fs::remove(tmpFile);
 }
 
+
+template<typename T>
+struct IdentityHash {
+    size_t operator()(T const & key) const noexcept {
+        return key;
+    }
+};
+
+TEST_CASE("OpenHashSetTC reseeds after pathological clustering"){
+    int64_t n = 20000;
+    OpenHashSetTC<int64_t, IdentityHash> s;
+    s.reserve(n);
+    int64_t keySize = n / 0.8;
+    for (int64_t i = 0; i < n / 2; ++i) {
+        s.insert(i);
+        s.insert(3 * keySize + i);
+    }
+    REQUIRE(s.seed() != 0);
+    REQUIRE(s.size() == n);
+    fs::path tmpFile = filesystem::temp_directory_path() / "set.bin";
+    s.write(tmpFile);
+    OpenHashSetTC<int64_t, IdentityHash> s2(tmpFile);
+    REQUIRE(s2.seed() == s.seed());
+    for (int64_t i = 0; i < n / 2; ++i) {
+        REQUIRE(s.contains(i));
+        REQUIRE(s2.contains(3 * keySize + i));
+    }
+    REQUIRE(!s2.contains(n));
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("OpenHashSetTC reads files written before hash seeds"){
+    OpenHashSetTC<int64_t> s;
+    for (int64_t i = 0; i < 10000; ++i) {
+        s.insert(i * 3);
+    }
+    fs::path tmpFile = filesystem::temp_directory_path() / "set_unseeded.bin";
+    s.write(tmpFile);
+
+    // Rewrite the file in the layout used before hash seeds: clear the flag in the keySize word, drop the seed word
+    // and move the slot flag offset back by its size.
+    vector<char> bytes(fs::file_size(tmpFile));
+    ifstream(tmpFile, ios::binary).read(bytes.data(), bytes.size());
+    auto word = [&](size_t offset) -> uint64_t & {
+        return *reinterpret_cast<uint64_t *>(bytes.data() + offset);
+    };
+    REQUIRE((word(8) & gradylib_helpers::hashSeedHeaderFlag) != 0);
+    REQUIRE(word(40) == 0);
+    word(8) &= ~gradylib_helpers::hashSeedHeaderFlag;
+    word(32) -= 8;
+    bytes.erase(bytes.begin() + 40, bytes.begin() + 48);
+    ofstream(tmpFile, ios::binary).write(bytes.data(), bytes.size());
+
+    OpenHashSetTC<int64_t> mapped(tmpFile);
+    ifstream ifs(tmpFile, ios::binary);
+    OpenHashSetTC<int64_t> streamed(ifs);
+    for (auto const * p : {&mapped, &streamed}) {
+        REQUIRE(p->seed() == 0);
+        REQUIRE(p->size() == s.size());
+        for (int64_t i = 0; i < 10000; ++i) {
+            REQUIRE(p->contains(i * 3));
+        }
+        REQUIRE(!p->contains(1));
+    }
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("OpenHashSetTC shrinks after mass erasure"){
+    OpenHashSetTC<int64_t> s;
+    s.setMinLoadFactor(0.1);
+    for (int64_t i = 0; i < 1500000; ++i) {
+        s.insert(i);
+    }
+    size_t fullCapacity = s.capacity();
+    for (int64_t i = 0; i < 1400000; ++i) {
+        s.erase(i);
+    }
+    REQUIRE(s.size() == 100000);
+    REQUIRE(s.capacity() < fullCapacity / 4);
+    for (int64_t i = 1300000; i < 1500000; ++i) {
+        REQUIRE(s.contains(i) == (i >= 1400000));
+    }
+    ThreadPool tp(3);
+    s.shrinkToFit(tp);
+    REQUIRE(s.capacity() == 125001);
+    REQUIRE(s.size() == 100000);
+    REQUIRE(s.contains(1499999));
+}
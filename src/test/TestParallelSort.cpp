@@ -0,0 +1,120 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<algorithm>
+#include<random>
+#include<string>
+#include<vector>
+
+#include"gradylib/OpenHashMap.hpp"
+#include"gradylib/OpenHashMapTC.hpp"
+#include"gradylib/ParallelSort.hpp"
+
+using namespace std;
+using namespace gradylib;
+
+TEST_CASE("OpenHashMap topK") {
+    ThreadPool tp(4);
+    OpenHashMap<string, int64_t> counts;
+    mt19937_64 gen(7);
+    vector<int64_t> values;
+    for (int i = 0; i < 200000; ++i) {
+        int64_t v = gen() % 1000000;
+        counts.put("k" + to_string(i), v);
+        values.push_back(v);
+    }
+    sort(values.begin(), values.end(), greater<>());
+    auto top = counts.topK(tp, 1000, [](auto const & a, auto const & b) {
+        return a.value() > b.value();
+    });
+    REQUIRE(top.size() == 1000);
+    for (size_t i = 0; i < top.size(); ++i) {
+        REQUIRE(top[i].value() == values[i]);
+        REQUIRE(counts.at(top[i].key()) == top[i].value());
+    }
+
+    auto all = counts.topK(tp, 500000, [](auto const & a, auto const & b) {
+        return a.value() < b.value();
+    });
+    REQUIRE(all.size() == counts.size());
+    REQUIRE(all.front().value() == values.back());
+
+    OpenHashMap<string, int64_t> empty;
+    REQUIRE(empty.topK(tp, 10, [](auto const & a, auto const & b) {
+        return a.value() > b.value();
+    }).empty());
+}
+
+TEST_CASE("OpenHashMap sortedEntries") {
+    ThreadPool tp(4);
+    OpenHashMap<string, int64_t> m;
+    for (int64_t i = 0; i < 100000; ++i) {
+        m.put(to_string(i), -i);
+    }
+    auto byKey = m.sortedEntriesByKey(tp);
+    REQUIRE(byKey.size() == m.size());
+    REQUIRE(is_sorted(byKey.begin(), byKey.end(), [](auto const & a, auto const & b) {
+        return a.key() < b.key();
+    }));
+    REQUIRE(byKey.front().key() == "0");
+
+    auto byValue = m.sortedEntriesByValue(tp);
+    REQUIRE(byValue.size() == m.size());
+    for (size_t i = 0; i < byValue.size(); ++i) {
+        REQUIRE(byValue[i].value() == static_cast<int64_t>(i) - 99999);
+        REQUIRE(byValue[i].key() == to_string(99999 - i));
+    }
+
+    auto byLength = m.sortedEntries(tp, [](auto const & a, auto const & b) {
+        return a.key().size() < b.key().size() || (a.key().size() == b.key().size() && a.key() < b.key());
+    });
+    REQUIRE(byLength.size() == m.size());
+    for (size_t i = 0; i < byLength.size(); ++i) {
+        REQUIRE(byLength[i].key() == to_string(i));
+    }
+}
+
+TEST_CASE("OpenHashMapTC sortedEntries and topK") {
+    ThreadPool tp(4);
+    OpenHashMapTC<int32_t, double> m;
+    mt19937 gen(11);
+    for (int i = 0; i < 150000; ++i) {
+        m.put(static_cast<int32_t>(gen()), i * 0.5);
+    }
+    m.erase(m.begin().key());
+
+    auto byKey = m.sortedEntriesByKey(tp);
+    REQUIRE(byKey.size() == m.size());
+    for (size_t i = 1; i < byKey.size(); ++i) {
+        REQUIRE(byKey[i - 1].key() < byKey[i].key());
+    }
+    REQUIRE(byKey.front().key() < 0);
+
+    auto byValue = m.sortedEntriesByValue(tp);
+    REQUIRE(is_sorted(byValue.begin(), byValue.end(), [](auto const & a, auto const & b) {
+        return a.value() < b.value();
+    }));
+
+    auto top = m.topK(tp, 10, [](auto const & a, auto const & b) {
+        return a.key() < b.key();
+    });
+    REQUIRE(top.size() == 10);
+    for (size_t i = 0; i < top.size(); ++i) {
+        REQUIRE(top[i].key() == byKey[i].key());
+    }
+}
+
+TEST_CASE("Parallel radix sort is stable") {
+    ThreadPool tp(4);
+    vector<pair<int16_t, int>> v;
+    for (int i = 0; i < 100000; ++i) {
+        v.emplace_back(static_cast<int16_t>((i * 7919) % 2001 - 1000), i);
+    }
+    auto expected = v;
+    stable_sort(expected.begin(), expected.end(), [](auto const & a, auto const & b) {
+        return a.first < b.first;
+    });
+    gradylib_helpers::parallelRadixSort(v, tp, [](pair<int16_t, int> const & p) {
+        return p.first;
+    });
+    REQUIRE(v == expected);
+}
@@ -0,0 +1,115 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<algorithm>
+#include<cstdint>
+#include<filesystem>
+#include<random>
+#include<vector>
+
+#include"gradylib/MMapViewableOpenHashMap.hpp"
+#include"gradylib/PostingList.hpp"
+
+using namespace std;
+using namespace gradylib;
+namespace fs = std::filesystem;
+
+namespace {
+    vector<int32_t> randomPostings(mt19937_64 & rng, size_t n, int32_t maxGap) {
+        uniform_int_distribution<int32_t> gapDist(0, maxGap);
+        vector<int32_t> ids;
+        int64_t value = 0;
+        for (size_t i = 0; i < n; ++i) {
+            value += gapDist(rng);
+            if (value > INT32_MAX) {
+                break;
+            }
+            ids.push_back(static_cast<int32_t>(value));
+        }
+        return ids;
+    }
+}
+
+TEST_CASE("PostingList round trips through MMapViewableOpenHashMap") {
+    mt19937_64 rng(17);
+    vector<vector<int32_t>> lists;
+    for (size_t n : {0, 1, 5, 127, 128, 129, 256, 1000, 5000}) {
+        lists.push_back(randomPostings(rng, n, 20));
+        lists.push_back(randomPostings(rng, n, 1 << 20));
+    }
+    lists.push_back({0, 0, 0, 7, 7, INT32_MAX});
+    lists.push_back(randomPostings(rng, 300, INT32_MAX / 256));
+
+    MMapViewableOpenHashMap<int64_t, PostingList>::Builder builder;
+    for (size_t i = 0; i < lists.size(); ++i) {
+        builder.put(static_cast<int64_t>(i), PostingList(lists[i]));
+    }
+    fs::path tmpFile = fs::temp_directory_path() / "postings.bin";
+    builder.write(tmpFile);
+    MMapViewableOpenHashMap<int64_t, PostingList> m(tmpFile);
+    for (size_t i = 0; i < lists.size(); ++i) {
+        PostingListView view = m.at(static_cast<int64_t>(i));
+        REQUIRE(view.size() == lists[i].size());
+        REQUIRE(view.toVector() == lists[i]);
+        vector<int32_t> walked;
+        for (auto c = view.cursor(); !c.atEnd(); c.next()) {
+            walked.push_back(c.value());
+        }
+        REQUIRE(walked == lists[i]);
+    }
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("PostingList advanceTo and intersect") {
+    mt19937_64 rng(23);
+    vector<int32_t> a = randomPostings(rng, 20000, 10);
+    vector<int32_t> b = randomPostings(rng, 300, 700);
+    MMapViewableOpenHashMap<int, PostingList>::Builder builder;
+    builder.put(0, PostingList(a));
+    builder.put(1, PostingList(b));
+    fs::path tmpFile = fs::temp_directory_path() / "postings_intersect.bin";
+    builder.write(tmpFile);
+    MMapViewableOpenHashMap<int, PostingList> m(tmpFile);
+    PostingListView va = m.at(0);
+    PostingListView vb = m.at(1);
+
+    uniform_int_distribution<int32_t> targetDist(-5, a.back() + 5);
+    for (int i = 0; i < 1000; ++i) {
+        int32_t target = targetDist(rng);
+        auto c = va.cursor();
+        c.advanceTo(target);
+        auto expected = lower_bound(a.begin(), a.end(), target);
+        if (expected == a.end()) {
+            REQUIRE(c.atEnd());
+        } else {
+            REQUIRE(c.value() == *expected);
+        }
+    }
+
+    vector<int32_t> expected;
+    set_intersection(a.begin(), a.end(), b.begin(), b.end(), back_inserter(expected));
+    vector<int32_t> got;
+    intersect(va, vb, got);
+    REQUIRE(got == expected);
+    got.clear();
+    intersect(vb, va, got);
+    REQUIRE(got == expected);
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("PostingList compresses dense lists and rejects unsorted ones") {
+    mt19937_64 rng(29);
+    vector<int32_t> ids = randomPostings(rng, 100000, 15);
+    fs::path tmpFile = fs::temp_directory_path() / "postings_size.bin";
+    {
+        ofstream ofs(tmpFile, ios::binary);
+        PostingList(ids).serialize(ofs);
+    }
+    // Gaps fit in four bits, so about half a byte per value against four bytes raw
+    REQUIRE(fs::file_size(tmpFile) * 6 < ids.size() * sizeof(int32_t));
+    {
+        ofstream ofs(tmpFile, ios::binary);
+        REQUIRE_THROWS(PostingList(vector<int32_t>{3, 2}).serialize(ofs));
+        REQUIRE_THROWS(PostingList(vector<int32_t>{-1, 2}).serialize(ofs));
+    }
+    fs::remove(tmpFile);
+}
@@ -0,0 +1,137 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<atomic>
+#include<chrono>
+#include<filesystem>
+#include<string>
+#include<thread>
+#include<vector>
+
+#include"gradylib/MMapS2IOpenHashMap.hpp"
+#include"gradylib/OpenHashMap.hpp"
+#include"gradylib/OpenHashMapTC.hpp"
+#include"gradylib/ReloadableMap.hpp"
+
+using namespace std;
+using namespace gradylib;
+namespace fs = std::filesystem;
+
+namespace {
+    // Write a new version of the map next to the target and rename it into place, the way a publisher should.
+    void publishVersion(fs::path const & path, int version) {
+        OpenHashMap<string, int> m;
+        for (int i = 0; i < 1000; ++i) {
+            m[to_string(i)] = i + version * 10000;
+        }
+        m["version"] = version;
+        fs::path tmp = path;
+        tmp += ".tmp";
+        writeMappable(tmp, m);
+        fs::rename(tmp, path);
+    }
+
+    template<typename Pred>
+    bool waitFor(Pred pred) {
+        for (int i = 0; i < 500; ++i) {
+            if (pred()) {
+                return true;
+            }
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        return pred();
+    }
+}
+
+TEST_CASE("ReloadableMap manual reload") {
+    fs::path tmpFile = fs::temp_directory_path() / "reloadable_manual.bin";
+    publishVersion(tmpFile, 1);
+    ReloadableMap<MMapS2IOpenHashMap<int>> rm(tmpFile, false);
+    {
+        auto h = rm.acquire();
+        REQUIRE((*h)["version"] == 1);
+        REQUIRE(h->size() == 1001);
+    }
+    publishVersion(tmpFile, 2);
+    REQUIRE(rm.reload());
+    REQUIRE(rm.reloadCount() == 1);
+    auto h = rm.acquire();
+    REQUIRE((*h)["version"] == 2);
+    REQUIRE((*h)["5"] == 20005);
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("ReloadableMap keeps the old map when the new file is bad") {
+    fs::path tmpFile = fs::temp_directory_path() / "reloadable_bad.bin";
+    publishVersion(tmpFile, 1);
+    ReloadableMap<MMapS2IOpenHashMap<int>> rm(tmpFile, false);
+    fs::remove(tmpFile);
+    REQUIRE(!rm.reload());
+    REQUIRE(rm.failedReloadCount() == 1);
+    REQUIRE(!rm.lastError().empty());
+    REQUIRE((*rm.acquire())["version"] == 1);
+}
+
+TEST_CASE("ReloadableMap constructor throws on missing file") {
+    REQUIRE_THROWS(ReloadableMap<MMapS2IOpenHashMap<int>>("/gradylib_nonexistent_dir/map.bin", false));
+}
+
+TEST_CASE("ReloadableMap watches the file and readers keep working across swaps") {
+    fs::path tmpFile = fs::temp_directory_path() / "reloadable_watch.bin";
+    publishVersion(tmpFile, 1);
+    ReloadableMap<MMapS2IOpenHashMap<int>> rm(tmpFile);
+
+    atomic<bool> stop{false};
+    atomic<int> errors{0};
+    vector<thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&]() {
+            while (!stop.load()) {
+                auto h = rm.acquire();
+                int version = (*h)["version"];
+                // Every entry seen through one handle comes from the same version of the file
+                for (int i = 0; i < 1000; i += 37) {
+                    if ((*h)[to_string(i)] != i + version * 10000) {
+                        ++errors;
+                    }
+                }
+            }
+        });
+    }
+
+    for (int version = 2; version <= 4; ++version) {
+        publishVersion(tmpFile, version);
+        REQUIRE(waitFor([&]() { return (*rm.acquire())["version"] == version; }));
+    }
+    stop.store(true);
+    for (auto & t : readers) {
+        t.join();
+    }
+    REQUIRE(errors == 0);
+    REQUIRE(waitFor([&]() { return rm.reloadCount() >= 3; }));
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("ReloadableMap waits for outstanding handles before destroying the old map") {
+    fs::path tmpFile = fs::temp_directory_path() / "reloadable_hold.bin";
+    OpenHashMapTC<int, int> m;
+    m[1] = 1;
+    m.write(tmpFile);
+    ReloadableMap<OpenHashMapTC<int, int>> rm(tmpFile, false);
+    auto held = rm.acquire();
+    m[1] = 2;
+    m.write(tmpFile.string() + ".tmp");
+    fs::rename(tmpFile.string() + ".tmp", tmpFile);
+    thread reloader([&rm]() {
+        rm.reload();
+    });
+    REQUIRE(waitFor([&]() { return (*rm.acquire()).at(1) == 2; }));
+    // The reloader is blocked on the held handle, and the old map is still readable through it
+    this_thread::sleep_for(chrono::milliseconds(50));
+    REQUIRE(rm.reloadCount() == 0);
+    REQUIRE(held->at(1) == 1);
+    held = rm.acquire();
+    reloader.join();
+    REQUIRE(rm.reloadCount() == 1);
+    REQUIRE(held->at(1) == 2);
+    fs::remove(tmpFile);
+}
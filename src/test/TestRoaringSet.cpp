@@ -0,0 +1,151 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<algorithm>
+#include<cstdint>
+#include<filesystem>
+#include<iterator>
+#include<random>
+#include<set>
+#include<vector>
+
+#include"gradylib/OpenHashSetTC.hpp"
+#include"gradylib/RoaringSet.hpp"
+
+using namespace std;
+using namespace gradylib;
+namespace fs = std::filesystem;
+
+namespace {
+    // Mixes sparse, dense and run shaped chunks
+    vector<uint32_t> mixedValues(mt19937_64 & rng) {
+        vector<uint32_t> values;
+        uniform_int_distribution<uint32_t> anyDist;
+        for (int i = 0; i < 3000; ++i) {
+            values.push_back(anyDist(rng));
+        }
+        bernoulli_distribution dense(0.4);
+        for (uint32_t v = 5 << 16; v < (7 << 16); ++v) {
+            if (dense(rng)) {
+                values.push_back(v);
+            }
+        }
+        for (uint32_t v = (9 << 16) + 100; v < (11 << 16) + 5000; ++v) {
+            values.push_back(v);
+        }
+        values.push_back(0);
+        values.push_back(UINT32_MAX);
+        return values;
+    }
+
+    template<typename Set>
+    void requireSameValues(Set const & s, set<uint32_t> const & expected) {
+        REQUIRE(s.size() == expected.size());
+        vector<uint32_t> got;
+        for (uint32_t v : s) {
+            got.push_back(v);
+        }
+        REQUIRE(got == vector<uint32_t>(expected.begin(), expected.end()));
+    }
+}
+
+TEST_CASE("RoaringSet insert, erase and contains match std::set") {
+    mt19937_64 rng(31);
+    RoaringSet s;
+    set<uint32_t> expected;
+    // Keep values in a few chunks so containers cross the array and bitset threshold both ways
+    uniform_int_distribution<uint32_t> valueDist(0, 3 * 65536 - 1);
+    for (int i = 0; i < 40000; ++i) {
+        uint32_t v = valueDist(rng);
+        s.insert(v);
+        expected.insert(v);
+    }
+    requireSameValues(s, expected);
+    for (int i = 0; i < 40000; ++i) {
+        uint32_t v = valueDist(rng);
+        s.erase(v);
+        expected.erase(v);
+    }
+    requireSameValues(s, expected);
+    for (uint32_t v = 0; v < 3 * 65536; v += 7) {
+        REQUIRE(s.contains(v) == expected.contains(v));
+    }
+    s.runOptimize();
+    requireSameValues(s, expected);
+    s.clear();
+    REQUIRE(s.empty());
+    REQUIRE(s.begin() == s.end());
+}
+
+TEST_CASE("RoaringSet runs convert back on modification") {
+    vector<uint32_t> values;
+    for (uint32_t v = 1000; v < 60000; ++v) {
+        values.push_back(v);
+    }
+    RoaringSet s(values);
+    REQUIRE(s.container(0).type == gradylib_helpers::RoaringContainerType::Run);
+    REQUIRE(s.memoryUsage() < 200);
+    s.erase(2000);
+    s.insert(70000);
+    REQUIRE(!s.contains(2000));
+    REQUIRE(s.contains(1999));
+    REQUIRE(s.contains(70000));
+    REQUIRE(s.size() == values.size());
+}
+
+TEST_CASE("RoaringSet union and intersection across memory and mmapped sets") {
+    mt19937_64 rng(37);
+    vector<uint32_t> va = mixedValues(rng);
+    vector<uint32_t> vb = mixedValues(rng);
+    set<uint32_t> sa(va.begin(), va.end());
+    set<uint32_t> sb(vb.begin(), vb.end());
+    RoaringSet a(va);
+    RoaringSet b(vb);
+    requireSameValues(a, sa);
+
+    set<uint32_t> expectedUnion;
+    set_union(sa.begin(), sa.end(), sb.begin(), sb.end(), inserter(expectedUnion, expectedUnion.end()));
+    set<uint32_t> expectedIntersection;
+    set_intersection(sa.begin(), sa.end(), sb.begin(), sb.end(), inserter(expectedIntersection, expectedIntersection.end()));
+
+    requireSameValues(setUnion(a, b), expectedUnion);
+    requireSameValues(setIntersection(a, b), expectedIntersection);
+
+    fs::path tmpFile = fs::temp_directory_path() / "roaring.bin";
+    b.write(tmpFile);
+    {
+        MMapRoaringSet mb(tmpFile, true);
+        requireSameValues(mb, sb);
+        for (uint32_t v : va) {
+            REQUIRE(mb.contains(v) == sb.contains(v));
+        }
+        requireSameValues(setUnion(a, mb), expectedUnion);
+        requireSameValues(setIntersection(mb, a), expectedIntersection);
+        requireSameValues(setIntersection(mb, mb), sb);
+    }
+    GRADY_LIB_MOCK_MMapRoaringSet_MMAP();
+    REQUIRE_THROWS(MMapRoaringSet(tmpFile));
+    GRADY_LIB_DEFAULT_MMapRoaringSet_MMAP();
+    fs::resize_file(tmpFile, 200);
+    REQUIRE_THROWS(MMapRoaringSet(tmpFile));
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("RoaringSet converts to and from OpenHashSetTC and is small for dense sets") {
+    mt19937_64 rng(41);
+    bernoulli_distribution dense(0.5);
+    OpenHashSetTC<uint32_t> hashSet;
+    for (uint32_t v = 0; v < 2000000; ++v) {
+        if (dense(rng)) {
+            hashSet.insert(v);
+        }
+    }
+    RoaringSet s(hashSet);
+    REQUIRE(s.size() == hashSet.size());
+    // One bit per id in the range, against more than five bytes per element for the hash set
+    REQUIRE(s.memoryUsage() * 10 < s.size() * 4);
+    OpenHashSetTC<uint32_t> back = s.toOpenHashSetTC();
+    REQUIRE(back.size() == hashSet.size());
+    for (uint32_t v : hashSet) {
+        REQUIRE(back.contains(v));
+    }
+}
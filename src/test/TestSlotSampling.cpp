@@ -0,0 +1,123 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<filesystem>
+#include<random>
+#include<string>
+#include<vector>
+
+#include"gradylib/MMapI2HRSOpenHashMap.hpp"
+#include"gradylib/MMapI2SOpenHashMap.hpp"
+#include"gradylib/MMapS2IOpenHashMap.hpp"
+#include"gradylib/MMapStringOpenHashSet.hpp"
+#include"gradylib/OpenHashMap.hpp"
+#include"gradylib/OpenHashMapTC.hpp"
+#include"gradylib/OpenHashSet.hpp"
+#include"gradylib/OpenHashSetTC.hpp"
+
+using namespace std;
+using namespace gradylib;
+namespace fs = std::filesystem;
+
+TEST_CASE("OpenHashMapTC sample is uniform over entries") {
+    OpenHashMapTC<int, int> m;
+    for (int i = 0; i < 2000; ++i) {
+        m.put(i, i);
+    }
+    for (int i = 0; i < 2000; i += 2) {
+        m.erase(i);
+    }
+    mt19937_64 rng(3);
+    vector<int> counts(2000, 0);
+    for (auto const & entry : m.sample(200000, rng)) {
+        REQUIRE(entry.key() == entry.value());
+        ++counts[entry.key()];
+    }
+    for (int i = 0; i < 2000; ++i) {
+        if (i % 2 == 0) {
+            REQUIRE(counts[i] == 0);
+        } else {
+            // Expected 200 per entry; 100 and 300 are about seven standard deviations out
+            REQUIRE(counts[i] > 100);
+            REQUIRE(counts[i] < 300);
+        }
+    }
+
+    OpenHashMapTC<int, int> empty;
+    REQUIRE(empty.sample(10, rng).empty());
+    REQUIRE(m.sample(0, rng).empty());
+}
+
+TEST_CASE("Heap container sample") {
+    mt19937 rng(5);
+    OpenHashMap<string, int> m;
+    OpenHashSet<string> s;
+    OpenHashSetTC<int64_t> stc;
+    for (int i = 0; i < 10000; ++i) {
+        m.put(to_string(i), i);
+        s.insert(to_string(i));
+        stc.insert(i * 3);
+    }
+    auto entries = m.sample(100, rng);
+    REQUIRE(entries.size() == 100);
+    for (auto const & entry : entries) {
+        REQUIRE(entry.key() == to_string(entry.value()));
+    }
+    auto keys = s.sample(100, rng);
+    REQUIRE(keys.size() == 100);
+    for (string const & key : keys) {
+        REQUIRE(s.contains(key));
+    }
+    auto tcKeys = stc.sample(100, rng);
+    REQUIRE(tcKeys.size() == 100);
+    for (int64_t key : tcKeys) {
+        REQUIRE(key % 3 == 0);
+        REQUIRE(stc.contains(key));
+    }
+}
+
+TEST_CASE("Mapped container sample") {
+    fs::path s2iFile = fs::temp_directory_path() / "sample_s2i.bin";
+    fs::path i2sFile = fs::temp_directory_path() / "sample_i2s.bin";
+    fs::path i2hrsFile = fs::temp_directory_path() / "sample_i2hrs.bin";
+    fs::path setFile = fs::temp_directory_path() / "sample_set.bin";
+    mt19937 rng(7);
+
+    OpenHashMap<string, int> s2i;
+    OpenHashMap<int, string> i2s;
+    OpenHashSet<string> set;
+    MMapI2HRSOpenHashMap<int>::Builder i2hrsBuilder;
+    for (int i = 0; i < 10000; ++i) {
+        s2i.put(to_string(i), i);
+        i2s.put(i, to_string(i));
+        set.insert(to_string(i));
+        i2hrsBuilder.put(i, to_string(i % 10));
+    }
+    writeMappable(s2iFile.string(), s2i);
+    writeMappable(i2sFile.string(), i2s);
+    writeMappable(setFile, set);
+    i2hrsBuilder.write(i2hrsFile.string());
+
+    MMapS2IOpenHashMap<int> s2iMapped(s2iFile);
+    for (auto const & [key, value] : s2iMapped.sample(100, rng)) {
+        REQUIRE(key == to_string(value));
+    }
+    MMapI2SOpenHashMap<int> i2sMapped(i2sFile);
+    for (auto const & [key, value] : i2sMapped.sample(100, rng)) {
+        REQUIRE(value == to_string(key));
+    }
+    MMapI2HRSOpenHashMap<int> i2hrsMapped(i2hrsFile);
+    auto hrsSample = i2hrsMapped.sample(100, rng);
+    REQUIRE(hrsSample.size() == 100);
+    for (auto const & [key, value] : hrsSample) {
+        REQUIRE(value == to_string(key % 10));
+    }
+    MMapStringOpenHashSet<> setMapped(setFile);
+    for (string_view key : setMapped.sample(100, rng)) {
+        REQUIRE(set.contains(key));
+    }
+
+    fs::remove(s2iFile);
+    fs::remove(i2sFile);
+    fs::remove(i2hrsFile);
+    fs::remove(setFile);
+}
@@ -0,0 +1,101 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<cstdint>
+#include<map>
+#include<random>
+#include<string>
+
+#include"gradylib/SmallOpenHashMap.hpp"
+
+using namespace std;
+using namespace gradylib;
+
+TEST_CASE("SmallOpenHashMap stays inline up to N entries") {
+    SmallOpenHashMap<int32_t, float, 8> m;
+    REQUIRE(sizeof(m) == 80);
+    REQUIRE(m.empty());
+    for (int32_t i = 0; i < 8; ++i) {
+        m.put(i * 7, static_cast<float>(i));
+    }
+    REQUIRE(!m.isSpilled());
+    REQUIRE(m.size() == 8);
+    for (int32_t i = 0; i < 8; ++i) {
+        REQUIRE(m.contains(i * 7));
+        REQUIRE(m.at(i * 7) == static_cast<float>(i));
+        REQUIRE(m.get(i * 7).value() == static_cast<float>(i));
+    }
+    REQUIRE(!m.contains(1));
+    REQUIRE(!m.get(1).has_value());
+    REQUIRE_THROWS(m.at(1));
+    m[0] += 10.0f;
+    REQUIRE(m.at(0) == 10.0f);
+    REQUIRE(!m.isSpilled());
+
+    m[100] = 1.0f;
+    REQUIRE(m.isSpilled());
+    REQUIRE(m.size() == 9);
+    for (int32_t i = 1; i < 8; ++i) {
+        REQUIRE(m.at(i * 7) == static_cast<float>(i));
+    }
+    REQUIRE(m.at(0) == 10.0f);
+    REQUIRE(m.at(100) == 1.0f);
+
+    m.clear();
+    REQUIRE(m.empty());
+    REQUIRE(!m.isSpilled());
+}
+
+TEST_CASE("SmallOpenHashMap erase, copy and iteration match std::map") {
+    mt19937_64 rng(11);
+    uniform_int_distribution<int> keyDist(0, 20);
+    uniform_int_distribution<int> opDist(0, 2);
+    SmallOpenHashMap<int, int, 4> m;
+    map<int, int> expected;
+    for (int i = 0; i < 5000; ++i) {
+        int key = keyDist(rng);
+        if (opDist(rng) == 0) {
+            m.erase(key);
+            expected.erase(key);
+        } else {
+            m.put(key, i);
+            expected[key] = i;
+        }
+        REQUIRE(m.size() == expected.size());
+        if (i % 500 == 0) {
+            // Start over so both the inline and the spilled forms get exercised
+            m.clear();
+            expected.clear();
+        }
+    }
+    SmallOpenHashMap<int, int, 4> copy = m;
+    SmallOpenHashMap<int, int, 4> const & constCopy = copy;
+    map<int, int> seen;
+    for (auto [key, value] : constCopy) {
+        seen[key] = value;
+    }
+    REQUIRE(seen == expected);
+    for (auto it = m.begin(); it != m.end(); ++it) {
+        it.value() += 1;
+    }
+    for (auto const & [key, value] : expected) {
+        REQUIRE(m.at(key) == value + 1);
+        REQUIRE(copy.at(key) == value);
+    }
+}
+
+TEST_CASE("SmallOpenHashMap with string keys") {
+    SmallOpenHashMap<string, int, 2> m;
+    m["a"] = 1;
+    m.put(string("b"), 2);
+    REQUIRE(m.contains(string_view("a")));
+    m.erase(string("a"));
+    REQUIRE(!m.contains(string("a")));
+    REQUIRE(m.at(string("b")) == 2);
+    m["c"] = 3;
+    m["d"] = 4;
+    REQUIRE(m.isSpilled());
+    REQUIRE(m.size() == 3);
+    REQUIRE(m.at(string("d")) == 4);
+    m.reserve(100);
+    REQUIRE(m.at(string("c")) == 3);
+}
@@ -0,0 +1,164 @@
+#include<catch2/catch_test_macros.hpp>
+
+#include<atomic>
+#include<filesystem>
+#include<string>
+#include<thread>
+#include<unordered_map>
+#include<vector>
+
+#include"gradylib/StringDictionary.hpp"
+
+using namespace std;
+using namespace gradylib;
+namespace fs = std::filesystem;
+
+TEST_CASE("StringDictionary builder") {
+    StringDictionary<>::Builder b;
+    REQUIRE(!b.contains("a"));
+    REQUIRE(b.intern("apple") == 0);
+    REQUIRE(b.intern("banana") == 1);
+    REQUIRE(b.intern("apple") == 0);
+    REQUIRE(b.intern("") == 2);
+    REQUIRE(b.size() == 3);
+    REQUIRE(b.at(1) == "banana");
+    REQUIRE(b.at(2) == "");
+    REQUIRE(b.id("banana") == 1);
+    REQUIRE(b.contains(""));
+    REQUIRE_THROWS(b.id("cherry"));
+    REQUIRE_THROWS(b.at(3));
+}
+
+TEST_CASE("StringDictionary write and map") {
+    StringDictionary<>::Builder b;
+    unordered_map<string, uint32_t> test;
+    for (int i = 0; i < 100000; ++i) {
+        string s = "str" + to_string(i * 7919 % 50000);
+        uint32_t id = b.intern(s);
+        auto [iter, inserted] = test.emplace(s, id);
+        REQUIRE(iter->second == id);
+    }
+    REQUIRE(b.size() == 50000);
+    fs::path tmpFile = fs::temp_directory_path() / "string_dictionary.bin";
+    b.write(tmpFile);
+
+    StringDictionary<> d(tmpFile);
+    REQUIRE(d.size() == 50000);
+    for (auto const & [s, id] : test) {
+        REQUIRE(d.contains(s));
+        REQUIRE(d.id(s) == id);
+        REQUIRE(d.at(id) == s);
+        REQUIRE(d[id] == s);
+    }
+    REQUIRE(!d.contains("missing"));
+    REQUIRE_THROWS(d.id("missing"));
+    REQUIRE_THROWS(d.at(50000));
+
+    StringDictionary<> moved(std::move(d));
+    REQUIRE(moved.at(test["str7919"]) == "str7919");
+    REQUIRE(d.size() == 0);
+    REQUIRE(!d.contains("str7919"));
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("StringDictionary empty") {
+    StringDictionary<uint64_t>::Builder b;
+    fs::path tmpFile = fs::temp_directory_path() / "string_dictionary_empty.bin";
+    b.write(tmpFile);
+    StringDictionary<uint64_t> d(tmpFile);
+    REQUIRE(d.size() == 0);
+    REQUIRE(!d.contains(""));
+    REQUIRE_THROWS(d.at(0));
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("StringDictionary concurrent builder") {
+    StringDictionary<>::ConcurrentBuilder cb(16);
+    int numThreads = 8;
+    int numStrings = 20000;
+    vector<vector<uint32_t>> ids(numThreads, vector<uint32_t>(numStrings));
+    vector<thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < numStrings; ++i) {
+                ids[t][i] = cb.intern("s" + to_string(i));
+            }
+        });
+    }
+    for (auto & t : threads) {
+        t.join();
+    }
+    REQUIRE(cb.size() == numStrings);
+    for (int t = 1; t < numThreads; ++t) {
+        REQUIRE(ids[t] == ids[0]);
+    }
+
+    fs::path tmpFile = fs::temp_directory_path() / "string_dictionary_concurrent.bin";
+    cb.write(tmpFile);
+    StringDictionary<> d(tmpFile);
+    REQUIRE(d.size() == numStrings);
+    vector<bool> seen(numStrings, false);
+    for (int i = 0; i < numStrings; ++i) {
+        uint32_t id = ids[0][i];
+        REQUIRE(id < numStrings);
+        REQUIRE(!seen[id]);
+        seen[id] = true;
+        REQUIRE(d.at(id) == "s" + to_string(i));
+        REQUIRE(d.id("s" + to_string(i)) == id);
+    }
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("StringDictionary concurrent builder runs out of IDs") {
+    StringDictionary<uint8_t>::ConcurrentBuilder cb(4);
+    vector<thread> threads;
+    atomic<int> failures{0};
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 100; ++i) {
+                try {
+                    cb.intern("s" + to_string(t * 100 + i));
+                } catch (...) {
+                    ++failures;
+                }
+            }
+        });
+    }
+    for (auto & t : threads) {
+        t.join();
+    }
+    REQUIRE(cb.size() == 255);
+    REQUIRE(failures == 400 - 255);
+    REQUIRE_THROWS(cb.intern("one more"));
+    auto b = cb.toBuilder();
+    REQUIRE(b.size() == 255);
+}
+
+TEST_CASE("StringDictionary mmap failure") {
+    StringDictionary<>::Builder b;
+    b.intern("x");
+    fs::path tmpFile = fs::temp_directory_path() / "string_dictionary_mock.bin";
+    b.write(tmpFile);
+    GRADY_LIB_MOCK_StringDictionary_MMAP<>();
+    REQUIRE_THROWS(StringDictionary<>(tmpFile));
+    GRADY_LIB_DEFAULT_StringDictionary_MMAP<>();
+    REQUIRE_THROWS(StringDictionary<>("/nonexistent/dictionary.bin"));
+    fs::remove(tmpFile);
+}
+
+TEST_CASE("StringDictionary rejects truncated files") {
+    StringDictionary<>::Builder b;
+    for (int i = 0; i < 1000; ++i) {
+        b.intern("str" + to_string(i));
+    }
+    fs::path tmpFile = fs::temp_directory_path() / "string_dictionary_truncated.bin";
+    b.write(tmpFile);
+    size_t size = fs::file_size(tmpFile);
+    fs::resize_file(tmpFile, size - 8);
+    REQUIRE_THROWS(StringDictionary<>(tmpFile));
+    fs::resize_file(tmpFile, size / 2);
+    REQUIRE_THROWS(StringDictionary<>(tmpFile));
+    fs::resize_file(tmpFile, 16);
+    REQUIRE_THROWS(StringDictionary<>(tmpFile));
+    fs::remove(tmpFile);
+}
@@ -4,6 +4,7 @@
 
 #include<unistd.h>
 
+#include<atomic>
 #include<fstream>
 #include<sstream>
 #include<unordered_set>
@@ -45,4 +46,20 @@ TEST_CASE("Thread pool") {
         unlink("testfile.txt");
         REQUIRE(s.size() == numWork);
     }
-}
\ No newline at end of file
+}
+TEST_CASE("runTasks from a task on the same pool") {
+    ThreadPool tp(2);
+    ThreadPool other(2);
+    REQUIRE(!tp.onWorkerThread());
+    atomic<long> sum{0};
+    atomic<int> onWorker{0};
+    // Every worker is busy in an outer task, so the inner tasks have to run inline
+    gradylib_helpers::runTasks(tp, 2, [&](size_t) {
+        onWorker += tp.onWorkerThread() && !other.onWorkerThread();
+        gradylib_helpers::runTasks(tp, 100, [&](size_t i) {
+            sum += i;
+        });
+    });
+    REQUIRE(onWorker == 2);
+    REQUIRE(sum == 2 * 4950);
+}